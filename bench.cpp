@@ -0,0 +1,772 @@
+
+// Benchmark the libraries
+//
+// Times each routine over a sweep of sizes, after warm-up calls, taking
+// repeated samples and reporting the median, 10th and 90th percentiles,
+// GFLOP/s and bandwidth from nominal operation counts, and the heap
+// allocations per call. Results are printed as CSV, and written with the
+// raw samples as JSON, for comparison between builds and machines.
+//
+// Usage: bench.out [-s 64,128,256] [-r repeats] [-w warmups] [-t seconds]
+//                  [-f filter] [-j file.json] [-b baseline.json] [-c tolerance]
+//        bench.out -T [-r repeats] [-w warmups] [-t seconds]
+//   -s  matrix sizes n to sweep (default 32,64,128,256); vector kernels
+//       use n*n elements
+//   -r  timed samples per routine and size (default 15)
+//   -w  untimed warm-up calls (default 2)
+//   -t  minimum time per sample, short calls being repeated to fill it
+//   -f  only run routines whose names contain filter
+//   -j  where to write the JSON (default bench.json, - for none)
+//   -b  baseline JSON, from an earlier run, to compare against
+//   -c  slowdown tolerated before flagging a regression (default 0.05)
+//   -T  autotune instead: time candidate block sizes and thresholds (see
+//       tuning.hpp) on this host, print them as CSV, and write the best
+//       to the tuning profile for this host, used by later runs (default
+//       7 repeats of at least 0.02s)
+//
+// With a baseline, each routine and size in both runs is compared by the
+// ratio of median times, current over baseline, with a 95% confidence
+// interval from resampling the samples of both runs (bootstrap). A case
+// looks slower if the whole interval lies above 1 + tolerance, where the
+// tolerance is widened to the spread of the baseline's own samples (p90
+// over p10) if that is larger. The samples of a run are taken back to
+// back, so the interval says nothing of the drift between runs, which is
+// often more than 5%: a case that looks slower is measured three more
+// times, in turn with any others, and only regresses if it is slower in
+// every one, and then the exit status is 2. A slowdown that lasts through
+// the rechecks, such as another load on the machine, is still reported,
+// so on a shared machine use a wider tolerance (-c 0.1 or more). Cases in
+// only one of the runs are listed as new or missing, and if none match at
+// all the run fails. Baselines are only comparable on the same host with
+// the same sizes and thread count.
+//
+// The autotuner searches one parameter at a time, the others fixed, in
+// the order they are listed in tuning.hpp, each timed on the kernel it
+// affects: gemm for its blocks, and its threading threshold by the
+// smallest size at which threads win; mixedlusolve and
+// mixedcholeskysolve for their panels; luinverse for its blocks and
+// threshold; and batchqr on 8 x 8 systems for the batch block.
+
+#include "factors.hpp"
+#include "solvers.hpp"
+#include "inverse.hpp"
+#include "batched.hpp"
+#include "matrix.hpp"
+#include "vector.hpp"
+#include "error.hpp"
+#include "profile.hpp"
+#include "tuning.hpp"
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <new>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#ifdef PROFILING
+
+// The profiler already counts every allocation
+static void allocations(long& n, long& bytes) { profilememory(n, bytes); }
+
+#else
+
+// Count every allocation made through new, including inside the library
+static std::atomic<long> nallocs(0), nbytes(0);
+
+static void allocations(long& n, long& bytes) { n = nallocs; bytes = nbytes; }
+
+void* operator new(std::size_t size)
+{
+  nallocs++;
+  nbytes += size;
+  void* p = std::malloc(size > 0 ? size : 1);
+  if (p == NULL) { throw std::bad_alloc(); }
+  return p;
+}
+
+void* operator new[](std::size_t size) { return operator new(size); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+
+#endif
+
+// The operands for one size, made before timing starts
+struct Workload
+{
+  int n;
+  Matrix A, B, C, S, R, V; // S is symmetric positive definite
+  Vector x, y, b, p, z; // Results go to p and z
+  double sink; // Keeps results of pure functions live
+};
+
+// A routine to time, with its nominal flop count and the least memory
+// traffic it must cause, in bytes, for size n. Iterative eigensolvers are
+// counted as their reduction to Hessenberg form, plus a nominal 6n^3 for
+// the QR iterations of qrshift, so their rates are only comparable with
+// themselves.
+struct Routine
+{
+  const char* name;
+  int maxn; // Largest size run, for the slowest routines
+  bool vec; // A vector kernel, of n*n elements
+  double (*flops)(double n);
+  double (*bytes)(double n);
+  void (*run)(Workload& w);
+};
+
+static double f_gemm(double n) { return 2.0*n*n*n; }
+static double b_gemm(double n) { return 24.0*n*n; }
+static double f_gemv(double n) { return 2.0*n*n; }
+static double b_gemv(double n) { return 8.0*n*n + 16.0*n; }
+static double f_dot(double n) { return 2.0*n*n; }
+static double b_dot(double n) { return 16.0*n*n; }
+static double f_axpy(double n) { return 2.0*n*n; }
+static double b_axpy(double n) { return 24.0*n*n; }
+static double f_lu(double n) { return 2.0*n*n*n/3.0; }
+static double f_qr(double n) { return 4.0*n*n*n/3.0; }
+static double f_chol(double n) { return n*n*n/3.0; }
+static double f_hess(double n) { return 10.0*n*n*n/3.0; }
+static double f_eig(double n) { return 16.0*n*n*n/3.0 + 6.0*n*n*n; }
+static double f_lusolve(double n) { return 2.0*n*n*n/3.0 + 2.0*n*n; }
+static double f_cholsolve(double n) { return n*n*n/3.0 + 2.0*n*n; }
+static double f_qrsolve(double n) { return 4.0*n*n*n/3.0 + 3.0*n*n; }
+static double b_fact(double n) { return 16.0*n*n; } // Read A, write the factors
+
+static void r_gemm(Workload& w) { w.C = w.A*w.B; }
+static void r_gemv(Workload& w) { w.z = w.A*w.x; }
+static void r_dot(Workload& w) { w.sink += inner(w.x, w.b); }
+static void r_axpy(Workload& w) { axpy(1e-9, w.x, w.y); }
+static void r_dgelu(Workload& w) { w.p = dgelu(w.A, w.C); }
+static void r_dgehh(Workload& w) { dgehh(w.A, w.R, w.V); }
+static void r_cholesky(Workload& w) { w.R = cholesky(w.S); }
+static void r_hessenberg(Workload& w) { hessenberg(w.A, w.R, w.V); }
+static void r_symqr(Workload& w) { symqr(w.S, w.p); }
+static void r_qrshift(Workload& w) { qrshift(w.S, w.p); }
+static void r_lusolve(Workload& w) { w.z = lusolve(w.A, w.b); }
+static void r_choleskysolve(Workload& w) { w.z = choleskysolve(w.S, w.b); }
+static void r_qrsolve(Workload& w) { w.z = qrsolve(w.A, w.b); }
+static void r_mixedlusolve(Workload& w) { int it; w.z = mixedlusolve(w.A, w.b, it); }
+static void r_mixedcholeskysolve(Workload& w) { int it; w.z = mixedcholeskysolve(w.S, w.b, it); }
+// For the autotuner: C and p hold the LU factors of A, and V a batch of
+// 8 x 8 systems, copied first as both are overwritten
+static void r_luinverse(Workload& w) { w.R = w.C; luinverse(w.R, w.p); }
+static void r_batchqr(Workload& w) { w.R = w.V; batchqr(8, 8, w.R, w.B); }
+
+static const Routine routines[] = {
+  {"gemm", 1 << 30, false, f_gemm, b_gemm, r_gemm},
+  {"gemv", 1 << 30, false, f_gemv, b_gemv, r_gemv},
+  {"dot", 1 << 30, true, f_dot, b_dot, r_dot},
+  {"axpy", 1 << 30, true, f_axpy, b_axpy, r_axpy},
+  {"dgelu", 1 << 30, false, f_lu, b_fact, r_dgelu},
+  {"dgehh", 1 << 30, false, f_qr, b_fact, r_dgehh},
+  {"cholesky", 1 << 30, false, f_chol, b_fact, r_cholesky},
+  {"hessenberg", 1 << 30, false, f_hess, b_fact, r_hessenberg},
+  {"symqr", 32, false, f_eig, b_fact, r_symqr},
+  {"qrshift", 128, false, f_eig, b_fact, r_qrshift},
+  {"lusolve", 1 << 30, false, f_lusolve, b_fact, r_lusolve},
+  {"choleskysolve", 1 << 30, false, f_cholsolve, b_fact, r_choleskysolve},
+  {"qrsolve", 1 << 30, false, f_qrsolve, b_fact, r_qrsolve},
+  {"mixedlusolve", 1 << 30, false, f_lusolve, b_fact, r_mixedlusolve}
+};
+
+static double f_inv(double n) { return 4.0*n*n*n/3.0; }
+static double f_batchqr(double n) { return 4.0*8*8*8/3.0*n; } // n systems
+
+static const Routine tuneroutines[] = {
+  {"gemm", 1 << 30, false, f_gemm, b_gemm, r_gemm},
+  {"mixedlusolve", 1 << 30, false, f_lusolve, b_fact, r_mixedlusolve},
+  {"mixedcholeskysolve", 1 << 30, false, f_cholsolve, b_fact, r_mixedcholeskysolve},
+  {"luinverse", 1 << 30, false, f_inv, b_fact, r_luinverse},
+  {"batchqr", 1 << 30, false, f_batchqr, b_fact, r_batchqr}
+};
+
+// Summary of the samples of one routine at one size
+struct Result
+{
+  std::string name;
+  int n, inner;
+  std::vector<double> samples; // Seconds per call
+  double median, p10, p90, min, mean, sd;
+  double gflops, gbs, allocs, bytes;
+};
+
+static double now()
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Percentile of sorted samples, interpolating linearly between ranks
+static double percentile(const std::vector<double>& s, double q)
+{
+  double pos = q*(s.size() - 1);
+  int lo = (int)pos;
+  int hi = (lo + 1 < (int)s.size() ? lo + 1 : lo);
+  return s[lo] + (pos - lo)*(s[hi] - s[lo]);
+}
+
+
+static void makeworkload(Workload& w, int n)
+{
+  w.n = n;
+  w.A.assign(n, n, 0.0);
+  w.B.assign(n, n, 0.0);
+  for (int i = 0; i < n; i++){
+    for (int j = 0; j < n; j++){
+      w.A(i, j) = rand()/(double)RAND_MAX - 0.5;
+      w.B(i, j) = rand()/(double)RAND_MAX - 0.5;
+    }
+    w.A(i, i) += n; // Well conditioned, so that every solver succeeds
+  }
+  // S = BB(T)/n + I
+  w.S = w.B*w.B.transpose();
+  for (int i = 0; i < n; i++){
+    for (int j = 0; j < n; j++){
+      w.S(i, j) /= n;
+    }
+    w.S(i, i) += 1.0;
+  }
+  int len = n*n;
+  w.x.resize(len);
+  w.y.resize(len);
+  w.b.resize(len);
+  for (int i = 0; i < len; i++){
+    w.x[i] = rand()/(double)RAND_MAX;
+    w.y[i] = rand()/(double)RAND_MAX;
+    w.b[i] = rand()/(double)RAND_MAX;
+  }
+  w.sink = 0.0;
+}
+
+
+static Result measure(const Routine& r, Workload& w, int reps, int warmups, double mintime)
+{
+  Result res;
+  res.name = r.name;
+  res.n = w.n;
+  // Vector kernels see the whole n*n vectors, the rest need length n
+  Vector xsave = w.x, bsave = w.b;
+  if (!r.vec) {
+    w.x.resize(w.n);
+    w.b.resize(w.n);
+    for (int i = 0; i < w.n; i++){
+      w.x[i] = xsave(i);
+      w.b[i] = bsave(i);
+    }
+  }
+  // Warm up, and find how many calls fill a sample
+  double t = 0.0;
+  for (int k = 0; k < warmups || k == 0; k++){
+    double t0 = now();
+    r.run(w);
+    t = now() - t0;
+  }
+  res.inner = (t > 0.0 && t < mintime ? (int)ceil(mintime/t) : 1);
+  res.samples.reserve(reps);
+  long a0, b0, a1, b1;
+  allocations(a0, b0);
+  for (int k = 0; k < reps; k++){
+    double t0 = now();
+    for (int i = 0; i < res.inner; i++){
+      r.run(w);
+    }
+    res.samples.push_back((now() - t0)/res.inner);
+  }
+  double calls = (double)reps*res.inner;
+  allocations(a1, b1);
+  res.allocs = (a1 - a0)/calls;
+  res.bytes = (b1 - b0)/calls;
+  w.x = xsave;
+  w.b = bsave;
+  // Statistics
+  std::vector<double> s = res.samples;
+  std::sort(s.begin(), s.end());
+  res.median = percentile(s, 0.5);
+  res.p10 = percentile(s, 0.1);
+  res.p90 = percentile(s, 0.9);
+  res.min = s[0];
+  double sum = 0.0, sumsq = 0.0;
+  for (size_t i = 0; i < s.size(); i++){
+    sum += s[i];
+  }
+  res.mean = sum/s.size();
+  for (size_t i = 0; i < s.size(); i++){
+    sumsq += (s[i] - res.mean)*(s[i] - res.mean);
+  }
+  res.sd = (s.size() > 1 ? sqrt(sumsq/(s.size() - 1)) : 0.0);
+  res.gflops = r.flops(w.n)/res.median*1e-9;
+  res.gbs = r.bytes(w.n)/res.median*1e-9;
+  return res;
+}
+
+
+static void writejson(const char* path, const std::vector<Result>& results, int reps, int warmups)
+{
+  std::ofstream out(path);
+  if (!out) {
+    throw( Error("BENCH", "Could not open the JSON file.") );
+  }
+  int threads = 1;
+#ifdef _OPENMP
+  threads = omp_get_max_threads();
+#endif
+  time_t tt = time(0);
+  char date[32];
+  strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", gmtime(&tt));
+  out << std::setprecision(9);
+  out << "{\n  \"host\": {\"compiler\": \"" << __VERSION__ << "\", \"threads\": " << threads
+      << ", \"date\": \"" << date << "\", \"repeats\": " << reps << ", \"warmups\": " << warmups << "},\n";
+  out << "  \"results\": [\n";
+  for (size_t k = 0; k < results.size(); k++){
+    const Result& r = results[k];
+    out << "    {\"routine\": \"" << r.name << "\", \"n\": " << r.n << ", \"inner\": " << r.inner
+	<< ", \"median\": " << r.median << ", \"p10\": " << r.p10 << ", \"p90\": " << r.p90
+	<< ", \"min\": " << r.min << ", \"mean\": " << r.mean << ", \"sd\": " << r.sd
+	<< ", \"gflops\": " << r.gflops << ", \"gbs\": " << r.gbs
+	<< ", \"allocs\": " << r.allocs << ", \"bytes\": " << r.bytes << ", \"samples\": [";
+    for (size_t i = 0; i < r.samples.size(); i++){
+      out << (i > 0 ? ", " : "") << r.samples[i];
+    }
+    out << "]}" << (k + 1 < results.size() ? "," : "") << "\n";
+  }
+  out << "  ]\n}\n";
+}
+
+
+// Read back the results of writejson, one per line, with only the fields
+// needed for comparison
+static std::vector<Result> readjson(const char* path, std::string& host)
+{
+  std::ifstream in(path);
+  if (!in) {
+    throw( Error("BENCH", "Could not open the baseline file.") );
+  }
+  std::vector<Result> results;
+  std::string line;
+  while (std::getline(in, line)){
+    size_t pos = line.find("\"host\"");
+    if (pos != std::string::npos) {
+      host = line.substr(line.find('{', pos));
+      host = host.substr(0, host.rfind('}') + 1);
+      continue;
+    }
+    pos = line.find("\"routine\": \"");
+    if (pos == std::string::npos) { continue; }
+    Result r;
+    pos += 12;
+    r.name = line.substr(pos, line.find('"', pos) - pos);
+    pos = line.find("\"n\": ");
+    size_t open = line.find('[');
+    size_t close = line.find(']');
+    if (pos == std::string::npos || open == std::string::npos || close == std::string::npos) {
+      throw( Error("BENCH", "Baseline is not in the format written by bench.") );
+    }
+    r.n = atoi(line.c_str() + pos + 5);
+    std::stringstream list(line.substr(open + 1, close - open - 1));
+    std::string item;
+    while (std::getline(list, item, ',')){
+      r.samples.push_back(atof(item.c_str()));
+    }
+    if (r.samples.empty()) {
+      throw( Error("BENCH", "Baseline result has no samples.") );
+    }
+    results.push_back(r);
+  }
+  return results;
+}
+
+// Median of n samples drawn with replacement from s
+static double resample(const std::vector<double>& s, std::vector<double>& work, unsigned long& seed)
+{
+  for (size_t i = 0; i < work.size(); i++){
+    seed = seed*6364136223846793005UL + 1442695040888963407UL;
+    work[i] = s[(seed >> 33) % s.size()];
+  }
+  size_t mid = work.size()/2;
+  std::nth_element(work.begin(), work.begin() + mid, work.end());
+  double m = work[mid];
+  if (work.size() % 2 == 0) {
+    m = 0.5*(m + *std::max_element(work.begin(), work.begin() + mid));
+  }
+  return m;
+}
+
+// Ratio of the median of cur to that of base, with the 95% bootstrap
+// confidence interval [lo, hi]
+static double medianratio(const std::vector<double>& cur, const std::vector<double>& base,
+			  double& lo, double& hi)
+{
+  const int NBOOT = 2000;
+  unsigned long seed = 42; // Repeatable verdicts
+  std::vector<double> wc(cur.size()), wb(base.size()), ratios(NBOOT);
+  for (int k = 0; k < NBOOT; k++){
+    double mc = resample(cur, wc, seed);
+    double mb = resample(base, wb, seed);
+    ratios[k] = mc/mb;
+  }
+  std::sort(ratios.begin(), ratios.end());
+  lo = percentile(ratios, 0.025);
+  hi = percentile(ratios, 0.975);
+  std::vector<double> sc = cur, sb = base;
+  std::sort(sc.begin(), sc.end());
+  std::sort(sb.begin(), sb.end());
+  return percentile(sc, 0.5)/percentile(sb, 0.5);
+}
+
+// The slowdown tolerated for a case: tol, or the spread of the baseline's
+// own samples if wider, as a case cannot be judged more finely than it
+// was measured
+static double casetol(const Result& b, double tol)
+{
+  std::vector<double> s = b.samples;
+  std::sort(s.begin(), s.end());
+  double spread = percentile(s, 0.9)/percentile(s, 0.1) - 1.0;
+  return (spread > tol ? spread : tol);
+}
+
+// Compare against the baseline, printing a verdict for each case, and
+// returning the cases that look slower, as indices into results and base.
+// Throws if no case is in both.
+static std::vector<std::pair<size_t, size_t> > compare(const std::vector<Result>& results,
+						       const std::vector<Result>& base,
+						       const std::string& host, double tol)
+{
+  std::vector<bool> matched(base.size(), false);
+  std::vector<std::pair<size_t, size_t> > suspects;
+  std::cout << "\nbaseline: " << host << "\n";
+  std::cout << "routine,n,base_median_s,median_s,ratio,ratio_lo,ratio_hi,tolerance,verdict\n";
+  for (size_t k = 0; k < results.size(); k++){
+    const Result& r = results[k];
+    size_t j = 0;
+    while (j < base.size() && (base[j].name != r.name || base[j].n != r.n)){ j++; }
+    if (j == base.size()) {
+      std::cout << r.name << "," << r.n << ",," << r.median << ",,,,,new\n";
+      continue;
+    }
+    matched[j] = true;
+    double lo, hi;
+    double ratio = medianratio(r.samples, base[j].samples, lo, hi);
+    double t = casetol(base[j], tol);
+    std::vector<double> sb = base[j].samples;
+    std::sort(sb.begin(), sb.end());
+    const char* verdict = "same";
+    if (lo > 1.0 + t) {
+      verdict = "slower?";
+      suspects.push_back(std::make_pair(k, j));
+    } else if (hi < 1.0/(1.0 + t)) {
+      verdict = "faster";
+    }
+    std::cout << r.name << "," << r.n << "," << percentile(sb, 0.5) << "," << r.median << ","
+	      << ratio << "," << lo << "," << hi << "," << t << "," << verdict << "\n";
+  }
+  int nmatched = 0;
+  for (size_t j = 0; j < base.size(); j++){
+    if (matched[j]) {
+      nmatched++;
+      continue;
+    }
+    std::vector<double> sb = base[j].samples;
+    std::sort(sb.begin(), sb.end());
+    std::cout << base[j].name << "," << base[j].n << "," << percentile(sb, 0.5) << ",,,,,,missing\n";
+  }
+  if (nmatched == 0) {
+    throw( Error("BENCH", "No case in the baseline matches this run.") );
+  }
+  std::cout << nmatched << " of " << base.size() << " baseline cases compared, "
+	    << suspects.size() << " to recheck\n";
+  return suspects;
+}
+
+// Rounds of remeasurement for the cases that look slower
+static const int RECHECKS = 3;
+
+// Measure each suspect case again in RECHECKS rounds, taking the cases in
+// turn within a round so that drift in the speed of the machine falls on
+// them alike, and return the number that were slower in every round
+static int recheck(const std::vector<Result>& results, const std::vector<Result>& base,
+		   const std::vector<std::pair<size_t, size_t> >& suspects,
+		   int reps, int warmups, double mintime, double tol)
+{
+  if (suspects.empty()) {
+    std::cout << "0 regressions\n";
+    return 0;
+  }
+  size_t ns = suspects.size();
+  std::vector<Workload> w(ns);
+  std::vector<const Routine*> rt(ns, NULL);
+  std::vector<int> slower(ns, 0);
+  for (size_t i = 0; i < ns; i++){
+    const Result& r = results[suspects[i].first];
+    makeworkload(w[i], r.n);
+    for (size_t k = 0; k < sizeof(routines)/sizeof(routines[0]); k++){
+      if (r.name == routines[k].name) { rt[i] = &routines[k]; }
+    }
+  }
+  std::cout << "\nround,routine,n,median_s,ratio,ratio_lo,ratio_hi\n";
+  for (int round = 1; round <= RECHECKS; round++){
+    for (size_t i = 0; i < ns; i++){
+      const Result& b = base[suspects[i].second];
+      Result r = measure(*rt[i], w[i], reps, warmups, mintime);
+      double lo, hi;
+      double ratio = medianratio(r.samples, b.samples, lo, hi);
+      if (lo > 1.0 + casetol(b, tol)) { slower[i]++; }
+      std::cout << round << "," << r.name << "," << r.n << "," << r.median << ","
+		<< ratio << "," << lo << "," << hi << std::endl;
+    }
+  }
+  int regressions = 0;
+  std::cout << "\nroutine,n,rounds_slower,verdict\n";
+  for (size_t i = 0; i < ns; i++){
+    const Result& r = results[suspects[i].first];
+    bool regressed = (slower[i] == RECHECKS);
+    regressions += (regressed ? 1 : 0);
+    std::cout << r.name << "," << r.n << "," << slower[i] << "/" << RECHECKS << ","
+	      << (regressed ? "SLOWER" : "noise") << "\n";
+  }
+  std::cout << regressions << " regression" << (regressions == 1 ? "" : "s") << " beyond "
+	    << 100*tol << "% or the baseline's spread\n";
+  return regressions;
+}
+
+
+// Autotuning
+
+// Size each kernel is tuned at, and the number of 8 x 8 systems for batchqr
+static const int TUNEN = 384;
+static const int GEMMN = 256;
+static const int TUNEBATCH = 4096;
+
+struct TuneContext
+{
+  Workload* w[5]; // Operands for each of tuneroutines
+  int reps, warmups;
+  double mintime;
+};
+
+// Median time of tuneroutines[k] with the parameters t
+static double tunetime(TuneContext& c, int k, const TuningParams& t)
+{
+  settuning(t);
+  return measure(tuneroutines[k], *c.w[k], c.reps, c.warmups, c.mintime).median;
+}
+
+// Set the field of t to the fastest of the candidates for kernel k,
+// printing each time
+static void tuneparam(TuneContext& c, int k, TuningParams& t, int TuningParams::*field,
+		      const char* param, const int* cands, int ncands)
+{
+  int best = t.*field;
+  double tbest = -1.0;
+  for (int i = 0; i < ncands; i++){
+    t.*field = cands[i];
+    double time = tunetime(c, k, t);
+    std::cout << param << "," << cands[i] << "," << time << std::endl;
+    if (tbest < 0.0 || time < tbest) {
+      tbest = time;
+      best = cands[i];
+    }
+  }
+  t.*field = best;
+}
+
+// The largest of the sizes at which kernel k is faster on one thread,
+// from timing it at each with thresholds low (threaded) and high (not).
+// Operands of each size replace those of k while it is timed.
+static int crossover(TuneContext& c, int k, TuningParams& t, const char* param,
+		     double TuningParams::*dfield, int TuningParams::*ifield,
+		     const int* sizes, int nsizes)
+{
+  Workload* saved = c.w[k];
+  int last = 0;
+  for (int i = 0; i < nsizes; i++){
+    Workload w;
+    makeworkload(w, sizes[i]);
+    w.p = dgelu(w.A, w.C);
+    c.w[k] = &w;
+    if (dfield) { t.*dfield = 1e300; } else { t.*ifield = 1 << 30; }
+    double serial = tunetime(c, k, t);
+    if (dfield) { t.*dfield = 0.0; } else { t.*ifield = 0; }
+    double threaded = tunetime(c, k, t);
+    std::cout << param << "," << sizes[i] << "," << serial << "," << threaded << std::endl;
+    last = (serial <= threaded ? sizes[i] : last);
+  }
+  c.w[k] = saved;
+  return last;
+}
+
+static int autotune(int reps, int warmups, double mintime)
+{
+  int threads = 1;
+#ifdef _OPENMP
+  threads = omp_get_max_threads();
+#endif
+  Workload wg, ws, wb;
+  makeworkload(wg, GEMMN);
+  makeworkload(ws, TUNEN);
+  ws.p = dgelu(ws.A, ws.C);
+  wb.V.assign(64, TUNEBATCH, 0.0);
+  for (int i = 0; i < 64; i++){
+    for (int s = 0; s < TUNEBATCH; s++){
+      wb.V(i, s) = rand()/(double)RAND_MAX - 0.5 + (i % 9 == 0 ? 8.0 : 0.0);
+    }
+  }
+  wb.n = TUNEBATCH;
+  wb.x.assign(TUNEBATCH, 0.0);
+  wb.b.assign(TUNEBATCH, 0.0);
+  TuneContext c = { {&wg, &ws, &ws, &ws, &wb}, reps, warmups, mintime };
+  TuningParams t = defaulttuning();
+  std::vector<double> before(5);
+  for (int k = 0; k < 5; k++) { before[k] = tunetime(c, k, t); }
+
+  std::cout << "parameter,value,median_s\n";
+  static const int gemmblocks[] = {32, 64, 128, 256, 512};
+  static const int panels[] = {16, 24, 32, 48, 64, 96, 128, 192};
+  static const int caches[] = {2048, 4096, 8192, 16384, 32768, 65536};
+  // The blocks of gemm interact, so the first is revisited
+  tuneparam(c, 0, t, &TuningParams::gemmblockk, "gemmblockk", gemmblocks, 4);
+  tuneparam(c, 0, t, &TuningParams::gemmblockj, "gemmblockj", gemmblocks, 5);
+  tuneparam(c, 0, t, &TuningParams::gemmblockk, "gemmblockk", gemmblocks, 4);
+  tuneparam(c, 1, t, &TuningParams::lublock, "lublock", panels, 8);
+  tuneparam(c, 2, t, &TuningParams::cholblock, "cholblock", panels, 8);
+  tuneparam(c, 3, t, &TuningParams::invblock, "invblock", panels, 8);
+  tuneparam(c, 4, t, &TuningParams::batchcache, "batchcache", caches, 6);
+  if (threads > 1) {
+    static const int gemmsizes[] = {16, 24, 32, 48, 64, 96, 128, 192, 256};
+    static const int invsizes[] = {32, 64, 96, 128, 192, 256, 384};
+    std::cout << "\nparameter,n,serial_s,threaded_s\n";
+    int n = crossover(c, 0, t, "gemmparallel", &TuningParams::gemmparallel, NULL, gemmsizes, 9);
+    t.gemmparallel = (n == 256 ? 1e300 : 2.0*n*n*(double)n);
+    t.invparallel = crossover(c, 3, t, "invparallel", NULL, &TuningParams::invparallel, invsizes, 7);
+    t.invparallel = (t.invparallel == 384 ? 1 << 30 : t.invparallel);
+  } else {
+    // Threads only cost on one
+    t.gemmparallel = 1e300;
+    t.invparallel = 1 << 30;
+  }
+
+  // Check each kernel against the defaults, which are kept if they are
+  // not beaten, as the search can be fooled by noise
+  TuningParams d = defaulttuning();
+  std::cout << "\nkernel,default_s,tuned_s,speedup\n";
+  for (int k = 0; k < 5; k++){
+    double after = tunetime(c, k, t);
+    std::cout << tuneroutines[k].name << "," << before[k] << "," << after << ","
+	      << before[k]/after << (after > before[k] ? ",kept default" : "") << std::endl;
+    if (after > before[k]) {
+      switch(k){
+      case 0: t.gemmblockk = d.gemmblockk; t.gemmblockj = d.gemmblockj; break;
+      case 1: t.lublock = d.lublock; break;
+      case 2: t.cholblock = d.cholblock; break;
+      case 3: t.invblock = d.invblock; break;
+      case 4: t.batchcache = d.batchcache; break;
+      }
+    }
+  }
+  std::string path = tuningpath();
+  savetuning(path.c_str(), t);
+  std::cout << "\nwrote " << path << "\n";
+  return 0;
+}
+
+
+int main(int argc, char* argv[])
+{
+  std::vector<int> sizes;
+  int reps = 15, warmups = 2;
+  double mintime = 1e-3;
+  const char* filter = "";
+  const char* json = "bench.json";
+  const char* baseline = NULL;
+  double tol = 0.05;
+  bool tune = false, setreps = false, settime = false;
+  for (int i = 1; i < argc; i++){
+    bool more = (i + 1 < argc);
+    if (!strcmp(argv[i], "-s") && more) {
+      std::stringstream list(argv[++i]);
+      std::string item;
+      while (std::getline(list, item, ',')){
+	sizes.push_back(atoi(item.c_str()));
+      }
+    } else if (!strcmp(argv[i], "-r") && more) { reps = atoi(argv[++i]); setreps = true; }
+    else if (!strcmp(argv[i], "-w") && more) { warmups = atoi(argv[++i]); }
+    else if (!strcmp(argv[i], "-t") && more) { mintime = atof(argv[++i]); settime = true; }
+    else if (!strcmp(argv[i], "-f") && more) { filter = argv[++i]; }
+    else if (!strcmp(argv[i], "-j") && more) { json = argv[++i]; }
+    else if (!strcmp(argv[i], "-b") && more) { baseline = argv[++i]; }
+    else if (!strcmp(argv[i], "-c") && more) { tol = atof(argv[++i]); }
+    else if (!strcmp(argv[i], "-T")) { tune = true; }
+    else {
+      std::cerr << "Usage: " << argv[0] << " [-s sizes] [-r repeats] [-w warmups] [-t seconds] [-f filter] [-j file.json] [-b baseline.json] [-c tolerance]\n"
+		<< "       " << argv[0] << " -T [-r repeats] [-w warmups] [-t seconds]\n";
+      return 1;
+    }
+  }
+  if (sizes.empty()) {
+    sizes.push_back(32); sizes.push_back(64); sizes.push_back(128); sizes.push_back(256);
+  }
+  reps = (tune && !setreps ? 7 : reps);
+  mintime = (tune && !settime ? 0.02 : mintime);
+  reps = (reps > 0 ? reps : 1);
+  srand(1234); // The same operands every run
+
+  if (tune) {
+    try {
+      std::cout << std::setprecision(6);
+      return autotune(reps, warmups, mintime);
+    } catch (Error& e) {
+      e.print();
+      return 1;
+    }
+  }
+
+  std::vector<Result> results;
+  try {
+    std::cout << "routine,n,repeats,inner,median_s,p10_s,p90_s,min_s,mean_s,sd_s,gflops,gbs,allocs,alloc_bytes\n";
+    std::cout << std::setprecision(6);
+    for (size_t k = 0; k < sizes.size(); k++){
+      Workload w;
+      makeworkload(w, sizes[k]);
+      for (size_t r = 0; r < sizeof(routines)/sizeof(routines[0]); r++){
+        const Routine& rt = routines[r];
+        if (sizes[k] > rt.maxn || !strstr(rt.name, filter)) { continue; }
+        Result res = measure(rt, w, reps, warmups, mintime);
+        std::cout << res.name << "," << res.n << "," << reps << "," << res.inner << ","
+		  << res.median << "," << res.p10 << "," << res.p90 << "," << res.min << ","
+		  << res.mean << "," << res.sd << "," << res.gflops << "," << res.gbs << ","
+		  << res.allocs << "," << res.bytes << std::endl;
+        results.push_back(res);
+      }
+    }
+    if (strcmp(json, "-")) {
+      writejson(json, results, reps, warmups);
+    }
+#ifdef PROFILING
+    profilereport(std::cerr);
+#endif
+    if (baseline) {
+      std::string host;
+      std::vector<Result> base = readjson(baseline, host);
+      std::vector<std::pair<size_t, size_t> > suspects = compare(results, base, host, tol);
+      if (recheck(results, base, suspects, reps, warmups, mintime, tol) > 0) {
+	return 2;
+      }
+    }
+  } catch (Error& e) {
+    e.print();
+    return 1;
+  }
+  return 0;
+}
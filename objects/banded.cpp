@@ -0,0 +1,298 @@
+/*
+ *   Implementation of banded.hpp
+ *
+ *   DATE               AUTHOR                  CHANGES
+ *   ============================================================================
+ *   19/10/26           Robert Shaw             Original code.
+ */
+
+#include "banded.hpp"
+#include "matrix.hpp"
+#include "error.hpp"
+#include <cmath>
+#include <iostream>
+#include <iomanip>
+
+// Threshold on the dimension below which products are not threaded
+static const int BANDPARALLEL = 20000;
+
+// BandedMatrix
+
+void BandedMatrix::cleanUp()
+{
+  if (v != NULL) {
+    delete[] v;
+  }
+  v = NULL;
+}
+
+
+BandedMatrix::BandedMatrix(int dim, int lower, int upper, const double& a)
+{
+  if (lower < 0 || upper < 0) {
+    throw( Error("BANDED", "Number of diagonals must be non-negative.") );
+  }
+  n = dim; kl = lower; ku = upper;
+  v = NULL;
+  if (n > 0) {
+    int w = width();
+    v = new double[(long)n*w];
+    // Only elements inside the matrix are set to a
+    for (int i = 0; i < n; i++){
+      for (int k = 0; k < w; k++){
+	int j = i + k - kl;
+	v[(long)i*w+k] = (j >= 0 && j < n ? a : 0.0);
+      }
+    }
+  }
+}
+
+
+BandedMatrix::BandedMatrix(const Matrix& A, int lower, int upper)
+{
+  if (!A.isSquare()) {
+    throw( Error("BANDED", "Matrix must be square.") );
+  }
+  if (lower < 0 || upper < 0) {
+    throw( Error("BANDED", "Number of diagonals must be non-negative.") );
+  }
+  n = A.nrows(); kl = lower; ku = upper;
+  v = NULL;
+  if (n > 0) {
+    int w = width();
+    v = new double[(long)n*w];
+    for (int i = 0; i < n; i++){
+      for (int k = 0; k < w; k++){
+	int j = i + k - kl;
+	v[(long)i*w+k] = (j >= 0 && j < n ? A(i, j) : 0.0);
+      }
+    }
+  }
+}
+
+
+BandedMatrix::BandedMatrix(const BandedMatrix& other) : n(0), kl(0), ku(0), v(NULL)
+{
+  *this = other;
+}
+
+
+BandedMatrix::~BandedMatrix()
+{
+  cleanUp();
+}
+
+
+double& BandedMatrix::operator()(int i, int j)
+{
+  if (!inBand(i, j)) {
+    throw( Error("BANDINDEX", "Element is outside the band.") );
+  }
+  return v[(long)i*width() + j - i + kl];
+}
+
+
+double BandedMatrix::operator()(int i, int j) const
+{
+  return (inBand(i, j) ? v[(long)i*width() + j - i + kl] : 0.0);
+}
+
+
+BandedMatrix& BandedMatrix::operator=(const BandedMatrix& other)
+{
+  if (this != &other) {
+    cleanUp();
+    n = other.n; kl = other.kl; ku = other.ku;
+    if (n > 0) {
+      long len = (long)n*width();
+      v = new double[len];
+      for (long k = 0; k < len; k++){
+	v[k] = other.v[k];
+      }
+    }
+  }
+  return *this;
+}
+
+
+void BandedMatrix::multiply(const Vector& x, Vector& y) const
+{
+  if (x.size() != n || y.size() != n) {
+    throw( Error("BANDMULT", "Vector and matrix are wrong sizes to multiply.") );
+  }
+  const double* xv = x.data();
+  double* yv = y.data();
+  int w = width();
+#pragma omp parallel for if (n > BANDPARALLEL)
+  for (int i = 0; i < n; i++){
+    // Columns j = i - kl + k, restricted to the matrix
+    int kmin = (kl - i > 0 ? kl - i : 0);
+    int kmax = (n - 1 - i + kl < w - 1 ? n - 1 - i + kl : w - 1);
+    const double* row = v + (long)i*w;
+    const double* xi = xv + i - kl;
+    double sum = 0.0;
+    for (int k = kmin; k <= kmax; k++){
+      sum += row[k]*xi[k];
+    }
+    yv[i] = sum;
+  }
+}
+
+
+Matrix BandedMatrix::toDense() const
+{
+  Matrix rmat(n, n, 0.0);
+  int w = width();
+  for (int i = 0; i < n; i++){
+    for (int k = 0; k < w; k++){
+      int j = i + k - kl;
+      if (j >= 0 && j < n) { rmat(i, j) = v[(long)i*w+k]; }
+    }
+  }
+  return rmat;
+}
+
+
+bool BandedMatrix::isSymmetric(double PRECISION) const
+{
+  bool rval = true;
+  int bw = (kl > ku ? kl : ku);
+  for (int i = 0; rval && i < n; i++){
+    for (int j = i+1; rval && j <= i+bw && j < n; j++){
+      rval = (fabs((*this)(i, j) - (*this)(j, i)) < PRECISION);
+    }
+  }
+  return rval;
+}
+
+
+void BandedMatrix::print(double PRECISION) const
+{
+  // Print as the diagonals, one row of the matrix per line
+  int w = width();
+  for (int i = 0; i < n; i++){
+    for (int k = 0; k < w; k++){
+      double val = (fabs(v[(long)i*w+k]) > PRECISION ? v[(long)i*w+k] : 0.0);
+      std::cout << std::setprecision(8) << std::setw(14) << val;
+    }
+    std::cout << "\n";
+  }
+}
+
+// TridiagonalMatrix
+
+TridiagonalMatrix::TridiagonalMatrix(int dim, const double& a)
+  : dl(dim > 1 ? dim-1 : 0, a), d(dim, a), du(dim > 1 ? dim-1 : 0, a)
+{
+}
+
+
+TridiagonalMatrix::TridiagonalMatrix(const Vector& sub, const Vector& diag, const Vector& super)
+  : dl(sub), d(diag), du(super)
+{
+  int n = d.size();
+  if (n > 0 && (dl.size() < n-1 || du.size() < n-1)) {
+    throw( Error("TRIDIAG", "Off-diagonals are too short.") );
+  }
+}
+
+
+TridiagonalMatrix::TridiagonalMatrix(const Matrix& A)
+{
+  if (!A.isSquare()) {
+    throw( Error("TRIDIAG", "Matrix must be square.") );
+  }
+  int n = A.nrows();
+  d.resize(n);
+  dl.resize(n > 1 ? n-1 : 0);
+  du.resize(n > 1 ? n-1 : 0);
+  for (int i = 0; i < n; i++){
+    d[i] = A(i, i);
+    if (i < n-1) {
+      dl[i] = A(i+1, i);
+      du[i] = A(i, i+1);
+    }
+  }
+}
+
+
+double TridiagonalMatrix::operator()(int i, int j) const
+{
+  double rval = 0.0;
+  if (i == j) { rval = d(i); }
+  else if (i == j+1) { rval = dl(j); }
+  else if (j == i+1) { rval = du(i); }
+  return rval;
+}
+
+
+void TridiagonalMatrix::multiply(const Vector& x, Vector& y) const
+{
+  int n = d.size();
+  if (x.size() != n || y.size() != n) {
+    throw( Error("TRIMULT", "Vector and matrix are wrong sizes to multiply.") );
+  }
+  if (n == 0) { return; }
+  if (n == 1) {
+    y[0] = d(0)*x(0);
+    return;
+  }
+  const double* xv = x.data();
+  const double* lv = dl.data();
+  const double* dv = d.data();
+  const double* uv = du.data();
+  double* yv = y.data();
+  yv[0] = dv[0]*xv[0] + uv[0]*xv[1];
+#pragma omp parallel for simd if (n > BANDPARALLEL)
+  for (int i = 1; i < n-1; i++){
+    yv[i] = lv[i-1]*xv[i-1] + dv[i]*xv[i] + uv[i]*xv[i+1];
+  }
+  yv[n-1] = lv[n-2]*xv[n-2] + dv[n-1]*xv[n-1];
+}
+
+
+Matrix TridiagonalMatrix::toDense() const
+{
+  int n = d.size();
+  Matrix rmat(n, n, 0.0);
+  for (int i = 0; i < n; i++){
+    rmat(i, i) = d(i);
+    if (i < n-1) {
+      rmat(i+1, i) = dl(i);
+      rmat(i, i+1) = du(i);
+    }
+  }
+  return rmat;
+}
+
+
+BandedMatrix TridiagonalMatrix::toBanded() const
+{
+  int n = d.size();
+  BandedMatrix rmat(n, 1, 1);
+  for (int i = 0; i < n; i++){
+    rmat(i, i) = d(i);
+    if (i < n-1) {
+      rmat(i+1, i) = dl(i);
+      rmat(i, i+1) = du(i);
+    }
+  }
+  return rmat;
+}
+
+// Products
+
+Vector operator*(const BandedMatrix& A, const Vector& x)
+{
+  Vector y(A.size());
+  A.multiply(x, y);
+  return y;
+}
+
+
+Vector operator*(const TridiagonalMatrix& T, const Vector& x)
+{
+  Vector y(T.size());
+  T.multiply(x, y);
+  return y;
+}
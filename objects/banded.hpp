@@ -0,0 +1,86 @@
+/*
+ *   Purpose: To define compact storage for banded and tridiagonal matrices,
+ *            so that they can be stored in O(n*bw) rather than O(n^2), and
+ *            solved by the banded routines in factors.hpp and solvers.hpp.
+ *
+ *   DATE             AUTHOR            CHANGES
+ *   ===============================================================
+ *   19/10/26         Robert Shaw       Original code.
+ */
+
+#ifndef BANDEDHEADERDEF
+#define BANDEDHEADERDEF
+
+#include "vector.hpp"
+
+// Declare forward dependencies
+class Matrix;
+
+// An n x n matrix with kl subdiagonals and ku superdiagonals. Row i is
+// stored in a row of width kl+ku+1, with element (i, j) at position
+// i*(kl+ku+1) + j - i + kl of data(); positions outside the matrix are zero.
+class BandedMatrix
+{
+private:
+  int n, kl, ku; // Dimension, no. of sub- and superdiagonals
+  double* v; // Band storage, by rows
+  void cleanUp();
+public:
+  // Constructors and destructor
+  BandedMatrix() : n(0), kl(0), ku(0), v(NULL) {}
+  BandedMatrix(int dim, int lower, int upper, const double& a = 0.0);
+  // From the band of a dense matrix, ignoring anything outside it
+  BandedMatrix(const Matrix& A, int lower, int upper);
+  BandedMatrix(const BandedMatrix& other);
+  ~BandedMatrix();
+  // Accessors
+  int size() const { return n; }
+  int nlower() const { return kl; }
+  int nupper() const { return ku; }
+  int width() const { return kl+ku+1; } // Length of a stored row
+  double* data() { return v; }
+  const double* data() const { return v; }
+  bool inBand(int i, int j) const { return (j-i <= ku && i-j <= kl && i >= 0 && j >= 0 && i < n && j < n); }
+  // Overloaded operators
+  double& operator()(int i, int j); // Element ij, throws an error outside the band
+  double operator()(int i, int j) const; // By value, zero outside the band
+  BandedMatrix& operator=(const BandedMatrix& other);
+  // y = Ax, into an existing y of the right size
+  void multiply(const Vector& x, Vector& y) const;
+  // Intrinsic functions
+  Matrix toDense() const;
+  bool isSymmetric(double PRECISION = 1e-12) const;
+  void print(double PRECISION = 1e-12) const;
+};
+
+// An n x n tridiagonal matrix, with subdiagonal dl (T(i+1, i) = dl(i)),
+// diagonal d and superdiagonal du (T(i, i+1) = du(i)), as used by
+// tridiagsolve in solvers.hpp
+class TridiagonalMatrix
+{
+private:
+  Vector dl, d, du;
+public:
+  TridiagonalMatrix() {}
+  TridiagonalMatrix(int dim, const double& a = 0.0);
+  TridiagonalMatrix(const Vector& sub, const Vector& diag, const Vector& super);
+  TridiagonalMatrix(const Matrix& A); // The tridiagonal part of A
+  // Accessors
+  int size() const { return d.size(); }
+  Vector& subdiag() { return dl; }
+  Vector& diag() { return d; }
+  Vector& superdiag() { return du; }
+  const Vector& subdiag() const { return dl; }
+  const Vector& diag() const { return d; }
+  const Vector& superdiag() const { return du; }
+  double operator()(int i, int j) const; // By value, zero off the three diagonals
+  void multiply(const Vector& x, Vector& y) const;
+  Matrix toDense() const;
+  BandedMatrix toBanded() const;
+};
+
+// Banded (tridiagonal) matrix x vector
+Vector operator*(const BandedMatrix& A, const Vector& x);
+Vector operator*(const TridiagonalMatrix& T, const Vector& x);
+
+#endif
@@ -0,0 +1,204 @@
+/*
+ *   Implementation of binary.hpp
+ *
+ *   DATE               AUTHOR                  CHANGES
+ *   ============================================================================
+ *   19/10/26           Robert Shaw             Original code.
+ */
+
+#include "binary.hpp"
+#include "error.hpp"
+#include <cstring>
+#include <fstream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Threshold on the length below which the checksum is not threaded
+static const uint64_t BINARYPARALLEL = 1 << 20;
+
+static const char BINARYMAGIC[8] = "LINALGB";
+static const uint32_t BINARYENDIAN = 0x01020304;
+
+// Checksum
+
+uint64_t binarychecksum(const double* data, uint64_t len, uint64_t start)
+{
+  uint64_t sum = 0;
+#pragma omp parallel for reduction(+:sum) if(len > BINARYPARALLEL)
+  for (uint64_t i = 0; i < len; i++){
+    uint64_t z;
+    memcpy(&z, data + i, sizeof(z));
+    // Finaliser of splitmix64, so that every bit affects the sum, and
+    // the index, so that moving an element changes it
+    z += (start + i + 1)*0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30))*0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27))*0x94D049BB133111EBULL;
+    sum += z ^ (z >> 31);
+  }
+  return sum;
+}
+
+// Saving
+
+static BinaryHeader makeheader(uint32_t kind, uint64_t rows, uint64_t cols)
+{
+  BinaryHeader h;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, BINARYMAGIC, sizeof(h.magic));
+  h.version = BINARYVERSION;
+  h.dtype = 1;
+  h.layout = 0;
+  h.kind = kind;
+  h.endian = BINARYENDIAN;
+  h.rows = rows;
+  h.cols = cols;
+  h.offset = BINARYOFFSET;
+  return h;
+}
+
+// Write the data row by row, then go back to fill in the checksum
+static void writebinary(const char* path, BinaryHeader& h, const double* const* rows, int nrows, int ncols)
+{
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  if (!out) {
+    throw( Error("BINWRITE", "Could not open the file for writing.") );
+  }
+  out.write((const char*)&h, sizeof(h));
+  h.checksum = 0;
+  for (int i = 0; i < nrows; i++){
+    out.write((const char*)rows[i], (std::streamsize)ncols*sizeof(double));
+    h.checksum += binarychecksum(rows[i], ncols, (uint64_t)i*ncols);
+  }
+  out.seekp(0);
+  out.write((const char*)&h, sizeof(h));
+  out.close();
+  if (!out) {
+    throw( Error("BINWRITE", "Could not write the file.") );
+  }
+}
+
+void savebinary(const char* path, const Matrix& A)
+{
+  int m = A.nrows(), n = A.ncols();
+  BinaryHeader h = makeheader(2, m, n);
+  const double** rows = new const double*[m > 0 ? m : 1];
+  for (int i = 0; i < m; i++){
+    rows[i] = &A[i];
+  }
+  try {
+    writebinary(path, h, rows, (n > 0 ? m : 0), n);
+  } catch (...) {
+    delete[] rows;
+    throw;
+  }
+  delete[] rows;
+}
+
+void savebinary(const char* path, const Vector& u)
+{
+  BinaryHeader h = makeheader(1, u.size(), 1);
+  const double* row = u.data();
+  writebinary(path, h, &row, (u.size() > 0 ? 1 : 0), u.size());
+}
+
+// MappedFile
+
+MappedFile::MappedFile(const char* path, bool verify)
+{
+  base = NULL;
+  length = 0;
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    throw( Error("BINOPEN", "Could not open the file.") );
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(BinaryHeader)) {
+    close(fd);
+    throw( Error("BINFORMAT", "File is too short to have a header.") );
+  }
+  length = st.st_size;
+  base = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd); // The mapping keeps the file open
+  if (base == MAP_FAILED) {
+    base = NULL;
+    throw( Error("BINOPEN", "Could not map the file.") );
+  }
+  memcpy(&header, base, sizeof(header));
+  // Check the header describes something we can read
+  const char* problem = NULL;
+  uint64_t len = header.rows*header.cols;
+  if (memcmp(header.magic, BINARYMAGIC, sizeof(header.magic)) != 0) {
+    problem = "Not a binary matrix file.";
+  } else if (header.endian != BINARYENDIAN) {
+    problem = "File was written with the other byte order.";
+  } else if (header.version > BINARYVERSION) {
+    problem = "File was written by a newer version.";
+  } else if (header.dtype != 1 || header.layout != 0 || (header.kind != 1 && header.kind != 2)) {
+    problem = "Unknown element type, layout or kind.";
+  } else if (header.rows > 0x7fffffff || header.cols > 0x7fffffff
+	     || (header.kind == 1 && header.cols != 1)) {
+    problem = "Dimensions are out of range.";
+  } else if (header.offset < sizeof(header) || header.offset % 64 != 0 || header.offset > length
+	     || len > (length - header.offset)/sizeof(double)) {
+    problem = "File is shorter than its header says.";
+  }
+  if (problem == NULL && verify && !this->verify()) {
+    problem = "Checksum does not match.";
+  }
+  if (problem != NULL) {
+    munmap(base, length);
+    base = NULL;
+    throw( Error("BINFORMAT", problem) );
+  }
+  // The views point into the mapping, and are never written through
+  double* d = (double*)data();
+  if (isMatrix()) {
+    int m = header.rows, n = header.cols;
+    mat.rows = m;
+    mat.cols = n;
+    mat.arr = (m > 0 ? new double*[m] : NULL);
+    mat.view = true;
+    for (int i = 0; i < m; i++){
+      mat.arr[i] = (n > 0 ? d + (uint64_t)i*n : NULL);
+    }
+  } else {
+    vec.n = header.rows;
+    vec.v = (vec.n > 0 ? d : NULL);
+    vec.view = true;
+  }
+}
+
+MappedFile::~MappedFile()
+{
+  if (base != NULL) {
+    munmap(base, length);
+  }
+}
+
+const Matrix& MappedFile::matrix() const
+{
+  if (!isMatrix()) {
+    throw( Error("BINKIND", "File holds a vector, not a matrix.") );
+  }
+  return mat;
+}
+
+const Vector& MappedFile::vector() const
+{
+  if (isMatrix()) {
+    throw( Error("BINKIND", "File holds a matrix, not a vector.") );
+  }
+  return vec;
+}
+
+const double* MappedFile::data() const
+{
+  return (const double*)((const char*)base + header.offset);
+}
+
+bool MappedFile::verify() const
+{
+  return binarychecksum(data(), header.rows*header.cols) == header.checksum;
+}
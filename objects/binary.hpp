@@ -0,0 +1,80 @@
+/*
+ *   Purpose: To save matrices and vectors in a versioned binary format,
+ *            and to load them again by mapping the file into memory, so
+ *            that they can be used in place without being read or copied.
+ *
+ *            A file is a 64 byte header, as below, followed at offset 64
+ *            by the elements as native doubles in row major order, with no
+ *            padding between rows. As mappings are page aligned, the data
+ *            is 64 byte (cache line) aligned. The checksum is the sum,
+ *            mod 2^64, of a 64 bit mix of each element's bits with its
+ *            index, so it can be found while streaming, or in parallel.
+ *
+ *   DATE             AUTHOR            CHANGES
+ *   ===============================================================
+ *   19/10/26         Robert Shaw       Original code.
+ */
+
+#ifndef BINARYHEADERDEF
+#define BINARYHEADERDEF
+
+#include "matrix.hpp"
+#include "vector.hpp"
+#include <cstddef>
+#include <stdint.h>
+
+static const uint32_t BINARYVERSION = 1; // Newer files are refused
+static const uint64_t BINARYOFFSET = 64; // Start of the data
+
+struct BinaryHeader
+{
+  char magic[8]; // "LINALGB" and a null
+  uint32_t version; // Format version, BINARYVERSION when written
+  uint32_t dtype; // Element type, 1 = double, the only one so far
+  uint32_t layout; // 0 = row major, the only one so far
+  uint32_t kind; // 1 = vector, 2 = matrix
+  uint32_t endian; // 0x01020304 as written, to detect byte order
+  uint32_t reserved;
+  uint64_t rows, cols; // A vector has cols = 1
+  uint64_t offset; // Of the data from the start of the file
+  uint64_t checksum; // Of the data, see binarychecksum
+};
+
+// Write A or u to the file at path, a row at a time
+void savebinary(const char* path, const Matrix& A);
+void savebinary(const char* path, const Vector& u);
+
+// Checksum of len doubles that start at element start of the whole data
+uint64_t binarychecksum(const double* data, uint64_t len, uint64_t start = 0);
+
+// A file mapped read-only into memory, and a view of its contents as a
+// Matrix or Vector. The views share the mapping, so are only valid while
+// the MappedFile exists, and may not be modified; copies of them are
+// ordinary matrices and vectors. Pages are read from disk as they are
+// first touched, so opening is immediate whatever the size unless verify
+// is true, which reads everything to check the checksum.
+class MappedFile
+{
+private:
+  void* base; // Start of the mapping
+  size_t length; // Of the mapping, in bytes
+  BinaryHeader header;
+  Matrix mat;
+  Vector vec;
+  // Not copyable, as the mapping is owned
+  MappedFile(const MappedFile& other);
+  MappedFile& operator=(const MappedFile& other);
+public:
+  MappedFile(const char* path, bool verify = false);
+  ~MappedFile();
+  // Accessors
+  bool isMatrix() const { return header.kind == 2; }
+  uint32_t version() const { return header.version; }
+  const Matrix& matrix() const; // Throws if the file holds a vector
+  const Vector& vector() const; // Throws if the file holds a matrix
+  const double* data() const;
+  // Recompute the checksum of the data and compare with the header
+  bool verify() const;
+};
+
+#endif
@@ -6,19 +6,30 @@
  *   14/08/15           Robert Shaw             Original code.
  *   15/08/15           Robert Shaw             Added error handling.
  *   20/08/15           Robert Shaw             Matrix-matrix mult. now uses inner.
+ *   19/10/26           Robert Shaw             Blocked matrix-matrix mult.
+ *   19/10/26           Robert Shaw             Non-owning views.
+ *   19/10/26           Robert Shaw             Profiled multiplication.
+ *   19/10/26           Robert Shaw             Power iteration 2-norm.
+ *   19/10/26           Robert Shaw             Tuned, threaded multiplication.
  */
  
  #include "matrix.hpp"
  #include "vector.hpp"
+#include "profile.hpp"
+#include "tuning.hpp"
 #include <cmath>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 // Clean up utility for memory deallocation
 
 void Matrix::cleanUp()
 {
-  // No memory to deallocate if the matrix is null
+  // No memory to deallocate if the matrix is null,
+  // and a view only owns its row pointers
   if(rows > 0){
-    if(cols > 0){
+    if(cols > 0 && !view){
       // Delete columns
       for (int i = 0; i < rows; i++){
 	delete[] arr[i];
@@ -27,11 +38,12 @@ void Matrix::cleanUp()
     // Delete rows
     delete[] arr;
   }
+  view = false;
 }
 
 // Constructors and destructor
 
-Matrix::Matrix(int m, int n)
+Matrix::Matrix(int m, int n) : view(false)
 {
   // Set no. of rows and columns
   rows = m;
@@ -56,7 +68,7 @@ Matrix::Matrix(int m, int n)
 
 // Same again, but initialise all elements to a
 
-Matrix::Matrix(int m, int n, const double& a)
+Matrix::Matrix(int m, int n, const double& a) : view(false)
 {
   // Set no. of rows and columns                            
   rows = m;
@@ -84,7 +96,7 @@ Matrix::Matrix(int m, int n, const double& a)
 
 // Same again, but now initialise all rows to a given vector, a
 
-Matrix::Matrix(int m, int n, const double* a)
+Matrix::Matrix(int m, int n, const double* a) : view(false)
 {
   // Set no. of rows and columns                      
   rows = m;
@@ -112,7 +124,7 @@ Matrix::Matrix(int m, int n, const double* a)
 
 // Copy constructor
 
-Matrix::Matrix(const Matrix& other)
+Matrix::Matrix(const Matrix& other) : view(false)
 {
   // Set size
   rows = other.nrows();
@@ -332,6 +344,13 @@ double& Matrix::operator[](int i)
   return arr[i][0];
 }
 
+
+const double& Matrix::operator[](int i) const
+{
+  // No bounds checking
+  return arr[i][0];
+}
+
 // Return pointer to element ij
 
 double& Matrix::operator()(int i, int j)
@@ -440,26 +459,56 @@ Matrix Matrix::operator-(const Matrix& other) const
 }
 
 // Matrix multiplication - will throw error if incompatible sizes, returning an empty matrix
+// The product is formed in cache-sized blocks, in i-k-j order, so that the
+// innermost loop runs along contiguous rows of both other and the result.
+// The block sizes, and the size above which the rows of the result are
+// shared between threads, are tuned (see tuning.hpp).
 
 Matrix Matrix::operator*(const Matrix& other) const
 {
   int oRows = other.nrows();
   int oCols = other.ncols();
+  double flops = 2.0*rows*cols*oCols;
+  PROFILE("gemm", flops);
   // Make return matrix of correct size
   // Left to right operator implies has shape (rows x oCols)
-  Matrix rMat(rows, oCols);
+  Matrix rMat(rows, oCols, 0.0);
   // Throw error if incompatible, leaving rMat empty
   if (cols != oRows){
     throw(Error("MATMULT", "Matrices are incompatible sizes for multiplication."));
   } else {
-    // Multiply them
-    Vector lhs(cols); // Store each vector on left hand side
-    Vector rhs(oRows); // Store each vector on right hand side
-    for (int i = 0; i < rows; i++){
-      lhs = rowAsVector(i);
-      for (int j = 0; j < oCols; j++){
-	rhs = other.colAsVector(j);
-	rMat(i, j) = inner(lhs, rhs); // Take dot product
+    const TuningParams& t = tuning();
+    int kblock = t.gemmblockk;
+    int jblock = t.gemmblockj;
+    // Multiply them, a block of other at a time, each thread taking a
+    // band of rows
+#pragma omp parallel if (flops > t.gemmparallel && rows > 1)
+    {
+#ifdef _OPENMP
+      int nthreads = omp_get_num_threads();
+      int tid = omp_get_thread_num();
+#else
+      int nthreads = 1;
+      int tid = 0;
+#endif
+      int start = (int)(((long)rows*tid)/nthreads);
+      int end = (int)(((long)rows*(tid+1))/nthreads);
+      for (int kk = 0; kk < cols; kk += kblock){
+	int kmax = (kk + kblock < cols ? kk + kblock : cols);
+	for (int jj = 0; jj < oCols; jj += jblock){
+	  int jmax = (jj + jblock < oCols ? jj + jblock : oCols);
+	  for (int i = start; i < end; i++){
+	    double* ri = rMat.arr[i];
+	    const double* ai = arr[i];
+	    for (int k = kk; k < kmax; k++){
+	      double aik = ai[k];
+	      const double* bk = other.arr[k];
+	      for (int j = jj; j < jmax; j++){
+		ri[j] += aik*bk[j];
+	      }
+	    }
+	  }
+	}
       }
     }
   }
@@ -551,6 +600,10 @@ bool Matrix::isTriangular(bool upper) const{
 
 // Friend functions
 
+// Most iterations, and relative change at which to stop, for the 2-norm
+static const int NORMITER = 200;
+static const double NORMTOL = 1e-10;
+
 // Calculate the induced matrix p-norm 
 // note that, like with vectors, the infinity norm is p=0
 double pnorm(const Matrix& m, int p)
@@ -582,7 +635,40 @@ double pnorm(const Matrix& m, int p)
     }
     }
     break;
-  case 2:
+  case 2: // The largest singular value, by power iteration on m(T)m,
+          // which converges to it from below
+    if (rows > 0 && cols > 0) {
+      double* x = new double[cols];
+      double* y = new double[rows];
+      for (int j = 0; j < cols; j++) { x[j] = 1.0 + double(j)/cols; }
+      double last = -1.0;
+      for (int iter = 0; iter < NORMITER; iter++){
+	// Normalise x, then y = m x, x = m(T) y
+	double xnorm = 0.0;
+	for (int j = 0; j < cols; j++) { xnorm += x[j]*x[j]; }
+	xnorm = std::sqrt(xnorm);
+	if (xnorm == 0.0) { break; }
+	for (int j = 0; j < cols; j++) { x[j] /= xnorm; }
+	double ynorm = 0.0;
+	for (int i = 0; i < rows; i++){
+	  const double* mi = m.arr[i];
+	  double sum = 0.0;
+	  for (int j = 0; j < cols; j++) { sum += mi[j]*x[j]; }
+	  y[i] = sum;
+	  ynorm += sum*sum;
+	}
+	rval = std::sqrt(ynorm); // ||m x|| for unit x
+	if (std::fabs(rval - last) <= NORMTOL*rval) { break; }
+	last = rval;
+	for (int j = 0; j < cols; j++) { x[j] = 0.0; }
+	for (int i = 0; i < rows; i++){
+	  const double* mi = m.arr[i];
+	  for (int j = 0; j < cols; j++) { x[j] += y[i]*mi[j]; }
+	}
+      }
+      delete[] x;
+      delete[] y;
+    }
     break;
   default:
     rval = 0.0;
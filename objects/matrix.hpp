@@ -12,6 +12,9 @@
  *     14/08/15         Robert Shaw           Added error throwing
  *     20/08/15         Robert Shaw           Changed approach to matrix-
  *                                            matrix multiplication.
+ *     19/10/26         Robert Shaw           Read-only row access.
+ *     19/10/26         Robert Shaw           Non-owning views, for mapped files.
+ *     19/10/26         Robert Shaw           Matrix 2-norm.
  */
 
 #ifndef MATRIXHEADERDEF
@@ -27,10 +30,12 @@ class Matrix
 private:
   int rows, cols; // No. of rows and columns of the matrix
   double** arr; // 2D array of matrix entries
+  bool view; // Rows point into memory owned elsewhere, e.g. a MappedFile
   void cleanUp(); // Utility function for memory deallocation
+  friend class MappedFile; // Makes views of mapped data
 public:
   // Constructors and destructor
-  Matrix() : rows(0), cols(0) {} // Default, forms zero length vector
+  Matrix() : rows(0), cols(0), view(false) {} // Default, forms zero length vector
   Matrix(int m, int n); // Declare an m x n matrix
   Matrix(int m, int n, const double& a); // Declare m x n matrix, all entries = a
   Matrix(int m, int n, const double* a); // Matrix of m row copies of n-vector a
@@ -54,6 +59,7 @@ public:
   void swapCols(int i, int j, int start = 0); // Assumed start/end points
   // Overloaded operators
   double& operator[](int i); // Return pointer to first element of row i
+  const double& operator[](int i) const; // Read-only version
   double& operator()(int i, int j); // Return pointer to element ij
   double operator()(int i, int j) const; // Return by value element ij
   Matrix& operator=(const Matrix& other); 
@@ -73,7 +79,8 @@ public:
   bool isSquare() const { return ( rows == cols ); }  // Determines whether the matrix is square
   bool isTriangular(bool upper = true) const; // Determines whether it is upper/lower triangular
   // Friend functions
-  friend double pnorm(const Matrix& m, int p); // The induced matrix p-norm
+  friend double pnorm(const Matrix& m, int p); // The induced matrix p-norm, p = 0 (infinity), 1 or 2
+                                               // (estimated from below by power iteration)
   friend double fnorm(const Matrix& m); // Calculate the Frobenius norm
 };
 
@@ -0,0 +1,443 @@
+/*
+ *   Implementation of packed.hpp
+ *
+ *   DATE               AUTHOR                  CHANGES
+ *   ============================================================================
+ *   19/10/26           Robert Shaw             Original code.
+ *   19/10/26           Robert Shaw             SYMV streams the packed rows.
+ */
+
+#include "packed.hpp"
+#include "matrix.hpp"
+#include "error.hpp"
+#include <cmath>
+#include <iostream>
+#include <iomanip>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// Threshold on the dimension below which products are not threaded
+static const int PACKEDPARALLEL = 500;
+
+// SymmetricMatrix
+
+// Adds row i of a packed lower triangle, vi, into y = Ax: the dot product
+// into y_i and the strictly lower part times x_i into y_j, j < i
+static void symvrow(const double* vi, int i, const double* x, double* y)
+{
+  double xi = x[i];
+  double sum = vi[i]*xi;
+#pragma omp simd reduction(+:sum)
+  for (int j = 0; j < i; j++){
+    sum += vi[j]*x[j];
+    y[j] += vi[j]*xi;
+  }
+  y[i] += sum;
+}
+
+void SymmetricMatrix::cleanUp()
+{
+  if (v != NULL) {
+    delete[] v;
+  }
+  v = NULL;
+}
+
+
+SymmetricMatrix::SymmetricMatrix(int dim, const double& a)
+{
+  n = dim;
+  v = NULL;
+  if (n > 0) {
+    long len = (long)n*(n+1)/2;
+    v = new double[len];
+    for (long k = 0; k < len; k++){
+      v[k] = a;
+    }
+  }
+}
+
+
+SymmetricMatrix::SymmetricMatrix(const Matrix& A)
+{
+  if (!A.isSquare()) {
+    throw( Error("SYMMETRIC", "Matrix must be square.") );
+  }
+  n = A.nrows();
+  v = NULL;
+  if (n > 0) {
+    v = new double[(long)n*(n+1)/2];
+    for (int i = 0; i < n; i++){
+      const double* ai = &A[i];
+      double* vi = v + (long)i*(i+1)/2;
+      for (int j = 0; j <= i; j++){
+	vi[j] = ai[j];
+      }
+    }
+  }
+}
+
+
+SymmetricMatrix::SymmetricMatrix(const SymmetricMatrix& other) : n(0), v(NULL)
+{
+  *this = other;
+}
+
+
+SymmetricMatrix::~SymmetricMatrix()
+{
+  cleanUp();
+}
+
+
+double& SymmetricMatrix::operator()(int i, int j)
+{
+  // No bounds checking
+  return (j <= i ? v[(long)i*(i+1)/2 + j] : v[(long)j*(j+1)/2 + i]);
+}
+
+
+double SymmetricMatrix::operator()(int i, int j) const
+{
+  return (j <= i ? v[(long)i*(i+1)/2 + j] : v[(long)j*(j+1)/2 + i]);
+}
+
+
+SymmetricMatrix& SymmetricMatrix::operator=(const SymmetricMatrix& other)
+{
+  if (this != &other) {
+    cleanUp();
+    n = other.n;
+    if (n > 0) {
+      long len = (long)n*(n+1)/2;
+      v = new double[len];
+      for (long k = 0; k < len; k++){
+	v[k] = other.v[k];
+      }
+    }
+  }
+  return *this;
+}
+
+
+void SymmetricMatrix::multiply(const Vector& x, Vector& y) const
+{
+  if (x.size() != n || y.size() != n) {
+    throw( Error("SYMV", "Vector and matrix are wrong sizes to multiply.") );
+  }
+  const double* xv = x.data();
+  double* yv = y.data();
+  // Row i of the lower triangle holds A(i,j) = A(j,i) for j <= i, so one
+  // pass down the packed rows gives both halves: the dot product with x
+  // goes into y_i and x_i times the row is scattered into y_j, j < i. As
+  // the scatter crosses rows, each thread accumulates into its own buffer,
+  // on the heap, and the buffers are summed into y a block of rows apiece.
+  for (int i = 0; i < n; i++) { yv[i] = 0.0; }
+#ifdef _OPENMP
+  if (n > PACKEDPARALLEL && omp_get_max_threads() > 1) {
+    double** parts = NULL;
+    int nparts = 0;
+#pragma omp parallel
+    {
+#pragma omp single
+      {
+	nparts = omp_get_num_threads();
+	parts = new double*[nparts];
+      }
+      int t = omp_get_thread_num();
+      double* part = yv; // The first thread accumulates straight into y
+      if (t > 0) {
+	part = new double[n];
+	for (int i = 0; i < n; i++) { part[i] = 0.0; }
+      }
+      parts[t] = part;
+#pragma omp for schedule(dynamic, 64)
+      for (int i = 0; i < n; i++){
+	symvrow(v + (long)i*(i+1)/2, i, xv, part);
+      }
+#pragma omp for schedule(static)
+      for (int i = 0; i < n; i++){
+	double sum = yv[i];
+	for (int p = 1; p < nparts; p++) { sum += parts[p][i]; }
+	yv[i] = sum;
+      }
+      if (t > 0) { delete[] part; }
+    }
+    delete[] parts;
+    return;
+  }
+#endif
+  for (int i = 0; i < n; i++){
+    symvrow(v + (long)i*(i+1)/2, i, xv, yv);
+  }
+}
+
+
+Matrix SymmetricMatrix::toDense() const
+{
+  Matrix rmat(n, n);
+  for (int i = 0; i < n; i++){
+    for (int j = 0; j <= i; j++){
+      rmat(i, j) = rmat(j, i) = v[(long)i*(i+1)/2 + j];
+    }
+  }
+  return rmat;
+}
+
+
+double SymmetricMatrix::trace() const
+{
+  double rval = 0.0;
+  for (int i = 0; i < n; i++){
+    rval += v[(long)i*(i+1)/2 + i];
+  }
+  return rval;
+}
+
+
+void SymmetricMatrix::print(double PRECISION) const
+{
+  // Print the lower triangle only
+  for (int i = 0; i < n; i++){
+    for (int j = 0; j <= i; j++){
+      double val = v[(long)i*(i+1)/2 + j];
+      val = (fabs(val) > PRECISION ? val : 0.0);
+      std::cout << std::setprecision(8) << std::setw(14) << val;
+    }
+    std::cout << "\n";
+  }
+}
+
+// TriangularMatrix
+
+void TriangularMatrix::cleanUp()
+{
+  if (v != NULL) {
+    delete[] v;
+  }
+  v = NULL;
+}
+
+
+TriangularMatrix::TriangularMatrix(int dim, bool up, const double& a)
+{
+  n = dim;
+  upper = up;
+  v = NULL;
+  if (n > 0) {
+    long len = (long)n*(n+1)/2;
+    v = new double[len];
+    for (long k = 0; k < len; k++){
+      v[k] = a;
+    }
+  }
+}
+
+
+TriangularMatrix::TriangularMatrix(const Matrix& A, bool up)
+{
+  if (!A.isSquare()) {
+    throw( Error("TRIANGULAR", "Matrix must be square.") );
+  }
+  n = A.nrows();
+  upper = up;
+  v = NULL;
+  if (n > 0) {
+    v = new double[(long)n*(n+1)/2];
+    for (int i = 0; i < n; i++){
+      const double* ai = &A[i];
+      double* vi = v + rowStart(i);
+      if (upper) {
+	for (int j = i; j < n; j++){
+	  vi[j-i] = ai[j];
+	}
+      } else {
+	for (int j = 0; j <= i; j++){
+	  vi[j] = ai[j];
+	}
+      }
+    }
+  }
+}
+
+
+TriangularMatrix::TriangularMatrix(const TriangularMatrix& other) : n(0), upper(true), v(NULL)
+{
+  *this = other;
+}
+
+
+TriangularMatrix::~TriangularMatrix()
+{
+  cleanUp();
+}
+
+
+double& TriangularMatrix::operator()(int i, int j)
+{
+  if ((upper && j < i) || (!upper && j > i)) {
+    throw( Error("TRIINDEX", "Element is outside the triangle.") );
+  }
+  return v[rowStart(i) + (upper ? j-i : j)];
+}
+
+
+double TriangularMatrix::operator()(int i, int j) const
+{
+  double rval = 0.0;
+  if ((upper && j >= i) || (!upper && j <= i)) {
+    rval = v[rowStart(i) + (upper ? j-i : j)];
+  }
+  return rval;
+}
+
+
+TriangularMatrix& TriangularMatrix::operator=(const TriangularMatrix& other)
+{
+  if (this != &other) {
+    cleanUp();
+    n = other.n;
+    upper = other.upper;
+    if (n > 0) {
+      long len = (long)n*(n+1)/2;
+      v = new double[len];
+      for (long k = 0; k < len; k++){
+	v[k] = other.v[k];
+      }
+    }
+  }
+  return *this;
+}
+
+
+void TriangularMatrix::multiply(const Vector& x, Vector& y) const
+{
+  if (x.size() != n || y.size() != n) {
+    throw( Error("TRMV", "Vector and matrix are wrong sizes to multiply.") );
+  }
+  const double* xv = x.data();
+  double* yv = y.data();
+#pragma omp parallel for schedule(dynamic, 64) if (n > PACKEDPARALLEL)
+  for (int i = 0; i < n; i++){
+    const double* vi = v + rowStart(i);
+    int start = (upper ? i : 0), len = (upper ? n-i : i+1);
+    const double* xi = xv + start;
+    double sum = 0.0;
+#pragma omp simd reduction(+:sum)
+    for (int j = 0; j < len; j++){
+      sum += vi[j]*xi[j];
+    }
+    yv[i] = sum;
+  }
+}
+
+
+TriangularMatrix TriangularMatrix::transpose() const
+{
+  TriangularMatrix rmat(n, !upper);
+  for (int i = 0; i < n; i++){
+    const double* vi = v + rowStart(i);
+    if (upper) {
+      for (int j = i; j < n; j++){
+	rmat(j, i) = vi[j-i];
+      }
+    } else {
+      for (int j = 0; j <= i; j++){
+	rmat(j, i) = vi[j];
+      }
+    }
+  }
+  return rmat;
+}
+
+
+Matrix TriangularMatrix::toDense() const
+{
+  Matrix rmat(n, n, 0.0);
+  for (int i = 0; i < n; i++){
+    const double* vi = v + rowStart(i);
+    if (upper) {
+      for (int j = i; j < n; j++){
+	rmat(i, j) = vi[j-i];
+      }
+    } else {
+      for (int j = 0; j <= i; j++){
+	rmat(i, j) = vi[j];
+      }
+    }
+  }
+  return rmat;
+}
+
+
+void TriangularMatrix::print(double PRECISION) const
+{
+  for (int i = 0; i < n; i++){
+    for (int j = 0; j < n; j++){
+      double val = (*this)(i, j);
+      val = (fabs(val) > PRECISION ? val : 0.0);
+      std::cout << std::setprecision(8) << std::setw(14) << val;
+    }
+    std::cout << "\n";
+  }
+}
+
+// Products
+
+Vector operator*(const SymmetricMatrix& A, const Vector& x)
+{
+  Vector y(A.size());
+  A.multiply(x, y);
+  return y;
+}
+
+
+Vector operator*(const TriangularMatrix& T, const Vector& x)
+{
+  Vector y(T.size());
+  T.multiply(x, y);
+  return y;
+}
+
+
+SymmetricMatrix syrk(const Matrix& A, bool trans)
+{
+  int m = A.nrows(), k = A.ncols();
+  int dim = (trans ? k : m);
+  SymmetricMatrix C(dim, 0.0);
+  double* c = C.data();
+  if (!trans) {
+    // C(i, j) is the inner product of rows i and j of A
+#pragma omp parallel for schedule(dynamic, 16) if (dim > PACKEDPARALLEL/4)
+    for (int i = 0; i < dim; i++){
+      const double* ai = &A[i];
+      double* ci = c + (long)i*(i+1)/2;
+      for (int j = 0; j <= i; j++){
+	const double* aj = &A[j];
+	double sum = 0.0;
+#pragma omp simd reduction(+:sum)
+	for (int l = 0; l < k; l++){
+	  sum += ai[l]*aj[l];
+	}
+	ci[j] = sum;
+      }
+    }
+  } else {
+    // Accumulate the outer product of each row of A with itself, with each
+    // thread owning a set of rows of C
+#pragma omp parallel for schedule(dynamic, 16) if (dim > PACKEDPARALLEL/4)
+    for (int i = 0; i < dim; i++){
+      double* ci = c + (long)i*(i+1)/2;
+      for (int l = 0; l < m; l++){
+	const double* al = &A[l];
+	double ali = al[i];
+#pragma omp simd
+	for (int j = 0; j <= i; j++){
+	  ci[j] += ali*al[j];
+	}
+      }
+    }
+  }
+  return C;
+}
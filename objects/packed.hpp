@@ -0,0 +1,99 @@
+/*
+ *   Purpose: To define packed storage for symmetric and triangular matrices,
+ *            keeping only one triangle, n(n+1)/2 elements rather than n^2,
+ *            along with the products that know about that structure (SYMV,
+ *            TRMV and SYRK). The factorisations and solves that take them
+ *            are in factors.hpp and solvers.hpp.
+ *
+ *   DATE             AUTHOR            CHANGES
+ *   ===============================================================
+ *   19/10/26         Robert Shaw       Original code.
+ */
+
+#ifndef PACKEDHEADERDEF
+#define PACKEDHEADERDEF
+
+#include "vector.hpp"
+
+// Declare forward dependencies
+class Matrix;
+
+// A symmetric n x n matrix, storing the lower triangle packed by rows, so
+// that element (i, j), j <= i, is at i(i+1)/2 + j of data(). Either (i, j)
+// or (j, i) may be used to access it.
+class SymmetricMatrix
+{
+private:
+  int n; // Dimension
+  double* v; // Packed lower triangle
+  void cleanUp();
+public:
+  // Constructors and destructor
+  SymmetricMatrix() : n(0), v(NULL) {}
+  SymmetricMatrix(int dim, const double& a = 0.0);
+  SymmetricMatrix(const Matrix& A); // From the lower triangle of A
+  SymmetricMatrix(const SymmetricMatrix& other);
+  ~SymmetricMatrix();
+  // Accessors
+  int size() const { return n; }
+  double* data() { return v; }
+  const double* data() const { return v; }
+  // Overloaded operators
+  double& operator()(int i, int j);
+  double operator()(int i, int j) const;
+  SymmetricMatrix& operator=(const SymmetricMatrix& other);
+  // y = Ax (SYMV), into an existing y of the right size
+  void multiply(const Vector& x, Vector& y) const;
+  // Intrinsic functions
+  Matrix toDense() const;
+  double trace() const;
+  void print(double PRECISION = 1e-12) const;
+};
+
+// An upper (or lower) triangular n x n matrix, storing that triangle packed
+// by rows, so that each row is contiguous. Element (i, j) is at
+// i*n - i(i-1)/2 + j - i, for j >= i, if upper, or at i(i+1)/2 + j, for
+// j <= i, if lower.
+class TriangularMatrix
+{
+private:
+  int n; // Dimension
+  bool upper; // Which triangle is stored
+  double* v; // Packed triangle
+  void cleanUp();
+public:
+  // Constructors and destructor
+  TriangularMatrix() : n(0), upper(true), v(NULL) {}
+  TriangularMatrix(int dim, bool up = true, const double& a = 0.0);
+  TriangularMatrix(const Matrix& A, bool up = true); // From a triangle of A
+  TriangularMatrix(const TriangularMatrix& other);
+  ~TriangularMatrix();
+  // Accessors
+  int size() const { return n; }
+  bool isUpper() const { return upper; }
+  double* data() { return v; }
+  const double* data() const { return v; }
+  // Start of the stored part of row i in data(), which holds columns
+  // i to n-1 if upper, or 0 to i if lower
+  long rowStart(int i) const { return (upper ? (long)i*n - (long)i*(i-1)/2 : (long)i*(i+1)/2); }
+  // Overloaded operators
+  double& operator()(int i, int j); // Element ij, throws an error outside the triangle
+  double operator()(int i, int j) const; // By value, zero outside the triangle
+  TriangularMatrix& operator=(const TriangularMatrix& other);
+  // y = Tx (TRMV), into an existing y of the right size
+  void multiply(const Vector& x, Vector& y) const;
+  // Intrinsic functions
+  TriangularMatrix transpose() const; // Upper becomes lower, and vice versa
+  Matrix toDense() const;
+  void print(double PRECISION = 1e-12) const;
+};
+
+// Symmetric (triangular) matrix x vector
+Vector operator*(const SymmetricMatrix& A, const Vector& x);
+Vector operator*(const TriangularMatrix& T, const Vector& x);
+
+// The symmetric rank-k update (SYRK), forming AA(T) for an m x k matrix A,
+// or A(T)A if trans is true, only computing the lower triangle
+SymmetricMatrix syrk(const Matrix& A, bool trans = false);
+
+#endif
@@ -0,0 +1,190 @@
+/*
+ *   Implementation of profile.hpp
+ *
+ *   DATE               AUTHOR                  CHANGES
+ *   ============================================================================
+ *   19/10/26           Robert Shaw             Original code.
+ */
+
+#include "profile.hpp"
+#include "error.hpp"
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <new>
+
+#ifdef PROFILING
+
+std::atomic<long> profileallocs(0), profilebytes(0);
+thread_local ProfileScope* profilecurrent = NULL;
+
+static ProfileRegion* profilehead = NULL; // List of all regions
+
+// Count every allocation made through new
+void* operator new(std::size_t size)
+{
+  profileallocs.fetch_add(1, std::memory_order_relaxed);
+  profilebytes.fetch_add(size, std::memory_order_relaxed);
+  void* p = std::malloc(size > 0 ? size : 1);
+  if (p == NULL) { throw std::bad_alloc(); }
+  return p;
+}
+
+void* operator new[](std::size_t size) { return operator new(size); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+
+ProfileRegion* profileregion(const char* name)
+{
+  ProfileRegion* r = NULL;
+#pragma omp critical(profileregions)
+  {
+    // Regions of the same name, from different places, are merged
+    r = profilehead;
+    while (r != NULL && strcmp(r->name, name) != 0){ r = r->next; }
+    if (r == NULL) {
+      r = new ProfileRegion;
+      r->name = name;
+      r->calls = r->nanos = r->maxnanos = r->allocs = r->bytes = 0;
+      r->flops = 0;
+      r->next = profilehead;
+      profilehead = r;
+    }
+  }
+  return r;
+}
+
+static ProfileStats makestats(const ProfileRegion* r)
+{
+  ProfileStats s;
+  s.name = r->name;
+  s.calls = r->calls;
+  s.total = r->nanos*1e-9;
+  s.max = r->maxnanos*1e-9;
+  s.flops = r->flops;
+  s.allocs = r->allocs;
+  s.bytes = r->bytes;
+  return s;
+}
+
+// The regions that have been entered, slowest first, in a new array
+static int sortedregions(const ProfileRegion**& list)
+{
+  int n = 0;
+  for (const ProfileRegion* r = profilehead; r != NULL; r = r->next){
+    if (r->calls > 0) { n++; }
+  }
+  list = new const ProfileRegion*[n > 0 ? n : 1];
+  n = 0;
+  for (const ProfileRegion* r = profilehead; r != NULL; r = r->next){
+    if (r->calls > 0) {
+      // Insertion sort, by total time
+      int j = n++;
+      while (j > 0 && list[j-1]->nanos < r->nanos){
+	list[j] = list[j-1];
+	j--;
+      }
+      list[j] = r;
+    }
+  }
+  return n;
+}
+
+int profilecount()
+{
+  const ProfileRegion** list;
+  int n = sortedregions(list);
+  delete[] list;
+  return n;
+}
+
+ProfileStats profilestats(int k)
+{
+  const ProfileRegion** list;
+  int n = sortedregions(list);
+  if (k < 0 || k >= n) {
+    delete[] list;
+    throw( Error("PROFILE", "No such region.") );
+  }
+  ProfileStats s = makestats(list[k]);
+  delete[] list;
+  return s;
+}
+
+bool profilestats(const char* name, ProfileStats& s)
+{
+  for (const ProfileRegion* r = profilehead; r != NULL; r = r->next){
+    if (strcmp(r->name, name) == 0 && r->calls > 0) {
+      s = makestats(r);
+      return true;
+    }
+  }
+  return false;
+}
+
+void profilereport(std::ostream& out)
+{
+  const ProfileRegion** list;
+  int n = sortedregions(list);
+  std::ios::fmtflags flags = out.flags();
+  std::streamsize precision = out.precision();
+  out << std::left << std::setw(28) << "region" << std::right << std::setw(10) << "calls"
+      << std::setw(12) << "total s" << std::setw(12) << "mean ms" << std::setw(12) << "max ms"
+      << std::setw(10) << "GFLOP/s" << std::setw(12) << "allocs" << std::setw(12) << "MB" << "\n";
+  for (int k = 0; k < n; k++){
+    ProfileStats s = makestats(list[k]);
+    out << std::left << std::setw(28) << s.name << std::right << std::setw(10) << s.calls
+	<< std::fixed << std::setprecision(4) << std::setw(12) << s.total
+	<< std::setw(12) << 1e3*s.total/s.calls << std::setw(12) << 1e3*s.max
+	<< std::setprecision(3) << std::setw(10) << (s.total > 0.0 ? 1e-9*s.flops/s.total : 0.0)
+	<< std::setw(12) << s.allocs << std::setprecision(1) << std::setw(12) << s.bytes/1048576.0
+	<< "\n";
+    out.unsetf(std::ios::fixed);
+  }
+  out.flags(flags);
+  out.precision(precision);
+  delete[] list;
+}
+
+void profilereset()
+{
+  for (ProfileRegion* r = profilehead; r != NULL; r = r->next){
+    r->calls = r->nanos = r->maxnanos = r->allocs = r->bytes = 0;
+    r->flops = 0;
+  }
+}
+
+void profilememory(long& allocs, long& bytes)
+{
+  allocs = profileallocs;
+  bytes = profilebytes;
+}
+
+#else
+
+// Nothing is recorded
+
+int profilecount() { return 0; }
+
+ProfileStats profilestats(int k)
+{
+  throw( Error("PROFILE", "No such region.") );
+}
+
+bool profilestats(const char* name, ProfileStats& s) { return false; }
+
+void profilereport(std::ostream& out)
+{
+  out << "Not profiling: build with -DPROFILING\n";
+}
+
+void profilereset() {}
+
+void profilememory(long& allocs, long& bytes)
+{
+  allocs = bytes = 0;
+}
+
+#endif
@@ -0,0 +1,137 @@
+/*
+ *   Purpose: To record where time goes inside the library, without an
+ *            external profiler. The routines, and the main phases within
+ *            them, are marked as regions with PROFILE(name, flops), and
+ *            each region counts its calls, its total and longest wall
+ *            times, the flops it was estimated to do, and the heap
+ *            allocations (and bytes) made while it ran. Times and counts
+ *            include those of any regions nested inside.
+ *
+ *            Regions only exist when built with -DPROFILING (e.g. make test
+ *            DEFINES=-DPROFILING). Otherwise PROFILE expands to nothing,
+ *            the flop estimates are not evaluated, and the report is empty.
+ *            Allocations are counted by replacing the global operator new,
+ *            so they include those made by other threads at the same time.
+ *            When built with -DTRACING each region is also recorded as a
+ *            span on the timeline of trace.hpp.
+ *
+ *            Routines whose work is only known as they go, such as the
+ *            iterative eigensolvers, add it with PROFILEFLOPS(flops), which
+ *            counts it to every region open on the calling thread.
+ *
+ *   DATE             AUTHOR            CHANGES
+ *   ===============================================================
+ *   19/10/26         Robert Shaw       Original code.
+ *   19/10/26         Robert Shaw       Regions are also traced.
+ *   19/10/26         Robert Shaw       Flops added as regions run.
+ */
+
+#ifndef PROFILEHEADERDEF
+#define PROFILEHEADERDEF
+
+#include "trace.hpp"
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+
+// Statistics of one region
+struct ProfileStats
+{
+  std::string name;
+  long calls;
+  double total, max; // Seconds
+  double flops; // Estimated, over all calls
+  long allocs, bytes; // Heap allocations, over all calls
+};
+
+// Number of regions entered so far, and the statistics of the k-th of
+// them, in decreasing order of total time
+int profilecount();
+ProfileStats profilestats(int k);
+// Statistics of the named region, returning false if it was never entered
+bool profilestats(const char* name, ProfileStats& s);
+// Print a table of every region, slowest first, to out
+void profilereport(std::ostream& out = std::cout);
+// Zero every region, e.g. after warming up
+void profilereset();
+// Allocations made, and bytes allocated, since the start of the program,
+// or zero if not profiling
+void profilememory(long& allocs, long& bytes);
+
+#ifdef PROFILING
+
+struct ProfileRegion
+{
+  const char* name;
+  std::atomic<long> calls, nanos, maxnanos, allocs, bytes;
+  std::atomic<long long> flops;
+  ProfileRegion* next; // Every region is in one list
+};
+
+// The region called name, made on first use
+ProfileRegion* profileregion(const char* name);
+
+extern std::atomic<long> profileallocs, profilebytes;
+
+class ProfileScope;
+// The innermost open region of this thread, from which the rest are
+// reached through their parents
+extern thread_local ProfileScope* profilecurrent;
+
+// Adds the time, flops and allocations from its construction to its
+// destruction to a region
+class ProfileScope
+{
+private:
+  ProfileRegion* region;
+  ProfileScope* parent;
+  long long flops;
+  long allocs, bytes;
+  std::chrono::steady_clock::time_point start;
+public:
+  ProfileScope(ProfileRegion* r, double f) : region(r), parent(profilecurrent), flops((long long)f)
+  {
+    profilecurrent = this;
+    allocs = profileallocs.load(std::memory_order_relaxed);
+    bytes = profilebytes.load(std::memory_order_relaxed);
+    start = std::chrono::steady_clock::now();
+  }
+  ~ProfileScope()
+  {
+    long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    region->calls.fetch_add(1, std::memory_order_relaxed);
+    region->nanos.fetch_add(ns, std::memory_order_relaxed);
+    region->flops.fetch_add(flops, std::memory_order_relaxed);
+    region->allocs.fetch_add(profileallocs.load(std::memory_order_relaxed) - allocs, std::memory_order_relaxed);
+    region->bytes.fetch_add(profilebytes.load(std::memory_order_relaxed) - bytes, std::memory_order_relaxed);
+    long prev = region->maxnanos.load(std::memory_order_relaxed);
+    while (ns > prev && !region->maxnanos.compare_exchange_weak(prev, ns)){}
+    profilecurrent = parent;
+  }
+  // Add f to this and each enclosing region
+  void addflops(double f)
+  {
+    for (ProfileScope* s = this; s != NULL; s = s->parent) { s->flops += (long long)f; }
+  }
+};
+
+#define PROFILEJOIN2(a, b) a##b
+#define PROFILEJOIN(a, b) PROFILEJOIN2(a, b)
+// Count the rest of the enclosing block as the region name, doing flops
+#define PROFILECOUNT(name, flops)					\
+  static ProfileRegion* PROFILEJOIN(profileregion, __LINE__) = profileregion(name); \
+  ProfileScope PROFILEJOIN(profilescope, __LINE__)(PROFILEJOIN(profileregion, __LINE__), (flops))
+// Add flops to the open regions
+#define PROFILEFLOPS(flops) do { if (profilecurrent != NULL) { profilecurrent->addflops(flops); } } while (0)
+
+#else
+
+#define PROFILECOUNT(name, flops)
+#define PROFILEFLOPS(flops)
+
+#endif
+
+#define PROFILE(name, flops) PROFILECOUNT(name, flops); TRACE(name)
+
+#endif
@@ -0,0 +1,586 @@
+/*
+ *   Implementation of sparse.hpp
+ *
+ *   DATE               AUTHOR                  CHANGES
+ *   ============================================================================
+ *   19/10/26           Robert Shaw             Original code.
+ *   19/10/26           Robert Shaw             Scatter buffers on the heap.
+ */
+
+#include "sparse.hpp"
+#include <cmath>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <utility>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// Threshold on the number of entries below which kernels are not threaded
+static const int SPARSEPARALLEL = 20000;
+
+// Utility functions on compressed arrays. Here 'outer' is the compressed
+// dimension (rows for CSR, cols for CSC) and 'inner' the other one.
+
+// Sort the entries of one row (column) by index, in place
+static void sortsegment(int* ix, double* v, int len)
+{
+  if (len < 32) { // Insertion sort is quickest for short rows
+    for (int i = 1; i < len; i++){
+      int itemp = ix[i];
+      double vtemp = v[i];
+      int j = i;
+      while (j > 0 && ix[j-1] > itemp) {
+	ix[j] = ix[j-1];
+	v[j] = v[j-1];
+	j--;
+      }
+      ix[j] = itemp;
+      v[j] = vtemp;
+    }
+  } else {
+    std::pair<int, double>* temp = new std::pair<int, double>[len];
+    for (int i = 0; i < len; i++) { temp[i] = std::make_pair(ix[i], v[i]); }
+    std::sort(temp, temp+len);
+    for (int i = 0; i < len; i++) { ix[i] = temp[i].first; v[i] = temp[i].second; }
+    delete[] temp;
+  }
+}
+
+// Transpose compressed arrays by a counting sort, so that the result is
+// sorted within each row (column) automatically. Output arrays are allocated.
+static void transposearrays(int nouter, int ninner, const int* ptr, const int* idx, const double* val,
+			    int*& tptr, int*& tidx, double*& tval)
+{
+  int nnz = ptr[nouter];
+  tptr = new int[ninner+1];
+  tidx = new int[nnz > 0 ? nnz : 1];
+  tval = new double[nnz > 0 ? nnz : 1];
+  for (int i = 0; i <= ninner; i++) { tptr[i] = 0; }
+  for (int k = 0; k < nnz; k++) { tptr[idx[k]+1]++; }
+  for (int i = 0; i < ninner; i++) { tptr[i+1] += tptr[i]; }
+  int* next = new int[ninner > 0 ? ninner : 1];
+  for (int i = 0; i < ninner; i++) { next[i] = tptr[i]; }
+  for (int i = 0; i < nouter; i++){
+    for (int k = ptr[i]; k < ptr[i+1]; k++){
+      int pos = next[idx[k]]++;
+      tidx[pos] = i;
+      tval[pos] = val[k];
+    }
+  }
+  delete[] next;
+}
+
+// y = Ax where A is held by rows in the arrays: each element of y is a
+// dot product, so the rows are simply shared between threads.
+static void gather(int nouter, const int* ptr, const int* idx, const double* val,
+		   const double* x, double* y)
+{
+#pragma omp parallel for schedule(static) if (ptr[nouter] > SPARSEPARALLEL)
+  for (int i = 0; i < nouter; i++){
+    double sum = 0.0;
+    for (int k = ptr[i]; k < ptr[i+1]; k++) { sum += val[k]*x[idx[k]]; }
+    y[i] = sum;
+  }
+}
+
+// y = Ax where A is held by columns in the arrays: each column is scattered
+// into y, so each thread accumulates into its own buffer, on the heap as
+// y may be too long for a thread's stack, and the buffers are then summed
+// into y a block of rows per thread.
+static void scatter(int nouter, int ninner, const int* ptr, const int* idx, const double* val,
+		    const double* x, double* y)
+{
+  for (int i = 0; i < ninner; i++) { y[i] = 0.0; }
+#ifdef _OPENMP
+  if (ptr[nouter] > SPARSEPARALLEL && omp_get_max_threads() > 1) {
+    double** parts = NULL;
+    int nparts = 0;
+#pragma omp parallel
+    {
+#pragma omp single
+      {
+	nparts = omp_get_num_threads();
+	parts = new double*[nparts];
+      }
+      int t = omp_get_thread_num();
+      double* part = y; // The first thread accumulates straight into y
+      if (t > 0) {
+	part = new double[ninner > 0 ? ninner : 1];
+	for (int i = 0; i < ninner; i++) { part[i] = 0.0; }
+      }
+      parts[t] = part;
+#pragma omp for schedule(static)
+      for (int j = 0; j < nouter; j++){
+	double xj = x[j];
+	for (int k = ptr[j]; k < ptr[j+1]; k++) { part[idx[k]] += val[k]*xj; }
+      }
+#pragma omp for schedule(static)
+      for (int i = 0; i < ninner; i++){
+	double sum = y[i];
+	for (int p = 1; p < nparts; p++) { sum += parts[p][i]; }
+	y[i] = sum;
+      }
+      if (t > 0) { delete[] part; }
+    }
+    delete[] parts;
+    return;
+  }
+#endif
+  for (int j = 0; j < nouter; j++){
+    double xj = x[j];
+    for (int k = ptr[j]; k < ptr[j+1]; k++) { y[idx[k]] += val[k]*xj; }
+  }
+}
+
+// SparseBuilder
+
+void SparseBuilder::cleanUp()
+{
+  if (capacity > 0) {
+    delete[] ri;
+    delete[] ci;
+    delete[] vals;
+  }
+}
+
+SparseBuilder::SparseBuilder(int m, int n, int reserve)
+{
+  rows = m;
+  cols = n;
+  nnz = 0;
+  capacity = (reserve > 0 ? reserve : 0);
+  if (capacity > 0) {
+    ri = new int[capacity];
+    ci = new int[capacity];
+    vals = new double[capacity];
+  } else {
+    ri = ci = NULL;
+    vals = NULL;
+  }
+}
+
+SparseBuilder::SparseBuilder(const SparseBuilder& other)
+{
+  rows = other.rows;
+  cols = other.cols;
+  nnz = capacity = other.nnz;
+  if (capacity > 0) {
+    ri = new int[capacity];
+    ci = new int[capacity];
+    vals = new double[capacity];
+    for (int k = 0; k < nnz; k++){
+      ri[k] = other.ri[k]; ci[k] = other.ci[k]; vals[k] = other.vals[k];
+    }
+  } else {
+    ri = ci = NULL;
+    vals = NULL;
+  }
+}
+
+SparseBuilder::~SparseBuilder()
+{
+  cleanUp();
+}
+
+SparseBuilder& SparseBuilder::operator=(const SparseBuilder& other)
+{
+  if (this != &other) {
+    cleanUp();
+    rows = other.rows;
+    cols = other.cols;
+    nnz = capacity = other.nnz;
+    if (capacity > 0) {
+      ri = new int[capacity];
+      ci = new int[capacity];
+      vals = new double[capacity];
+      for (int k = 0; k < nnz; k++){
+	ri[k] = other.ri[k]; ci[k] = other.ci[k]; vals[k] = other.vals[k];
+      }
+    } else {
+      ri = ci = NULL;
+      vals = NULL;
+    }
+  }
+  return *this;
+}
+
+// Add a triplet, doubling the storage when full
+void SparseBuilder::add(int i, int j, const double& a)
+{
+  if (i < 0 || i >= rows || j < 0 || j >= cols) {
+    throw( Error("SPADD", "Triplet is outside the matrix.") );
+  }
+  if (nnz == capacity) {
+    int newcap = (capacity > 0 ? 2*capacity : 16);
+    int* newri = new int[newcap];
+    int* newci = new int[newcap];
+    double* newvals = new double[newcap];
+    for (int k = 0; k < nnz; k++){
+      newri[k] = ri[k]; newci[k] = ci[k]; newvals[k] = vals[k];
+    }
+    cleanUp();
+    ri = newri; ci = newci; vals = newvals;
+    capacity = newcap;
+  }
+  ri[nnz] = i;
+  ci[nnz] = j;
+  vals[nnz] = a;
+  nnz++;
+}
+
+// SparseMatrix
+
+void SparseMatrix::cleanUp()
+{
+  if (ptr != NULL) { delete[] ptr; }
+  if (idx != NULL) { delete[] idx; }
+  if (val != NULL) { delete[] val; }
+  ptr = idx = NULL;
+  val = NULL;
+}
+
+void SparseMatrix::allocate(int nouter, int n)
+{
+  ptr = new int[nouter+1];
+  idx = new int[n > 0 ? n : 1];
+  val = new double[n > 0 ? n : 1];
+  nnz = n;
+}
+
+// Compress the triplets: count the entries in each row (column), place them,
+// then sort each row (column) and sum any duplicates in place
+SparseMatrix::SparseMatrix(const SparseBuilder& coo, bool bycols)
+{
+  rows = coo.rows;
+  cols = coo.cols;
+  csc = bycols;
+  ptr = idx = NULL; val = NULL;
+  int nouter = (csc ? cols : rows);
+  const int* outer = (csc ? coo.ci : coo.ri);
+  const int* inner = (csc ? coo.ri : coo.ci);
+  int n = coo.nnz;
+  allocate(nouter, n);
+  for (int i = 0; i <= nouter; i++) { ptr[i] = 0; }
+  for (int k = 0; k < n; k++) { ptr[outer[k]+1]++; }
+  for (int i = 0; i < nouter; i++) { ptr[i+1] += ptr[i]; }
+  int* next = new int[nouter > 0 ? nouter : 1];
+  for (int i = 0; i < nouter; i++) { next[i] = ptr[i]; }
+  for (int k = 0; k < n; k++){
+    int pos = next[outer[k]]++;
+    idx[pos] = inner[k];
+    val[pos] = coo.vals[k];
+  }
+  // Sort and merge each row (column), recording the new lengths in next
+#pragma omp parallel for schedule(dynamic, 256) if (n > SPARSEPARALLEL)
+  for (int i = 0; i < nouter; i++){
+    int start = ptr[i], len = ptr[i+1] - ptr[i];
+    sortsegment(idx+start, val+start, len);
+    int count = 0;
+    for (int k = start; k < start+len; k++){
+      if (count > 0 && idx[start+count-1] == idx[k]) {
+	val[start+count-1] += val[k];
+      } else {
+	idx[start+count] = idx[k];
+	val[start+count] = val[k];
+	count++;
+      }
+    }
+    next[i] = count;
+  }
+  // Close up the gaps left by the duplicates
+  int pos = 0;
+  for (int i = 0; i < nouter; i++){
+    int start = ptr[i];
+    ptr[i] = pos;
+    for (int k = 0; k < next[i]; k++){
+      idx[pos] = idx[start+k];
+      val[pos] = val[start+k];
+      pos++;
+    }
+  }
+  ptr[nouter] = pos;
+  nnz = pos;
+  delete[] next;
+}
+
+// Convert from dense, counting the entries of each row (column) first
+SparseMatrix::SparseMatrix(const Matrix& A, bool bycols, double PRECISION)
+{
+  rows = A.nrows();
+  cols = A.ncols();
+  csc = bycols;
+  ptr = idx = NULL; val = NULL;
+  int nouter = (csc ? cols : rows);
+  int ninner = (csc ? rows : cols);
+  int* counts = new int[nouter+1];
+  counts[0] = 0;
+#pragma omp parallel for schedule(static) if (rows*cols > SPARSEPARALLEL)
+  for (int i = 0; i < nouter; i++){
+    int count = 0;
+    for (int j = 0; j < ninner; j++){
+      double a = (csc ? A(j, i) : A(i, j));
+      if (fabs(a) > PRECISION) { count++; }
+    }
+    counts[i+1] = count;
+  }
+  for (int i = 0; i < nouter; i++) { counts[i+1] += counts[i]; }
+  allocate(nouter, counts[nouter]);
+  for (int i = 0; i <= nouter; i++) { ptr[i] = counts[i]; }
+  delete[] counts;
+#pragma omp parallel for schedule(static) if (rows*cols > SPARSEPARALLEL)
+  for (int i = 0; i < nouter; i++){
+    int pos = ptr[i];
+    for (int j = 0; j < ninner; j++){
+      double a = (csc ? A(j, i) : A(i, j));
+      if (fabs(a) > PRECISION) {
+	idx[pos] = j;
+	val[pos] = a;
+	pos++;
+      }
+    }
+  }
+}
+
+SparseMatrix::SparseMatrix(int m, int n, const int* p, const int* ix, const double* v, bool bycols)
+{
+  rows = m;
+  cols = n;
+  csc = bycols;
+  ptr = idx = NULL; val = NULL;
+  int nouter = (csc ? cols : rows);
+  allocate(nouter, p[nouter]);
+  for (int i = 0; i <= nouter; i++) { ptr[i] = p[i]; }
+  for (int k = 0; k < nnz; k++) { idx[k] = ix[k]; val[k] = v[k]; }
+}
+
+SparseMatrix::SparseMatrix(const SparseMatrix& other)
+{
+  rows = other.rows;
+  cols = other.cols;
+  csc = other.csc;
+  ptr = idx = NULL; val = NULL;
+  nnz = 0;
+  if (other.ptr != NULL) {
+    int nouter = (csc ? cols : rows);
+    allocate(nouter, other.nnz);
+    for (int i = 0; i <= nouter; i++) { ptr[i] = other.ptr[i]; }
+    for (int k = 0; k < nnz; k++) { idx[k] = other.idx[k]; val[k] = other.val[k]; }
+  }
+}
+
+SparseMatrix::~SparseMatrix()
+{
+  cleanUp();
+}
+
+SparseMatrix& SparseMatrix::operator=(const SparseMatrix& other)
+{
+  if (this != &other) {
+    cleanUp();
+    rows = other.rows;
+    cols = other.cols;
+    csc = other.csc;
+    nnz = 0;
+    if (other.ptr != NULL) {
+      int nouter = (csc ? cols : rows);
+      allocate(nouter, other.nnz);
+      for (int i = 0; i <= nouter; i++) { ptr[i] = other.ptr[i]; }
+      for (int k = 0; k < nnz; k++) { idx[k] = other.idx[k]; val[k] = other.val[k]; }
+    }
+  }
+  return *this;
+}
+
+// Element ij, by binary search within row i (column j)
+double SparseMatrix::operator()(int i, int j) const
+{
+  double rval = 0.0;
+  if (ptr != NULL) {
+    int outer = (csc ? j : i);
+    int inner = (csc ? i : j);
+    const int* first = idx + ptr[outer];
+    const int* last = idx + ptr[outer+1];
+    const int* pos = std::lower_bound(first, last, inner);
+    if (pos != last && *pos == inner) { rval = val[pos - idx]; }
+  }
+  return rval;
+}
+
+Vector SparseMatrix::diagonal() const
+{
+  int dim = (rows < cols ? rows : cols);
+  Vector d(dim);
+  for (int i = 0; i < dim; i++) { d[i] = (*this)(i, i); }
+  return d;
+}
+
+// Multiply into y - a gather for y = Ax by rows or y = A(T)x by columns,
+// and a scatter otherwise
+void SparseMatrix::multiply(const Vector& x, Vector& y, bool trans) const
+{
+  int xsize = (trans ? rows : cols);
+  int ysize = (trans ? cols : rows);
+  if (x.size() != xsize || y.size() != ysize) {
+    throw( Error("SPMV", "Vector and sparse matrix are wrong sizes to multiply.") );
+  }
+  if (ptr == NULL) {
+    for (int i = 0; i < ysize; i++) { y[i] = 0.0; }
+  } else if (csc == trans) {
+    gather(ysize, ptr, idx, val, x.data(), y.data());
+  } else {
+    scatter(xsize, ysize, ptr, idx, val, x.data(), y.data());
+  }
+}
+
+// The arrays of A stored by rows are those of A(T) stored by columns, so the
+// transpose in the same format needs one counting sort
+SparseMatrix SparseMatrix::transpose() const
+{
+  SparseMatrix rmat;
+  rmat.rows = cols;
+  rmat.cols = rows;
+  rmat.csc = csc;
+  if (ptr != NULL) {
+    int nouter = (csc ? cols : rows);
+    int ninner = (csc ? rows : cols);
+    transposearrays(nouter, ninner, ptr, idx, val, rmat.ptr, rmat.idx, rmat.val);
+    rmat.nnz = nnz;
+  }
+  return rmat;
+}
+
+SparseMatrix SparseMatrix::toCSR() const
+{
+  SparseMatrix rmat;
+  if (!csc) {
+    rmat = *this;
+  } else {
+    rmat = transpose();
+    rmat.rows = rows;
+    rmat.cols = cols;
+    rmat.csc = false;
+  }
+  return rmat;
+}
+
+SparseMatrix SparseMatrix::toCSC() const
+{
+  SparseMatrix rmat;
+  if (csc) {
+    rmat = *this;
+  } else {
+    rmat = transpose();
+    rmat.rows = rows;
+    rmat.cols = cols;
+    rmat.csc = true;
+  }
+  return rmat;
+}
+
+Matrix SparseMatrix::toDense() const
+{
+  Matrix rmat(rows, cols, 0.0);
+  if (ptr != NULL) {
+    int nouter = (csc ? cols : rows);
+    for (int i = 0; i < nouter; i++){
+      for (int k = ptr[i]; k < ptr[i+1]; k++){
+	if (csc) {
+	  rmat(idx[k], i) = val[k];
+	} else {
+	  rmat(i, idx[k]) = val[k];
+	}
+      }
+    }
+  }
+  return rmat;
+}
+
+// Symmetric if square, and equal to its transpose entry by entry (both
+// have sorted indices, so only explicitly stored zeroes can differ)
+bool SparseMatrix::isSymmetric(double PRECISION) const
+{
+  bool rval = isSquare();
+  if (rval && ptr != NULL) {
+    SparseMatrix T = transpose();
+    for (int i = 0; rval && i < rows; i++){
+      int k = ptr[i], l = T.ptr[i];
+      while (rval && (k < ptr[i+1] || l < T.ptr[i+1])) {
+	if (l >= T.ptr[i+1] || (k < ptr[i+1] && idx[k] < T.idx[l])) {
+	  rval = (fabs(val[k]) < PRECISION); k++;
+	} else if (k >= ptr[i+1] || T.idx[l] < idx[k]) {
+	  rval = (fabs(T.val[l]) < PRECISION); l++;
+	} else {
+	  rval = (fabs(val[k] - T.val[l]) < PRECISION); k++; l++;
+	}
+      }
+    }
+  }
+  return rval;
+}
+
+// Pretty print the stored entries as (row, column, value) triplets
+void SparseMatrix::print(double PRECISION) const
+{
+  if (ptr != NULL) {
+    int nouter = (csc ? cols : rows);
+    for (int i = 0; i < nouter; i++){
+      for (int k = ptr[i]; k < ptr[i+1]; k++){
+	double v = (fabs(val[k]) > PRECISION ? val[k] : 0.0);
+	std::cout << std::setw(8) << (csc ? idx[k] : i) << std::setw(8) << (csc ? i : idx[k])
+		  << std::setprecision(8) << std::setw(16) << v << "\n";
+      }
+    }
+  }
+}
+
+// Products with vectors and dense matrices
+
+Vector operator*(const SparseMatrix& A, const Vector& x)
+{
+  Vector y(A.nrows());
+  if (x.size() != A.ncols()) {
+    throw( Error("SPMATVEC", "Vector and sparse matrix are wrong sizes to multiply.") );
+  }
+  A.multiply(x, y);
+  return y;
+}
+
+Vector operator*(const Vector& x, const SparseMatrix& A)
+{
+  Vector y(A.ncols());
+  if (x.size() != A.nrows()) {
+    throw( Error("SPVECMAT", "Vector and sparse matrix are wrong sizes to multiply.") );
+  }
+  A.multiply(x, y, true);
+  return y;
+}
+
+// Sparse x dense, a row of the sparse matrix at a time, which combines
+// the rows of B
+Matrix operator*(const SparseMatrix& A, const Matrix& B)
+{
+  if (A.ncols() != B.nrows()) {
+    throw( Error("SPMATMULT", "Matrices are incompatible sizes for multiplication.") );
+  }
+  SparseMatrix R;
+  R = A.toCSR();
+  int n = B.ncols();
+  Matrix C(A.nrows(), n, 0.0);
+  const int* ptr = R.getPtr();
+  const int* idx = R.getIdx();
+  const double* val = R.getVal();
+  if (ptr != NULL) {
+#pragma omp parallel for schedule(static) if (A.nonzeros()*n > SPARSEPARALLEL)
+    for (int i = 0; i < A.nrows(); i++){
+      double* ci = &C[i];
+      for (int k = ptr[i]; k < ptr[i+1]; k++){
+	double a = val[k];
+	int j = idx[k];
+	for (int l = 0; l < n; l++) { ci[l] += a*B(j, l); }
+      }
+    }
+  }
+  return C;
+}
@@ -0,0 +1,103 @@
+/*
+ *     PURPOSE: defines class SparseMatrix, a matrix of doubles stored in
+ *              compressed sparse row (CSR) or column (CSC) format, and
+ *              class SparseBuilder, which assembles one from a list of
+ *              (row, column, value) triplets (COO format).
+ *
+ *     DATE             AUTHOR                CHANGES
+ *     =====================================================================
+ *     19/10/26         Robert Shaw           Original code.
+ */
+
+#ifndef SPARSEHEADERDEF
+#define SPARSEHEADERDEF
+
+#include "matrix.hpp"
+#include "vector.hpp"
+#include "error.hpp"
+
+class SparseBuilder
+{
+private:
+  int rows, cols; // Shape of the matrix being built
+  int nnz; // Number of triplets so far
+  int capacity; // Number of triplets there is space for
+  int* ri; // Row indices
+  int* ci; // Column indices
+  double* vals; // Values
+  void cleanUp(); // Deallocates memory
+public:
+  // Constructors and destructor
+  SparseBuilder(int m, int n, int reserve = 0); // Empty m x n matrix
+  SparseBuilder(const SparseBuilder& other); // Copy constructor
+  ~SparseBuilder(); // Destructor
+  SparseBuilder& operator=(const SparseBuilder& other);
+  // Accessors
+  int nrows() const { return rows; }
+  int ncols() const { return cols; }
+  int size() const { return nnz; } // Number of triplets, including duplicates
+  // Add a to element (i, j) - duplicate entries are summed
+  void add(int i, int j, const double& a);
+  void clear() { nnz = 0; } // Remove all triplets, keeping the memory
+  friend class SparseMatrix;
+};
+
+class SparseMatrix
+{
+private:
+  int rows, cols; // No. of rows and columns
+  int nnz; // No. of stored entries
+  bool csc; // True if stored by columns, false if by rows
+  int* ptr; // Start of each row (column) in idx and val, length rows+1 (cols+1)
+  int* idx; // Column (row) index of each entry, ascending within a row (column)
+  double* val; // Value of each entry
+  void cleanUp(); // Deallocates memory
+  void allocate(int nouter, int n); // Allocate ptr for nouter rows (cols), and n entries
+public:
+  // Constructors and destructor
+  SparseMatrix() : rows(0), cols(0), nnz(0), csc(false), ptr(NULL), idx(NULL), val(NULL) {}
+  // From triplets, summing duplicates, stored by rows unless bycols is true
+  SparseMatrix(const SparseBuilder& coo, bool bycols = false);
+  // From a dense matrix, dropping elements with absolute value <= PRECISION
+  SparseMatrix(const Matrix& A, bool bycols = false, double PRECISION = 0.0);
+  // Directly from compressed arrays, which are copied in
+  SparseMatrix(int m, int n, const int* p, const int* ix, const double* v, bool bycols = false);
+  SparseMatrix(const SparseMatrix& other); // Copy constructor
+  ~SparseMatrix(); // Destructor
+  // Accessors
+  int nrows() const { return rows; }
+  int ncols() const { return cols; }
+  int nonzeros() const { return nnz; }
+  bool isCSC() const { return csc; }
+  bool isSquare() const { return (rows == cols); }
+  // Raw compressed arrays, for kernels
+  const int* getPtr() const { return ptr; }
+  const int* getIdx() const { return idx; }
+  const double* getVal() const { return val; }
+  double* getVal() { return val; } // Values may be changed, but not the pattern
+  Vector diagonal() const; // Returns the diagonal as a vector
+  // Overloaded operators
+  double operator()(int i, int j) const; // Element ij by value, zero if not stored
+  SparseMatrix& operator=(const SparseMatrix& other);
+  // Multiply y = Ax (or y = A(T)x if trans) into an existing vector y of
+  // the right size, rather than returning a new vector. Threaded by rows
+  // (columns), the scattered product summing a buffer from each thread.
+  void multiply(const Vector& x, Vector& y, bool trans = false) const;
+  // Intrinsic functions
+  SparseMatrix transpose() const; // Transpose, in the same storage format
+  SparseMatrix toCSR() const; // Copy stored by rows
+  SparseMatrix toCSC() const; // Copy stored by columns
+  Matrix toDense() const; // Dense copy
+  bool isSymmetric(double PRECISION = 1e-12) const;
+  void print(double PRECISION = 1e-12) const; // Pretty prints the triplets
+};
+
+// Sparse matrix x vector, and vector x sparse matrix (i.e. A(T)x, as
+// for dense matrices) - will throw an error if wrong shapes
+Vector operator*(const SparseMatrix& A, const Vector& x);
+Vector operator*(const Vector& x, const SparseMatrix& A);
+
+// Sparse matrix x dense matrix
+Matrix operator*(const SparseMatrix& A, const Matrix& B);
+
+#endif
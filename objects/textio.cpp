@@ -0,0 +1,592 @@
+/*
+ *   Implementation of textio.hpp
+ *
+ *   DATE               AUTHOR                  CHANGES
+ *   ============================================================================
+ *   19/10/26           Robert Shaw             Original code.
+ */
+
+#include "textio.hpp"
+#include "matrix.hpp"
+#include "vector.hpp"
+#include "sparse.hpp"
+#include "error.hpp"
+#include <charconv>
+#include <cstring>
+#include <cctype>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+// Bytes read or written at a time
+static const long TEXTCHUNK = 1 << 22;
+// Threshold on the lines in a chunk below which they are parsed serially
+static const long TEXTPARALLEL = 1000;
+
+// Grow the array a, holding len elements, to hold at least need
+template <class T>
+static void grow(T*& a, long& cap, long need, long len)
+{
+  if (need <= cap) { return; }
+  long newcap = (cap > 0 ? cap : 1024);
+  while (newcap < need){
+    newcap *= 2;
+  }
+  T* b = new T[newcap];
+  for (long k = 0; k < len; k++){
+    b[k] = a[k];
+  }
+  delete[] a;
+  a = b;
+  cap = newcap;
+}
+
+// Reading
+
+// Hands out a file as blocks of whole lines, reading a chunk at a time
+class ChunkReader
+{
+private:
+  std::ifstream in;
+  char* buf;
+  long cap, len, start; // Text not yet handed out is buf[start, len)
+public:
+  ChunkReader(const char* path);
+  ~ChunkReader() { delete[] buf; }
+  // Sets [b, e) to the next block of lines, returning false at the end
+  bool next(const char*& b, const char*& e);
+};
+
+ChunkReader::ChunkReader(const char* path) : in(path, std::ios::binary)
+{
+  if (!in) {
+    throw( Error("TEXTOPEN", "Could not open the file.") );
+  }
+  cap = TEXTCHUNK;
+  buf = new char[cap];
+  len = start = 0;
+}
+
+bool ChunkReader::next(const char*& b, const char*& e)
+{
+  // Move the unfinished last line to the front, and fill up after it
+  len -= start;
+  memmove(buf, buf + start, len);
+  start = 0;
+  while (true){
+    if (in) {
+      in.read(buf + len, cap - len);
+      len += in.gcount();
+    }
+    long end = len;
+    while (end > 0 && buf[end-1] != '\n'){ end--; }
+    if (end == 0 && !in) {
+      end = len; // The last line need not end in a newline
+    }
+    if (end > 0) {
+      b = buf;
+      e = buf + end;
+      start = end;
+      return true;
+    }
+    if (!in) { return false; }
+    // A line longer than the buffer
+    grow(buf, cap, 2*cap, len);
+  }
+}
+
+// Record the start of each line in [b, e) holding data, skipping blank
+// lines and, if comments is true, those starting with %. The line count
+// is returned, and starts[count] set to e.
+static long splitlines(const char* b, const char* e, const char**& starts, long& cap, bool comments)
+{
+  long n = 0;
+  grow(starts, cap, 1, 0);
+  const char* p = b;
+  while (p < e){
+    const char* q = (const char*)memchr(p, '\n', e - p);
+    q = (q != NULL ? q + 1 : e);
+    const char* s = p;
+    while (s < q && (*s == ' ' || *s == '\t' || *s == '\r')){ s++; }
+    if (s < q && *s != '\n' && !(comments && *s == '%')) {
+      grow(starts, cap, n + 2, n);
+      starts[n++] = p;
+    }
+    p = q;
+  }
+  starts[n] = e;
+  return n;
+}
+
+// Parse a number from p, no further than end, moving p past it and then
+// past any blanks and one sep. Returns false if there was no number.
+static bool parsefield(const char*& p, const char* end, double& x, char sep)
+{
+  while (p < end && (*p == ' ' || *p == '\t')){ p++; }
+  if (p < end && *p == '+') { p++; }
+  std::from_chars_result r = std::from_chars(p, end, x);
+  if (r.ec != std::errc()) { return false; }
+  p = r.ptr;
+  while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')){ p++; }
+  if (sep != ' ' && p < end && *p == sep) { p++; }
+  return true;
+}
+
+// True if p has reached the end of its line
+static bool atend(const char* p, const char* end)
+{
+  while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')){ p++; }
+  return (p == end || *p == '\n');
+}
+
+// Matrix Market header
+struct MMHeader
+{
+  bool coord; // Coordinate, else array
+  bool pattern; // No values, every entry is 1
+  int sym; // 0 general, 1 symmetric, -1 skew-symmetric
+  long rows, cols, nnz; // nnz is the number of entries in the file
+};
+
+static void parsebanner(const char* b, const char* e, MMHeader& h)
+{
+  const char* q = (const char*)memchr(b, '\n', e - b);
+  std::string line(b, (q != NULL ? q : e));
+  for (size_t k = 0; k < line.size(); k++){
+    line[k] = tolower(line[k]);
+  }
+  std::istringstream words(line);
+  std::string banner, object, format, field, symmetry;
+  words >> banner >> object >> format >> field >> symmetry;
+  if (banner != "%%matrixmarket" || object != "matrix") {
+    throw( Error("TEXTFORMAT", "Not a Matrix Market matrix file.") );
+  }
+  if (format != "coordinate" && format != "array") {
+    throw( Error("TEXTFORMAT", "Unknown Matrix Market format.") );
+  }
+  if (field != "real" && field != "double" && field != "integer" && field != "pattern") {
+    throw( Error("TEXTFORMAT", "Only real, integer and pattern fields are supported.") );
+  }
+  if (symmetry != "general" && symmetry != "symmetric" && symmetry != "skew-symmetric") {
+    throw( Error("TEXTFORMAT", "Only general, symmetric and skew-symmetric storage are supported.") );
+  }
+  h.coord = (format == "coordinate");
+  h.pattern = (field == "pattern");
+  h.sym = (symmetry == "general" ? 0 : (symmetry == "symmetric" ? 1 : -1));
+  if (h.pattern && !h.coord) {
+    throw( Error("TEXTFORMAT", "Pattern files must be in coordinate format.") );
+  }
+}
+
+// Read a Matrix Market file. Array files are read into A, with only the
+// lower triangle set if symmetric. Coordinate files are read into the
+// triplets ri, ci (zero based) and vals, one per entry in the file.
+static void readmmfile(const char* path, MMHeader& h, Matrix& A, int*& ri, int*& ci, double*& vals)
+{
+  ChunkReader reader(path);
+  const char* b;
+  const char* e;
+  const char** starts = NULL;
+  long scap = 0;
+  double* tmp = NULL; // Values of a chunk, for symmetric arrays
+  long tcap = 0;
+  bool first = true, sized = false;
+  long done = 0, expect = 0;
+  long ai = 0, aj = 0; // Next element of a symmetric array
+  try {
+    while (reader.next(b, e)){
+      if (first) {
+	parsebanner(b, e, h);
+	first = false;
+      }
+      long nl = splitlines(b, e, starts, scap, true);
+      long l0 = 0;
+      if (!sized && nl > 0) {
+	// The size line
+	const char* p = starts[0];
+	double m, n, nz = 0;
+	if (!parsefield(p, starts[1], m, ' ') || !parsefield(p, starts[1], n, ' ')
+	    || (h.coord && !parsefield(p, starts[1], nz, ' ')) || !atend(p, starts[1])
+	    || m < 0 || n < 0 || nz < 0 || m > 0x7fffffff || n > 0x7fffffff) {
+	  throw( Error("TEXTFORMAT", "Bad size line.") );
+	}
+	h.rows = m;
+	h.cols = n;
+	if (h.sym != 0 && h.rows != h.cols) {
+	  throw( Error("TEXTFORMAT", "Symmetric matrix is not square.") );
+	}
+	if (h.coord) {
+	  expect = h.nnz = nz;
+	  ri = new int[expect > 0 ? expect : 1];
+	  ci = new int[expect > 0 ? expect : 1];
+	  vals = new double[expect > 0 ? expect : 1];
+	} else {
+	  A.assign(h.rows, h.cols, 0.0);
+	  expect = (h.sym == 0 ? h.rows*h.cols : (h.sym == 1 ? h.rows*(h.rows+1)/2 : h.rows*(h.rows-1)/2));
+	  h.nnz = expect;
+	}
+	sized = true;
+	l0 = 1;
+      }
+      long count = nl - l0;
+      if (done + count > expect) {
+	throw( Error("TEXTFORMAT", "More entries than the size line says.") );
+      }
+      const char** lines = starts + l0;
+      bool ok = true;
+      if (h.coord) {
+	bool pattern = h.pattern;
+	long rows = h.rows, cols = h.cols;
+#pragma omp parallel for reduction(&&:ok) if(count > TEXTPARALLEL)
+	for (long k = 0; k < count; k++){
+	  const char* p = lines[k];
+	  double i, j, v = 1.0;
+	  bool good = parsefield(p, lines[k+1], i, ' ') && parsefield(p, lines[k+1], j, ' ')
+	    && (pattern || parsefield(p, lines[k+1], v, ' ')) && atend(p, lines[k+1])
+	    && i >= 1 && i <= rows && j >= 1 && j <= cols;
+	  ri[done + k] = (good ? (int)i - 1 : 0);
+	  ci[done + k] = (good ? (int)j - 1 : 0);
+	  vals[done + k] = v;
+	  ok = ok && good;
+	}
+      } else if (h.sym == 0) {
+	// Column by column, so element k is at (k % rows, k / rows)
+	long rows = h.rows;
+#pragma omp parallel for reduction(&&:ok) if(count > TEXTPARALLEL)
+	for (long k = 0; k < count; k++){
+	  const char* p = lines[k];
+	  double v;
+	  bool good = parsefield(p, lines[k+1], v, ' ') && atend(p, lines[k+1]);
+	  A((done + k) % rows, (done + k) / rows) = (good ? v : 0.0);
+	  ok = ok && good;
+	}
+      } else {
+	// The lower triangle column by column; parse, then place in turn
+	grow(tmp, tcap, count, 0);
+#pragma omp parallel for reduction(&&:ok) if(count > TEXTPARALLEL)
+	for (long k = 0; k < count; k++){
+	  const char* p = lines[k];
+	  bool good = parsefield(p, lines[k+1], tmp[k], ' ') && atend(p, lines[k+1]);
+	  ok = ok && good;
+	}
+	for (long k = 0; k < count; k++){
+	  if (ai == aj && h.sym == -1) { ai++; } // Skew diagonal is not stored
+	  if (ai >= h.rows) { aj++; ai = aj + (h.sym == -1 ? 1 : 0); }
+	  A(ai, aj) = tmp[k];
+	  ai++;
+	}
+      }
+      if (!ok) {
+	throw( Error("TEXTFORMAT", "Entry is not a number or is out of range.") );
+      }
+      done += count;
+    }
+    if (first) {
+      throw( Error("TEXTFORMAT", "File is empty.") );
+    }
+    if (!sized || done != expect) {
+      throw( Error("TEXTFORMAT", "Fewer entries than the size line says.") );
+    }
+  } catch (...) {
+    delete[] starts;
+    delete[] tmp;
+    delete[] ri;
+    delete[] ci;
+    delete[] vals;
+    ri = ci = NULL;
+    vals = NULL;
+    throw;
+  }
+  delete[] starts;
+  delete[] tmp;
+}
+
+void readmm(const char* path, Matrix& A)
+{
+  MMHeader h;
+  int* ri = NULL;
+  int* ci = NULL;
+  double* vals = NULL;
+  readmmfile(path, h, A, ri, ci, vals);
+  if (h.coord) {
+    A.assign(h.rows, h.cols, 0.0);
+    for (long k = 0; k < h.nnz; k++){
+      A(ri[k], ci[k]) += vals[k];
+      if (h.sym != 0 && ri[k] != ci[k]) {
+	A(ci[k], ri[k]) += h.sym*vals[k];
+      }
+    }
+    delete[] ri;
+    delete[] ci;
+    delete[] vals;
+  } else if (h.sym != 0) {
+    for (int j = 0; j < h.cols; j++){
+      for (int i = j + 1; i < h.rows; i++){
+	A(j, i) = h.sym*A(i, j);
+      }
+    }
+  }
+}
+
+void readmm(const char* path, SparseMatrix& A)
+{
+  MMHeader h;
+  Matrix D;
+  int* ri = NULL;
+  int* ci = NULL;
+  double* vals = NULL;
+  readmmfile(path, h, D, ri, ci, vals);
+  if (h.coord) {
+    SparseBuilder coo(h.rows, h.cols, (h.sym != 0 ? 2*h.nnz : h.nnz));
+    for (long k = 0; k < h.nnz; k++){
+      coo.add(ri[k], ci[k], vals[k]);
+      if (h.sym != 0 && ri[k] != ci[k]) {
+	coo.add(ci[k], ri[k], h.sym*vals[k]);
+      }
+    }
+    delete[] ri;
+    delete[] ci;
+    delete[] vals;
+    A = SparseMatrix(coo);
+  } else {
+    for (int j = 0; j < h.cols && h.sym != 0; j++){
+      for (int i = j + 1; i < h.rows; i++){
+	D(j, i) = h.sym*D(i, j);
+      }
+    }
+    A = SparseMatrix(D);
+  }
+}
+
+// A vector from a single row or column
+static void tovector(const Matrix& A, Vector& u)
+{
+  if (A.ncols() == 1 || A.nrows() == 1) {
+    u.resize(A.nrows()*A.ncols());
+    for (int i = 0; i < A.nrows(); i++){
+      for (int j = 0; j < A.ncols(); j++){
+	u[i + j] = A(i, j);
+      }
+    }
+  } else {
+    throw( Error("TEXTFORMAT", "File holds a matrix, not a vector.") );
+  }
+}
+
+void readmm(const char* path, Vector& u)
+{
+  Matrix A;
+  readmm(path, A);
+  tovector(A, u);
+}
+
+void readcsv(const char* path, Matrix& A)
+{
+  ChunkReader reader(path);
+  const char* b;
+  const char* e;
+  const char** starts = NULL;
+  long scap = 0;
+  double* data = NULL;
+  long dcap = 0;
+  long rows = 0, cols = 0;
+  bool first = true;
+  try {
+    while (reader.next(b, e)){
+      long nl = splitlines(b, e, starts, scap, false);
+      long l0 = 0;
+      if (first && nl > 0) {
+	// Count the fields, and skip a line of names
+	const char* p = starts[0];
+	const char* q = starts[1];
+	cols = 1;
+	while (p < q && *p != '\n'){
+	  cols += (*p++ == ',');
+	}
+	double x;
+	p = starts[0];
+	l0 = (parsefield(p, q, x, ',') ? 0 : 1);
+	first = false;
+      }
+      long count = nl - l0;
+      grow(data, dcap, (rows + count)*cols, rows*cols);
+      const char** lines = starts + l0;
+      double* row0 = data + rows*cols;
+      long n = cols;
+      bool ok = true;
+#pragma omp parallel for reduction(&&:ok) if(count > TEXTPARALLEL)
+      for (long k = 0; k < count; k++){
+	const char* p = lines[k];
+	bool good = true;
+	for (long j = 0; j < n && good; j++){
+	  good = parsefield(p, lines[k+1], row0[k*n + j], ',');
+	}
+	ok = ok && good && atend(p, lines[k+1]);
+      }
+      if (!ok) {
+	throw( Error("TEXTFORMAT", "Field is not a number, or row has the wrong length.") );
+      }
+      rows += count;
+    }
+  } catch (...) {
+    delete[] starts;
+    delete[] data;
+    throw;
+  }
+  A.resize(rows, cols);
+  for (long i = 0; i < rows; i++){
+    for (long j = 0; j < cols; j++){
+      A(i, j) = data[i*cols + j];
+    }
+  }
+  delete[] starts;
+  delete[] data;
+}
+
+void readcsv(const char* path, Vector& u)
+{
+  Matrix A;
+  readcsv(path, A);
+  tovector(A, u);
+}
+
+// Writing
+
+// Formatted text, written to the file whenever the buffer fills
+class TextSink
+{
+private:
+  std::ofstream out;
+  char* buf;
+  long len;
+  void flush();
+public:
+  TextSink(const char* path);
+  ~TextSink() { delete[] buf; }
+  void put(double x);
+  void put(long k);
+  void put(char c);
+  void put(const char* s);
+  void close(); // Write what is left, and check it all went
+};
+
+TextSink::TextSink(const char* path) : out(path, std::ios::binary | std::ios::trunc)
+{
+  if (!out) {
+    throw( Error("TEXTOPEN", "Could not open the file for writing.") );
+  }
+  buf = new char[TEXTCHUNK];
+  len = 0;
+}
+
+void TextSink::flush()
+{
+  out.write(buf, len);
+  len = 0;
+}
+
+// Shortest text that reads back as x, at most 24 characters
+void TextSink::put(double x)
+{
+  if (len > TEXTCHUNK - 64) { flush(); }
+  len = std::to_chars(buf + len, buf + TEXTCHUNK, x).ptr - buf;
+}
+
+void TextSink::put(long k)
+{
+  if (len > TEXTCHUNK - 64) { flush(); }
+  len = std::to_chars(buf + len, buf + TEXTCHUNK, k).ptr - buf;
+}
+
+void TextSink::put(char c)
+{
+  if (len == TEXTCHUNK) { flush(); }
+  buf[len++] = c;
+}
+
+void TextSink::put(const char* s)
+{
+  while (*s){
+    put(*s++);
+  }
+}
+
+void TextSink::close()
+{
+  flush();
+  out.close();
+  if (!out) {
+    throw( Error("TEXTWRITE", "Could not write the file.") );
+  }
+}
+
+void writemm(const char* path, const Matrix& A)
+{
+  TextSink out(path);
+  out.put("%%MatrixMarket matrix array real general\n");
+  out.put((long)A.nrows()); out.put(' '); out.put((long)A.ncols()); out.put('\n');
+  for (int j = 0; j < A.ncols(); j++){
+    for (int i = 0; i < A.nrows(); i++){
+      out.put(A(i, j));
+      out.put('\n');
+    }
+  }
+  out.close();
+}
+
+void writemm(const char* path, const Vector& u)
+{
+  TextSink out(path);
+  out.put("%%MatrixMarket matrix array real general\n");
+  out.put((long)u.size()); out.put(" 1\n");
+  for (int i = 0; i < u.size(); i++){
+    out.put(u(i));
+    out.put('\n');
+  }
+  out.close();
+}
+
+void writemm(const char* path, const SparseMatrix& A)
+{
+  TextSink out(path);
+  out.put("%%MatrixMarket matrix coordinate real general\n");
+  out.put((long)A.nrows()); out.put(' '); out.put((long)A.ncols()); out.put(' ');
+  out.put((long)A.nonzeros()); out.put('\n');
+  const int* ptr = A.getPtr();
+  const int* idx = A.getIdx();
+  const double* val = A.getVal();
+  int nouter = (A.isCSC() ? A.ncols() : A.nrows());
+  for (int r = 0; r < nouter; r++){
+    for (int k = ptr[r]; k < ptr[r+1]; k++){
+      out.put((long)(A.isCSC() ? idx[k] : r) + 1); out.put(' ');
+      out.put((long)(A.isCSC() ? r : idx[k]) + 1); out.put(' ');
+      out.put(val[k]);
+      out.put('\n');
+    }
+  }
+  out.close();
+}
+
+void writecsv(const char* path, const Matrix& A)
+{
+  TextSink out(path);
+  for (int i = 0; i < A.nrows(); i++){
+    const double* row = &A[i];
+    for (int j = 0; j < A.ncols(); j++){
+      if (j > 0) { out.put(','); }
+      out.put(row[j]);
+    }
+    out.put('\n');
+  }
+  out.close();
+}
+
+void writecsv(const char* path, const Vector& u)
+{
+  TextSink out(path);
+  for (int i = 0; i < u.size(); i++){
+    out.put(u(i));
+    out.put('\n');
+  }
+  out.close();
+}
@@ -0,0 +1,47 @@
+/*
+ *   Purpose: To read and write matrices and vectors as text, in the Matrix
+ *            Market exchange format (dense array or sparse coordinate) and
+ *            as comma separated values, for swapping data with other tools.
+ *
+ *            Readers take the file a chunk of whole lines at a time, so the
+ *            text is never all in memory at once, and parse the lines of
+ *            each chunk in parallel with std::from_chars, straight into
+ *            their place in the result. Writers format with std::to_chars,
+ *            which gives the shortest text that reads back to exactly the
+ *            same double, into a buffer that is written out when full.
+ *
+ *   DATE             AUTHOR            CHANGES
+ *   ===============================================================
+ *   19/10/26         Robert Shaw       Original code.
+ */
+
+#ifndef TEXTIOHEADERDEF
+#define TEXTIOHEADERDEF
+
+// Declare forward dependencies
+class Matrix;
+class Vector;
+class SparseMatrix;
+
+// Matrix Market. Any of the real, integer or pattern fields, and general,
+// symmetric or skew-symmetric storage, can be read into any of the types:
+// a coordinate file is filled out with zeros when read as a Matrix, and a
+// Vector may be read from a file with a single row or column. Matrices
+// and vectors are written in array format, and sparse matrices in
+// coordinate format, always general and real.
+void readmm(const char* path, Matrix& A);
+void readmm(const char* path, Vector& u);
+void readmm(const char* path, SparseMatrix& A);
+void writemm(const char* path, const Matrix& A);
+void writemm(const char* path, const Vector& u);
+void writemm(const char* path, const SparseMatrix& A);
+
+// CSV, a row of the matrix per line, or an element of the vector. Every
+// row must have the same number of fields. A first line that does not
+// start with a number is taken as column names, and skipped.
+void readcsv(const char* path, Matrix& A);
+void readcsv(const char* path, Vector& u);
+void writecsv(const char* path, const Matrix& A);
+void writecsv(const char* path, const Vector& u);
+
+#endif
@@ -0,0 +1,137 @@
+/*
+ *   Implementation of trace.hpp
+ *
+ *   DATE               AUTHOR                  CHANGES
+ *   ============================================================================
+ *   19/10/26           Robert Shaw             Original code.
+ */
+
+#include "trace.hpp"
+#include "error.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+
+#ifdef TRACING
+
+// Events kept per thread, a power of two; older ones are overwritten
+static const long TRACECAPACITY = 1 << 16;
+
+struct TraceEvent
+{
+  const char* name;
+  long long start, dur; // Nanoseconds
+  long arg;
+  char phase;
+};
+
+// One per thread, written only by that thread
+struct TraceRing
+{
+  TraceEvent events[TRACECAPACITY];
+  std::atomic<long> head; // Number of events ever written
+  int tid;
+  TraceRing* next;
+};
+
+static const std::chrono::steady_clock::time_point traceorigin = std::chrono::steady_clock::now();
+static std::atomic<TraceRing*> tracerings(NULL); // Every thread's ring
+static std::atomic<int> tracethreads(0);
+static thread_local TraceRing* tracering = NULL; // This thread's
+
+// Write the trace at exit, where nothing may be thrown
+static void traceexit()
+{
+  const char* path = getenv("TRACEFILE");
+  try {
+    tracewrite(path != NULL ? path : "trace.json");
+  } catch (Error& e) {
+    e.print();
+  }
+}
+
+long long tracenow()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - traceorigin).count();
+}
+
+void traceevent(const char* name, char phase, long long start, long long dur, long arg)
+{
+  TraceRing* r = tracering;
+  if (r == NULL) {
+    // First event on this thread: make its ring, and add it to the list
+    r = tracering = new TraceRing;
+    r->head.store(0, std::memory_order_relaxed);
+    r->tid = tracethreads.fetch_add(1);
+    r->next = tracerings.load();
+    while (!tracerings.compare_exchange_weak(r->next, r)){}
+    if (r->tid == 0) { atexit(traceexit); }
+  }
+  long h = r->head.load(std::memory_order_relaxed);
+  TraceEvent& e = r->events[h & (TRACECAPACITY - 1)];
+  e.name = name;
+  e.phase = phase;
+  e.start = start;
+  e.dur = dur;
+  e.arg = arg;
+  // Publish the event only once it is complete
+  r->head.store(h + 1, std::memory_order_release);
+}
+
+long tracewrite(const char* path)
+{
+  std::ofstream out(path);
+  if (!out) {
+    throw( Error("TRACEWRITE", "Could not open the trace file.") );
+  }
+  long written = 0, dropped = 0;
+  out << std::fixed << std::setprecision(3);
+  out << "{\"traceEvents\": [\n";
+  for (TraceRing* r = tracerings.load(); r != NULL; r = r->next){
+    out << (written > 0 ? ",\n" : "") << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": "
+	<< r->tid << ", \"args\": {\"name\": \"thread " << r->tid << "\"}}";
+    written++;
+    long h = r->head.load(std::memory_order_acquire);
+    long first = (h > TRACECAPACITY ? h - TRACECAPACITY : 0);
+    dropped += first;
+    for (long k = first; k < h; k++){
+      const TraceEvent& e = r->events[k & (TRACECAPACITY - 1)];
+      // Times in microseconds
+      out << ",\n{\"name\": \"" << e.name << "\", \"ph\": \"" << e.phase << "\", \"pid\": 1, \"tid\": "
+	  << r->tid << ", \"ts\": " << e.start*1e-3;
+      if (e.phase == 'X') { out << ", \"dur\": " << e.dur*1e-3; }
+      else { out << ", \"s\": \"t\""; }
+      if (e.arg >= 0) { out << ", \"args\": {\"n\": " << e.arg << "}"; }
+      out << "}";
+      written++;
+    }
+  }
+  out << "\n], \"displayTimeUnit\": \"ns\", \"otherData\": {\"dropped\": " << dropped << "}}\n";
+  out.close();
+  if (!out) {
+    throw( Error("TRACEWRITE", "Could not write the trace file.") );
+  }
+  return written;
+}
+
+void traceclear()
+{
+  for (TraceRing* r = tracerings.load(); r != NULL; r = r->next){
+    r->head.store(0);
+  }
+}
+
+#else
+
+// Nothing is recorded
+
+long tracewrite(const char* path)
+{
+  return 0;
+}
+
+void traceclear() {}
+
+#endif
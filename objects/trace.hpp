@@ -0,0 +1,67 @@
+/*
+ *   Purpose: To record a timeline of what each thread was doing, as spans
+ *            that can be viewed in chrome://tracing or ui.perfetto.dev.
+ *            TRACE(name) marks the rest of the enclosing block as a span,
+ *            TRACEARG(name, arg) does the same recording an integer with
+ *            it (a panel, sweep or cluster number, say), and
+ *            TRACEMARK(name, arg) records an instant, such as a deflation.
+ *            Every PROFILE region of profile.hpp is traced as well.
+ *
+ *            Each thread appends to its own ring buffer, with no locks, so
+ *            tracing perturbs the timings as little as possible; when a
+ *            ring is full the oldest events are overwritten. The events of
+ *            every thread are written in the Chrome trace JSON format by
+ *            tracewrite, and at exit to the file named by the environment
+ *            variable TRACEFILE, or trace.json.
+ *
+ *            Spans only exist when built with -DTRACING (e.g. make test
+ *            DEFINES=-DTRACING). Otherwise the macros expand to nothing.
+ *
+ *   DATE             AUTHOR            CHANGES
+ *   ===============================================================
+ *   19/10/26         Robert Shaw       Original code.
+ */
+
+#ifndef TRACEHEADERDEF
+#define TRACEHEADERDEF
+
+// Write every thread's events to path, returning the number written
+long tracewrite(const char* path);
+// Discard the events so far; only while no other thread is tracing
+void traceclear();
+
+#ifdef TRACING
+
+// Nanoseconds since the program started
+long long tracenow();
+// Append an event to this thread's ring: phase 'X' is a span of dur
+// nanoseconds, 'i' an instant. An arg < 0 is not recorded.
+void traceevent(const char* name, char phase, long long start, long long dur, long arg);
+
+// Records a span from its construction to its destruction
+class TraceScope
+{
+private:
+  const char* name;
+  long arg;
+  long long start;
+public:
+  TraceScope(const char* n, long a) : name(n), arg(a), start(tracenow()) {}
+  ~TraceScope() { traceevent(name, 'X', start, tracenow() - start, arg); }
+};
+
+#define TRACEJOIN2(a, b) a##b
+#define TRACEJOIN(a, b) TRACEJOIN2(a, b)
+#define TRACE(name) TraceScope TRACEJOIN(tracescope, __LINE__)(name, -1)
+#define TRACEARG(name, arg) TraceScope TRACEJOIN(tracescope, __LINE__)(name, (arg))
+#define TRACEMARK(name, arg) traceevent(name, 'i', tracenow(), 0, (arg))
+
+#else
+
+#define TRACE(name)
+#define TRACEARG(name, arg)
+#define TRACEMARK(name, arg)
+
+#endif
+
+#endif
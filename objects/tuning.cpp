@@ -0,0 +1,166 @@
+/*
+ *   Implementation of tuning.hpp
+ *
+ *   DATE               AUTHOR                  CHANGES
+ *   ============================================================================
+ *   19/10/26           Robert Shaw             Original code.
+ */
+
+#include "tuning.hpp"
+#include "error.hpp"
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+TuningParams defaulttuning()
+{
+  TuningParams t;
+  t.gemmblockk = 64;
+  t.gemmblockj = 64;
+  t.gemmparallel = 4e6;
+  t.lublock = 64;
+  t.cholblock = 64;
+  t.invblock = 64;
+  t.invparallel = 128;
+  t.batchcache = 16384;
+  return t;
+}
+
+// Throws if a value would break a kernel, rather than just be slow
+static void checktuning(const TuningParams& t)
+{
+  if (t.gemmblockk < 1 || t.gemmblockj < 1 || t.lublock < 1 || t.cholblock < 1 || t.invblock < 1) {
+    throw( Error("TUNE", "Block sizes must be positive.") );
+  }
+  if (!(t.gemmparallel >= 0.0) || t.invparallel < 0 || t.batchcache < 1) {
+    throw( Error("TUNE", "Thresholds must not be negative.") );
+  }
+}
+
+// Parse the profile at path into t, returning false if it does not exist
+static bool readtuning(const char* path, TuningParams& t)
+{
+  std::ifstream in(path);
+  if (!in) { return false; }
+  std::string line;
+  int lineno = 0;
+  while (std::getline(in, line)){
+    lineno++;
+    size_t hash = line.find('#');
+    if (hash != std::string::npos) { line.erase(hash); }
+    if (line.find_first_not_of(" \t\r") == std::string::npos) { continue; }
+    std::istringstream fields(line);
+    std::string name, eq;
+    double value;
+    if (!(fields >> name >> eq >> value) || eq != "=") {
+      std::ostringstream msg;
+      msg << "Line " << lineno << " of the profile is not name = value.";
+      throw( Error("TUNEFORMAT", msg.str()) );
+    }
+    if (name == "gemmblockk") { t.gemmblockk = (int)value; }
+    else if (name == "gemmblockj") { t.gemmblockj = (int)value; }
+    else if (name == "gemmparallel") { t.gemmparallel = value; }
+    else if (name == "lublock") { t.lublock = (int)value; }
+    else if (name == "cholblock") { t.cholblock = (int)value; }
+    else if (name == "invblock") { t.invblock = (int)value; }
+    else if (name == "invparallel") { t.invparallel = (int)value; }
+    else if (name == "batchcache") { t.batchcache = (int)value; }
+    else {
+      throw( Error("TUNEFORMAT", "Unknown parameter " + name + " in the profile.") );
+    }
+  }
+  checktuning(t);
+  return true;
+}
+
+// The values in use, read from the profile on first use. A bad profile
+// is reported, and the defaults kept, as this may be during startup.
+static TuningParams& current()
+{
+  static TuningParams t = []() {
+    TuningParams d = defaulttuning();
+    TuningParams p = d;
+    try {
+      if (readtuning(tuningpath().c_str(), p)) { d = p; }
+    } catch (Error& e) {
+      e.print();
+    }
+    return d;
+  }();
+  return t;
+}
+
+const TuningParams& tuning()
+{
+  return current();
+}
+
+void settuning(const TuningParams& t)
+{
+  checktuning(t);
+  current() = t;
+}
+
+std::string tuningpath()
+{
+  const char* path = getenv("TUNINGFILE");
+  if (path != NULL) { return path; }
+  char host[256];
+  if (gethostname(host, sizeof(host)) != 0) { strcpy(host, "unknown"); }
+  host[sizeof(host) - 1] = '\0';
+  return std::string("tuning-") + host + ".txt";
+}
+
+bool loadtuning(const char* path)
+{
+  TuningParams t = tuning();
+  if (!readtuning(path, t)) { return false; }
+  settuning(t);
+  return true;
+}
+
+void savetuning(const char* path, const TuningParams& t)
+{
+  checktuning(t);
+  std::ofstream out(path);
+  if (!out) {
+    throw( Error("TUNEWRITE", "Could not open the profile for writing.") );
+  }
+  char host[256];
+  if (gethostname(host, sizeof(host)) != 0) { strcpy(host, "unknown"); }
+  host[sizeof(host) - 1] = '\0';
+  std::string cpu = "unknown";
+  std::ifstream info("/proc/cpuinfo");
+  std::string line;
+  while (std::getline(info, line)){
+    if (line.compare(0, 10, "model name") == 0 && line.find(':') != std::string::npos) {
+      cpu = line.substr(line.find(':') + 2);
+      break;
+    }
+  }
+  int threads = 1;
+#ifdef _OPENMP
+  threads = omp_get_max_threads();
+#endif
+  out << "# Tuning profile, from bench.out -T\n"
+      << "# host: " << host << "\n"
+      << "# cpu: " << cpu << "\n"
+      << "# threads: " << threads << "\n"
+      << "gemmblockk = " << t.gemmblockk << "\n"
+      << "gemmblockj = " << t.gemmblockj << "\n"
+      << "gemmparallel = " << t.gemmparallel << "\n"
+      << "lublock = " << t.lublock << "\n"
+      << "cholblock = " << t.cholblock << "\n"
+      << "invblock = " << t.invblock << "\n"
+      << "invparallel = " << t.invparallel << "\n"
+      << "batchcache = " << t.batchcache << "\n";
+  out.close();
+  if (!out) {
+    throw( Error("TUNEWRITE", "Could not write the profile.") );
+  }
+}
@@ -0,0 +1,54 @@
+/*
+ *   Purpose: To hold the block sizes and thresholds of the blocked and
+ *            threaded kernels, whose best values depend on the cache
+ *            sizes and core count of the machine. They start at built-in
+ *            defaults, which are replaced when first used by those in the
+ *            tuning profile for this host, if there is one: the file named
+ *            by the environment variable TUNINGFILE, or else
+ *            tuning-<hostname>.txt in the working directory.
+ *
+ *            Profiles are written by the autotuner, bench.out -T (make
+ *            tune), which times candidate values of each parameter on
+ *            this machine. A profile is text, a "name = value" line per
+ *            parameter, with # comments; parameters it does not give keep
+ *            their defaults.
+ *
+ *   DATE             AUTHOR            CHANGES
+ *   ===============================================================
+ *   19/10/26         Robert Shaw       Original code.
+ */
+
+#ifndef TUNINGHEADERDEF
+#define TUNINGHEADERDEF
+
+#include <string>
+
+struct TuningParams
+{
+  int gemmblockk; // Block of the inner dimension in matrix multiplication
+  int gemmblockj; // and of the columns of the result
+  double gemmparallel; // Flops (2mnk) above which multiplication is threaded
+  int lublock; // Panel width of the single precision LU in mixedlusolve
+  int cholblock; // and of the cholesky in mixedcholeskysolve
+  int invblock; // Rows or columns per block in luinverse, choleskyinverse
+  int invparallel; // Order above which those are threaded
+  int batchcache; // Doubles of matrices per thread block in batched.hpp
+};
+
+// The built-in values
+TuningParams defaulttuning();
+// The values in use, from the profile for this host if it was found
+const TuningParams& tuning();
+// Replace the values in use, throwing an error if any is out of range.
+// Not while other threads are using them.
+void settuning(const TuningParams& t);
+
+// The profile for this host, as above
+std::string tuningpath();
+// Read the profile at path into the values in use, returning false if
+// there is no such file, and throwing an error if it is malformed
+bool loadtuning(const char* path);
+// Write t to a profile at path, with the host it was tuned on
+void savetuning(const char* path, const TuningParams& t);
+
+#endif
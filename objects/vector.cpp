@@ -8,6 +8,8 @@
  *   19/08/15           Robert Shaw             Added p-norm and dot product.
  *   20/08/15           Robert Shaw             Added outer product, angle, sorting.
  *   26/08/15           Robert Shaw             Added cross/triple products.
+ *   19/10/26           Robert Shaw             Vectorised inner, fused kernels.
+ *   19/10/26           Robert Shaw             Non-owning views.
  */
  
  #include "vector.hpp"
@@ -19,14 +21,15 @@
 // Memory clean up function
 void Vector::cleanUp()
 {
-  // if n = 0, no memory was ever allocated!
-  if ( size() > 0 ) {
+  // if n = 0, no memory was ever allocated, and a view owns none
+  if ( size() > 0 && !view ) {
     delete[] v;
   }
+  view = false;
 }
 
 // Constructors
-Vector::Vector(int length)
+Vector::Vector(int length) : view(false)
 {
   n = length; // Set length of vector
   if(length > 0){ // Allocate memory
@@ -37,7 +40,7 @@ Vector::Vector(int length)
 }
 
 
-Vector::Vector(int length, const double& a)
+Vector::Vector(int length, const double& a) : view(false)
 {
   n = length; // Set length of vector
   if(length > 0){ // Allocate memory and set all values to a
@@ -51,7 +54,7 @@ Vector::Vector(int length, const double& a)
 }
 
 
-Vector::Vector(int length, const double* a)
+Vector::Vector(int length, const double* a) : view(false)
 {
   n = length; // Set length
   if (length > 0) { // Allocate memory, and copy a into vector
@@ -66,7 +69,7 @@ Vector::Vector(int length, const double* a)
 
 // Copy constructor
 
-Vector::Vector(const Vector& u)
+Vector::Vector(const Vector& u) : view(false)
 {
   n = u.size(); // Get size
   if(n > 0) { // Allocate size, and copy in values
@@ -102,21 +105,23 @@ void Vector::resize(int length) // Resize with loss of values
 
 void Vector::resizeCopy(int length) { 
   // Resizes, keeping as many values as fit
-  double* tempV;
-  if ( n > 0 ) {
-    tempV = new double[n]; // Store old values
-    for (int i = 0; i < n; i++) {
+  double* tempV = NULL;
+  int oldn = n;
+  if ( oldn > 0 ) {
+    tempV = new double[oldn]; // Store old values
+    for (int i = 0; i < oldn; i++) {
       tempV[i] = v[i];
     }
   }
   // Do the resizing
   resize(length);
   // Copy in old values as far as fits, leaving excess empty
-  if ( n > 0 ) {
-    int m = ( n < length ? n : length ); // m is the lesser of n, length
+  if ( oldn > 0 ) {
+    int m = ( oldn < length ? oldn : length ); // m is the lesser of oldn, length
     for (int i = 0; i < m; i++) {
       v[i] = tempV[i];
     }
+    delete[] tempV;
   }
 }
 
@@ -327,6 +332,9 @@ Vector Vector::sorted() const
   u.sort();
   return u;
 }
+// Length above which the fused kernels are threaded
+static const int VECPARALLEL = 50000;
+
 // Friend functions
 // Inner (dot) product of two vectors
 double inner(const Vector& u, const Vector& w)
@@ -337,8 +345,11 @@ double inner(const Vector& u, const Vector& w)
   int wsize = w.size();
   if(usize == wsize){
     // Calculate inner product
+    const double* uv = u.v;
+    const double* wv = w.v;
+#pragma omp parallel for simd reduction(+:rVal) if (usize > VECPARALLEL)
     for (int i = 0; i < usize; i++){
-      rVal += u(i)*w(i); // Round brackets return by value, not reference
+      rVal += uv[i]*wv[i];
     }
   } else { // Throw error, and return null vector
     throw( Error("VECDOT", "Vectors different sizes.") );
@@ -423,3 +434,51 @@ double triple(const Vector& u, const Vector& w, const Vector& z)
   r = cross(u, w);
   return inner(r, z);
 }
+
+// Fused kernels for iterative methods
+
+void axpy(double a, const Vector& x, Vector& y)
+{
+  int n = x.size();
+  if (n != y.size()) {
+    throw( Error("AXPY", "Vectors different sizes.") );
+  }
+  const double* xv = x.v;
+  double* yv = y.v;
+#pragma omp parallel for simd if (n > VECPARALLEL)
+  for (int i = 0; i < n; i++){
+    yv[i] += a*xv[i];
+  }
+}
+
+void axpby(double a, const Vector& x, double b, Vector& y)
+{
+  int n = x.size();
+  if (n != y.size()) {
+    throw( Error("AXPBY", "Vectors different sizes.") );
+  }
+  const double* xv = x.v;
+  double* yv = y.v;
+#pragma omp parallel for simd if (n > VECPARALLEL)
+  for (int i = 0; i < n; i++){
+    yv[i] = a*xv[i] + b*yv[i];
+  }
+}
+
+double axpynorm(double a, const Vector& x, Vector& y)
+{
+  int n = x.size();
+  if (n != y.size()) {
+    throw( Error("AXPY", "Vectors different sizes.") );
+  }
+  const double* xv = x.v;
+  double* yv = y.v;
+  double rVal = 0.0;
+#pragma omp parallel for simd reduction(+:rVal) if (n > VECPARALLEL)
+  for (int i = 0; i < n; i++){
+    double yi = yv[i] + a*xv[i];
+    yv[i] = yi;
+    rVal += yi*yi;
+  }
+  return rVal;
+}
@@ -9,6 +9,11 @@
  *     20/08/15         Robert Shaw           Added outer product, angle,
  *                                            and sorting.
  *     26/08/15         Robert Shaw           Added triple and cross products.
+ *     19/10/26         Robert Shaw           Matrix-vector products no longer
+ *                                            copy out rows/columns.
+ *     19/10/26         Robert Shaw           Raw data access.
+ *     19/10/26         Robert Shaw           Fused kernels for iterative solvers.
+ *     19/10/26         Robert Shaw           Non-owning views, for mapped files.
  */
 
 #ifndef VECTORHEADERDEF
@@ -22,10 +27,12 @@ class Vector
 private:
   int n; // The number of elements
   double* v; // The elements themselves
+  bool view; // v points into memory owned elsewhere, e.g. a MappedFile
   void cleanUp(); // Deallocates memory
+  friend class MappedFile; // Makes views of mapped data
 public:
   // Constructors and destructor
-  Vector() : n(0), v(NULL) {} // Default constructor, zero length vector
+  Vector() : n(0), v(NULL), view(false) {} // Default constructor, zero length vector
   Vector(int length); // Empty vector of length length
   Vector(int length, const double& a); // Vector with 'length' values, all a
   Vector(int length, const double* a); // Initialise vector to array a
@@ -33,6 +40,8 @@ public:
   ~Vector(); // Destructor
   // Accessors
   int size() const { return n; } // Returns size of vector, n
+  double* data() { return v; } // Raw access to the elements, for kernels
+  const double* data() const { return v; }
   // Shaping functions
   void resize(int length); // Resizes the vector to length 'length',
                            // without preserving values
@@ -64,6 +73,12 @@ public:
   friend Matrix outer(const Vector& u, const Vector& w);
   // Return angle (in radians) between two vectors
   friend double angle(const Vector& u, const Vector& w);
+  // Fused, in-place kernels for iterative methods. These are vectorised,
+  // and threaded for long vectors, and never allocate.
+  friend void axpy(double a, const Vector& x, Vector& y); // y = y + ax
+  friend void axpby(double a, const Vector& x, double b, Vector& y); // y = ax + by
+  // y = y + ax, returning the inner product of the new y with itself
+  friend double axpynorm(double a, const Vector& x, Vector& y);
 
   // !!!ONLY FOR 3D VECTORS!!!
   // Calculate the cross product of two vectors
@@ -102,15 +117,16 @@ inline Vector operator*(const Vector& v, const Matrix& mat)
   int n = v.size();
   int cols = mat.ncols();
   int rows = mat.nrows();
-  Vector rVec(cols); // Return vector should have dimension cols                  
+  Vector rVec(cols, 0.0); // Return vector should have dimension cols                  
   // For this to work we require n = rows                                      
   if (n != rows) {
     throw(Error("VECMATMULT", "Vector and matrix are wrong sizes to multiply."));
-  } else { // Do the multiplication                                         
-    for (int i = 0; i < cols; i++){
-      Vector temp(rows); // Get each column of the matrix
-      temp = mat.colAsVector(i);
-      rVec[i] = inner(v, temp);
+  } else { // Do the multiplication, accumulating a row of the matrix at a time
+    for (int i = 0; i < rows; i++){
+      double vi = v(i);
+      for (int j = 0; j < cols; j++){
+	rVec[j] += vi*mat(i, j);
+      }
     }
   }
   return rVec;
@@ -128,9 +144,11 @@ inline Vector operator*(const Matrix& mat, const Vector& v)
     throw(Error("MATVECMULT", "Vector and matrix are wrong sizes to multiply."));
   } else { // Do the multiplication                                                                            
     for (int i = 0; i < rows; i++){
-      Vector temp(cols);
-      temp = mat.rowAsVector(i);
-      rVec[i] = inner(v, temp);
+      double sum = 0.0;
+      for (int j = 0; j < cols; j++){
+	sum += mat(i, j)*v(j);
+      }
+      rVec[i] = sum;
     }
   }
   return rVec;
@@ -0,0 +1,744 @@
+// Implements batched.hpp
+
+#include "batched.hpp"
+#include "matrix.hpp"
+#include "error.hpp"
+#include "profile.hpp"
+#include "tuning.hpp"
+#include <cmath>
+
+// Most systems in a thread block, so per-system workspaces can live on
+// the stack
+static const int BATCHMAX = 512;
+
+// Systems per thread block, so that a block of matrices of elems entries
+// each (tuning().batchcache doubles, 128KB by default) stays in cache
+// while it is factorised
+static int batchlanes(int elems)
+{
+  int l = tuning().batchcache/(elems > 0 ? elems : 1);
+  l = (l > BATCHMAX ? BATCHMAX : l);
+  l = l - l%8;
+  return (l < 8 ? 8 : l);
+}
+
+
+static void batchcheck(const Matrix& A, int elems, const Matrix& B, int brows)
+{
+  if (A.nrows() != elems || B.nrows() != brows || B.ncols() != A.ncols()) {
+    throw( Error("BATCH", "Batched systems are different sizes.") );
+  }
+}
+
+// Apply the interchanges in P to the rows of B (n rows) for systems s0 to
+// s1, or to the n x n matrices in A (n*n rows) if width is n. The rows
+// swapped differ between systems, so each candidate row is swapped by
+// selection in every system, skipping rows no system swaps with.
+static void batchswap(int n, int width, const Matrix& P, double* const* row,
+		      int k, int s0, int s1)
+{
+  const double* pk = &P[k];
+  for (int i = k+1; i < n; i++){
+    bool any = false;
+    for (int s = s0; s < s1; s++){
+      any = any || (pk[s] == i);
+    }
+    if (!any) { continue; }
+    for (int j = 0; j < width; j++){
+      double* ak = row[k*width+j];
+      double* ai = row[i*width+j];
+#pragma omp simd
+      for (int s = s0; s < s1; s++){
+	bool sel = (pk[s] == i);
+	double t = ak[s];
+	ak[s] = (sel ? ai[s] : t);
+	ai[s] = (sel ? t : ai[s]);
+      }
+    }
+  }
+}
+
+// Triangular solve for systems s0 to s1, where element (i, j) of each
+// matrix is in row i*n + j of t. Solves with the lower (upper) triangle
+// of op(T) = T or T(T), depending on trans, if lower is true (false).
+static void batchsweep(int n, const double* const* t, double* const* b,
+		       bool lower, bool trans, bool unit, int s0, int s1)
+{
+  for (int ii = 0; ii < n; ii++){
+    int i = (lower ? ii : n-1-ii);
+    double* bi = b[i];
+    int jmin = (lower ? 0 : i+1), jmax = (lower ? i : n);
+    for (int j = jmin; j < jmax; j++){
+      const double* tij = t[trans ? j*n+i : i*n+j];
+      const double* bj = b[j];
+#pragma omp simd
+      for (int s = s0; s < s1; s++){
+	bi[s] -= tij[s]*bj[s];
+      }
+    }
+    if (!unit) {
+      const double* tii = t[i*n+i];
+#pragma omp simd
+      for (int s = s0; s < s1; s++){
+	bi[s] /= tii[s];
+      }
+    }
+  }
+}
+
+// Row pointers into a batch, row[e] being element e of every system
+static double** batchrows(Matrix& A)
+{
+  int e = A.nrows();
+  double** row = new double*[e > 0 ? e : 1];
+  for (int i = 0; i < e; i++){
+    row[i] = &A[i];
+  }
+  return row;
+}
+
+
+static const double** batchrows(const Matrix& A)
+{
+  int e = A.nrows();
+  const double** row = new const double*[e > 0 ? e : 1];
+  for (int i = 0; i < e; i++){
+    row[i] = &A[i];
+  }
+  return row;
+}
+
+
+bool batchlu(int n, Matrix& A, Matrix& P)
+{
+  int m = A.ncols();
+  PROFILE("batchlu", 2.0*n*n*n*m/3.0);
+  if (A.nrows() != n*n) {
+    throw( Error("BATCHLU", "Matrices are the wrong size.") );
+  }
+  P.assign(n, m, 0.0);
+  if (n == 0 || m == 0) { return true; }
+  double** a = batchrows(A);
+  int nb = batchlanes(n*n);
+  bool ok = true;
+#pragma omp parallel for schedule(static) reduction(&&:ok) if (m > nb)
+  for (int s0 = 0; s0 < m; s0 += nb){
+    TRACEARG("batchlu/block", s0);
+    int s1 = (s0 + nb < m ? s0 + nb : m);
+    double best[BATCHMAX];
+    double* bs = best - s0; // Indexed by system
+    for (int k = 0; k < n; k++){
+      // Choose the largest pivot in column k of each system
+      double* pk = &P[k];
+      const double* akk = a[k*n+k];
+#pragma omp simd
+      for (int s = s0; s < s1; s++){
+	pk[s] = k;
+	bs[s] = fabs(akk[s]);
+      }
+      for (int i = k+1; i < n; i++){
+	const double* aik = a[i*n+k];
+#pragma omp simd
+	for (int s = s0; s < s1; s++){
+	  bool sel = (fabs(aik[s]) > bs[s]);
+	  bs[s] = (sel ? fabs(aik[s]) : bs[s]);
+	  pk[s] = (sel ? i : pk[s]);
+	}
+      }
+      // Whole rows are swapped, so L is permuted as in dgelu
+      batchswap(n, n, P, a, k, s0, s1);
+#pragma omp simd reduction(&&:ok)
+      for (int s = s0; s < s1; s++){
+	ok = ok && (akk[s] != 0.0);
+	bs[s] = 1.0/akk[s];
+      }
+      // Eliminate below the pivot
+      for (int i = k+1; i < n; i++){
+	double* lik = a[i*n+k];
+#pragma omp simd
+	for (int s = s0; s < s1; s++){
+	  lik[s] *= bs[s];
+	}
+	for (int j = k+1; j < n; j++){
+	  double* aij = a[i*n+j];
+	  const double* akj = a[k*n+j];
+#pragma omp simd
+	  for (int s = s0; s < s1; s++){
+	    aij[s] -= lik[s]*akj[s];
+	  }
+	}
+      }
+    }
+  }
+  delete[] a;
+  return ok;
+}
+
+
+void batchlusolve(int n, const Matrix& A, const Matrix& P, Matrix& B)
+{
+  batchcheck(A, n*n, B, n);
+  int m = B.ncols();
+  if (P.nrows() != n || P.ncols() != m) {
+    throw( Error("BATCHLU", "Pivots are the wrong size.") );
+  }
+  if (n == 0 || m == 0) { return; }
+  const double** a = batchrows(A);
+  double** b = batchrows(B);
+  int nb = batchlanes(n*n);
+#pragma omp parallel for schedule(static) if (m > nb)
+  for (int s0 = 0; s0 < m; s0 += nb){
+    int s1 = (s0 + nb < m ? s0 + nb : m);
+    for (int k = 0; k < n; k++){
+      batchswap(n, 1, P, b, k, s0, s1);
+    }
+    batchsweep(n, a, b, true, false, true, s0, s1); // Ly = Pb
+    batchsweep(n, a, b, false, false, false, s0, s1); // Ux = y
+  }
+  delete[] a;
+  delete[] b;
+}
+
+
+bool batchcholesky(int n, Matrix& A)
+{
+  int m = A.ncols();
+  PROFILE("batchcholesky", (double)n*n*n*m/3.0);
+  if (A.nrows() != n*n) {
+    throw( Error("BATCHCHOL", "Matrices are the wrong size.") );
+  }
+  if (n == 0 || m == 0) { return true; }
+  double** a = batchrows(A);
+  int nb = batchlanes(n*n);
+  bool ok = true;
+#pragma omp parallel for schedule(static) reduction(&&:ok) if (m > nb)
+  for (int s0 = 0; s0 < m; s0 += nb){
+    TRACEARG("batchcholesky/block", s0);
+    int s1 = (s0 + nb < m ? s0 + nb : m);
+    double inv[BATCHMAX];
+    double* is = inv - s0;
+    for (int k = 0; k < n; k++){
+      double* akk = a[k*n+k];
+#pragma omp simd reduction(&&:ok)
+      for (int s = s0; s < s1; s++){
+	ok = ok && (akk[s] > 0.0);
+	akk[s] = sqrt(akk[s]);
+	is[s] = 1.0/akk[s];
+      }
+      for (int j = k+1; j < n; j++){
+	double* akj = a[k*n+j];
+#pragma omp simd
+	for (int s = s0; s < s1; s++){
+	  akj[s] *= is[s];
+	}
+      }
+      // Reduce the rows below symmetrically
+      for (int i = k+1; i < n; i++){
+	const double* aki = a[k*n+i];
+	for (int j = i; j < n; j++){
+	  double* aij = a[i*n+j];
+	  const double* akj = a[k*n+j];
+#pragma omp simd
+	  for (int s = s0; s < s1; s++){
+	    aij[s] -= aki[s]*akj[s];
+	  }
+	}
+      }
+      for (int j = 0; j < k; j++){
+	double* akj = a[k*n+j];
+#pragma omp simd
+	for (int s = s0; s < s1; s++){
+	  akj[s] = 0.0;
+	}
+      }
+    }
+  }
+  delete[] a;
+  return ok;
+}
+
+
+void batchcholeskysolve(int n, const Matrix& A, Matrix& B)
+{
+  batchcheck(A, n*n, B, n);
+  int m = B.ncols();
+  if (n == 0 || m == 0) { return; }
+  const double** a = batchrows(A);
+  double** b = batchrows(B);
+  int nb = batchlanes(n*n);
+#pragma omp parallel for schedule(static) if (m > nb)
+  for (int s0 = 0; s0 < m; s0 += nb){
+    int s1 = (s0 + nb < m ? s0 + nb : m);
+    batchsweep(n, a, b, true, true, false, s0, s1); // R(T)y = b
+    batchsweep(n, a, b, false, false, false, s0, s1); // Rx = y
+  }
+  delete[] a;
+  delete[] b;
+}
+
+
+bool batchqr(int rows, int cols, Matrix& A, Matrix& T)
+{
+  int m = A.ncols();
+  PROFILE("batchqr", (2.0*rows*cols*cols - 2.0*cols*cols*cols/3.0)*m);
+  if (rows < cols || A.nrows() != rows*cols) {
+    throw( Error("BATCHQR", "Matrices are the wrong size.") );
+  }
+  T.assign(cols, m, 0.0);
+  if (cols == 0 || m == 0) { return true; }
+  double** a = batchrows(A);
+  int nb = batchlanes(rows*cols);
+  bool ok = true;
+#pragma omp parallel for schedule(static) reduction(&&:ok) if (m > nb)
+  for (int s0 = 0; s0 < m; s0 += nb){
+    TRACEARG("batchqr/block", s0);
+    int s1 = (s0 + nb < m ? s0 + nb : m);
+    double work[BATCHMAX];
+    double* w = work - s0;
+    for (int k = 0; k < cols; k++){
+      // Norm of the column below the diagonal
+#pragma omp simd
+      for (int s = s0; s < s1; s++){
+	w[s] = 0.0;
+      }
+      for (int i = k+1; i < rows; i++){
+	const double* aik = a[i*cols+k];
+#pragma omp simd
+	for (int s = s0; s < s1; s++){
+	  w[s] += aik[s]*aik[s];
+	}
+      }
+      // beta = -sign(akk)||x||, v = (x - beta e1)/(akk - beta), and
+      // tau = (beta - akk)/beta, or no reflection if x is already zero
+      double* akk = a[k*cols+k];
+      double* tk = &T[k];
+#pragma omp simd reduction(&&:ok)
+      for (int s = s0; s < s1; s++){
+	bool none = (w[s] == 0.0);
+	double nrm = sqrt(akk[s]*akk[s] + w[s]);
+	double beta = (akk[s] >= 0.0 ? -nrm : nrm);
+	tk[s] = (none ? 0.0 : (beta - akk[s])/beta);
+	w[s] = (none ? 0.0 : 1.0/(akk[s] - beta)); // Scales v
+	akk[s] = (none ? akk[s] : beta);
+	ok = ok && (akk[s] != 0.0);
+      }
+      for (int i = k+1; i < rows; i++){
+	double* aik = a[i*cols+k];
+#pragma omp simd
+	for (int s = s0; s < s1; s++){
+	  aik[s] *= w[s];
+	}
+      }
+      // Apply the reflector to the remaining columns
+      for (int j = k+1; j < cols; j++){
+	double* akj = a[k*cols+j];
+#pragma omp simd
+	for (int s = s0; s < s1; s++){
+	  w[s] = akj[s];
+	}
+	for (int i = k+1; i < rows; i++){
+	  const double* vi = a[i*cols+k];
+	  const double* aij = a[i*cols+j];
+#pragma omp simd
+	  for (int s = s0; s < s1; s++){
+	    w[s] += vi[s]*aij[s];
+	  }
+	}
+#pragma omp simd
+	for (int s = s0; s < s1; s++){
+	  w[s] *= tk[s];
+	  akj[s] -= w[s];
+	}
+	for (int i = k+1; i < rows; i++){
+	  const double* vi = a[i*cols+k];
+	  double* aij = a[i*cols+j];
+#pragma omp simd
+	  for (int s = s0; s < s1; s++){
+	    aij[s] -= vi[s]*w[s];
+	  }
+	}
+      }
+    }
+  }
+  delete[] a;
+  return ok;
+}
+
+
+void batchqrsolve(int rows, int cols, const Matrix& A, const Matrix& T, Matrix& B)
+{
+  batchcheck(A, rows*cols, B, rows);
+  int m = B.ncols();
+  if (T.nrows() != cols || T.ncols() != m) {
+    throw( Error("BATCHQR", "Reflectors are the wrong size.") );
+  }
+  if (cols == 0 || m == 0) { return; }
+  const double** a = batchrows(A);
+  double** b = batchrows(B);
+  int nb = batchlanes(rows*cols);
+#pragma omp parallel for schedule(static) if (m > nb)
+  for (int s0 = 0; s0 < m; s0 += nb){
+    int s1 = (s0 + nb < m ? s0 + nb : m);
+    double work[BATCHMAX];
+    double* w = work - s0;
+    // Q(T)b, a reflector at a time
+    for (int k = 0; k < cols; k++){
+      const double* tk = &T[k];
+      double* bk = b[k];
+#pragma omp simd
+      for (int s = s0; s < s1; s++){
+	w[s] = bk[s];
+      }
+      for (int i = k+1; i < rows; i++){
+	const double* vi = a[i*cols+k];
+	const double* bi = b[i];
+#pragma omp simd
+	for (int s = s0; s < s1; s++){
+	  w[s] += vi[s]*bi[s];
+	}
+      }
+#pragma omp simd
+      for (int s = s0; s < s1; s++){
+	w[s] *= tk[s];
+	bk[s] -= w[s];
+      }
+      for (int i = k+1; i < rows; i++){
+	const double* vi = a[i*cols+k];
+	double* bi = b[i];
+#pragma omp simd
+	for (int s = s0; s < s1; s++){
+	  bi[s] -= vi[s]*w[s];
+	}
+      }
+    }
+    // Then Rx = Q(T)b, R being the top cols x cols of each matrix, which
+    // has the same row stride as a square matrix of dimension cols
+    batchsweep(cols, a, b, false, false, false, s0, s1);
+  }
+  delete[] a;
+  delete[] b;
+}
+
+
+void batchtrisolve(int n, const Matrix& T, Matrix& B, bool upper, bool trans, bool unit)
+{
+  batchcheck(T, n*n, B, n);
+  int m = B.ncols();
+  if (n == 0 || m == 0) { return; }
+  const double** t = batchrows(T);
+  double** b = batchrows(B);
+  int nb = batchlanes(n*n);
+#pragma omp parallel for schedule(static) if (m > nb)
+  for (int s0 = 0; s0 < m; s0 += nb){
+    int s1 = (s0 + nb < m ? s0 + nb : m);
+    batchsweep(n, t, b, (upper == trans), trans, unit, s0, s1);
+  }
+  delete[] t;
+  delete[] b;
+}
+
+// Closed form eigensolvers, one system per lane. The rotation that
+// diagonalises the 2 x 2 [app apq; apq aqq], as for a Jacobi step, with
+// t = tan, c = cos and s = sin, giving app - t apq and aqq + t apq on the
+// diagonal, with vectors (c, -s) and (s, c).
+static inline void batchrotation(double app, double apq, double aqq,
+				 double& c, double& s, double& t)
+{
+  bool zero = (apq == 0.0);
+  double theta = (aqq - app)/(zero ? 1.0 : 2.0*apq);
+  t = (theta >= 0.0 ? 1.0 : -1.0)/(fabs(theta) + sqrt(theta*theta + 1.0));
+  t = (zero ? 0.0 : t);
+  c = 1.0/sqrt(t*t + 1.0);
+  s = t*c;
+}
+
+// Exchange eigenpairs i and j of an n x n lane if vals(i) > vals(j)
+static inline void batchorder(int n, double* l, double* v, int i, int j)
+{
+  bool sel = (l[i] > l[j]);
+  double t = l[i];
+  l[i] = (sel ? l[j] : t);
+  l[j] = (sel ? t : l[j]);
+  for (int k = 0; k < n; k++){
+    t = v[k*n+i];
+    v[k*n+i] = (sel ? v[k*n+j] : t);
+    v[k*n+j] = (sel ? t : v[k*n+j]);
+  }
+}
+
+
+// Exchange eigenpairs a and b of a 3 x 3 if la > lb, without branches
+static inline void batchorder3(double& la, double& lb, double* va, double* vb)
+{
+  bool sel = (la > lb);
+  double t = la;
+  la = (sel ? lb : t); lb = (sel ? t : lb);
+  t = va[0]; va[0] = (sel ? vb[0] : t); vb[0] = (sel ? t : vb[0]);
+  t = va[1]; va[1] = (sel ? vb[1] : t); vb[1] = (sel ? t : vb[1]);
+  t = va[2]; va[2] = (sel ? vb[2] : t); vb[2] = (sel ? t : vb[2]);
+}
+
+// The closed forms read system s of the batch directly, and are written
+// out without loops, so that the loop over systems can be vectorised
+static inline void batchsym2(const double* const* a, double* const* l, double* const* v, int s)
+{
+  double a00 = a[0][s], a01 = a[1][s], a11 = a[3][s];
+  double c, sn, t;
+  batchrotation(a00, a01, a11, c, sn, t);
+  double l0 = a00 - t*a01, l1 = a11 + t*a01;
+  bool sel = (l0 > l1);
+  l[0][s] = (sel ? l1 : l0);
+  l[1][s] = (sel ? l0 : l1);
+  // Vectors (c, -s) and (s, c), exchanged if the values were
+  v[0][s] = (sel ? sn : c);
+  v[1][s] = (sel ? c : sn);
+  v[2][s] = (sel ? c : -sn);
+  v[3][s] = (sel ? -sn : c);
+}
+
+
+static inline void batchsym3(const double* const* a, double* const* l, double* const* v, int s)
+{
+  double a00 = a[0][s], a01 = a[1][s], a02 = a[2][s], a11 = a[4][s], a12 = a[5][s], a22 = a[8][s];
+  double q = (a00 + a11 + a22)/3.0;
+  double p1 = a01*a01 + a02*a02 + a12*a12;
+  double p2 = (a00-q)*(a00-q) + (a11-q)*(a11-q) + (a22-q)*(a22-q) + 2.0*p1;
+  double p = sqrt(p2/6.0);
+  bool scalar = (p == 0.0); // A = qI
+  double ip = 1.0/(scalar ? 1.0 : p);
+  ip = (scalar ? 0.0 : ip);
+  double b00 = (a00-q)*ip, b11 = (a11-q)*ip, b22 = (a22-q)*ip;
+  double b01 = a01*ip, b02 = a02*ip, b12 = a12*ip;
+  double r = 0.5*(b00*(b11*b22 - b12*b12) - b01*(b01*b22 - b12*b02) + b02*(b01*b12 - b11*b02));
+  r = (r < -1.0 ? -1.0 : (r > 1.0 ? 1.0 : r));
+  double phi = acos(r)/3.0;
+  double lmax = q + 2.0*p*cos(phi);
+  double lmin = q + 2.0*p*cos(phi + 2.0943951023931955);
+  double lmid = 3.0*q - lmax - lmin;
+  // The isolated eigenvalue is at least 1.5p from the others
+  double iso = (lmax - lmid > lmid - lmin ? lmax : lmin);
+  // Its vector is orthogonal to the rows of A - iso I, any two of which
+  // span their space, so take the largest cross product
+  double d00 = a00 - iso, d11 = a11 - iso, d22 = a22 - iso;
+  double c00 = a01*a12 - a02*d11, c01 = a02*a01 - d00*a12, c02 = d00*d11 - a01*a01;
+  double c10 = a01*d22 - a02*a12, c11 = a02*a02 - d00*d22, c12 = d00*a12 - a01*a02;
+  double c20 = d11*d22 - a12*a12, c21 = a12*a02 - a01*d22, c22 = a01*a12 - d11*a02;
+  double n0 = c00*c00 + c01*c01 + c02*c02;
+  double n1 = c10*c10 + c11*c11 + c12*c12;
+  double n2 = c20*c20 + c21*c21 + c22*c22;
+  bool sel1 = (n1 > n0), sel2 = (n2 > (sel1 ? n1 : n0));
+  double e0 = (sel2 ? c20 : (sel1 ? c10 : c00));
+  double e1 = (sel2 ? c21 : (sel1 ? c11 : c01));
+  double e2 = (sel2 ? c22 : (sel1 ? c12 : c02));
+  double nrm = (sel2 ? n2 : (sel1 ? n1 : n0));
+  // A scalar matrix takes e = (1, 0, 0)
+  nrm = 1.0/sqrt(scalar ? 1.0 : nrm);
+  e0 = (scalar ? 1.0 : e0*nrm);
+  e1 = (scalar ? 0.0 : e1*nrm);
+  e2 = (scalar ? 0.0 : e2*nrm);
+  // An orthonormal basis u, w of the plane orthogonal to e, with u = e x x_k
+  // for the axis x_k along which e is smallest
+  bool ax0 = (fabs(e0) <= fabs(e1) && fabs(e0) <= fabs(e2));
+  bool ax1 = (!ax0 && fabs(e1) <= fabs(e2));
+  double u0 = (ax0 ? 0.0 : (ax1 ? -e2 : e1));
+  double u1 = (ax0 ? e2 : (ax1 ? 0.0 : -e0));
+  double u2 = (ax0 ? -e1 : (ax1 ? e0 : 0.0));
+  nrm = 1.0/sqrt(u0*u0 + u1*u1 + u2*u2);
+  u0 *= nrm; u1 *= nrm; u2 *= nrm;
+  double w0 = e1*u2 - e2*u1, w1 = e2*u0 - e0*u2, w2 = e0*u1 - e1*u0;
+  // A restricted to that plane, and e's Rayleigh quotient
+  double au0 = a00*u0 + a01*u1 + a02*u2, au1 = a01*u0 + a11*u1 + a12*u2, au2 = a02*u0 + a12*u1 + a22*u2;
+  double aw0 = a00*w0 + a01*w1 + a02*w2, aw1 = a01*w0 + a11*w1 + a12*w2, aw2 = a02*w0 + a12*w1 + a22*w2;
+  double ae0 = a00*e0 + a01*e1 + a02*e2, ae1 = a01*e0 + a11*e1 + a12*e2, ae2 = a02*e0 + a12*e1 + a22*e2;
+  double m00 = u0*au0 + u1*au1 + u2*au2;
+  double m01 = w0*au0 + w1*au1 + w2*au2;
+  double m11 = w0*aw0 + w1*aw1 + w2*aw2;
+  double c, sn, t;
+  batchrotation(m00, m01, m11, c, sn, t);
+  double l0 = e0*ae0 + e1*ae1 + e2*ae2, l1 = m00 - t*m01, l2 = m11 + t*m01;
+  double v0[3] = {e0, e1, e2};
+  double v1[3] = {c*u0 - sn*w0, c*u1 - sn*w1, c*u2 - sn*w2};
+  double v2[3] = {sn*u0 + c*w0, sn*u1 + c*w1, sn*u2 + c*w2};
+  batchorder3(l0, l1, v0, v1);
+  batchorder3(l1, l2, v1, v2);
+  batchorder3(l0, l1, v0, v1);
+  l[0][s] = l0; l[1][s] = l1; l[2][s] = l2;
+  v[0][s] = v0[0]; v[1][s] = v1[0]; v[2][s] = v2[0];
+  v[3][s] = v0[1]; v[4][s] = v1[1]; v[5][s] = v2[1];
+  v[6][s] = v0[2]; v[7][s] = v1[2]; v[8][s] = v2[2];
+}
+
+// The closed forms for n = 1 to 3
+static void batchclosed(int n, const Matrix& A, Matrix& vals, Matrix& vecs)
+{
+  int m = A.ncols();
+  // Local copies of the row pointers, which are then loop invariant
+  const double* a[9];
+  double* l[3];
+  double* v[9];
+  for (int e = 0; e < n*n; e++){
+    a[e] = &A[e];
+    v[e] = &vecs[e];
+  }
+  for (int k = 0; k < n; k++){
+    l[k] = &vals[k];
+  }
+  if (n == 1) {
+    for (int s = 0; s < m; s++){
+      l[0][s] = a[0][s];
+      v[0][s] = 1.0;
+    }
+  } else if (n == 2) {
+#pragma omp parallel for simd schedule(static) firstprivate(a, l, v) if (m > 4*BATCHMAX)
+    for (int s = 0; s < m; s++){
+      batchsym2(a, l, v, s);
+    }
+  } else {
+#pragma omp parallel for simd schedule(static) firstprivate(a, l, v) if (m > 4*BATCHMAX)
+    for (int s = 0; s < m; s++){
+      batchsym3(a, l, v, s);
+    }
+  }
+}
+
+
+bool batchsymeig(int n, const Matrix& A, Matrix& vals)
+{
+  Matrix vecs;
+  return batchsymeig(n, A, vals, vecs);
+}
+
+
+bool batchsymeig(int n, const Matrix& A, Matrix& vals, Matrix& vecs)
+{
+  // Roughly, for the closed forms, counting each square root or
+  // trigonometric function as one flop. batchjacobi adds its own.
+  PROFILE("batchsymeig", (n == 2 ? 25.0 : (n == 3 ? 200.0 : 0.0))*A.ncols());
+  if (n > 8 || A.nrows() != n*n) {
+    throw( Error("BATCHEIG", "Matrices are the wrong size, or larger than 8 x 8.") );
+  }
+  if (n > 3) {
+    return batchjacobi(n, A, vals, vecs);
+  }
+  vals.assign(n, A.ncols(), 0.0);
+  vecs.assign(n*n, A.ncols(), 0.0);
+  if (n > 0 && A.ncols() > 0) { batchclosed(n, A, vals, vecs); }
+  return true;
+}
+
+
+bool batchjacobi(int n, const Matrix& A, Matrix& vals, Matrix& vecs,
+		 double PRECISION, int MAXSWEEP)
+{
+  int m = A.ncols();
+  PROFILE("batchjacobi", 0.0);
+  if (n > 8 || A.nrows() != n*n) {
+    throw( Error("BATCHJACOBI", "Matrices are the wrong size, or larger than 8 x 8.") );
+  }
+  vals.assign(n, m, 0.0);
+  vecs.assign(n*n, m, 0.0);
+  if (n == 0 || m == 0) { return true; }
+  const double** a = batchrows(A);
+  double** l = batchrows(vals);
+  double** v = batchrows(vecs);
+  int nb = batchlanes(n*n);
+  bool ok = true;
+  double flops = 0.0; // Counted by the threads, added after
+#pragma omp parallel for schedule(static) reduction(&&:ok) reduction(+:flops) if (m > nb)
+  for (int s0 = 0; s0 < m; s0 += nb){
+    TRACEARG("batchsymeig/block", s0);
+    int s1 = (s0 + nb < m ? s0 + nb : m);
+    // Working copy of the block, symmetrised from the upper triangle,
+    // with element (i, j) of lane s at w[(i*n + j)*nb + s - s0]
+    double* w = new double[(long)n*n*nb];
+    for (int i = 0; i < n; i++){
+      for (int j = 0; j < n; j++){
+	double* wij = w + (long)(i*n+j)*nb - s0;
+	const double* aij = a[i <= j ? i*n+j : j*n+i];
+	double* vij = v[i*n+j];
+	for (int s = s0; s < s1; s++){
+	  wij[s] = aij[s];
+	  vij[s] = (i == j ? 1.0 : 0.0);
+	}
+      }
+    }
+    bool done = false;
+    for (int sweep = 0; !done && sweep < MAXSWEEP; sweep++){
+      for (int p = 0; p < n-1; p++){
+	for (int q = p+1; q < n; q++){
+	  double* wpp = w + (long)(p*n+p)*nb - s0;
+	  double* wqq = w + (long)(q*n+q)*nb - s0;
+	  double* wpq = w + (long)(p*n+q)*nb - s0;
+	  double* wqp = w + (long)(q*n+p)*nb - s0;
+#pragma omp simd
+	  for (int s = s0; s < s1; s++){
+	    double c, sn, t;
+	    // Negligible elements are skipped, by the identity rotation
+	    double apq = (fabs(wpq[s]) > PRECISION*sqrt(fabs(wpp[s]*wqq[s])) ? wpq[s] : 0.0);
+	    batchrotation(wpp[s], apq, wqq[s], c, sn, t);
+	    wpp[s] -= t*apq;
+	    wqq[s] += t*apq;
+	    wpq[s] = wqp[s] = (apq == 0.0 ? wpq[s] : 0.0);
+	    for (int k = 0; k < n; k++){
+	      double* wkp = w + (long)(k*n+p)*nb - s0;
+	      double* wkq = w + (long)(k*n+q)*nb - s0;
+	      double* wpk = w + (long)(p*n+k)*nb - s0;
+	      double* wqk = w + (long)(q*n+k)*nb - s0;
+	      double x = wkp[s], y = wkq[s];
+	      bool off = (k != p && k != q);
+	      wkp[s] = wpk[s] = (off ? c*x - sn*y : wkp[s]);
+	      wkq[s] = wqk[s] = (off ? sn*x + c*y : wkq[s]);
+	      x = v[k*n+p][s]; y = v[k*n+q][s];
+	      v[k*n+p][s] = c*x - sn*y;
+	      v[k*n+q][s] = sn*x + c*y;
+	    }
+	  }
+	}
+      }
+      // Converged when every off-diagonal element is negligible
+      int left = 0;
+      for (int p = 0; p < n-1; p++){
+	for (int q = p+1; q < n; q++){
+	  const double* wpp = w + (long)(p*n+p)*nb - s0;
+	  const double* wqq = w + (long)(q*n+q)*nb - s0;
+	  const double* wpq = w + (long)(p*n+q)*nb - s0;
+#pragma omp simd reduction(+:left)
+	  for (int s = s0; s < s1; s++){
+	    left += (fabs(wpq[s]) > PRECISION*sqrt(fabs(wpp[s]*wqq[s])) ? 1 : 0);
+	  }
+	}
+      }
+      done = (left == 0);
+      // Each rotation is about 20 flops, and 12 for each k, on every lane
+      flops += (n*(n-1)/2)*(20.0 + 12.0*n)*(s1 - s0);
+    }
+    ok = ok && done;
+    // Eigenvalues from the diagonal, then sorted with their vectors
+    for (int s = s0; s < s1; s++){
+      double ls[8], vs[64];
+      for (int k = 0; k < n; k++){
+	ls[k] = w[(long)(k*n+k)*nb + s - s0];
+      }
+      for (int e = 0; e < n*n; e++){
+	vs[e] = v[e][s];
+      }
+      for (int i = 0; i < n-1; i++){
+	for (int j = n-1; j > i; j--){
+	  batchorder(n, ls, vs, j-1, j);
+	}
+      }
+      for (int k = 0; k < n; k++){
+	l[k][s] = ls[k];
+      }
+      for (int e = 0; e < n*n; e++){
+	v[e][s] = vs[e];
+      }
+    }
+    delete[] w;
+  }
+  delete[] a;
+  delete[] l;
+  delete[] v;
+  PROFILEFLOPS(flops);
+  return ok;
+}
@@ -0,0 +1,82 @@
+/*
+ *   Purpose: To factorise and solve large batches of small, independent
+ *            systems at once. As for the batched thomas in solvers.hpp,
+ *            the batch is interleaved (struct of arrays): each system is a
+ *            column, so that element e of system s is at row e, column s of
+ *            a Matrix. An n x n matrix has element (i, j) at row i*n + j,
+ *            and right hand sides are n x m, one column per system. Every
+ *            inner loop then runs across the systems and is vectorised, and
+ *            blocks of systems are spread over threads.
+ *
+ *   DATE             AUTHOR            CHANGES
+ *   ===============================================================
+ *   19/10/26         Robert Shaw       Original code.
+ *   19/10/26         Robert Shaw       Batched symmetric eigensolvers.
+ *   19/10/26         Robert Shaw       batchsymeig reports convergence.
+ */
+
+#ifndef BATCHEDHEADERDEF
+#define BATCHEDHEADERDEF
+
+// Declare forward dependencies
+class Matrix;
+
+// LU decomposition with partial pivoting of the n x n matrices in A, in
+// place, with the multipliers of L below the diagonal, as for dgelu. Row
+// k of P holds, for each system, the row swapped with row k at step k.
+// Returns true if no pivot was zero; systems that were singular are left
+// with non-finite factors, and the rest are unaffected.
+bool batchlu(int n, Matrix& A, Matrix& P);
+void batchlusolve(int n, const Matrix& A, const Matrix& P, Matrix& B);
+
+// Cholesky factorisation A = R(T)R of the symmetric positive definite
+// n x n matrices in A, overwriting each with R (the lower triangle is
+// zeroed). Only the upper triangle is read. Returns true if every matrix
+// was positive definite.
+bool batchcholesky(int n, Matrix& A);
+void batchcholeskysolve(int n, const Matrix& A, Matrix& B);
+
+// Householder QR factorisation of the rows x cols matrices in A (with
+// rows >= cols), in place: R is left in the upper triangle, and the
+// reflectors I - tau v v(T), with v(k) = 1, below the diagonal, with the
+// tau for each step in the rows of T (cols x m). Returns true if every R
+// has a nonzero diagonal. The solve takes rows x m right hand sides and
+// leaves the (least squares) solutions in their first cols rows.
+bool batchqr(int rows, int cols, Matrix& A, Matrix& T);
+void batchqrsolve(int rows, int cols, const Matrix& A, const Matrix& T, Matrix& B);
+
+// Solve Tx = b, or T(T)x = b if trans is true, for each n x n triangular
+// matrix in T, upper or lower, overwriting B with the solutions. If unit
+// is true the diagonal is taken to be all ones, and is not read.
+void batchtrisolve(int n, const Matrix& T, Matrix& B, bool upper = true,
+		   bool trans = false, bool unit = false);
+
+// Eigenvalues of the real symmetric n x n matrices in A, returned in
+// ascending order in the rows of vals (n x m), and in the second instance
+// the eigenvectors, column k of each n x n matrix in vecs belonging to
+// vals(k). Only the upper triangle of A is read. For n = 2 a single
+// Jacobi rotation is exact. For n = 3 the isolated eigenvalue (the one
+// furthest from the middle) comes from the trigonometric solution of the
+// characteristic cubic, its vector from the largest cross product of two
+// rows of A - lI, refined by its Rayleigh quotient, and the other two from
+// a rotation in the plane orthogonal to it, so that close or repeated
+// eigenvalues still give orthonormal vectors. Sizes 4 to 8 use
+// batchjacobi, and anything larger throws an error. Returns false if
+// batchjacobi did not converge; the closed forms always succeed.
+// Accuracy, on random matrices with entries in [-1, 1], including ones
+// with repeated and nearly repeated eigenvalues, relative to the largest
+// element of A: eigenvalues agree with symqr to 4e-15 for n = 2 and 1e-14
+// for n = 3. For n = 4 to 8 they differ by up to 2e-12, which is symqr's
+// own tolerance, as the residuals ||Av - lv|| here are below 2e-14 and the
+// vectors are orthonormal to 4e-15, for every n.
+bool batchsymeig(int n, const Matrix& A, Matrix& vals);
+bool batchsymeig(int n, const Matrix& A, Matrix& vals, Matrix& vecs);
+
+// The cyclic Jacobi method, for n <= 8, with every rotation applied across
+// the batch at once. Sweeps continue until every matrix has off-diagonal
+// elements below PRECISION times its diagonal, so eigenvalues are found
+// to high relative accuracy. Returns true if all converged within MAXSWEEP.
+bool batchjacobi(int n, const Matrix& A, Matrix& vals, Matrix& vecs,
+		 double PRECISION = 1e-14, int MAXSWEEP = 30);
+
+#endif
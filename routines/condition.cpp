@@ -0,0 +1,201 @@
+// Implements condition.hpp
+
+#include "condition.hpp"
+#include "factors.hpp"
+#include "matrix.hpp"
+#include "vector.hpp"
+#include "error.hpp"
+#include <cmath>
+
+// Relative change at which the 2-norm power iteration stops
+static const double CONDTOL = 1e-6;
+
+// A factorisation of A, through which systems with A or A(T) are solved
+struct CondFactors
+{
+  int kind; // 1 = LU, 2 = cholesky, 3 = QR
+  const Matrix* F; // B from dgelu, or R
+  const Vector* p; // Pivots from dgelu
+  const Matrix* v; // Reflectors from dgehh
+};
+
+// Solve Ux = y, overwriting x = y, where U is the upper triangle of F
+static void uppersolve(const Matrix& F, Vector& x)
+{
+  int n = x.size();
+  for (int i = n-1; i >= 0; i--){
+    const double* fi = &F[i];
+    double sum = x(i);
+    for (int j = i+1; j < n; j++) { sum -= fi[j]*x(j); }
+    x[i] = sum/fi[i];
+  }
+}
+
+// Solve U(T)x = y in place, by rows of U
+static void uppertsolve(const Matrix& F, Vector& x)
+{
+  int n = x.size();
+  for (int j = 0; j < n; j++){
+    const double* fj = &F[j];
+    double xj = (x[j] /= fj[j]);
+    for (int i = j+1; i < n; i++) { x[i] -= fj[i]*xj; }
+  }
+}
+
+// Solve Lx = y in place, L the unit lower triangle of F
+static void lowersolve(const Matrix& F, Vector& x)
+{
+  int n = x.size();
+  for (int i = 1; i < n; i++){
+    const double* fi = &F[i];
+    double sum = x(i);
+    for (int j = 0; j < i; j++) { sum -= fi[j]*x(j); }
+    x[i] = sum;
+  }
+}
+
+// Solve L(T)x = y in place, by rows of L
+static void lowertsolve(const Matrix& F, Vector& x)
+{
+  int n = x.size();
+  for (int j = n-1; j > 0; j--){
+    const double* fj = &F[j];
+    double xj = x(j);
+    for (int i = 0; i < j; i++) { x[i] -= fj[i]*xj; }
+  }
+}
+
+// Overwrite x with A^-1 x, or A^-T x if trans
+static void condsolve(const CondFactors& f, Vector& x, bool trans)
+{
+  switch(f.kind){
+  case 1: // PA = LU
+    if (!trans) {
+      implicitpb(*f.p, x);
+      lowersolve(*f.F, x);
+      uppersolve(*f.F, x);
+    } else {
+      // A(T) = U(T)L(T)P, so undo the interchanges last, in reverse
+      uppertsolve(*f.F, x);
+      lowertsolve(*f.F, x);
+      for (int k = f.p->size()-1; k >= 0; k--) { x.swap(k, (int)(*f.p)(k)); }
+    }
+    break;
+  case 2: // A = R(T)R, which is symmetric
+    uppertsolve(*f.F, x);
+    uppersolve(*f.F, x);
+    break;
+  case 3: // A = QR
+    if (!trans) {
+      implicitqtb(*f.v, x);
+      uppersolve(*f.F, x);
+    } else {
+      uppertsolve(*f.F, x);
+      implicitqx(*f.v, x);
+    }
+    break;
+  }
+}
+
+static int argmaxabs(const Vector& x)
+{
+  int j = 0;
+  for (int i = 1; i < x.size(); i++) { j = (fabs(x(i)) > fabs(x(j)) ? i : j); }
+  return j;
+}
+
+// Hager and Higham's estimate of ||A^-1||_1, following dlacon
+static double invnorm1(const CondFactors& f, int n)
+{
+  if (n == 0) { return 0.0; }
+  Vector x(n), xi(n);
+  for (int i = 0; i < n; i++) { x[i] = 1.0/n; }
+  condsolve(f, x, false);
+  double est = pnorm(x, 1);
+  if (n > 1) {
+    for (int i = 0; i < n; i++) { xi[i] = (x(i) >= 0.0 ? 1.0 : -1.0); }
+    x = xi;
+    condsolve(f, x, true);
+    int j = argmaxabs(x);
+    for (int iter = 2; iter <= 5; iter++){
+      // Try the column of A^-1 that the gradient points to
+      x.assign(n, 0.0);
+      x[j] = 1.0;
+      condsolve(f, x, false);
+      double old = est;
+      est = pnorm(x, 1);
+      bool repeated = true;
+      for (int i = 0; i < n; i++){
+	double s = (x(i) >= 0.0 ? 1.0 : -1.0);
+	repeated = repeated && (s == xi(i));
+	xi[i] = s;
+      }
+      if (repeated || est <= old) {
+	est = (est > old ? est : old);
+	break;
+      }
+      x = xi;
+      condsolve(f, x, true);
+      int jlast = j;
+      j = argmaxabs(x);
+      if (fabs(x(jlast)) == fabs(x(j))) { break; }
+    }
+    // An alternating vector, which catches cases the above can miss
+    for (int i = 0; i < n; i++) { x[i] = (i % 2 == 0 ? 1.0 : -1.0)*(1.0 + double(i)/(n-1)); }
+    condsolve(f, x, false);
+    double alt = 2.0*pnorm(x, 1)/(3.0*n);
+    est = (alt > est ? alt : est);
+  }
+  return est;
+}
+
+static void condcheck(const Matrix& A, const Matrix& F)
+{
+  if (!A.isSquare() || F.nrows() != A.nrows() || F.ncols() != A.ncols()) {
+    throw( Error("CONDEST", "Factors are the wrong size.") );
+  }
+}
+
+double lucond(const Matrix& A, const Matrix& B, const Vector& p)
+{
+  condcheck(A, B);
+  CondFactors f = { 1, &B, &p, NULL };
+  return pnorm(A, 1)*invnorm1(f, A.nrows());
+}
+
+double choleskycond(const Matrix& A, const Matrix& R)
+{
+  condcheck(A, R);
+  CondFactors f = { 2, &R, NULL, NULL };
+  return pnorm(A, 1)*invnorm1(f, A.nrows());
+}
+
+double qrcond(const Matrix& A, const Matrix& R, const Matrix& v)
+{
+  condcheck(A, R);
+  CondFactors f = { 3, &R, NULL, &v };
+  return pnorm(A, 1)*invnorm1(f, A.nrows());
+}
+
+double lucond2(const Matrix& A, const Matrix& B, const Vector& p, int MAXITER)
+{
+  condcheck(A, B);
+  CondFactors f = { 1, &B, &p, NULL };
+  int n = A.nrows();
+  if (n == 0) { return 0.0; }
+  // The largest eigenvalue of (A(T)A)^-1 = A^-1 A^-T is 1/smin^2
+  Vector x(n);
+  for (int i = 0; i < n; i++) { x[i] = 1.0 + double(i)/n; }
+  double lambda = 0.0;
+  for (int iter = 0; iter < MAXITER; iter++){
+    double xnorm = pnorm(x, 2);
+    if (xnorm == 0.0) { break; }
+    x = (1.0/xnorm)*x;
+    condsolve(f, x, true);
+    condsolve(f, x, false);
+    double last = lambda;
+    lambda = pnorm(x, 2);
+    if (fabs(lambda - last) <= CONDTOL*lambda) { break; }
+  }
+  return pnorm(A, 2)*sqrt(lambda);
+}
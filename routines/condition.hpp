@@ -0,0 +1,38 @@
+/*
+ *   Purpose: To estimate condition numbers from factorisations that have
+ *            already been formed, so that the accuracy of a solve can be
+ *            judged for O(n^2) more work, rather than the O(n^3) of
+ *            forming the inverse.
+ *
+ *            The 1-norm estimates are ||A||_1 times an estimate of
+ *            ||A^-1||_1 by Hager's method, as refined by Higham (the
+ *            algorithm of LAPACK's dlacon), which takes at most five
+ *            solves with A and four with A(T), and is almost always
+ *            within a factor of 3 of the true value, and never above it.
+ *            The 2-norm estimate divides pnorm(A, 2) by the smallest
+ *            singular value, found by power iteration on (A(T)A)^-1.
+ *
+ *   DATE             AUTHOR            CHANGES
+ *   ===============================================================
+ *   19/10/26         Robert Shaw       Original code.
+ */
+
+#ifndef CONDITIONHEADERDEF
+#define CONDITIONHEADERDEF
+
+// Declare forward dependencies
+class Matrix;
+class Vector;
+
+// The 1-norm condition number of the square matrix A, from its LU
+// factors B and pivots p from dgelu, its cholesky factor R, or its QR
+// factors R and v from dgehh
+double lucond(const Matrix& A, const Matrix& B, const Vector& p);
+double choleskycond(const Matrix& A, const Matrix& R);
+double qrcond(const Matrix& A, const Matrix& R, const Matrix& v);
+
+// The 2-norm condition number of A from its LU factors, taking at most
+// MAXITER pairs of solves
+double lucond2(const Matrix& A, const Matrix& B, const Vector& p, int MAXITER = 50);
+
+#endif
@@ -0,0 +1,403 @@
+// Implements factcache.hpp
+
+#include "factcache.hpp"
+#include "factors.hpp"
+#include "solvers.hpp"
+#include "binary.hpp"
+#include "matrix.hpp"
+#include "vector.hpp"
+#include "error.hpp"
+#include "profile.hpp"
+#include <climits>
+#include <cstring>
+#include <fstream>
+
+// Elements above which the hash is found in parallel
+static const long CACHEPARALLEL = 1 << 16;
+
+static const char FACTCACHEMAGIC[8] = "LINALGF";
+
+struct FactorCacheHeader
+{
+  char magic[8]; // "LINALGF" and a null
+  uint32_t version; // FACTCACHEVERSION when written
+  uint32_t endian; // 0x01020304 as written
+  uint64_t count; // No. of entries
+  uint64_t reserved[5];
+};
+
+struct FactorCacheRecord
+{
+  uint64_t key;
+  uint32_t kind, dim;
+  uint64_t checksum; // Of the factors then the pivots, see binarychecksum
+  uint64_t reserved;
+};
+
+uint64_t FactorCache::hash(const Matrix& A)
+{
+  int m = A.nrows(), n = A.ncols();
+  uint64_t h = 0;
+#pragma omp parallel for reduction(+:h) if((long)m*n > CACHEPARALLEL)
+  for (int i = 0; i < m; i++){
+    h += binarychecksum(&A[i], n, (uint64_t)i*n);
+  }
+  // Include the shape, so that reshaped data differs
+  h ^= (uint64_t)m*0x9E3779B97F4A7C15ULL + (uint64_t)n;
+  h = (h ^ (h >> 30))*0xBF58476D1CE4E5B9ULL;
+  h = (h ^ (h >> 27))*0x94D049BB133111EBULL;
+  return h ^ (h >> 31);
+}
+
+FactorCache::FactorCache(long maxbytes) : nbuckets(64), head(NULL), tail(NULL), nentries(0),
+					  nbytes(0), budget(maxbytes), nhits(0), nmisses(0), nevictions(0)
+{
+  buckets = new Entry*[nbuckets];
+  for (int i = 0; i < nbuckets; i++) { buckets[i] = NULL; }
+}
+
+FactorCache::~FactorCache()
+{
+  cleanUp();
+  delete[] buckets;
+}
+
+void FactorCache::cleanUp()
+{
+  while (head != NULL){
+    Entry* e = head;
+    head = head->next;
+    release(e);
+  }
+  tail = NULL;
+  for (int i = 0; i < nbuckets; i++) { buckets[i] = NULL; }
+  nentries = nbytes = 0;
+}
+
+FactorCache::Entry* FactorCache::find(uint64_t key, int kind)
+{
+  Entry* e = buckets[key & (nbuckets - 1)];
+  while (e != NULL && (e->key != key || e->kind != kind)){ e = e->chain; }
+  return e;
+}
+
+// Add e as the most recent entry, then evict to fit the budget. The
+// cache takes one reference to e.
+void FactorCache::insert(Entry* e)
+{
+  if (nentries >= nbuckets) {
+    // Rehash into twice as many buckets
+    Entry** old = buckets;
+    int nold = nbuckets;
+    nbuckets *= 2;
+    buckets = new Entry*[nbuckets];
+    for (int i = 0; i < nbuckets; i++) { buckets[i] = NULL; }
+    for (int i = 0; i < nold; i++){
+      Entry* c = old[i];
+      while (c != NULL){
+	Entry* next = c->chain;
+	c->chain = buckets[c->key & (nbuckets - 1)];
+	buckets[c->key & (nbuckets - 1)] = c;
+	c = next;
+      }
+    }
+    delete[] old;
+  }
+  Entry*& b = buckets[e->key & (nbuckets - 1)];
+  e->chain = b;
+  b = e;
+  e->refs++;
+  e->prev = NULL;
+  e->next = head;
+  if (head != NULL) { head->prev = e; } else { tail = e; }
+  head = e;
+  nentries++;
+  nbytes += e->bytes;
+  evict();
+}
+
+// Unlink e from its bucket and the recency list, dropping the cache's
+// reference without freeing it
+void FactorCache::remove(Entry* e)
+{
+  Entry** p = &buckets[e->key & (nbuckets - 1)];
+  while (*p != e){ p = &(*p)->chain; }
+  *p = e->chain;
+  if (e->prev != NULL) { e->prev->next = e->next; } else { head = e->next; }
+  if (e->next != NULL) { e->next->prev = e->prev; } else { tail = e->prev; }
+  e->refs--;
+  nentries--;
+  nbytes -= e->bytes;
+}
+
+// Free e once neither the cache nor any solve refers to it
+void FactorCache::release(Entry* e)
+{
+  if (--e->refs <= 0) { delete e; }
+}
+
+void FactorCache::evict()
+{
+  while (nbytes > budget && tail != NULL){
+    Entry* e = tail;
+    e->refs++;
+    remove(e);
+    release(e);
+    nevictions++;
+  }
+}
+
+// Memory held for n x n factors of the given kind
+static long entrybytes(int n, int kind)
+{
+  return (long)n*n*sizeof(double) + (kind == 1 ? (long)n*sizeof(double) : 0) + 128;
+}
+
+Vector FactorCache::solve(const Matrix& A, const Vector& b, int kind)
+{
+  int dim = A.nrows();
+  if (dim != A.ncols() || dim != b.size()) {
+    throw( Error("FACTCACHE", "Matrix and vector sizes do not match.") );
+  }
+  PROFILE("factcache", 0.0);
+  uint64_t key = hash(A);
+  Vector x;
+  Entry* e = NULL;
+#pragma omp critical(factorcache)
+  {
+    e = find(key, kind);
+    if (e != NULL && e->factors.nrows() == dim) {
+      // Pin it, then move it to the front of the recency list
+      e->refs++;
+      remove(e);
+      insert(e);
+      nhits++;
+    } else {
+      e = NULL;
+      nmisses++;
+    }
+  }
+  if (e != NULL) {
+    // Solve outside the lock. The factors are not changed while held,
+    // and the pin keeps them if the entry is evicted meanwhile.
+    try {
+      if (kind == 1) {
+	x = ::lusolve(e->factors, e->piv, b);
+      } else {
+	x = ::choleskysolve(b, e->factors);
+      }
+    } catch (...) {
+#pragma omp critical(factorcache)
+      release(e);
+      throw;
+    }
+#pragma omp critical(factorcache)
+    release(e);
+    return x;
+  }
+  // Factorise outside the lock, so that misses proceed in parallel
+  e = new Entry;
+  e->key = key;
+  e->kind = kind;
+  e->refs = 0;
+  e->bytes = entrybytes(dim, kind);
+  try {
+    if (kind == 1) {
+      e->piv = dgelu(A, e->factors);
+      x = ::lusolve(e->factors, e->piv, b);
+    } else {
+      e->factors = cholesky(A);
+      x = ::choleskysolve(b, e->factors);
+    }
+  } catch (...) {
+    delete e;
+    throw;
+  }
+  bool kept = false;
+#pragma omp critical(factorcache)
+  {
+    // Another thread may have added the same factors meanwhile
+    if (e->bytes <= budget && find(key, kind) == NULL) {
+      insert(e);
+      kept = true;
+    }
+  }
+  if (!kept) { delete e; }
+  return x;
+}
+
+Vector FactorCache::lusolve(const Matrix& A, const Vector& b)
+{
+  return solve(A, b, 1);
+}
+
+Vector FactorCache::choleskysolve(const Matrix& A, const Vector& b)
+{
+  return solve(A, b, 2);
+}
+
+FactorCacheStats FactorCache::stats() const
+{
+  FactorCacheStats s;
+#pragma omp critical(factorcache)
+  {
+    s.hits = nhits;
+    s.misses = nmisses;
+    s.evictions = nevictions;
+    s.entries = nentries;
+    s.bytes = nbytes;
+    s.budget = budget;
+  }
+  return s;
+}
+
+void FactorCache::setbudget(long maxbytes)
+{
+#pragma omp critical(factorcache)
+  {
+    budget = maxbytes;
+    evict();
+  }
+}
+
+void FactorCache::clear()
+{
+#pragma omp critical(factorcache)
+  {
+    cleanUp();
+    nhits = nmisses = nevictions = 0;
+  }
+}
+
+// Persistence
+
+void FactorCache::save(const char* path) const
+{
+  std::ofstream out(path, std::ios::binary);
+  if (!out) {
+    throw( Error("CACHEOPEN", "Could not open the file for writing.") );
+  }
+#pragma omp critical(factorcache)
+  {
+    FactorCacheHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, FACTCACHEMAGIC, sizeof(h.magic));
+    h.version = FACTCACHEVERSION;
+    h.endian = 0x01020304;
+    h.count = nentries;
+    out.write((const char*)&h, sizeof(h));
+    for (const Entry* e = head; e != NULL; e = e->next){
+      int n = e->factors.nrows();
+      uint64_t npiv = (e->kind == 1 ? e->piv.size() : 0);
+      FactorCacheRecord r;
+      memset(&r, 0, sizeof(r));
+      r.key = e->key;
+      r.kind = e->kind;
+      r.dim = n;
+      for (int i = 0; i < n; i++){
+	r.checksum += binarychecksum(&e->factors[i], n, (uint64_t)i*n);
+      }
+      if (npiv > 0) { r.checksum += binarychecksum(e->piv.data(), npiv, (uint64_t)n*n); }
+      out.write((const char*)&r, sizeof(r));
+      for (int i = 0; i < n; i++){
+	out.write((const char*)&e->factors[i], n*sizeof(double));
+      }
+      if (npiv > 0) { out.write((const char*)e->piv.data(), npiv*sizeof(double)); }
+    }
+  }
+  out.close();
+  if (!out) {
+    throw( Error("CACHEWRITE", "Could not write the file.") );
+  }
+}
+
+int FactorCache::load(const char* path)
+{
+  std::ifstream in(path, std::ios::binary);
+  if (!in) {
+    throw( Error("CACHEOPEN", "Could not open the file.") );
+  }
+  FactorCacheHeader h;
+  if (!in.read((char*)&h, sizeof(h)) || memcmp(h.magic, FACTCACHEMAGIC, sizeof(h.magic)) != 0) {
+    throw( Error("CACHEFORMAT", "Not a factor cache file.") );
+  }
+  if (h.endian != 0x01020304) {
+    throw( Error("CACHEFORMAT", "File was written with a different byte order.") );
+  }
+  if (h.version > FACTCACHEVERSION) {
+    throw( Error("CACHEFORMAT", "File is from a newer version.") );
+  }
+  // Sizes are checked against what is left of the file before anything
+  // is allocated, so a corrupt count or dimension is refused
+  std::streamoff start = in.tellg();
+  in.seekg(0, std::ios::end);
+  uint64_t remaining = (std::streamoff)in.tellg() - start;
+  in.seekg(start);
+  if (h.count > remaining/sizeof(FactorCacheRecord)) {
+    throw( Error("CACHEFORMAT", "Entry count exceeds the file size.") );
+  }
+  // Read and check every entry before adding any
+  long count = h.count;
+  Entry** list = new Entry*[count > 0 ? count : 1];
+  long nread = 0;
+  try {
+    for (; nread < count; nread++){
+      FactorCacheRecord r;
+      if (!in.read((char*)&r, sizeof(r)) || (r.kind != 1 && r.kind != 2)) {
+	throw( Error("CACHEFORMAT", "Bad entry record.") );
+      }
+      remaining -= sizeof(r);
+      uint64_t nelem = (uint64_t)r.dim*r.dim + (r.kind == 1 && r.dim > 0 ? r.dim - 1 : 0);
+      if (r.dim > INT_MAX || nelem > remaining/sizeof(double)) {
+	throw( Error("CACHEFORMAT", "Entry dimension exceeds the file size.") );
+      }
+      remaining -= nelem*sizeof(double);
+      int n = r.dim;
+      Entry* e = list[nread] = new Entry;
+      e->key = r.key;
+      e->kind = r.kind;
+      e->refs = 0;
+      e->bytes = entrybytes(n, r.kind);
+      e->factors.assign(n, n, 0.0);
+      uint64_t checksum = 0;
+      for (int i = 0; i < n && in; i++){
+	in.read((char*)&e->factors[i], n*sizeof(double));
+	checksum += binarychecksum(&e->factors[i], n, (uint64_t)i*n);
+      }
+      if (r.kind == 1 && n > 0) {
+	e->piv.resize(n-1);
+	in.read((char*)e->piv.data(), (n-1)*sizeof(double));
+	checksum += binarychecksum(e->piv.data(), n-1, (uint64_t)n*n);
+      }
+      if (!in || checksum != r.checksum) {
+	nread++;
+	throw( Error("CACHEFORMAT", "Entry is truncated or corrupt.") );
+      }
+    }
+  } catch (...) {
+    for (long k = 0; k < nread; k++) { delete list[k]; }
+    delete[] list;
+    throw;
+  }
+  int added = 0;
+#pragma omp critical(factorcache)
+  {
+    // Take the most recent entries that fit the budget together, and add
+    // them in reverse to keep their order, evicting older ones as needed
+    long total = 0, take = 0;
+    while (take < count && total + list[take]->bytes <= budget){
+      total += list[take++]->bytes;
+    }
+    for (long k = count-1; k >= 0; k--){
+      Entry* e = list[k];
+      if (k < take && find(e->key, e->kind) == NULL) {
+	insert(e);
+	added++;
+      } else {
+	delete e;
+      }
+    }
+  }
+  delete[] list;
+  return added;
+}
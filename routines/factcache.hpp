@@ -0,0 +1,97 @@
+/*
+ *   Purpose: To avoid refactorising matrices that recur. A FactorCache
+ *            holds LU and cholesky factors keyed by a hash of the
+ *            dimensions and contents of the matrix they came from, so that
+ *            solving again with an equal matrix costs O(n^2) to hash and
+ *            solve instead of O(n^3). The least recently used factors are
+ *            evicted to keep the total size within a memory budget.
+ *
+ *            The key is 64 bits, the sum of a mix of each element's bits
+ *            with its position (as binarychecksum in binary.hpp), so equal
+ *            matrices always hit, while two different matrices of the same
+ *            size share a key with probability about 2^-64. Keys are exact
+ *            on the bits, so -0.0 and 0.0 differ.
+ *
+ *            The factors can be saved to a file and loaded again, so a
+ *            restarted program need not refactorise. The file is a 64 byte
+ *            header, then for each entry, most recently used first, a 32
+ *            byte record (key, kind, dimension, checksum) followed by the
+ *            n x n factors and, for LU, the n-1 pivots, as native doubles.
+ *
+ *            Solves may be called from several threads at once. Only the
+ *            lookups are serialised. A hit pins its entry while it solves,
+ *            so an entry evicted meanwhile is freed by its last solve.
+ *
+ *   DATE             AUTHOR            CHANGES
+ *   ===============================================================
+ *   19/10/26         Robert Shaw       Original code.
+ *   19/10/26         Robert Shaw       Solves with cached factors unlocked.
+ */
+
+#ifndef FACTCACHEHEADERDEF
+#define FACTCACHEHEADERDEF
+
+#include "matrix.hpp"
+#include "vector.hpp"
+#include <stdint.h>
+
+static const uint32_t FACTCACHEVERSION = 1; // Newer files are refused
+
+struct FactorCacheStats
+{
+  long hits, misses; // Lookups, since the cache was made or cleared
+  long evictions; // Entries removed to stay within the budget
+  long entries, bytes; // Held now
+  long budget; // Most bytes that may be held
+};
+
+class FactorCache
+{
+private:
+  struct Entry
+  {
+    uint64_t key;
+    int kind; // 1 = LU, 2 = cholesky
+    Matrix factors; // LU from dgelu, or R from cholesky
+    Vector piv; // Pivots from dgelu
+    long bytes;
+    int refs; // Solves using the factors, and one while held
+    Entry *prev, *next; // Recency list, most recent first
+    Entry* chain; // Next in the same bucket
+  };
+  Entry** buckets;
+  int nbuckets; // A power of two
+  Entry *head, *tail;
+  long nentries, nbytes, budget;
+  long nhits, nmisses, nevictions;
+  Entry* find(uint64_t key, int kind);
+  void insert(Entry* e);
+  void remove(Entry* e);
+  void release(Entry* e);
+  void evict();
+  void cleanUp();
+  Vector solve(const Matrix& A, const Vector& b, int kind);
+  // Not copyable, as the entries are owned
+  FactorCache(const FactorCache& other);
+  FactorCache& operator=(const FactorCache& other);
+public:
+  FactorCache(long maxbytes = 256L << 20);
+  ~FactorCache();
+  // As lusolve and choleskysolve in solvers.hpp, but reusing the factors
+  // of an equal matrix if they are held, and holding them otherwise
+  Vector lusolve(const Matrix& A, const Vector& b);
+  Vector choleskysolve(const Matrix& A, const Vector& b);
+  FactorCacheStats stats() const;
+  // Change the budget, evicting entries as needed
+  void setbudget(long maxbytes);
+  // Remove every entry, and zero the statistics
+  void clear();
+  // Write every entry to the file at path, or add those in the file to
+  // the cache, as far as the budget allows, returning the number added
+  void save(const char* path) const;
+  int load(const char* path);
+  // The key of A
+  static uint64_t hash(const Matrix& A);
+};
+
+#endif
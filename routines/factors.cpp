@@ -4,6 +4,9 @@
 #include "matrix.hpp"
 #include "error.hpp"
 #include "factors.hpp"
+#include "banded.hpp"
+#include "packed.hpp"
+#include "profile.hpp"
 #include <iostream>
 #include <cmath>
 
@@ -68,6 +71,7 @@ bool dgehh(const Matrix& x, Matrix& y, Matrix& v)
   // Get dimensions of x
   int m = x.nrows();
   int n = x.ncols();
+  PROFILE("dgehh", 2.0*m*n*n - 2.0*n*n*n/3.0);
   // Make sure v and y are the same size as x
   v.resize(m, n); 
   y.resize(m, n);
@@ -168,16 +172,37 @@ void implicitqtb(const Matrix& v, Vector& b)
 
 // Form explicitly the Q matrix from the HH decomposition
 Matrix explicitq(const Matrix& v)
+{
+  return explicitq(v, v.ncols());
+}
+
+// Form the first ncols columns of Q, for any ncols up to m. The reflectors
+// are applied in reverse order to the leading columns of the identity, so
+// that reflector k only ever touches rows k to m-1, a row at a time.
+Matrix explicitq(const Matrix& v, int ncols)
 {
   int m = v.nrows();
   int n = v.ncols();
-  Matrix rmat(m, n); // Return matrix
-  // Do implicitqx for x = the identity vector in each dimension
-  for (int i = 0; i < n; i++) {
-    Vector temp(m, 0.0); // Temporary vector of all zeroes
-    temp[i] = 1.0; // Turn into the identity
-    implicitqx(v, temp); // Get the ith column of q
-    rmat.setCol(i, temp); // Set the ith column of q 
+  PROFILE("explicitq", 4.0*m*n*ncols - 2.0*(m + ncols)*n*n + 4.0*n*n*n/3.0);
+  Matrix rmat(m, ncols, 0.0); // Return matrix
+  for (int i = 0; i < ncols && i < m; i++) { rmat(i, i) = 1.0; }
+  Vector w(ncols); // Stores v(T)Q for each reflector
+  for (int k = (n < m ? n : m) - 1; k > -1; k--) {
+    for (int j = 0; j < ncols; j++) { w[j] = 0.0; }
+    for (int i = k; i < m; i++) {
+      double vik = v(i, k);
+      if (vik != 0.0) {
+	const double* qi = &rmat[i];
+	for (int j = 0; j < ncols; j++) { w[j] += vik*qi[j]; }
+      }
+    }
+    for (int i = k; i < m; i++) {
+      double vik = 2.0*v(i, k);
+      if (vik != 0.0) {
+	double* qi = &rmat[i];
+	for (int j = 0; j < ncols; j++) { qi[j] -= vik*w(j); }
+      }
+    }
   }
   return rmat;
 }
@@ -189,6 +214,7 @@ Matrix explicitq(const Matrix& v)
 Vector dgelu(const Matrix& A, Matrix& B) 
 {
   int dim = A.nrows(); // Assume square
+  PROFILE("dgelu", 2.0*dim*dim*dim/3.0);
   B = A; // Copy A into B
   Vector p(dim-1); // For returning the permutations at each step
   Matrix L(dim, dim, 0.0); // Matrix of all zeroes
@@ -201,12 +227,13 @@ Vector dgelu(const Matrix& A, Matrix& B)
   for (int k = 0; k < dim-1; k++){
     // Find the pivot in column k
     int pivot = k;
-    double testval = B(k, k);
+    double testval = fabs(B(k, k));
     // Choose the pivot as the biggest (by absolute value)
     // element in column k
     for (int i = k+1; i < dim; i++){
       if(fabs(B(i, k)) > testval){
 	pivot = i;
+	testval = fabs(B(i, k));
       }
     }
     // Interchange rows for submatrices of B and L
@@ -271,12 +298,220 @@ void implicitpb(const Vector& p, Vector& b)
   }
 }
 
+// LU of a banded matrix with partial pivoting, in place on the band of B
+Vector dgblu(const BandedMatrix& A, BandedMatrix& B)
+{
+  int dim = A.size();
+  int kl = A.nlower(), ku = A.nupper() + kl;
+  PROFILE("dgblu", 2.0*dim*kl*(double)ku);
+  B = BandedMatrix(dim, kl, ku, 0.0);
+  for (int i = 0; i < dim; i++){
+    for (int j = (i-kl > 0 ? i-kl : 0); j <= i+A.nupper() && j < dim; j++){
+      B(i, j) = A(i, j);
+    }
+  }
+  Vector p(dim > 1 ? dim-1 : 0); // Row interchanges at each step
+  // Work directly on the band storage, where (i, j) is at i*w + j - i + kl
+  double* b = B.data();
+  long w = B.width();
+  for (int k = 0; k < dim-1; k++){
+    int imax = (k+kl < dim-1 ? k+kl : dim-1);
+    int jmax = (k+ku < dim-1 ? k+ku : dim-1);
+    // Choose the biggest (by absolute value) element in column k as pivot
+    int pivot = k;
+    double testval = fabs(b[k*w+kl]);
+    for (int i = k+1; i <= imax; i++){
+      if (fabs(b[i*w+k-i+kl]) > testval) {
+	pivot = i;
+	testval = fabs(b[i*w+k-i+kl]);
+      }
+    }
+    p[k] = pivot;
+    if (pivot != k) { // Swap the rest of rows k and pivot
+      for (int j = k; j <= jmax; j++){
+	double temp = b[k*w+j-k+kl];
+	b[k*w+j-k+kl] = b[pivot*w+j-pivot+kl];
+	b[pivot*w+j-pivot+kl] = temp;
+      }
+    }
+    double ukk = b[k*w+kl];
+    if (ukk == 0.0) { continue; } // Column is already eliminated
+    // Eliminate below the diagonal, storing the multipliers in place
+    const double* rk = b + k*w - k + kl;
+    for (int i = k+1; i <= imax; i++){
+      double* ri = b + i*w - i + kl;
+      double lik = ri[k]/ukk;
+      ri[k] = lik;
+      for (int j = k+1; j <= jmax; j++){
+	ri[j] -= lik*rk[j];
+      }
+    }
+  }
+  return p;
+}
+
+
+// Cholesky of a banded matrix, row by row within the band
+BandedMatrix bandedcholesky(const BandedMatrix& A)
+{
+  int dim = A.size();
+  int bw = A.nupper();
+  PROFILE("bandedcholesky", dim*bw*(bw + 1.0));
+  BandedMatrix R(dim, 0, bw, 0.0);
+  for (int i = 0; i < dim; i++){
+    for (int j = i; j <= i+bw && j < dim; j++){
+      R(i, j) = A(i, j);
+    }
+  }
+  // Row i of R holds columns i to i+bw, at positions 0 to bw
+  double* r = R.data();
+  long w = R.width();
+  for (int k = 0; k < dim; k++){
+    double* rk = r + k*w;
+    if (!(rk[0] > 0.0)) {
+      throw( Error("BANDCHOL", "Matrix is not positive definite.") );
+    }
+    double rootval = sqrt(rk[0]);
+    int jmax = (k+bw < dim-1 ? k+bw : dim-1) - k;
+    for (int j = 0; j <= jmax; j++){
+      rk[j] /= rootval;
+    }
+    // Reduce the rows below symmetrically
+    for (int i = 1; i <= jmax; i++){
+      double* ri = r + (k+i)*w;
+      double rki = rk[i];
+      for (int j = i; j <= jmax; j++){
+	ri[j-i] -= rki*rk[j];
+      }
+    }
+  }
+  return R;
+}
+
+
+TriangularMatrix cholesky(const SymmetricMatrix& A)
+{
+  int dim = A.size();
+  PROFILE("cholesky(packed)", dim*dim*(double)dim/3.0);
+  // Row i of the upper triangle is column i of the stored lower triangle
+  TriangularMatrix R(dim, true);
+  double* r = R.data();
+  for (int i = 0; i < dim; i++){
+    double* ri = r + R.rowStart(i);
+    for (int j = i; j < dim; j++){
+      ri[j-i] = A(j, i);
+    }
+  }
+  // Row k of R is contiguous, holding columns k to dim-1
+  for (int k = 0; k < dim; k++){
+    double* rk = r + R.rowStart(k);
+    if (!(rk[0] > 0.0)) {
+      throw( Error("CHOLESKY", "Matrix is not positive definite.") );
+    }
+    double rootval = sqrt(rk[0]);
+    int len = dim - k;
+    for (int j = 0; j < len; j++){
+      rk[j] /= rootval;
+    }
+    // Rank one update of the trailing rows, each owned by one thread
+#pragma omp parallel for schedule(dynamic, 16) if (len > 200)
+    for (int i = 1; i < len; i++){
+      double* ri = r + R.rowStart(k+i);
+      double rki = rk[i];
+#pragma omp simd
+      for (int j = i; j < len; j++){
+	ri[j-i] -= rki*rk[j];
+      }
+    }
+  }
+  return R;
+}
+
+
+TriangularMatrix ldlt(const SymmetricMatrix& A, Vector& d)
+{
+  int dim = A.size();
+  PROFILE("ldlt", dim*dim*(double)dim/3.0);
+  TriangularMatrix L(dim, false);
+  d.resize(dim);
+  double* l = L.data();
+  const double* a = A.data();
+  // Row by row, with w holding L(i, k)*d(k) for the current row, so that
+  // every inner product is between two contiguous rows of L
+  double* w = new double[dim > 0 ? dim : 1];
+  for (int i = 0; i < dim; i++){
+    double* li = l + L.rowStart(i);
+    const double* ai = a + (long)i*(i+1)/2; // Same layout as L
+    for (int j = 0; j < i; j++){
+      const double* lj = l + L.rowStart(j);
+      double sum = ai[j];
+      for (int k = 0; k < j; k++){
+	sum -= w[k]*lj[k];
+      }
+      w[j] = sum;
+      li[j] = sum/d(j);
+    }
+    double dii = ai[i];
+    for (int k = 0; k < i; k++){
+      dii -= w[k]*li[k];
+    }
+    if (dii == 0.0) {
+      delete[] w;
+      throw( Error("LDLT", "Zero pivot encountered.") );
+    }
+    d[i] = dii;
+    li[i] = 1.0;
+  }
+  delete[] w;
+  return L;
+}
+
+
+// LU decomposition of the shifted Hessenberg matrix H - mu*I. Only
+// the rows k, k+1 can be candidates for the pivot at step k, and the
+// elimination only changes row k+1, so each step is O(n).
+Vector dhslu(const Matrix& H, double mu, Matrix& B)
+{
+  int dim = H.nrows(); // Assume square
+  PROFILE("dhslu", 2.0*dim*dim);
+  B = H;
+  double hnorm = 0.0; // Largest element of the shifted matrix
+  for (int i = 0; i < dim; i++){
+    B(i, i) -= mu;
+    for (int j = (i > 0 ? i-1 : 0); j < dim; j++){
+      hnorm = (fabs(B(i, j)) > hnorm ? fabs(B(i, j)) : hnorm);
+    }
+  }
+  double tiny = (hnorm > 0.0 ? hnorm : 1.0)*2.2e-16;
+  Vector p(dim > 0 ? dim-1 : 0);
+  for (int k = 0; k < dim-1; k++){
+    // Choose the larger of the two candidate pivots
+    if (fabs(B(k+1, k)) > fabs(B(k, k))) {
+      B.swapRows(k, k+1, k);
+      p[k] = 1.0;
+    } else {
+      p[k] = 0.0;
+    }
+    if (B(k, k) == 0.0) { B(k, k) = tiny; }
+    double l = B(k+1, k)/B(k, k);
+    B(k+1, k) = l;
+    double* bk = &B[k];
+    double* bk1 = &B[k+1];
+    for (int j = k+1; j < dim; j++){
+      bk1[j] -= l*bk[j];
+    }
+  }
+  if (dim > 0 && B(dim-1, dim-1) == 0.0) { B(dim-1, dim-1) = tiny; }
+  return p;
+}
+
 // Compute the Cholesky factorisation of a real symmetric
 // positive definite matrix. Returns the upper triangular
 // matrix R.
 Matrix cholesky(const Matrix& A)
 {
   int dim = A.nrows(); // Assume square
+  PROFILE("cholesky", dim*dim*(double)dim/3.0);
   Matrix R;
   R = A; // Initialise R
   // Reduce the elements of R symmetrically
@@ -306,6 +541,7 @@ bool hessenberg(const Matrix& x, Matrix& y, Matrix& v)
 {
   bool rval = true;
   int dim = x.nrows();
+  PROFILE("hessenberg", 10.0*dim*dim*dim/3.0);
   if (x.isTriangular()){ // No need to reduce it
     y = x;
     v.assign(dim, dim, 0.0);
@@ -461,3 +697,441 @@ Matrix explicitg(const Vector& g, int i, int k, int dim)
   return G;
 }
   
+
+// In-place application of a givens rotation to rows i and k of A, giving G(T)A
+void igivens(const Vector& G, Matrix& A, int i, int k)
+{
+  double c = G(0), s = G(1);
+  double* ai = &A[i];
+  double* ak = &A[k];
+  int n = A.ncols();
+  for (int j = 0; j < n; j++){
+    double tau1 = ai[j];
+    double tau2 = ak[j];
+    ai[j] = c*tau1 - s*tau2;
+    ak[j] = s*tau1 + c*tau2;
+  }
+}
+
+// In-place application to columns i and k of A, giving AG, for rows start to end-1
+void igivens(Matrix& A, const Vector& G, int i, int k, int start, int end)
+{
+  double c = G(0), s = G(1);
+  end = (end < 0 ? A.nrows() : end);
+  for (int j = start; j < end; j++){
+    double tau1 = A(j, i);
+    double tau2 = A(j, k);
+    A(j, i) = c*tau1 - s*tau2;
+    A(j, k) = s*tau1 + c*tau2;
+  }
+}
+
+// The circle method: for N (even) players, player N-1 stays fixed while
+// the others rotate around it. For odd n, a dummy player n is added,
+// and any pair involving it is dropped. Called with pairs = NULL, simply
+// returns the number of rounds.
+int roundrobin(int n, int round, int* pairs)
+{
+  int N = (n%2 == 0 ? n : n+1);
+  if (pairs == NULL) { return (N > 1 ? N-1 : 0); }
+  int npairs = 0;
+  for (int i = 0; i < N/2; i++){
+    int a, b;
+    if (i == 0) {
+      a = round; b = N-1;
+    } else {
+      a = (round + i)%(N-1);
+      b = (round + N - 1 - i)%(N-1);
+    }
+    if (a < n && b < n) {
+      pairs[2*npairs] = (a < b ? a : b);
+      pairs[2*npairs+1] = (a < b ? b : a);
+      npairs++;
+    }
+  }
+  return npairs;
+}
+
+// One-sided Jacobi SVD. The columns of A are held as the rows of W = A(T), so
+// that each rotation runs along contiguous memory, and rotations are
+// accumulated likewise in the rows of V(T). A rotation of columns p, q is
+// only done if they are not already orthogonal to relative precision
+// PRECISION, which gives high relative accuracy in the singular values.
+bool jacobisvd(const Matrix& A, Vector& s, Matrix& U, Matrix& V, double PRECISION, int MAXSWEEP)
+{
+  PROFILE("jacobisvd", 0.0);
+  bool rval = false;
+  // Work with whichever of A, A(T) has at least as many rows as columns
+  bool trans = (A.nrows() < A.ncols());
+  Matrix W;
+  if (trans) { W = A; } else { W = A.transpose(); }
+  int n = W.nrows(); // Number of columns being orthogonalised
+  int m = W.ncols();
+  Matrix Vt(n, n, 0.0);
+  for (int i = 0; i < n; i++) { Vt(i, i) = 1.0; }
+
+  int nrounds = roundrobin(n, 0, NULL);
+  int* pairs = new int[n+1];
+  Vector* rots = new Vector[n/2 + 1]; // Rotation for each pair in a round
+  for (int i = 0; i < n/2 + 1; i++) { rots[i].resize(2); }
+  int sweep = 0;
+  while (!rval && sweep < MAXSWEEP) {
+    int nrot = 0; // Rotations done this sweep
+    for (int r = 0; r < nrounds; r++){
+      int npairs = roundrobin(n, r, pairs);
+      // The pairs are disjoint, so can all be rotated at once
+#pragma omp parallel for schedule(static) reduction(+:nrot)
+      for (int i = 0; i < npairs; i++){
+	int p = pairs[2*i], q = pairs[2*i+1];
+	const double* wp = &W[p];
+	const double* wq = &W[q];
+	double alpha = 0.0, beta = 0.0, gamma = 0.0;
+	for (int j = 0; j < m; j++){
+	  alpha += wp[j]*wp[j];
+	  beta += wq[j]*wq[j];
+	  gamma += wp[j]*wq[j];
+	}
+	if (fabs(gamma) > PRECISION*sqrt(alpha*beta) && fabs(gamma) > 0.0) {
+	  double zeta = (beta - alpha)/(2.0*gamma);
+	  double t = (zeta < 0.0 ? -1.0 : 1.0)/(fabs(zeta) + sqrt(1.0 + zeta*zeta));
+	  rots[i][0] = 1.0/sqrt(1.0 + t*t);
+	  rots[i][1] = rots[i](0)*t;
+	  igivens(rots[i], W, p, q);
+	  igivens(rots[i], Vt, p, q);
+	  nrot++;
+	}
+      }
+    }
+    // Every pair is tested, with three inner products, and each rotation
+    // is applied to two rows of W and of V(T)
+    PROFILEFLOPS(3.0*m*n*(n-1) + 6.0*(m+n)*nrot);
+    rval = (nrot == 0);
+    sweep++;
+  }
+  delete[] pairs;
+  delete[] rots;
+
+  // Singular values are the column norms, the normalised columns give U
+  s.resize(n);
+  Matrix Ut(n, m);
+  for (int i = 0; i < n; i++){
+    double norm = 0.0;
+    for (int j = 0; j < m; j++) { norm += W(i, j)*W(i, j); }
+    norm = sqrt(norm);
+    s[i] = norm;
+    for (int j = 0; j < m; j++) { Ut(i, j) = (norm > 0.0 ? W(i, j)/norm : 0.0); }
+  }
+  // Sort into descending order
+  for (int i = 0; i < n-1; i++){
+    int imax = i;
+    for (int j = i+1; j < n; j++) { imax = (s(j) > s(imax) ? j : imax); }
+    if (imax != i) {
+      s.swap(i, imax);
+      Ut.swapRows(i, imax);
+      Vt.swapRows(i, imax);
+    }
+  }
+  if (trans) { // A(T) = V S U(T), so swap the roles of U and V
+    U = Vt.transpose();
+    V = Ut.transpose();
+  } else {
+    U = Ut.transpose();
+    V = Vt.transpose();
+  }
+  return rval;
+}
+
+// Columns of B each thread takes in the product of a left reflector with B
+static const int BIDIAGBLOCK = 256;
+
+// Householder bidiagonalisation of the m x n matrix x, m >= n, such that
+// Q(T) x P = B, where B is upper bidiagonal with diagonal d and
+// superdiagonal e. The left reflectors are stored in the columns of u as
+// in dgehh, and the right reflectors in the columns of v as in hessenberg,
+// so that Q = explicitq(u) and P = explicitq(v). Each reflector is formed
+// in a contiguous vector, and applied to the remaining submatrix in place
+// a row at a time: the rank-1 updates are split by rows between threads,
+// and the product u(T)B by blocks of columns, each summed down the rows.
+bool bidiag(const Matrix& x, Vector& d, Vector& e, Matrix& u, Matrix& v)
+{
+  int m = x.nrows();
+  int n = x.ncols();
+  PROFILE("bidiag", 4.0*m*n*n - 4.0*n*n*n/3.0);
+  if (m < n) { return false; }
+  Matrix B;
+  B = x;
+  d.assign(n, 0.0);
+  e.assign(n > 0 ? n-1 : 0, 0.0);
+  u.assign(m, n, 0.0);
+  v.assign(n, n, 0.0);
+  Vector w(n); // Workspace for the products with the reflectors
+  Vector uk(m), vk(n); // The current reflectors
+  double* wv = w.data();
+  double* uv = uk.data();
+  double* vv = vk.data();
+  for (int k = 0; k < n; k++){
+    // Left reflector, zeroing column k below the diagonal
+    double norm = 0.0;
+    for (int i = k; i < m; i++) { norm += B(i, k)*B(i, k); }
+    norm = sqrt(norm);
+    if (norm > 0.0) {
+      double alpha = (B(k, k) < 0 ? -norm : norm);
+      for (int i = k; i < m; i++) { uv[i] = B(i, k); }
+      uv[k] += alpha;
+      double unorm = sqrt(2.0*norm*(norm + fabs(B(k, k))));
+      for (int i = k; i < m; i++) {
+	uv[i] /= unorm;
+	u(i, k) = uv[i];
+      }
+      // w = u(T)B, then B = B - 2uw(T), for columns k+1 onwards
+      int nblocks = (n - k - 1 + BIDIAGBLOCK - 1)/BIDIAGBLOCK;
+#pragma omp parallel for schedule(static) if ((m-k)*(n-k) > 20000)
+      for (int b = 0; b < nblocks; b++){
+	int j0 = k + 1 + b*BIDIAGBLOCK;
+	int j1 = (j0 + BIDIAGBLOCK < n ? j0 + BIDIAGBLOCK : n);
+	for (int j = j0; j < j1; j++) { wv[j] = 0.0; }
+	for (int i = k; i < m; i++){
+	  double ui = uv[i];
+	  const double* bi = &B[i];
+#pragma omp simd
+	  for (int j = j0; j < j1; j++) { wv[j] += ui*bi[j]; }
+	}
+      }
+#pragma omp parallel for schedule(static) if ((m-k)*(n-k) > 20000)
+      for (int i = k; i < m; i++){
+	double ui = 2.0*uv[i];
+	double* bi = &B[i];
+#pragma omp simd
+	for (int j = k+1; j < n; j++) { bi[j] -= ui*wv[j]; }
+      }
+      d[k] = -alpha;
+    } else {
+      d[k] = 0.0;
+    }
+    if (k < n-1) {
+      // Right reflector, zeroing row k to the right of the superdiagonal
+      norm = 0.0;
+      for (int j = k+1; j < n; j++) { norm += B(k, j)*B(k, j); }
+      norm = sqrt(norm);
+      if (norm > 0.0 && k < n-2) {
+	double alpha = (B(k, k+1) < 0 ? -norm : norm);
+	for (int j = k+1; j < n; j++) { vv[j] = B(k, j); }
+	vv[k+1] += alpha;
+	double vnorm = sqrt(2.0*norm*(norm + fabs(B(k, k+1))));
+	for (int j = k+1; j < n; j++) {
+	  vv[j] /= vnorm;
+	  v(j, k+1) = vv[j];
+	}
+	// Apply to rows k+1 onwards, B = B - 2(Bv)v(T)
+#pragma omp parallel for schedule(static) if ((m-k)*(n-k) > 20000)
+	for (int i = k+1; i < m; i++){
+	  double* bi = &B[i];
+	  double sum = 0.0;
+#pragma omp simd reduction(+:sum)
+	  for (int j = k+1; j < n; j++) { sum += bi[j]*vv[j]; }
+	  sum *= 2.0;
+#pragma omp simd
+	  for (int j = k+1; j < n; j++) { bi[j] -= sum*vv[j]; }
+	}
+	e[k] = -alpha;
+      } else {
+	e[k] = B(k, k+1);
+      }
+    }
+  }
+  return true;
+}
+
+// Rotate rows i and k of the (optional) matrix Q by [c, s], such that
+// row i becomes c*row_i + s*row_k and row k becomes c*row_k - s*row_i.
+static void rotaterows(Matrix* Q, Vector& G, double c, double s, int i, int k)
+{
+  if (Q != NULL) {
+    G[0] = c; G[1] = -s;
+    igivens(G, *Q, i, k);
+  }
+}
+
+// Implicit zero-shift-safe QR iteration on the upper bidiagonal matrix
+// with diagonal d and superdiagonal e (Golub-Kahan SVD steps with a
+// Wilkinson shift). The left and right rotations are accumulated into the
+// rows of Ut and Vt respectively, if these are not NULL. On exit, d holds
+// the singular values, unsorted and possibly negative.
+bool bidiagqr(Vector& d, Vector& e, Matrix* Ut, Matrix* Vt, double PRECISION, int MAXITER)
+{
+  int n = d.size();
+  PROFILE("bidiagqr", 0.0);
+  // Each rotation costs 6 flops per element of the rows it accumulates
+  // into, besides those on the bidiagonal, counted at the end
+  double uflops = (Ut != NULL ? 6.0*Ut->ncols() : 0.0);
+  double vflops = (Vt != NULL ? 6.0*Vt->ncols() : 0.0);
+  double flops = 0.0;
+  Vector G(2);
+  double bnorm = 0.0;
+  for (int i = 0; i < n; i++){
+    bnorm = (fabs(d(i)) > bnorm ? fabs(d(i)) : bnorm);
+    if (i < n-1) { bnorm = (fabs(e(i)) > bnorm ? fabs(e(i)) : bnorm); }
+  }
+  double tol = PRECISION*bnorm;
+  int iter = 0;
+  MAXITER *= (n > 1 ? n : 1);
+  while (iter < MAXITER) {
+    // Set negligible superdiagonal elements to zero
+    for (int i = 0; i < n-1; i++){
+      if (fabs(e(i)) <= PRECISION*(fabs(d(i)) + fabs(d(i+1)))) {
+	e[i] = 0.0;
+      }
+    }
+    // Find the unreduced block p..q at the bottom of the matrix
+    int q = n-1;
+    while (q > 0 && e(q-1) == 0.0) { q--; }
+    if (q == 0) { break; } // Diagonal - finished
+    int p = q-1;
+    while (p > 0 && e(p-1) != 0.0) { p--; }
+
+    // Look for a zero on the diagonal of the block
+    int z = -1;
+    for (int i = p; i <= q; i++){
+      if (fabs(d(i)) <= tol) { z = i; d[i] = 0.0; break; }
+    }
+    if (z > -1 && z < q) {
+      // Chase e(z) along row z with left rotations of rows z, j
+      double f = e(z);
+      e[z] = 0.0;
+      for (int j = z+1; j <= q && f != 0.0; j++){
+	double r = sqrt(d(j)*d(j) + f*f);
+	double c = d(j)/r, s = f/r;
+	d[j] = r;
+	if (j < q) {
+	  f = -s*e(j);
+	  e[j] = c*e(j);
+	}
+	rotaterows(Ut, G, c, s, j, z);
+	flops += 10.0 + uflops;
+      }
+    } else if (z == q) {
+      // Chase e(q-1) up column q with right rotations of columns j, q
+      double f = e(q-1);
+      e[q-1] = 0.0;
+      for (int j = q-1; j >= p && f != 0.0; j--){
+	double r = sqrt(d(j)*d(j) + f*f);
+	double c = d(j)/r, s = f/r;
+	d[j] = r;
+	if (j > p) {
+	  f = -s*e(j-1);
+	  e[j-1] = c*e(j-1);
+	}
+	rotaterows(Vt, G, c, s, j, q);
+	flops += 10.0 + vflops;
+      }
+    } else {
+      // Wilkinson shift from the trailing 2x2 block of B(T)B
+      double t11 = d(q-1)*d(q-1) + (q-1 > p ? e(q-2)*e(q-2) : 0.0);
+      double t12 = d(q-1)*e(q-1);
+      double t22 = d(q)*d(q) + e(q-1)*e(q-1);
+      double delta = (t11 - t22)/2.0;
+      double mu = t22 - t12*t12/(delta + (delta < 0 ? -1.0 : 1.0)*sqrt(delta*delta + t12*t12));
+      if (delta == 0.0 && t12 == 0.0) { mu = t22; }
+      double y = d(p)*d(p) - mu;
+      double x = d(p)*e(p);
+      // Chase the bulge down the block
+      for (int k = p; k < q; k++){
+	// Right rotation of columns k, k+1
+	double r = sqrt(y*y + x*x);
+	double c = (r > 0.0 ? y/r : 1.0), s = (r > 0.0 ? x/r : 0.0);
+	if (k > p) { e[k-1] = r; }
+	double f = c*d(k) + s*e(k);
+	e[k] = c*e(k) - s*d(k);
+	double g = s*d(k+1); // Bulge at (k+1, k)
+	d[k+1] = c*d(k+1);
+	d[k] = f;
+	rotaterows(Vt, G, c, s, k, k+1);
+	// Left rotation of rows k, k+1
+	r = sqrt(d(k)*d(k) + g*g);
+	c = (r > 0.0 ? d(k)/r : 1.0); s = (r > 0.0 ? g/r : 0.0);
+	d[k] = r;
+	f = c*e(k) + s*d(k+1);
+	d[k+1] = c*d(k+1) - s*e(k);
+	e[k] = f;
+	if (k < q-1) {
+	  x = s*e(k+1); // Bulge at (k, k+2)
+	  e[k+1] = c*e(k+1);
+	  y = e(k);
+	}
+	rotaterows(Ut, G, c, s, k, k+1);
+	flops += 40.0 + uflops + vflops;
+      }
+    }
+    iter++;
+  }
+  PROFILEFLOPS(flops);
+  return (iter < MAXITER);
+}
+
+// Singular value decomposition, by Householder bidiagonalisation followed
+// by the implicitly shifted bidiagonal QR algorithm. The rotations of the
+// second phase are accumulated into small n x n matrices, which are then
+// multiplied into the reflectors in one go.
+static bool svdcore(const Matrix& A, Vector& s, Matrix* U, Matrix* V, bool full, double PRECISION)
+{
+  bool trans = (A.nrows() < A.ncols());
+  Matrix X;
+  if (trans) { X = A.transpose(); } else { X = A; }
+  int m = X.nrows();
+  int n = X.ncols();
+  Vector e; Matrix qu, qv;
+  bool rval = bidiag(X, s, e, qu, qv);
+  bool vectors = (U != NULL && V != NULL);
+  Matrix Ut, Vt;
+  if (vectors) {
+    Ut.assign(n, n, 0.0);
+    Vt.assign(n, n, 0.0);
+    for (int i = 0; i < n; i++) { Ut(i, i) = Vt(i, i) = 1.0; }
+  }
+  rval = rval && bidiagqr(s, e, (vectors ? &Ut : NULL), (vectors ? &Vt : NULL), PRECISION, 75);
+  // Make the values positive, and sort into descending order
+  for (int i = 0; i < n; i++){
+    if (s(i) < 0.0) {
+      s[i] = -s(i);
+      if (vectors) { for (int j = 0; j < n; j++) { Vt(i, j) = -Vt(i, j); } }
+    }
+  }
+  for (int i = 0; i < n-1; i++){
+    int imax = i;
+    for (int j = i+1; j < n; j++) { imax = (s(j) > s(imax) ? j : imax); }
+    if (imax != i) {
+      s.swap(i, imax);
+      if (vectors) {
+	Ut.swapRows(i, imax);
+	Vt.swapRows(i, imax);
+      }
+    }
+  }
+  if (vectors) {
+    // Left vectors are Q[I; 0]Ut(T), extended by the rest of Q if full
+    Matrix Q = explicitq(qu, (full ? m : n));
+    Matrix W(Q.ncols(), Q.ncols(), 0.0);
+    for (int i = 0; i < n; i++){
+      for (int j = 0; j < n; j++) { W(i, j) = Ut(j, i); }
+    }
+    for (int i = n; i < Q.ncols(); i++) { W(i, i) = 1.0; }
+    Matrix left = Q*W;
+    Matrix right = explicitq(qv)*Vt.transpose();
+    if (trans) {
+      *U = right; *V = left;
+    } else {
+      *U = left; *V = right;
+    }
+  }
+  return rval;
+}
+
+bool svd(const Matrix& A, Vector& s, double PRECISION)
+{
+  return svdcore(A, s, NULL, NULL, false, PRECISION);
+}
+
+bool svd(const Matrix& A, Vector& s, Matrix& U, Matrix& V, bool full, double PRECISION)
+{
+  return svdcore(A, s, &U, &V, full, PRECISION);
+}
@@ -8,6 +8,11 @@
  *    20/08/15            Robert Shaw          Added Householder.
  *    21/08/15            Robert Shaw          LU and Cholesky.
  *    22/08/15            Robert Shaw          Hessenberg added.
+ *    19/10/26            Robert Shaw          In-place givens, Jacobi SVD.
+ *    19/10/26            Robert Shaw          Bidiagonalisation and SVD.
+ *    19/10/26            Robert Shaw          Shifted Hessenberg LU.
+ *    19/10/26            Robert Shaw          Banded LU and cholesky.
+ *    19/10/26            Robert Shaw          Packed cholesky and LDL(T).
  */
 
 #ifndef FACTORSHEADERDEF
@@ -17,6 +22,9 @@
 class Matrix;
 class Vector;
 class Error;
+class BandedMatrix;
+class SymmetricMatrix;
+class TriangularMatrix;
 
 // Declare the modified Gram-Schmidt procedure
 // which takes a set of vectors in a full-rank
@@ -38,7 +46,10 @@ void implicitqx(const Matrix& v, Vector& x);
 void implicitqtb(const Matrix& v, Vector& b);
 
 // Return the full Q matrix from the HH decomp
+// The second instance returns only the first ncols columns, which may be
+// more than v.ncols(), up to the full m x m orthogonal matrix.
 Matrix explicitq(const Matrix& v);
+Matrix explicitq(const Matrix& v, int ncols);
 
 // Get the LU decomposition of A by Gaussian Elimination with 
 // partial pivoting. This actually computes PA = LU, putting L, U
@@ -61,6 +72,39 @@ Matrix cholesky(const Matrix& A);
 // used implicitly later on. Returns true if successful.
 bool hessenberg(const Matrix& x, Matrix& y, Matrix& v); 
 
+// LU decomposition of the shifted upper Hessenberg matrix H - mu*I, with
+// partial pivoting, in O(n^2). Only adjacent rows are ever interchanged, so
+// L has a single subdiagonal, stored below the diagonal of U in B. Returns
+// a vector p with p(k) = 1 if rows k and k+1 were interchanged at step k.
+// Zero pivots are replaced by a tiny multiple of the norm of H, as is
+// needed when mu is (almost) an exact eigenvalue in inverse iteration.
+Vector dhslu(const Matrix& H, double mu, Matrix& B);
+
+// LU decomposition of a banded matrix A, with kl subdiagonals and ku
+// superdiagonals, by Gaussian elimination with partial pivoting in
+// O(n*kl*(kl+ku)). Interchanges can add kl superdiagonals to U, so B has
+// kl subdiagonals, holding the multipliers of L, and kl+ku superdiagonals,
+// holding U. As the interchanges are only applied to later columns, p(k) is
+// the row that was swapped with row k at step k, and must be applied in
+// turn during forward substitution, rather than all at once as for dgelu.
+Vector dgblu(const BandedMatrix& A, BandedMatrix& B);
+
+// Cholesky factorisation A = R(T)R of the symmetric positive definite
+// banded matrix A, where R is upper triangular with the same no. of
+// superdiagonals as A. Only the upper triangle of A is read.
+BandedMatrix bandedcholesky(const BandedMatrix& A);
+
+// Cholesky factorisation A = R(T)R of the symmetric positive definite
+// matrix A in packed storage, returning the packed upper triangular R.
+// Throws an error if A is not positive definite.
+TriangularMatrix cholesky(const SymmetricMatrix& A);
+
+// Factorise the symmetric matrix A = LDL(T), with L unit lower triangular
+// and D diagonal, returned in d. Unlike cholesky, A need not be positive
+// definite, but there is no pivoting, so an error is thrown if a pivot is
+// zero, and the factorisation may be unstable if A is indefinite.
+TriangularMatrix ldlt(const SymmetricMatrix& A, Vector& d);
+
 // Procedures for computing and applying givens rotations:
 // givens(a, b) will take scalars a, b and compute c = cos(t)
 // and s=sin(t), returning them in the 2-vector [c, s].
@@ -76,4 +120,46 @@ Matrix lgivens(const Vector& G, const Matrix& A, int i, int k);
 // given matrix positions i and k, and dimension dim
 Matrix explicitg(const Vector& g, int i, int k, int dim);
 
+// In-place versions of the above: igivens(G, A) overwrites rows i and k of
+// A with those of G(T)A, and igivens(A, G) overwrites columns i and k of A
+// with those of AG. The latter only touches rows start to end-1 (end < 0
+// meaning all rows), so that the work can be split between threads.
+void igivens(const Vector& G, Matrix& A, int i, int k);
+void igivens(Matrix& A, const Vector& G, int i, int k, int start = 0, int end = -1);
+
+// Round-robin (tournament) ordering of the index pairs of an n x n matrix,
+// such that each round consists of disjoint pairs, and all n(n-1)/2 pairs
+// are covered in roundrobin(n, 0, NULL) rounds. For a given round, the pairs are
+// written to pairs[2*i], pairs[2*i+1], and their number is returned.
+int roundrobin(int n, int round, int* pairs);
+
+// One-sided (Hestenes) Jacobi singular value decomposition A = U S V(T),
+// where A is m x n. The rotations within each round act on disjoint column
+// pairs, and are applied in parallel. Returns the singular values in
+// descending order in s, with the thin U (m x min(m,n)) and V
+// (n x min(m,n)). Returns true if converged within MAXSWEEP sweeps.
+bool jacobisvd(const Matrix& A, Vector& s, Matrix& U, Matrix& V, double PRECISION = 1e-14, int MAXSWEEP = 60);
+
+// Reduce the m x n matrix x, m >= n, to upper bidiagonal form by
+// Householder reflections from either side, Q(T)xP = B. The diagonal of
+// B is returned in d, the superdiagonal in e, and the reflectors for Q
+// and P in u and v, such that Q = explicitq(u) and P = explicitq(v).
+// Returns false if m < n.
+bool bidiag(const Matrix& x, Vector& d, Vector& e, Matrix& u, Matrix& v);
+
+// Diagonalise the upper bidiagonal matrix (d, e) by implicitly shifted QR,
+// leaving the (unsorted, signed) singular values in d. The left and right
+// rotations are applied to the rows of Ut and Vt, unless they are NULL.
+// Gives up after MAXITER iterations per value. Returns true if successful.
+bool bidiagqr(Vector& d, Vector& e, Matrix* Ut, Matrix* Vt, double PRECISION = 1e-15, int MAXITER = 75);
+
+// Compute the singular value decomposition A = U S V(T) of the m x n
+// matrix A by bidiagonalisation and bidiagonal QR. The singular values are
+// returned in descending order in s. The first instance only computes the
+// values. The second also gives the vectors, thin (U is m x k, V is n x k,
+// with k = min(m, n)) by default, or full (U is m x m, V is n x n).
+// Returns true if successful.
+bool svd(const Matrix& A, Vector& s, double PRECISION = 1e-15);
+bool svd(const Matrix& A, Vector& s, Matrix& U, Matrix& V, bool full = false, double PRECISION = 1e-15);
+
 #endif
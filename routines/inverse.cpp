@@ -0,0 +1,274 @@
+// Implements inverse.hpp
+
+#include "inverse.hpp"
+#include "factors.hpp"
+#include "matrix.hpp"
+#include "vector.hpp"
+#include "error.hpp"
+#include "profile.hpp"
+#include "tuning.hpp"
+#include <cmath>
+
+// Columns per thread within a block. The block size and the order above
+// which the inverses are threaded are tuning().invblock and invparallel.
+static const int INVCHUNK = 256;
+
+// Determinants
+
+// Multiply the mantissa m, exponent e by d, keeping 0.5 <= |m| < 1
+static void detmultiply(double& m, long& e, double d)
+{
+  int de;
+  m = frexp(m*d, &de);
+  e += de;
+}
+
+// Sign of the permutation from dgelu, one interchange per p(k) != k
+static int pivotsign(const Vector& p)
+{
+  int sign = 1;
+  for (int k = 0; k < p.size(); k++) { sign = ((int)p(k) != k ? -sign : sign); }
+  return sign;
+}
+
+double ludet(const Matrix& B, const Vector& p)
+{
+  double m = pivotsign(p);
+  long e = 0;
+  for (int i = 0; i < B.nrows(); i++){
+    // Elements after a zero pivot are not meaningful
+    if (B(i, i) == 0.0) { return 0.0; }
+    detmultiply(m, e, B(i, i));
+  }
+  // Saturates to +-inf or 0 only if the determinant does
+  return ldexp(m, e > 4096 ? 4096 : (e < -4096 ? -4096 : (int)e));
+}
+
+double choleskydet(const Matrix& R)
+{
+  double m = 1.0;
+  long e = 0;
+  for (int i = 0; i < R.nrows(); i++){
+    detmultiply(m, e, R(i, i));
+    detmultiply(m, e, R(i, i));
+  }
+  return ldexp(m, e > 4096 ? 4096 : (e < -4096 ? -4096 : (int)e));
+}
+
+double det(const Matrix& A)
+{
+  if (!A.isSquare()) {
+    throw( Error("DET", "Matrix is not square.") );
+  }
+  if (A.nrows() == 0) { return 1.0; }
+  Matrix B;
+  Vector p = dgelu(A, B);
+  return ludet(B, p);
+}
+
+double lulogdet(const Matrix& B, const Vector& p, int& sign)
+{
+  double rval = 0.0;
+  sign = pivotsign(p);
+  for (int i = 0; i < B.nrows(); i++){
+    double d = B(i, i);
+    if (d == 0.0) {
+      sign = 0;
+      return -INFINITY;
+    }
+    sign = (d < 0.0 ? -sign : sign);
+    rval += log(fabs(d));
+  }
+  return rval;
+}
+
+double choleskylogdet(const Matrix& R)
+{
+  double rval = 0.0;
+  for (int i = 0; i < R.nrows(); i++) { rval += 2.0*log(fabs(R(i, i))); }
+  return rval;
+}
+
+double logdet(const Matrix& A, int& sign)
+{
+  if (!A.isSquare()) {
+    throw( Error("DET", "Matrix is not square.") );
+  }
+  sign = 1;
+  if (A.nrows() == 0) { return 0.0; }
+  Matrix B;
+  Vector p = dgelu(A, B);
+  return lulogdet(B, p, sign);
+}
+
+// Inverses
+
+// Overwrite the upper triangle of U with that of U^-1, reading nothing
+// below the diagonal. Rows are finished from the bottom up, nb at a
+// time: first the contributions of the rows already finished, in
+// parallel by chunks of columns, then those within the block. work holds
+// nb rows of length n.
+static void upperinverse(Matrix& U, double* work, int nb)
+{
+  int n = U.nrows();
+  int threshold = tuning().invparallel;
+  for (int i1 = n; i1 > 0; i1 -= nb){
+    int i0 = (i1 - nb > 0 ? i1 - nb : 0);
+    // w_i[j] = sum over k = i1 to j of U(i, k) X(k, j), for j >= i1
+#pragma omp parallel for schedule(dynamic) if (n > threshold)
+    for (int c0 = i1; c0 < n; c0 += INVCHUNK){
+      int c1 = (c0 + INVCHUNK < n ? c0 + INVCHUNK : n);
+      for (int i = i0; i < i1; i++){
+	double* w = work + (long)(i-i0)*n;
+	for (int j = c0; j < c1; j++) { w[j] = 0.0; }
+      }
+      for (int k = i1; k < c1; k++){
+	const double* xk = &U[k];
+	int jstart = (k > c0 ? k : c0);
+	for (int i = i0; i < i1; i++){
+	  double* w = work + (long)(i-i0)*n;
+	  double uik = U(i, k);
+#pragma omp simd
+	  for (int j = jstart; j < c1; j++){
+	    w[j] += uik*xk[j];
+	  }
+	}
+      }
+    }
+    // Then the rows of the block, each using those below it
+    for (int i = i1-1; i >= i0; i--){
+      double* w = work + (long)(i-i0)*n;
+      double* ui = &U[i];
+      for (int j = i+1; j < i1; j++) { w[j] = 0.0; }
+      for (int k = i+1; k < i1; k++){
+	const double* xk = &U[k];
+	double uik = ui[k];
+#pragma omp simd
+	for (int j = k; j < n; j++){
+	  w[j] += uik*xk[j];
+	}
+      }
+      double d = 1.0/ui[i];
+      ui[i] = d;
+      for (int j = i+1; j < n; j++) { ui[j] = -d*w[j]; }
+    }
+  }
+}
+
+// Throws if a diagonal element of the factor F is zero
+static void invcheck(const Matrix& F)
+{
+  if (!F.isSquare()) {
+    throw( Error("INVERSE", "Factors are not square.") );
+  }
+  for (int i = 0; i < F.nrows(); i++){
+    if (F(i, i) == 0.0) {
+      throw( Error("INVERSE", "Matrix is singular.") );
+    }
+  }
+}
+
+// As dgetri: A^-1 = U^-1 L^-1 P, so U is inverted in place, then
+// X = U^-1 L^-1 is found by solving XL = U^-1 a block of columns at a
+// time from the right, and finally the columns are interchanged
+void luinverse(Matrix& B, const Vector& p)
+{
+  invcheck(B);
+  int n = B.nrows();
+  PROFILE("luinverse", 4.0*n*n*(double)n/3.0);
+  int nb = tuning().invblock;
+  int threshold = tuning().invparallel;
+  double* work = new double[(long)nb*n + 1];
+  upperinverse(B, work, nb);
+  for (int j1 = n; j1 > 0; j1 -= nb){
+    int j0 = (j1 - nb > 0 ? j1 - nb : 0);
+    // Save the columns of L in the block, as rows of work
+    for (int j = j0; j < j1; j++){
+      double* w = work + (long)(j-j0)*n;
+      for (int k = j+1; k < n; k++) { w[k] = B(k, j); }
+    }
+    // Each row of X is independent. Columns to the right of the block are
+    // finished, and within it they are found from the right.
+#pragma omp parallel for schedule(static) if (n > threshold)
+    for (int i = 0; i < n; i++){
+      double* bi = &B[i];
+      for (int j = j1-1; j >= j0; j--){
+	const double* w = work + (long)(j-j0)*n;
+	double sum = (i <= j ? bi[j] : 0.0); // U^-1 has nothing below the diagonal
+#pragma omp simd reduction(+:sum)
+	for (int k = j+1; k < n; k++){
+	  sum -= bi[k]*w[k];
+	}
+	bi[j] = sum;
+      }
+    }
+  }
+  delete[] work;
+  // Undo the interchanges, in reverse
+  for (int k = p.size()-1; k >= 0; k--){
+    if ((int)p(k) != k) { B.swapCols(k, (int)p(k)); }
+  }
+}
+
+// As dpotri: A^-1 = R^-1 R^-T, so R is inverted in place, then the
+// product formed in place from the top down, a block of rows at a time
+void choleskyinverse(Matrix& R)
+{
+  invcheck(R);
+  int n = R.nrows();
+  PROFILE("choleskyinverse", 2.0*n*n*(double)n/3.0);
+  int nb = tuning().invblock;
+  int threshold = tuning().invparallel;
+  double* work = new double[(long)nb*n + 1];
+  upperinverse(R, work, nb);
+  for (int i0 = 0; i0 < n; i0 += nb){
+    int i1 = (i0 + nb < n ? i0 + nb : n);
+    // Copy the rows of the block, which are overwritten
+    for (int i = i0; i < i1; i++){
+      double* w = work + (long)(i-i0)*n;
+      const double* ri = &R[i];
+      for (int k = i; k < n; k++) { w[k] = ri[k]; }
+    }
+    // (R^-1 R^-T)(i, j) = sum over k >= j of X(i, k) X(j, k), for j >= i
+#pragma omp parallel for schedule(dynamic, 16) if (n > threshold)
+    for (int j = i0; j < n; j++){
+      const double* xj = (j < i1 ? work + (long)(j-i0)*n : &R[j]);
+      int iend = (j < i1 ? j+1 : i1);
+      for (int i = i0; i < iend; i++){
+	const double* w = work + (long)(i-i0)*n;
+	double sum = 0.0;
+#pragma omp simd reduction(+:sum)
+	for (int k = j; k < n; k++){
+	  sum += w[k]*xj[k];
+	}
+	R(i, j) = sum;
+      }
+    }
+  }
+  delete[] work;
+  // Fill in the lower triangle
+  for (int i = 1; i < n; i++){
+    for (int j = 0; j < i; j++) { R(i, j) = R(j, i); }
+  }
+}
+
+Matrix inverse(const Matrix& A)
+{
+  if (!A.isSquare()) {
+    throw( Error("INVERSE", "Matrix is not square.") );
+  }
+  Matrix B;
+  Vector p = dgelu(A, B);
+  luinverse(B, p);
+  return B;
+}
+
+Matrix spdinverse(const Matrix& A)
+{
+  if (!A.isSquare()) {
+    throw( Error("INVERSE", "Matrix is not square.") );
+  }
+  Matrix R = cholesky(A);
+  choleskyinverse(R);
+  return R;
+}
@@ -0,0 +1,53 @@
+/*
+ *   Purpose: To compute determinants and inverses from the LU factors of
+ *            dgelu and the cholesky factor R, rather than by solving with
+ *            each column of the identity.
+ *
+ *            Determinants are accumulated as a mantissa and a binary
+ *            exponent, so they only overflow (to +-inf) or underflow (to
+ *            zero) if the determinant itself does; the log-determinants
+ *            never do, returning the sign separately.
+ *
+ *            The inverses overwrite the factors, working a block of rows
+ *            or columns at a time (tuning().invblock, see tuning.hpp) so
+ *            that the bulk of the work is done on data in cache, and in
+ *            parallel, with only a block-sized workspace. Inverting from the LU factors takes
+ *            4n^3/3 flops, and from the cholesky factor 2n^3/3.
+ *
+ *   DATE             AUTHOR            CHANGES
+ *   ===============================================================
+ *   19/10/26         Robert Shaw       Original code.
+ *   19/10/26         Robert Shaw       Block size and threshold tuned.
+ */
+
+#ifndef INVERSEHEADERDEF
+#define INVERSEHEADERDEF
+
+// Declare forward dependencies
+class Matrix;
+class Vector;
+
+// The determinant of A from its LU factors B and pivots p, from its
+// cholesky factor R, or by forming its LU factors
+double ludet(const Matrix& B, const Vector& p);
+double choleskydet(const Matrix& R);
+double det(const Matrix& A);
+
+// log|det(A)|, similarly, setting sign to the sign of det(A) (-1, 0 or
+// 1, when the log is -inf). For the cholesky factor the sign is 1.
+double lulogdet(const Matrix& B, const Vector& p, int& sign);
+double choleskylogdet(const Matrix& R);
+double logdet(const Matrix& A, int& sign);
+
+// Overwrite the LU factors B (with pivots p) of A with A^-1, or the upper
+// triangular cholesky factor R of the symmetric positive definite A with
+// A^-1 (in full, not just a triangle). The lower triangle of R is not
+// read. Throws an error, leaving the factors unchanged, if A is singular.
+void luinverse(Matrix& B, const Vector& p);
+void choleskyinverse(Matrix& R);
+
+// Return A^-1, by the above, for general or symmetric positive definite A
+Matrix inverse(const Matrix& A);
+Matrix spdinverse(const Matrix& A);
+
+#endif
@@ -0,0 +1,482 @@
+// Implements iterative.hpp
+
+#include "iterative.hpp"
+#include "factors.hpp"
+#include "vector.hpp"
+#include "matrix.hpp"
+#include "sparse.hpp"
+#include "error.hpp"
+#include "profile.hpp"
+#include <cmath>
+
+// Size above which dense operator products are threaded
+static const int DENSEPARALLEL = 200;
+
+// Linear operators
+
+void LinearOperator::applyT(const Vector& x, Vector& y) const
+{
+  throw( Error("APPLYT", "Operator has no transpose defined.") );
+}
+
+
+DenseOperator::DenseOperator(const Matrix& mat) : A(mat)
+{
+  if (!A.isSquare()) {
+    throw( Error("DENSEOP", "Linear operators must be square.") );
+  }
+}
+
+
+int DenseOperator::size() const
+{
+  return A.nrows();
+}
+
+
+void DenseOperator::apply(const Vector& x, Vector& y) const
+{
+  int n = A.nrows();
+  if (x.size() != n || y.size() != n) {
+    throw( Error("APPLY", "Vectors are the wrong size for the operator.") );
+  }
+  PROFILEFLOPS(2.0*n*n);
+  const double* xv = x.data();
+  double* yv = y.data();
+#pragma omp parallel for if (n > DENSEPARALLEL)
+  for (int i = 0; i < n; i++){
+    const double* row = &A[i];
+    double sum = 0.0;
+#pragma omp simd reduction(+:sum)
+    for (int j = 0; j < n; j++){
+      sum += row[j]*xv[j];
+    }
+    yv[i] = sum;
+  }
+}
+
+
+void DenseOperator::applyT(const Vector& x, Vector& y) const
+{
+  int n = A.nrows();
+  if (x.size() != n || y.size() != n) {
+    throw( Error("APPLY", "Vectors are the wrong size for the operator.") );
+  }
+  PROFILEFLOPS(2.0*n*n);
+  const double* xv = x.data();
+  double* yv = y.data();
+  for (int j = 0; j < n; j++){
+    yv[j] = 0.0;
+  }
+  // Accumulate a row at a time, so that A is traversed contiguously
+  for (int i = 0; i < n; i++){
+    const double* row = &A[i];
+    double xi = xv[i];
+#pragma omp simd
+    for (int j = 0; j < n; j++){
+      yv[j] += xi*row[j];
+    }
+  }
+}
+
+
+SparseOperator::SparseOperator(const SparseMatrix& mat) : A(mat)
+{
+  if (!A.isSquare()) {
+    throw( Error("SPARSEOP", "Linear operators must be square.") );
+  }
+}
+
+
+int SparseOperator::size() const
+{
+  return A.nrows();
+}
+
+
+void SparseOperator::apply(const Vector& x, Vector& y) const
+{
+  PROFILEFLOPS(2.0*A.nonzeros());
+  A.multiply(x, y);
+}
+
+
+void SparseOperator::applyT(const Vector& x, Vector& y) const
+{
+  PROFILEFLOPS(2.0*A.nonzeros());
+  A.multiply(x, y, true);
+}
+
+
+CallbackOperator::CallbackOperator(int dim, void (*func)(const Vector&, Vector&, void*), void* d,
+				   void (*funcT)(const Vector&, Vector&, void*))
+  : n(dim), f(func), ft(funcT), data(d)
+{
+  if (f == NULL) {
+    throw( Error("CALLBACKOP", "No function given for operator.") );
+  }
+}
+
+
+void CallbackOperator::apply(const Vector& x, Vector& y) const
+{
+  f(x, y, data);
+}
+
+
+void CallbackOperator::applyT(const Vector& x, Vector& y) const
+{
+  if (ft == NULL) {
+    throw( Error("APPLYT", "Operator has no transpose defined.") );
+  }
+  ft(x, y, data);
+}
+
+// Iterative solvers. Their regions count the vector operations as they
+// go, and the operators and preconditioners add their own products (those
+// given by callbacks are not counted).
+
+// Record the residual norm rnorm for the current iteration
+static void record(IterControl& ctl, double rnorm)
+{
+  ctl.resid = rnorm;
+  if (ctl.history) {
+    ctl.residuals[ctl.iters] = rnorm;
+  }
+}
+
+
+bool pcg(const LinearOperator& A, const Vector& b, Vector& x, IterControl& ctl,
+	 const LinearOperator* M)
+{
+  int n = A.size();
+  PROFILE("pcg", 4.0*n);
+  if (b.size() != n || (M != NULL && M->size() != n)) {
+    throw( Error("PCG", "Operator, preconditioner and rhs are different sizes.") );
+  }
+  if (x.size() != n) {
+    x.assign(n, 0.0);
+  }
+  ctl.iters = 0;
+  ctl.converged = false;
+  ctl.residuals.resize(ctl.history ? ctl.maxiter+1 : 0);
+
+  // All work vectors are allocated up front, so that iterations never allocate
+  Vector r(n), z(n), p(n), q(n);
+  double bnorm = sqrt(inner(b, b));
+  double tol = ctl.rtol*bnorm;
+  tol = (ctl.atol > tol ? ctl.atol : tol);
+  if (bnorm == 0.0) { // The solution is trivially zero
+    x.assign(n, 0.0);
+  }
+  A.apply(x, q);
+  for (int i = 0; i < n; i++){
+    r[i] = b(i) - q(i);
+  }
+  double rr = inner(r, r);
+  record(ctl, sqrt(rr));
+  ctl.converged = (sqrt(rr) <= tol);
+
+  double rz = 0.0;
+  if (!ctl.converged) {
+    // z = M^-1 r, and the first search direction is p = z
+    if (M != NULL) { M->apply(r, z); }
+    else { z = r; }
+    p = z;
+    rz = inner(r, z);
+  }
+
+  while (!ctl.converged && ctl.iters < ctl.maxiter) {
+    A.apply(p, q);
+    double pq = inner(p, q);
+    if (pq <= 0.0) { // A is not positive definite, so CG breaks down
+      break;
+    }
+    double alpha = rz/pq;
+    axpy(alpha, p, x);
+    rr = axpynorm(-alpha, q, r);
+    PROFILEFLOPS(13.0*n); // Two inner products, three updates
+    ctl.iters++;
+    record(ctl, sqrt(rr));
+    ctl.converged = (sqrt(rr) <= tol);
+    if (!ctl.converged) {
+      // New direction, conjugate to the previous ones
+      double rznew;
+      if (M != NULL) {
+	M->apply(r, z);
+	rznew = inner(r, z);
+	axpby(1.0, z, rznew/rz, p);
+      } else {
+	rznew = rr;
+	axpby(1.0, r, rznew/rz, p);
+      }
+      rz = rznew;
+    }
+  }
+  if (ctl.history) {
+    ctl.residuals.resizeCopy(ctl.iters+1);
+  }
+  return ctl.converged;
+}
+
+
+// Form y = A~x for the preconditioned operator A~, which is AM^-1 (right),
+// M^-1 A (left) or just A if there is no preconditioner. For right
+// preconditioning, z is left holding M^-1 x, otherwise z is scratch space.
+static void precapply(const LinearOperator& A, const LinearOperator* M, bool right,
+		      const Vector& x, Vector& y, Vector& z)
+{
+  if (M == NULL) {
+    A.apply(x, y);
+  } else if (right) {
+    M->apply(x, z);
+    A.apply(z, y);
+  } else {
+    A.apply(x, z);
+    M->apply(z, y);
+  }
+}
+
+// Form the (left preconditioned, if so) residual r = b - Ax, returning |r|
+static double presidual(const LinearOperator& A, const LinearOperator* M, bool right,
+			const Vector& b, const Vector& x, Vector& r, Vector& z)
+{
+  int n = b.size();
+  A.apply(x, z);
+  for (int i = 0; i < n; i++){
+    z[i] = b(i) - z(i);
+  }
+  if (M != NULL && !right) { M->apply(z, r); }
+  else { r = z; }
+  return sqrt(inner(r, r));
+}
+
+// Set up x, ctl and the convergence tolerance for gmres and bicgstab
+static double presetup(const LinearOperator& A, const Vector& b, Vector& x, IterControl& ctl,
+		       const LinearOperator* M, bool right, Vector& z)
+{
+  int n = A.size();
+  if (b.size() != n || (M != NULL && M->size() != n)) {
+    throw( Error("ITERSOLVE", "Operator, preconditioner and rhs are different sizes.") );
+  }
+  if (x.size() != n) {
+    x.assign(n, 0.0);
+  }
+  ctl.iters = 0;
+  ctl.converged = false;
+  ctl.residuals.resize(ctl.history ? ctl.maxiter+1 : 0);
+  // Tolerance is relative to the (preconditioned) rhs
+  double bnorm;
+  if (M != NULL && !right) {
+    M->apply(b, z);
+    bnorm = sqrt(inner(z, z));
+  } else {
+    bnorm = sqrt(inner(b, b));
+  }
+  if (bnorm == 0.0) { // The solution is trivially zero
+    x.assign(n, 0.0);
+  }
+  double tol = ctl.rtol*bnorm;
+  return (ctl.atol > tol ? ctl.atol : tol);
+}
+
+
+bool gmres(const LinearOperator& A, const Vector& b, Vector& x, IterControl& ctl,
+	   int m, const LinearOperator* M, bool right)
+{
+  int n = A.size();
+  PROFILE("gmres", 0.0);
+  if (m < 1) {
+    throw( Error("GMRES", "Restart length must be positive.") );
+  }
+  m = (m > n ? n : m);
+  Vector r(n), w(n), z(n);
+  double tol = presetup(A, b, x, ctl, M, right, z);
+
+  // Krylov basis, Hessenberg matrix, rotations and least squares rhs
+  Vector* V = new Vector[m+1];
+  for (int i = 0; i <= m; i++){
+    V[i].resize(n);
+  }
+  Matrix H(m+1, m);
+  Vector cs(m), sn(m), g(m+1), y(m), h(m+1);
+
+  double beta = presidual(A, M, right, b, x, r, z);
+  record(ctl, beta);
+  ctl.converged = (beta <= tol);
+  while (!ctl.converged && ctl.iters < ctl.maxiter) {
+    // Start a new cycle from the current residual
+    for (int i = 0; i < n; i++){
+      V[0][i] = r(i)/beta;
+    }
+    g.assign(m+1, 0.0);
+    g[0] = beta;
+    int k = 0; // Number of basis vectors added this cycle
+    bool breakdown = false;
+    while (k < m && !ctl.converged && !breakdown && ctl.iters < ctl.maxiter) {
+      int j = k;
+      precapply(A, M, right, V[j], w, z);
+      // Orthogonalise against the basis by CGS2: two passes of classical
+      // Gram-Schmidt, whose inner products are independent of each other
+      for (int i = 0; i <= j; i++){
+	H(i, j) = 0.0;
+      }
+      for (int pass = 0; pass < 2; pass++){
+	for (int i = 0; i <= j; i++){
+	  h[i] = inner(V[i], w);
+	}
+	for (int i = 0; i <= j; i++){
+	  axpy(-h(i), V[i], w);
+	  H(i, j) += h(i);
+	}
+      }
+      double hnorm = sqrt(inner(w, w));
+      PROFILEFLOPS(8.0*n*(j+1) + 3.0*n); // CGS2, then normalising
+      H(j+1, j) = hnorm;
+      if (hnorm > 0.0) {
+	for (int i = 0; i < n; i++){
+	  V[j+1][i] = w(i)/hnorm;
+	}
+      } else { // The Krylov space is invariant, so the solution lies in it
+	breakdown = true;
+      }
+
+      // Apply the previous rotations to the new column, then eliminate
+      // the subdiagonal with a new one
+      for (int i = 0; i < j; i++){
+	double hi = H(i, j), hk = H(i+1, j);
+	H(i, j) = cs(i)*hi - sn(i)*hk;
+	H(i+1, j) = sn(i)*hi + cs(i)*hk;
+      }
+      Vector G = givens(H(j, j), H(j+1, j), 0.0);
+      cs[j] = G(0); sn[j] = G(1);
+      H(j, j) = cs(j)*H(j, j) - sn(j)*H(j+1, j);
+      H(j+1, j) = 0.0;
+      g[j+1] = sn(j)*g(j);
+      g[j] = cs(j)*g(j);
+
+      k++;
+      ctl.iters++;
+      record(ctl, fabs(g(j+1)));
+      ctl.converged = (fabs(g(j+1)) <= tol);
+    }
+
+    // Solve the triangular least squares system Hy = g, and update x
+    for (int i = k-1; i >= 0; i--){
+      double sum = g(i);
+      for (int l = i+1; l < k; l++){
+	sum -= H(i, l)*y(l);
+      }
+      y[i] = (H(i, i) != 0.0 ? sum/H(i, i) : 0.0);
+    }
+    w.assign(n, 0.0);
+    for (int i = 0; i < k; i++){
+      axpy(y(i), V[i], w);
+    }
+    PROFILEFLOPS(2.0*n*k);
+    if (M != NULL && right) {
+      M->apply(w, z);
+      axpy(1.0, z, x);
+    } else {
+      axpy(1.0, w, x);
+    }
+
+    // Restart from the true residual, which may differ from the estimate
+    beta = presidual(A, M, right, b, x, r, z);
+    ctl.resid = beta;
+    ctl.converged = (beta <= tol);
+    if (breakdown && !ctl.converged) {
+      break;
+    }
+  }
+  delete[] V;
+  if (ctl.history) {
+    ctl.residuals.resizeCopy(ctl.iters+1);
+  }
+  return ctl.converged;
+}
+
+
+bool bicgstab(const LinearOperator& A, const Vector& b, Vector& x, IterControl& ctl,
+	      const LinearOperator* M, bool right)
+{
+  int n = A.size();
+  PROFILE("bicgstab", 0.0);
+  Vector r(n), rhat(n), p(n, 0.0), v(n, 0.0), s(n), t(n), z(n), phat(n);
+  double tol = presetup(A, b, x, ctl, M, right, z);
+
+  double rr = presidual(A, M, right, b, x, r, z);
+  record(ctl, rr);
+  ctl.converged = (rr <= tol);
+  rhat = r; // Shadow residual
+  double rho = 1.0, alpha = 1.0, omega = 1.0;
+  while (!ctl.converged && ctl.iters < ctl.maxiter) {
+    double rhonew = inner(rhat, r);
+    if (rhonew == 0.0) { // Breakdown - the shadow residual is orthogonal to r
+      break;
+    }
+    double beta = (rhonew/rho)*(alpha/omega);
+    rho = rhonew;
+    // p = r + beta(p - omega v)
+    axpy(-omega, v, p);
+    axpby(1.0, r, beta, p);
+    precapply(A, M, right, p, v, phat);
+    double rv = inner(rhat, v);
+    if (rv == 0.0) {
+      break;
+    }
+    alpha = rho/rv;
+    // Half step, with s overwriting r
+    double ss = sqrt(axpynorm(-alpha, v, r));
+    axpy(alpha, (M != NULL && right ? phat : p), x);
+    PROFILEFLOPS(15.0*n); // Two inner products, four updates
+    ctl.iters++;
+    if (ss <= tol) {
+      record(ctl, ss);
+      ctl.converged = true;
+      break;
+    }
+    // Stabilising step
+    precapply(A, M, right, r, t, s);
+    double tt = inner(t, t);
+    omega = (tt > 0.0 ? inner(t, r)/tt : 0.0);
+    axpy(omega, (M != NULL && right ? s : r), x);
+    rr = sqrt(axpynorm(-omega, t, r));
+    PROFILEFLOPS(10.0*n);
+    record(ctl, rr);
+    ctl.converged = (rr <= tol);
+    if (omega == 0.0) {
+      break;
+    }
+  }
+  if (ctl.history) {
+    ctl.residuals.resizeCopy(ctl.iters+1);
+  }
+  return ctl.converged;
+}
+
+
+Vector cgsolve(const Matrix& A, const Vector& b, double PRECISION, int MAXITER)
+{
+  DenseOperator op(A);
+  IterControl ctl(PRECISION, MAXITER);
+  Vector x;
+  pcg(op, b, x, ctl);
+  if (!ctl.converged) {
+    throw( Error("CGSOLVE", "Conjugate gradient failed to converge.") );
+  }
+  return x;
+}
+
+
+Vector cgsolve(const SparseMatrix& A, const Vector& b, double PRECISION, int MAXITER)
+{
+  SparseOperator op(A);
+  IterControl ctl(PRECISION, MAXITER);
+  Vector x;
+  pcg(op, b, x, ctl);
+  if (!ctl.converged) {
+    throw( Error("CGSOLVE", "Conjugate gradient failed to converge.") );
+  }
+  return x;
+}
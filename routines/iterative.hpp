@@ -0,0 +1,121 @@
+/*
+ *   Purpose: To define an abstract linear operator, so that iterative
+ *            solvers only need to know how to form Ax, and the iterative
+ *            solvers themselves, for large (sparse) systems Ax = b.
+ *
+ *   DATE             AUTHOR            CHANGES
+ *   ===============================================================
+ *   19/10/26         Robert Shaw       Original code, conjugate gradient.
+ *   19/10/26         Robert Shaw       GMRES and BiCGSTAB.
+ */
+
+#ifndef ITERATIVEHEADERDEF
+#define ITERATIVEHEADERDEF
+
+#include "vector.hpp"
+
+// Declare forward dependencies
+class Matrix;
+class SparseMatrix;
+
+// A square linear operator A, defined only by its action y = Ax
+class LinearOperator
+{
+public:
+  virtual ~LinearOperator() {}
+  virtual int size() const = 0; // The dimension n of the (n x n) operator
+  // Form y = Ax, where y is already of size n
+  virtual void apply(const Vector& x, Vector& y) const = 0;
+  // Form y = A(T)x - by default, throws an error, as not all operators can
+  virtual void applyT(const Vector& x, Vector& y) const;
+};
+
+// Wrappers for dense and sparse matrices. These only keep a reference,
+// so the matrix must outlive the operator.
+class DenseOperator : public LinearOperator
+{
+private:
+  const Matrix& A;
+public:
+  DenseOperator(const Matrix& mat);
+  int size() const;
+  void apply(const Vector& x, Vector& y) const;
+  void applyT(const Vector& x, Vector& y) const;
+};
+
+class SparseOperator : public LinearOperator
+{
+private:
+  const SparseMatrix& A;
+public:
+  SparseOperator(const SparseMatrix& mat);
+  int size() const;
+  void apply(const Vector& x, Vector& y) const;
+  void applyT(const Vector& x, Vector& y) const;
+};
+
+// A matrix-free operator, given by a function f(x, y, data) that forms
+// y = Ax, where data is passed through untouched. The transpose function
+// is optional.
+class CallbackOperator : public LinearOperator
+{
+private:
+  int n;
+  void (*f)(const Vector& x, Vector& y, void* data);
+  void (*ft)(const Vector& x, Vector& y, void* data);
+  void* data;
+public:
+  CallbackOperator(int dim, void (*func)(const Vector&, Vector&, void*), void* d = NULL,
+		   void (*funcT)(const Vector&, Vector&, void*) = NULL);
+  int size() const { return n; }
+  void apply(const Vector& x, Vector& y) const;
+  void applyT(const Vector& x, Vector& y) const;
+};
+
+// Stopping criteria for the iterative solvers, and a report of how
+// the solve went. The solve stops when |r| <= max(rtol*|b|, atol), where
+// r = b - Ax, or after maxiter iterations.
+struct IterControl
+{
+  // Input
+  double rtol; // Relative tolerance on the residual norm
+  double atol; // Absolute tolerance on the residual norm
+  int maxiter; // Maximum number of iterations
+  bool history; // Whether to record the residual norm at each iteration
+  // Output
+  int iters; // Number of iterations done
+  bool converged; // Whether the tolerance was reached
+  double resid; // Final residual norm
+  Vector residuals; // Residual norms, starting with the initial one, if history
+
+  IterControl(double r = 1e-10, int m = 1000, double a = 0.0, bool h = false)
+    : rtol(r), atol(a), maxiter(m), history(h), iters(0), converged(false), resid(0.0) {}
+};
+
+// Solve Ax = b for symmetric positive definite A by the (preconditioned)
+// conjugate gradient method. x is used as the initial guess if it is the
+// right size, and is set to zero otherwise. M, if given, applies the
+// inverse of the (SPD) preconditioner. Returns true if converged.
+bool pcg(const LinearOperator& A, const Vector& b, Vector& x, IterControl& ctl,
+	 const LinearOperator* M = NULL);
+
+// Solve Ax = b for general A by restarted GMRES(m), building each Krylov
+// basis with classical Gram-Schmidt applied twice (CGS2) and updating the
+// least squares problem with givens rotations. Each matrix-vector product
+// counts as one iteration. M, if given, applies the inverse of the
+// preconditioner - on the right (solving AM^-1 u = b, x = M^-1 u) if right
+// is true, otherwise on the left (M^-1 Ax = M^-1 b), in which case the
+// tolerances are on the preconditioned residual M^-1 r.
+bool gmres(const LinearOperator& A, const Vector& b, Vector& x, IterControl& ctl,
+	   int m = 30, const LinearOperator* M = NULL, bool right = true);
+
+// Solve Ax = b for general A by BiCGSTAB, with preconditioning as above.
+// Each iteration does two matrix-vector products.
+bool bicgstab(const LinearOperator& A, const Vector& b, Vector& x, IterControl& ctl,
+	      const LinearOperator* M = NULL, bool right = true);
+
+// Convenience versions for matrices, with no preconditioning
+Vector cgsolve(const Matrix& A, const Vector& b, double PRECISION = 1e-10, int MAXITER = 1000);
+Vector cgsolve(const SparseMatrix& A, const Vector& b, double PRECISION = 1e-10, int MAXITER = 1000);
+
+#endif
@@ -0,0 +1,637 @@
+// Implements precond.hpp
+
+#include "precond.hpp"
+#include "factors.hpp"
+#include "vector.hpp"
+#include "matrix.hpp"
+#include "sparse.hpp"
+#include "error.hpp"
+#include "profile.hpp"
+#include <cmath>
+
+// Number of rows (in a level, or in total) above which work is threaded
+static const int PRECPARALLEL = 2000;
+
+// Level schedules
+
+void TriSchedule::cleanUp()
+{
+  if (order != NULL) { delete[] order; }
+  if (levptr != NULL) { delete[] levptr; }
+  order = NULL; levptr = NULL;
+}
+
+
+TriSchedule::TriSchedule(const SparseMatrix& A, bool lo) : lower(lo)
+{
+  if (A.isCSC() || !A.isSquare()) {
+    throw( Error("TRISCHED", "Schedules need a square matrix stored by rows.") );
+  }
+  n = A.nrows();
+  const int* ptr = A.getPtr();
+  const int* idx = A.getIdx();
+  // The level of a row is one more than that of any row it depends on,
+  // which must be computed in the order of the solve
+  int* lev = new int[n > 0 ? n : 1];
+  nlev = 0;
+  for (int s = 0; s < n; s++){
+    int i = (lower ? s : n-1-s);
+    int l = 0;
+    if (ptr != NULL) {
+      for (int p = ptr[i]; p < ptr[i+1]; p++){
+	int j = idx[p];
+	if ((lower && j < i) || (!lower && j > i)) {
+	  l = (lev[j]+1 > l ? lev[j]+1 : l);
+	}
+      }
+    }
+    lev[i] = l;
+    nlev = (l+1 > nlev ? l+1 : nlev);
+  }
+  // Group rows by level, with a counting sort
+  order = new int[n > 0 ? n : 1];
+  levptr = new int[nlev+1];
+  for (int l = 0; l <= nlev; l++){
+    levptr[l] = 0;
+  }
+  for (int i = 0; i < n; i++){
+    levptr[lev[i]+1]++;
+  }
+  for (int l = 0; l < nlev; l++){
+    levptr[l+1] += levptr[l];
+  }
+  for (int i = 0; i < n; i++){
+    order[levptr[lev[i]]++] = i;
+  }
+  for (int l = nlev; l > 0; l--){
+    levptr[l] = levptr[l-1];
+  }
+  levptr[0] = 0;
+  delete[] lev;
+}
+
+
+TriSchedule::TriSchedule(const TriSchedule& other)
+  : n(0), nlev(0), lower(true), order(NULL), levptr(NULL)
+{
+  *this = other;
+}
+
+
+TriSchedule::~TriSchedule()
+{
+  cleanUp();
+}
+
+
+TriSchedule& TriSchedule::operator=(const TriSchedule& other)
+{
+  if (this != &other) {
+    cleanUp();
+    n = other.n;
+    nlev = other.nlev;
+    lower = other.lower;
+    if (other.order != NULL) {
+      order = new int[n > 0 ? n : 1];
+      levptr = new int[nlev+1];
+      for (int i = 0; i < n; i++){
+	order[i] = other.order[i];
+      }
+      for (int l = 0; l <= nlev; l++){
+	levptr[l] = other.levptr[l];
+      }
+    }
+  }
+  return *this;
+}
+
+
+void TriSchedule::solve(const SparseMatrix& A, const double* dinv, double* y) const
+{
+  const int* ptr = A.getPtr();
+  const int* idx = A.getIdx();
+  const double* val = A.getVal();
+  if (ptr == NULL) { // No off-diagonal entries
+    for (int i = 0; i < n; i++){
+      y[i] = (dinv == NULL ? y[i] : y[i]*dinv[i]);
+    }
+    return;
+  }
+  for (int l = 0; l < nlev; l++){
+    int start = levptr[l], end = levptr[l+1];
+#pragma omp parallel for if (end - start > PRECPARALLEL)
+    for (int s = start; s < end; s++){
+      int i = order[s];
+      double sum = y[i];
+      for (int p = ptr[i]; p < ptr[i+1]; p++){
+	int j = idx[p];
+	if ((lower && j < i) || (!lower && j > i)) {
+	  sum -= val[p]*y[j];
+	}
+      }
+      y[i] = (dinv == NULL ? sum : sum*dinv[i]);
+    }
+  }
+}
+
+// Position of the diagonal in each row of the CSR matrix A,
+// returning false if any are missing
+static bool diagonals(const SparseMatrix& A, int* dpos)
+{
+  int n = A.nrows();
+  const int* ptr = A.getPtr();
+  const int* idx = A.getIdx();
+  bool found = (ptr != NULL);
+  if (found) {
+#pragma omp parallel for reduction(&&:found) if (n > PRECPARALLEL)
+    for (int i = 0; i < n; i++){
+      dpos[i] = -1;
+      for (int p = ptr[i]; p < ptr[i+1]; p++){
+	if (idx[p] == i) { dpos[i] = p; }
+      }
+      found = found && (dpos[i] > -1);
+    }
+  }
+  return found;
+}
+
+// Jacobi
+
+JacobiPrecond::JacobiPrecond(const Matrix& A)
+{
+  PROFILE("jacobiprecond", A.nrows());
+  if (!A.isSquare()) {
+    throw( Error("JACOBIPC", "Matrix must be square.") );
+  }
+  int n = A.nrows();
+  dinv.resize(n);
+  for (int i = 0; i < n; i++){
+    dinv[i] = A(i, i);
+  }
+  for (int i = 0; i < n; i++){
+    if (dinv(i) == 0.0) {
+      throw( Error("JACOBIPC", "Zero on the diagonal.") );
+    }
+    dinv[i] = 1.0/dinv(i);
+  }
+}
+
+
+JacobiPrecond::JacobiPrecond(const SparseMatrix& A)
+{
+  PROFILE("jacobiprecond", A.nrows());
+  if (!A.isSquare()) {
+    throw( Error("JACOBIPC", "Matrix must be square.") );
+  }
+  dinv = A.diagonal();
+  int n = dinv.size();
+  for (int i = 0; i < n; i++){
+    if (dinv(i) == 0.0) {
+      throw( Error("JACOBIPC", "Zero on the diagonal.") );
+    }
+    dinv[i] = 1.0/dinv(i);
+  }
+}
+
+
+void JacobiPrecond::apply(const Vector& x, Vector& y) const
+{
+  int n = dinv.size();
+  if (x.size() != n || y.size() != n) {
+    throw( Error("PRECAPPLY", "Vectors are the wrong size for the preconditioner.") );
+  }
+  PROFILEFLOPS(n);
+  const double* xv = x.data();
+  const double* dv = dinv.data();
+  double* yv = y.data();
+#pragma omp parallel for simd if (n > PRECPARALLEL)
+  for (int i = 0; i < n; i++){
+    yv[i] = xv[i]*dv[i];
+  }
+}
+
+// Block Jacobi
+
+BlockJacobiPrecond::BlockJacobiPrecond(const Matrix& A, int blocksize, bool posdef)
+  : bs(blocksize), spd(posdef)
+{
+  if (!A.isSquare()) {
+    throw( Error("BJACOBIPC", "Matrix must be square.") );
+  }
+  factor(&A, NULL);
+}
+
+
+BlockJacobiPrecond::BlockJacobiPrecond(const SparseMatrix& A, int blocksize, bool posdef)
+  : bs(blocksize), spd(posdef)
+{
+  if (!A.isSquare()) {
+    throw( Error("BJACOBIPC", "Matrix must be square.") );
+  }
+  factor(NULL, &A);
+}
+
+// Factorise the diagonal blocks of whichever of A and S is given
+void BlockJacobiPrecond::factor(const Matrix* A, const SparseMatrix* S)
+{
+  int n = (A != NULL ? A->nrows() : S->nrows());
+  if (bs < 1) {
+    throw( Error("BJACOBIPC", "Block size must be positive.") );
+  }
+  bs = (bs > n ? n : bs);
+  PROFILE("blockjacobiprecond", (spd ? 1.0 : 2.0)*n*bs*(double)bs/3.0);
+  blocks.assign(n, bs, 0.0);
+  piv.assign(n, 0.0);
+  int nblocks = (n + bs - 1)/bs;
+  // Blocks are independent, so are factorised in parallel. Nothing may be
+  // thrown out of the parallel loop, so failures are combined and thrown
+  // after it.
+  bool ok = true;
+#pragma omp parallel for schedule(dynamic) reduction(&&:ok)
+  for (int b = 0; b < nblocks; b++){
+    int start = b*bs;
+    int nb = (start + bs > n ? n - start : bs);
+    try {
+      Matrix D(nb, nb);
+      for (int i = 0; i < nb; i++){
+	for (int j = 0; j < nb; j++){
+	  D(i, j) = (A != NULL ? (*A)(start+i, start+j) : (*S)(start+i, start+j));
+	}
+      }
+      Matrix F;
+      if (spd) {
+	F = cholesky(D);
+      } else {
+	Vector p = dgelu(D, F);
+	for (int k = 0; k < nb-1; k++){
+	  piv[start+k] = p(k);
+	}
+      }
+      // A block that is not positive definite gives a NaN on the diagonal
+      // of R, and a singular one a zero pivot in U
+      for (int i = 0; i < nb; i++){
+	double fii = F(i, i);
+	if (!(spd ? fii > 0.0 : fabs(fii) > 0.0) || !std::isfinite(fii)) { ok = false; }
+	for (int j = 0; j < nb; j++){
+	  blocks(start+i, j) = F(i, j);
+	}
+      }
+    } catch (...) {
+      ok = false;
+    }
+  }
+  if (!ok) {
+    throw( Error("BJACOBIPC", (spd ? "A diagonal block is not positive definite."
+				: "A diagonal block is singular.")) );
+  }
+}
+
+
+void BlockJacobiPrecond::apply(const Vector& x, Vector& y) const
+{
+  int n = blocks.nrows();
+  if (x.size() != n || y.size() != n) {
+    throw( Error("PRECAPPLY", "Vectors are the wrong size for the preconditioner.") );
+  }
+  int nblocks = (n + bs - 1)/bs;
+  PROFILEFLOPS(2.0*n*bs);
+  const double* xv = x.data();
+  double* yv = y.data();
+#pragma omp parallel for if (n > PRECPARALLEL)
+  for (int b = 0; b < nblocks; b++){
+    int start = b*bs;
+    int nb = (start + bs > n ? n - start : bs);
+    double* yb = yv + start;
+    for (int i = 0; i < nb; i++){
+      yb[i] = xv[start+i];
+    }
+    if (spd) {
+      // Solve R(T)Ry = x
+      for (int i = 0; i < nb; i++){
+	double sum = yb[i];
+	for (int j = 0; j < i; j++){
+	  sum -= blocks(start+j, i)*yb[j];
+	}
+	yb[i] = sum/blocks(start+i, i);
+      }
+    } else {
+      // Solve LUy = Px, as in lusolve
+      for (int k = 0; k < nb-1; k++){
+	int pk = (int)piv(start+k);
+	double temp = yb[k];
+	yb[k] = yb[pk];
+	yb[pk] = temp;
+      }
+      for (int i = 1; i < nb; i++){
+	double sum = yb[i];
+	const double* row = &blocks[start+i];
+	for (int j = 0; j < i; j++){
+	  sum -= row[j]*yb[j];
+	}
+	yb[i] = sum;
+      }
+    }
+    // Back substitution is the same for both
+    for (int i = nb-1; i >= 0; i--){
+      const double* row = &blocks[start+i];
+      double sum = yb[i];
+      for (int j = i+1; j < nb; j++){
+	sum -= row[j]*yb[j];
+      }
+      yb[i] = sum/row[i];
+    }
+  }
+}
+
+// ILU(0)
+
+ILU0Precond::ILU0Precond(const Matrix& A) : LU(A)
+{
+  factor();
+}
+
+
+ILU0Precond::ILU0Precond(const SparseMatrix& A) : LU(A.isCSC() ? A.toCSR() : A)
+{
+  factor();
+}
+
+
+void ILU0Precond::factor()
+{
+  PROFILE("ilu0", 0.0);
+  if (!LU.isSquare()) {
+    throw( Error("ILU0", "Matrix must be square.") );
+  }
+  int n = LU.nrows();
+  int* dpos = new int[n > 0 ? n : 1];
+  if (!diagonals(LU, dpos)) {
+    delete[] dpos;
+    throw( Error("ILU0", "Matrix has an unstored diagonal element.") );
+  }
+  lsched = TriSchedule(LU, true);
+  usched = TriSchedule(LU, false);
+  const int* ptr = LU.getPtr();
+  const int* idx = LU.getIdx();
+  double* val = LU.getVal();
+  const int* order = lsched.getOrder();
+  const int* levptr = lsched.getLevels();
+
+  // Row i is eliminated using only rows k < i in its pattern, which all lie
+  // in earlier levels, so each level is factorised in parallel
+  bool ok = true;
+  double flops = 0.0; // Counted by the threads, added after
+  for (int l = 0; l < lsched.levels(); l++){
+#pragma omp parallel for reduction(&&:ok) reduction(+:flops) if (levptr[l+1] - levptr[l] > PRECPARALLEL)
+    for (int s = levptr[l]; s < levptr[l+1]; s++){
+      int i = order[s];
+      for (int p = ptr[i]; p < dpos[i]; p++){
+	int k = idx[p];
+	double lik = val[p]/val[dpos[k]];
+	val[p] = lik;
+	flops += 1.0;
+	// Update the rest of row i where row k has an entry, merging the
+	// two sorted rows
+	int q = p+1, r = dpos[k]+1;
+	while (q < ptr[i+1] && r < ptr[k+1]){
+	  if (idx[q] == idx[r]) {
+	    val[q] -= lik*val[r];
+	    flops += 2.0;
+	    q++; r++;
+	  } else if (idx[q] < idx[r]) {
+	    q++;
+	  } else {
+	    r++;
+	  }
+	}
+      }
+      ok = ok && (val[dpos[i]] != 0.0);
+    }
+    if (!ok) {
+      delete[] dpos;
+      throw( Error("ILU0", "Zero pivot.") );
+    }
+  }
+  PROFILEFLOPS(flops);
+  dinv.resize(n);
+#pragma omp parallel for if (n > PRECPARALLEL)
+  for (int i = 0; i < n; i++){
+    dinv[i] = 1.0/val[dpos[i]];
+  }
+  delete[] dpos;
+}
+
+
+void ILU0Precond::apply(const Vector& x, Vector& y) const
+{
+  int n = LU.nrows();
+  if (x.size() != n || y.size() != n) {
+    throw( Error("PRECAPPLY", "Vectors are the wrong size for the preconditioner.") );
+  }
+  PROFILEFLOPS(2.0*LU.nonzeros());
+  const double* xv = x.data();
+  double* yv = y.data();
+  for (int i = 0; i < n; i++){
+    yv[i] = xv[i];
+  }
+  lsched.solve(LU, NULL, yv);
+  usched.solve(LU, dinv.data(), yv);
+}
+
+// IC(0)
+
+IC0Precond::IC0Precond(const Matrix& A)
+{
+  factor(SparseMatrix(A));
+}
+
+
+IC0Precond::IC0Precond(const SparseMatrix& A)
+{
+  factor(A.isCSC() ? A.toCSR() : A);
+}
+
+
+void IC0Precond::factor(const SparseMatrix& A)
+{
+  PROFILE("ic0", 0.0);
+  if (!A.isSquare()) {
+    throw( Error("IC0", "Matrix must be square.") );
+  }
+  int n = A.nrows();
+  const int* aptr = A.getPtr();
+  const int* aidx = A.getIdx();
+  const double* aval = A.getVal();
+  if (aptr == NULL) {
+    throw( Error("IC0", "Matrix has an unstored diagonal element.") );
+  }
+  // Copy out the lower triangle, including the diagonal
+  int* ptr = new int[n+1];
+  ptr[0] = 0;
+#pragma omp parallel for if (n > PRECPARALLEL)
+  for (int i = 0; i < n; i++){
+    int count = 0;
+    for (int p = aptr[i]; p < aptr[i+1]; p++){
+      count += (aidx[p] <= i ? 1 : 0);
+    }
+    ptr[i+1] = count;
+  }
+  for (int i = 0; i < n; i++){
+    ptr[i+1] += ptr[i];
+  }
+  int nnz = ptr[n];
+  int* idx = new int[nnz > 0 ? nnz : 1];
+  double* val = new double[nnz > 0 ? nnz : 1];
+  bool ok = true;
+#pragma omp parallel for reduction(&&:ok) if (n > PRECPARALLEL)
+  for (int i = 0; i < n; i++){
+    int q = ptr[i];
+    for (int p = aptr[i]; p < aptr[i+1] && aidx[p] <= i; p++){
+      idx[q] = aidx[p];
+      val[q] = aval[p];
+      q++;
+    }
+    ok = ok && (q > ptr[i] && idx[q-1] == i);
+  }
+  if (!ok) {
+    delete[] ptr; delete[] idx; delete[] val;
+    throw( Error("IC0", "Matrix has an unstored diagonal element.") );
+  }
+  L = SparseMatrix(n, n, ptr, idx, val);
+  delete[] ptr; delete[] idx; delete[] val;
+
+  lsched = TriSchedule(L, true);
+  const int* lptr = L.getPtr();
+  const int* lidx = L.getIdx();
+  double* lval = L.getVal();
+  const int* order = lsched.getOrder();
+  const int* levptr = lsched.getLevels();
+
+  // Row i of L needs only the rows j < i in its pattern, which lie in
+  // earlier levels. The diagonal is the last entry in each row.
+  double flops = 0.0; // Counted by the threads, added after
+  for (int l = 0; l < lsched.levels(); l++){
+#pragma omp parallel for reduction(&&:ok) reduction(+:flops) if (levptr[l+1] - levptr[l] > PRECPARALLEL)
+    for (int s = levptr[l]; s < levptr[l+1]; s++){
+      int i = order[s];
+      int di = lptr[i+1]-1;
+      for (int p = lptr[i]; p < di; p++){
+	int j = lidx[p];
+	int dj = lptr[j+1]-1;
+	// l_ij = (a_ij - sum_{m < j} l_im l_jm)/l_jj, merging rows i and j
+	double sum = lval[p];
+	int q = lptr[i], r = lptr[j];
+	while (q < p && r < dj){
+	  if (lidx[q] == lidx[r]) {
+	    sum -= lval[q]*lval[r];
+	    flops += 2.0;
+	    q++; r++;
+	  } else if (lidx[q] < lidx[r]) {
+	    q++;
+	  } else {
+	    r++;
+	  }
+	}
+	lval[p] = sum/lval[dj];
+      }
+      double d = lval[di];
+      for (int p = lptr[i]; p < di; p++){
+	d -= lval[p]*lval[p];
+      }
+      flops += 3.0*(di - lptr[i]) + 1.0;
+      ok = ok && (d > 0.0);
+      lval[di] = (d > 0.0 ? sqrt(d) : 1.0);
+    }
+    if (!ok) {
+      throw( Error("IC0", "Breakdown - matrix is not positive definite enough.") );
+    }
+  }
+
+  PROFILEFLOPS(flops);
+  LT = L.transpose();
+  usched = TriSchedule(LT, false);
+  dinv.resize(n);
+#pragma omp parallel for if (n > PRECPARALLEL)
+  for (int i = 0; i < n; i++){
+    dinv[i] = 1.0/lval[lptr[i+1]-1];
+  }
+}
+
+
+void IC0Precond::apply(const Vector& x, Vector& y) const
+{
+  int n = L.nrows();
+  if (x.size() != n || y.size() != n) {
+    throw( Error("PRECAPPLY", "Vectors are the wrong size for the preconditioner.") );
+  }
+  PROFILEFLOPS(4.0*L.nonzeros());
+  const double* xv = x.data();
+  double* yv = y.data();
+  for (int i = 0; i < n; i++){
+    yv[i] = xv[i];
+  }
+  lsched.solve(L, dinv.data(), yv);
+  usched.solve(LT, dinv.data(), yv);
+}
+
+// SSOR
+
+SSORPrecond::SSORPrecond(const Matrix& mat, double w) : A(mat), omega(w)
+{
+  setup();
+}
+
+
+SSORPrecond::SSORPrecond(const SparseMatrix& mat, double w)
+  : A(mat.isCSC() ? mat.toCSR() : mat), omega(w)
+{
+  setup();
+}
+
+
+void SSORPrecond::setup()
+{
+  PROFILE("ssorprecond", A.nrows());
+  if (!A.isSquare()) {
+    throw( Error("SSOR", "Matrix must be square.") );
+  }
+  if (omega <= 0.0 || omega >= 2.0) {
+    throw( Error("SSOR", "Relaxation parameter must be in (0, 2).") );
+  }
+  int n = A.nrows();
+  dinv = A.diagonal();
+  for (int i = 0; i < n; i++){
+    if (dinv(i) == 0.0) {
+      throw( Error("SSOR", "Zero on the diagonal.") );
+    }
+    dinv[i] = omega/dinv(i);
+  }
+  lsched = TriSchedule(A, true);
+  usched = TriSchedule(A, false);
+}
+
+
+void SSORPrecond::apply(const Vector& x, Vector& y) const
+{
+  int n = A.nrows();
+  if (x.size() != n || y.size() != n) {
+    throw( Error("PRECAPPLY", "Vectors are the wrong size for the preconditioner.") );
+  }
+  PROFILEFLOPS(2.0*A.nonzeros() + 3.0*n);
+  const double* xv = x.data();
+  const double* dv = dinv.data();
+  double* yv = y.data();
+  for (int i = 0; i < n; i++){
+    yv[i] = xv[i];
+  }
+  // y = (2-w)/w (D/w + U)^-1 (D/w) (D/w + L)^-1 x
+  lsched.solve(A, dv, yv);
+  for (int i = 0; i < n; i++){
+    yv[i] /= dv[i];
+  }
+  usched.solve(A, dv, yv);
+  double scale = (2.0 - omega)/omega;
+  for (int i = 0; i < n; i++){
+    yv[i] *= scale;
+  }
+}
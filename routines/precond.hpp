@@ -0,0 +1,132 @@
+/*
+ *   Purpose: To define preconditioners for the iterative solvers in
+ *            iterative.hpp. Each is a LinearOperator whose apply(x, y)
+ *            forms y = M^-1 x, for some cheap approximation M to A, and
+ *            can be built from either a dense or a sparse matrix.
+ *            Setup is done in parallel where the algorithm allows, and
+ *            applying a preconditioner never allocates.
+ *
+ *   DATE             AUTHOR            CHANGES
+ *   ===============================================================
+ *   19/10/26         Robert Shaw       Original code.
+ */
+
+#ifndef PRECONDHEADERDEF
+#define PRECONDHEADERDEF
+
+#include "iterative.hpp"
+#include "vector.hpp"
+#include "matrix.hpp"
+#include "sparse.hpp"
+
+// A level schedule for the solution of a sparse triangular system, using
+// the lower (or upper) triangle of a matrix stored by rows. Rows in the
+// same level depend only on rows in earlier levels, so each level is
+// solved in parallel.
+class TriSchedule
+{
+private:
+  int n, nlev; // No. of rows and levels
+  bool lower; // Whether the schedule is for the lower triangle
+  int* order; // Rows, grouped by level
+  int* levptr; // Start of each level in order, length nlev+1
+  void cleanUp();
+public:
+  TriSchedule() : n(0), nlev(0), lower(true), order(NULL), levptr(NULL) {}
+  TriSchedule(const SparseMatrix& A, bool lo);
+  TriSchedule(const TriSchedule& other);
+  ~TriSchedule();
+  TriSchedule& operator=(const TriSchedule& other);
+  int levels() const { return nlev; }
+  int size() const { return n; }
+  const int* getOrder() const { return order; }
+  const int* getLevels() const { return levptr; }
+  // Solve in place with the lower (upper) triangle of the CSR matrix A that
+  // the schedule was built from, ignoring its stored diagonal and instead
+  // multiplying by dinv (which should be the inverse diagonal), or taking
+  // a unit diagonal if dinv is NULL
+  void solve(const SparseMatrix& A, const double* dinv, double* y) const;
+};
+
+// Diagonal (Jacobi) scaling, M = diag(A)
+class JacobiPrecond : public LinearOperator
+{
+private:
+  Vector dinv; // Inverse of the diagonal
+public:
+  JacobiPrecond(const Matrix& A);
+  JacobiPrecond(const SparseMatrix& A);
+  int size() const { return dinv.size(); }
+  void apply(const Vector& x, Vector& y) const;
+};
+
+// Block Jacobi, where M is the block diagonal of A, in blocks of size bs
+// (the last may be smaller). Each block is factorised by dgelu, or by
+// cholesky if spd is true, and an error is thrown if any block is
+// singular or, for cholesky, not positive definite.
+class BlockJacobiPrecond : public LinearOperator
+{
+private:
+  int bs; // Block size
+  bool spd; // Whether the blocks are cholesky (rather than LU) factors
+  Matrix blocks; // n x bs, with block b's factors in rows b*bs to b*bs+bs-1
+  Vector piv; // Pivots from dgelu for each block, stored in the same way
+  void factor(const Matrix* A, const SparseMatrix* S);
+public:
+  BlockJacobiPrecond(const Matrix& A, int blocksize, bool posdef = false);
+  BlockJacobiPrecond(const SparseMatrix& A, int blocksize, bool posdef = false);
+  int size() const { return blocks.nrows(); }
+  void apply(const Vector& x, Vector& y) const;
+};
+
+// Incomplete LU factorisation with no fill, M = LU, where L and U have
+// the same sparsity pattern as the lower and upper triangles of A
+class ILU0Precond : public LinearOperator
+{
+private:
+  SparseMatrix LU; // Unit L below the diagonal, U on and above it
+  Vector dinv; // Inverse of the diagonal of U
+  TriSchedule lsched, usched;
+  void factor();
+public:
+  ILU0Precond(const Matrix& A);
+  ILU0Precond(const SparseMatrix& A);
+  int size() const { return LU.nrows(); }
+  int levels() const { return lsched.levels(); } // Parallelism available
+  void apply(const Vector& x, Vector& y) const;
+};
+
+// Incomplete cholesky factorisation with no fill, M = LL(T), where L
+// has the sparsity pattern of the lower triangle of the SPD matrix A
+class IC0Precond : public LinearOperator
+{
+private:
+  SparseMatrix L, LT; // The factor and its transpose, stored by rows
+  Vector dinv; // Inverse of the diagonal of L
+  TriSchedule lsched, usched;
+  void factor(const SparseMatrix& A);
+public:
+  IC0Precond(const Matrix& A);
+  IC0Precond(const SparseMatrix& A);
+  int size() const { return L.nrows(); }
+  void apply(const Vector& x, Vector& y) const;
+};
+
+// Symmetric successive over-relaxation, with 0 < omega < 2,
+// M = (D/w + L)(D/w)^-1(D/w + U)w/(2-w), where A = L + D + U
+class SSORPrecond : public LinearOperator
+{
+private:
+  SparseMatrix A;
+  double omega;
+  Vector dinv; // omega/diag(A)
+  TriSchedule lsched, usched;
+  void setup();
+public:
+  SSORPrecond(const Matrix& mat, double w = 1.0);
+  SSORPrecond(const SparseMatrix& mat, double w = 1.0);
+  int size() const { return A.nrows(); }
+  void apply(const Vector& x, Vector& y) const;
+};
+
+#endif
@@ -5,8 +5,16 @@
 #include "vector.hpp"
 #include "matrix.hpp"
 #include "error.hpp"
+#include "banded.hpp"
+#include "packed.hpp"
+#include "profile.hpp"
+#include "tuning.hpp"
 #include <cmath>
+#include <cfloat>
 #include <iostream>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 // Back substitution of the triangular system Rx = y
 Vector backsub(const Matrix& R, const Vector& y)
@@ -33,6 +41,7 @@ Vector backsub(const Matrix& R, const Vector& y)
 Vector qrsolve(const Matrix& A, const Vector& b)
 {
   int dim = A.nrows();
+  PROFILE("qrsolve", 4.0*dim*dim*dim/3.0 + 3.0*dim*dim);
   Vector x(dim); // For returning the answer
   Matrix v; Matrix r; // For the Householder algorithm
   // dgehh resizes v and r for us, so they
@@ -88,6 +97,26 @@ Vector qrsquares(const Matrix& A, const Vector& b)
   return x;
 }
 
+// Use the singular value decomposition to solve the, possibly rank-deficient,
+// least-squares problem, truncating the tiny singular values
+Vector svdsquares(const Matrix& A, const Vector& b, double PRECISION)
+{
+  int n = A.ncols();
+  Vector x(n, 0.0); // Solution vector
+  Vector s; Matrix U; Matrix V;
+  if (!svd(A, s, U, V)) {
+    throw( Error("SVDSQRS", "Singular value decomposition did not converge.") );
+  }
+  int k = s.size();
+  Vector y(k); // y = S^+ U(T) b
+  y = b*U;
+  for (int i = 0; i < k; i++){
+    y[i] = (s(i) > PRECISION*s(0) ? y(i)/s(i) : 0.0);
+  }
+  x = V*y;
+  return x;
+}
+
 // Use the LU decomposition (Gaussian elimination with partial pivoting)
 // to solve the system Ax = b. First, PA = LU is formed, and so we must 
 // solve PAx = Pb. Pb is formed by implicitpb, then we can solve LUx = Pb
@@ -96,6 +125,7 @@ Vector qrsquares(const Matrix& A, const Vector& b)
 Vector lusolve(const Matrix& A, const Vector& b)
 {
   int dim = A.nrows(); // Assume square
+  PROFILE("lusolve", 2.0*dim*dim*dim/3.0 + 2.0*dim*dim);
   Vector x(dim); // Will contain the solution
   // First, LU decompose A
   Vector p(dim-1);
@@ -142,21 +172,679 @@ Vector lusolve(const Matrix& B, const Vector& p, const Vector& b)
     }
     x[i] = x[i] - sum;
   }
-  // Now we need to solve Ux = y for x                     
-  // First remove L from B, to get U
-  Matrix U;
-  U = B;
-  for(int i = 1; i<dim; i++){
+  // Now we need to solve Ux = y for x, by backsub, which only reads
+  // the upper triangle of B, so L need not be removed
+  x = backsub(B, x);
+  return x;
+}
+
+
+// Mixed precision refinement. The single precision factors are held by
+// rows, through an array of row pointers, so that row interchanges are
+// pointer swaps. Columns are factorised in panels (of tuning().lublock
+// or cholblock), and the trailing matrix updated a panel at a time, which
+// is the bulk of the work.
+
+// Copy A into single precision rows, returning false if it overflows
+static bool singlecopy(const Matrix& A, float* a, float** row)
+{
+  int dim = A.nrows();
+  bool ok = true;
+  for (int i = 0; i < dim; i++){
+    row[i] = a + (long)i*dim;
+    const double* ai = &A[i];
+    for (int j = 0; j < dim; j++){
+      ok = ok && (fabs(ai[j]) <= FLT_MAX);
+      row[i][j] = (float)ai[j];
+    }
+  }
+  return ok;
+}
+
+// Blocked LU with partial pivoting, in place. piv[k] is the row swapped
+// with row k at step k, as for dgelu. Returns false on a zero pivot.
+static bool sgetrf(int dim, float** row, int* piv)
+{
+  int nb = tuning().lublock;
+  for (int k0 = 0; k0 < dim; k0 += nb){
+    int kend = (k0 + nb < dim ? k0 + nb : dim);
+    // Factorise the panel, columns k0 to kend-1 of all rows below k0
+    for (int k = k0; k < kend; k++){
+      TRACEARG("sgetrf/column", k);
+      int pivot = k;
+      float testval = fabsf(row[k][k]);
+      for (int i = k+1; i < dim; i++){
+	if (fabsf(row[i][k]) > testval) {
+	  pivot = i;
+	  testval = fabsf(row[i][k]);
+	}
+      }
+      if (!(testval > 0.0f) || testval > FLT_MAX) { return false; }
+      piv[k] = pivot;
+      float* tmp = row[k]; row[k] = row[pivot]; row[pivot] = tmp;
+      const float* rk = row[k];
+      float rkk = rk[k];
+      for (int i = k+1; i < dim; i++){
+	float* ri = row[i];
+	float lik = (ri[k] /= rkk);
+	for (int j = k+1; j < kend; j++){
+	  ri[j] -= lik*rk[j];
+	}
+      }
+    }
+    if (kend == dim) { break; }
+    // U12 = L11^-1 A12, L11 being unit lower triangular
+    for (int k = k0+1; k < kend; k++){
+      float* rk = row[k];
+      for (int m = k0; m < k; m++){
+	float lkm = rk[m];
+	const float* rm = row[m];
+#pragma omp simd
+	for (int j = kend; j < dim; j++){
+	  rk[j] -= lkm*rm[j];
+	}
+      }
+    }
+    // A22 -= L21 U12
+#pragma omp parallel if (dim - kend > 2*nb)
+    {
+      TRACEARG("sgetrf/update", k0);
+#pragma omp for schedule(static)
+      for (int i = kend; i < dim; i++){
+	float* ri = row[i];
+	for (int m = k0; m < kend; m++){
+	  float lim = ri[m];
+	  const float* rm = row[m];
+#pragma omp simd
+	  for (int j = kend; j < dim; j++){
+	    ri[j] -= lim*rm[j];
+	  }
+	}
+      }
+    }
+  }
+  return true;
+}
+
+// Blocked cholesky A = R(T)R, overwriting the upper triangle of the rows
+// with R. Returns false if A is not positive definite (in single precision).
+static bool spotrf(int dim, float** row)
+{
+  int nb = tuning().cholblock;
+  for (int k0 = 0; k0 < dim; k0 += nb){
+    int kend = (k0 + nb < dim ? k0 + nb : dim);
+    // Rows of the panel are finished one at a time, each updating the
+    // later rows of the panel only
+    for (int k = k0; k < kend; k++){
+      TRACEARG("spotrf/row", k);
+      float* rk = row[k];
+      if (!(rk[k] > 0.0f) || rk[k] > FLT_MAX) { return false; }
+      float rootval = sqrtf(rk[k]);
+      for (int j = k; j < dim; j++){
+	rk[j] /= rootval;
+      }
+      for (int i = k+1; i < kend; i++){
+	float* ri = row[i];
+	float rki = rk[i];
+#pragma omp simd
+	for (int j = i; j < dim; j++){
+	  ri[j] -= rki*rk[j];
+	}
+      }
+    }
+    // Then the rest of the upper triangle, by the whole panel at once
+#pragma omp parallel if (dim - kend > 2*nb)
+    {
+      TRACEARG("spotrf/update", k0);
+#pragma omp for schedule(dynamic, 16)
+      for (int i = kend; i < dim; i++){
+	float* ri = row[i];
+	for (int m = k0; m < kend; m++){
+	  float rmi = row[m][i];
+	  const float* rm = row[m];
+#pragma omp simd
+	  for (int j = i; j < dim; j++){
+	    ri[j] -= rmi*rm[j];
+	  }
+	}
+      }
+    }
+  }
+  return true;
+}
+
+// Solve with the single precision factors, overwriting x
+static void sgetrs(int dim, float** row, const int* piv, float* x)
+{
+  for (int k = 0; k < dim; k++){
+    float tmp = x[k]; x[k] = x[piv[k]]; x[piv[k]] = tmp;
+  }
+  for (int i = 1; i < dim; i++){
+    const float* ri = row[i];
+    float sum = x[i];
     for (int j = 0; j < i; j++){
-      U(i, j) = 0.0;
+      sum -= ri[j]*x[j];
+    }
+    x[i] = sum;
+  }
+  for (int i = dim-1; i > -1; i--){
+    const float* ri = row[i];
+    float sum = x[i];
+    for (int j = i+1; j < dim; j++){
+      sum -= ri[j]*x[j];
+    }
+    x[i] = sum/ri[i];
+  }
+}
+
+
+static void spotrs(int dim, float** row, float* x)
+{
+  // R(T)y = b, a row of R at a time
+  for (int k = 0; k < dim; k++){
+    const float* rk = row[k];
+    x[k] /= rk[k];
+    float xk = x[k];
+    for (int j = k+1; j < dim; j++){
+      x[j] -= rk[j]*xk;
+    }
+  }
+  for (int i = dim-1; i > -1; i--){
+    const float* ri = row[i];
+    float sum = x[i];
+    for (int j = i+1; j < dim; j++){
+      sum -= ri[j]*x[j];
+    }
+    x[i] = sum/ri[i];
+  }
+}
+
+// The refinement loop shared by both solvers, with the factors in row
+// (and piv, if LU). Returns the number of steps, or -1 if it failed.
+static int refine(const Matrix& A, const Vector& b, Vector& x, float** row,
+		  const int* piv, int MAXITER)
+{
+  int dim = A.nrows();
+  double anorm = 0.0;
+  for (int i = 0; i < dim; i++){
+    const double* ai = &A[i];
+    double sum = 0.0;
+    for (int j = 0; j < dim; j++){
+      sum += fabs(ai[j]);
+    }
+    anorm = (sum > anorm ? sum : anorm);
+  }
+  double cte = anorm*DBL_EPSILON*sqrt((double)dim);
+  float* work = new float[dim];
+  double* r = new double[dim];
+  double* xv = x.data();
+  const double* bv = b.data();
+  int iters = -1;
+  double rprev = 0.0;
+  for (int it = 0; it <= MAXITER; it++){
+    // Residual in double precision
+    double rnorm = 0.0, xnorm = 0.0;
+    bool finite = true;
+#pragma omp parallel for reduction(max:rnorm, xnorm) reduction(&&:finite) if (dim > 500)
+    for (int i = 0; i < dim; i++){
+      const double* ai = &A[i];
+      double sum = bv[i];
+      for (int j = 0; j < dim; j++){
+	sum -= ai[j]*xv[j];
+      }
+      r[i] = sum;
+      finite = finite && (fabs(sum) <= DBL_MAX);
+      rnorm = (fabs(sum) > rnorm ? fabs(sum) : rnorm);
+      xnorm = (fabs(xv[i]) > xnorm ? fabs(xv[i]) : xnorm);
+    }
+    PROFILEFLOPS(2.0*dim*dim);
+    if (!finite) { break; }
+    if (rnorm <= xnorm*cte) {
+      iters = it;
+      break;
+    }
+    if (it > 0 && rnorm > 0.5*rprev) { break; } // Stagnated
+    rprev = rnorm;
+    // Correction, in single precision
+    for (int i = 0; i < dim; i++){
+      work[i] = (float)r[i];
+    }
+    if (piv != NULL) { sgetrs(dim, row, piv, work); }
+    else { spotrs(dim, row, work); }
+    for (int i = 0; i < dim; i++){
+      xv[i] += work[i];
+    }
+    PROFILEFLOPS(2.0*dim*dim);
+  }
+  delete[] work;
+  delete[] r;
+  return iters;
+}
+
+// Factorise, solve and refine, for mixedlusolve if lu is true, or else
+// mixedcholeskysolve. Returns the number of steps, or -1 if it failed.
+static int mixedsolve(const Matrix& A, const Vector& b, Vector& x, bool lu, int MAXITER)
+{
+  int dim = A.nrows();
+  if (!A.isSquare() || b.size() != dim) {
+    throw( Error("MIXEDSOLVE", "Matrix and vector are wrong sizes.") );
+  }
+  x.resize(dim);
+  if (dim == 0) { return 0; }
+  float* a = new float[(long)dim*dim];
+  float** row = new float*[dim];
+  int* piv = (lu ? new int[dim] : NULL);
+  int iters = -1;
+  bool ok = singlecopy(A, a, row);
+  if (ok) {
+    PROFILE("mixed/factor", (lu ? 2.0 : 1.0)*dim*dim*(double)dim/3.0);
+    ok = (lu ? sgetrf(dim, row, piv) : spotrf(dim, row));
+  }
+  if (ok) {
+    // Initial solution, in single precision
+    float* work = new float[dim];
+    for (int i = 0; i < dim; i++){
+      work[i] = (float)b(i);
+    }
+    if (lu) { sgetrs(dim, row, piv, work); }
+    else { spotrs(dim, row, work); }
+    for (int i = 0; i < dim; i++){
+      x[i] = work[i];
+    }
+    delete[] work;
+    PROFILE("mixed/refine", 0.0); // Counted by each step
+    iters = refine(A, b, x, row, piv, MAXITER);
+  }
+  delete[] a;
+  delete[] row;
+  if (piv != NULL) { delete[] piv; }
+  return iters;
+}
+
+
+// The refinement steps add their flops as they go, and a failure falls
+// back to solving in double precision
+Vector mixedlusolve(const Matrix& A, const Vector& b, int& iters, int MAXITER)
+{
+  PROFILE("mixedlusolve", 2.0*A.nrows()*A.nrows()*(A.nrows()/3.0 + 1.0));
+  Vector x;
+  iters = mixedsolve(A, b, x, true, MAXITER);
+  if (iters < 0) {
+    PROFILEFLOPS(2.0*A.nrows()*A.nrows()*(A.nrows()/3.0 + 1.0));
+    x = lusolve(A, b);
+  }
+  return x;
+}
+
+
+Vector mixedcholeskysolve(const Matrix& A, const Vector& b, int& iters, int MAXITER)
+{
+  PROFILE("mixedcholeskysolve", (double)A.nrows()*A.nrows()*(A.nrows()/3.0 + 2.0));
+  Vector x;
+  iters = mixedsolve(A, b, x, false, MAXITER);
+  if (iters < 0) {
+    PROFILEFLOPS((double)A.nrows()*A.nrows()*(A.nrows()/3.0 + 2.0));
+    x = choleskysolve(A, b);
+  }
+  return x;
+}
+
+// Solve the shifted Hessenberg system (H - mu*I)x = b, by first forming
+// the O(n^2) decomposition with dhslu
+Vector hessenbergsolve(const Matrix& H, double mu, const Vector& b)
+{
+  Matrix B; Vector p;
+  p = dhslu(H, mu, B);
+  return hessenbergsolve(B, p, b);
+}
+
+// And with the decomposition already formed. L has only one subdiagonal,
+// so the forward substitution is O(n), and backsub ignores the L part of B.
+Vector hessenbergsolve(const Matrix& B, const Vector& p, const Vector& b)
+{
+  int dim = b.size();
+  Vector x(dim); // Solution vector
+  x = b;
+  for (int k = 0; k < dim-1; k++){
+    if (p(k) != 0.0) { x.swap(k, k+1); }
+    x[k+1] -= B(k+1, k)*x(k);
+  }
+  x = backsub(B, x);
+  return x;
+}
+
+// Solve a tridiagonal system by Gaussian elimination with partial pivoting,
+// where interchanging rows i, i+1 introduces a second superdiagonal, du2.
+Vector tridiagsolve(const Vector& dl, const Vector& d, const Vector& du, const Vector& b)
+{
+  int dim = d.size();
+  PROFILE("tridiagsolve", 10.0*dim);
+  Vector x(dim); // Solution vector
+  x = b;
+  if (dim == 0) { return x; }
+  // Copy the diagonals, as they are overwritten by the elimination
+  Vector l(dim), u(dim), u1(dim, 0.0), u2(dim, 0.0);
+  double tnorm = 0.0;
+  for (int i = 0; i < dim; i++){
+    u[i] = d(i);
+    tnorm = (fabs(d(i)) > tnorm ? fabs(d(i)) : tnorm);
+    if (i < dim-1) {
+      l[i] = dl(i); u1[i] = du(i);
+      tnorm = (fabs(dl(i)) > tnorm ? fabs(dl(i)) : tnorm);
+      tnorm = (fabs(du(i)) > tnorm ? fabs(du(i)) : tnorm);
+    }
+  }
+  double tiny = (tnorm > 0.0 ? tnorm : 1.0)*2.2e-16;
+  for (int i = 0; i < dim-1; i++){
+    if (fabs(u(i)) >= fabs(l(i))) { // No interchange
+      if (u(i) == 0.0) { u[i] = tiny; }
+      double fact = l(i)/u(i);
+      u[i+1] -= fact*u1(i);
+      x[i+1] -= fact*x(i);
+    } else { // Interchange rows i and i+1
+      double fact = u(i)/l(i);
+      u[i] = l(i);
+      double temp = u(i+1);
+      u[i+1] = u1(i) - fact*temp;
+      if (i < dim-2) {
+	u2[i] = u1(i+1);
+	u1[i+1] = -fact*u2(i);
+      }
+      u1[i] = temp;
+      temp = x(i);
+      x[i] = x(i+1);
+      x[i+1] = temp - fact*x(i+1);
+    }
+  }
+  if (u(dim-1) == 0.0) { u[dim-1] = tiny; }
+  // Back substitution with the three upper diagonals
+  x[dim-1] /= u(dim-1);
+  if (dim > 1) { x[dim-2] = (x(dim-2) - u1(dim-2)*x(dim-1))/u(dim-2); }
+  for (int i = dim-3; i > -1; i--){
+    x[i] = (x(i) - u1(i)*x(i+1) - u2(i)*x(i+2))/u(i);
+  }
+  return x;
+}
+
+
+Vector tridiagsolve(const TridiagonalMatrix& T, const Vector& b)
+{
+  return tridiagsolve(T.subdiag(), T.diag(), T.superdiag(), b);
+}
+
+
+Vector thomas(const TridiagonalMatrix& T, const Vector& b)
+{
+  int dim = T.size();
+  PROFILE("thomas", 8.0*dim);
+  if (b.size() != dim) {
+    throw( Error("THOMAS", "Vector and matrix are different sizes.") );
+  }
+  const Vector& dl = T.subdiag();
+  const Vector& d = T.diag();
+  const Vector& du = T.superdiag();
+  Vector x(dim), c(dim); // Solution, and modified superdiagonal
+  if (dim == 0) { return x; }
+  // Forward sweep
+  double piv = d(0);
+  for (int i = 0; i < dim; i++){
+    if (i > 0) { piv = d(i) - dl(i-1)*c(i-1); }
+    if (piv == 0.0) {
+      throw( Error("THOMAS", "Zero pivot, matrix needs pivoting.") );
+    }
+    c[i] = (i < dim-1 ? du(i)/piv : 0.0);
+    x[i] = (i > 0 ? b(i) - dl(i-1)*x(i-1) : b(i))/piv;
+  }
+  // Back substitution
+  for (int i = dim-2; i > -1; i--){
+    x[i] -= c(i)*x(i+1);
+  }
+  return x;
+}
+
+
+void thomas(const Matrix& DL, const Matrix& D, const Matrix& DU, Matrix& B)
+{
+  int dim = D.nrows(), m = D.ncols();
+  PROFILE("thomas", 8.0*dim*m);
+  if (B.nrows() != dim || B.ncols() != m || (dim > 1 && (DL.nrows() < dim-1 || DU.nrows() < dim-1
+      || DL.ncols() != m || DU.ncols() != m))) {
+    throw( Error("THOMAS", "Batched systems are different sizes.") );
+  }
+  if (dim == 0 || m == 0) { return; }
+  Matrix C(dim, m, 0.0); // Modified superdiagonals
+  const int BATCHBLOCK = 256; // Systems per thread block
+  bool ok = true;
+#pragma omp parallel for reduction(&&:ok) if (m > BATCHBLOCK)
+  for (int s0 = 0; s0 < m; s0 += BATCHBLOCK){
+    int s1 = (s0 + BATCHBLOCK < m ? s0 + BATCHBLOCK : m);
+    // Forward sweep, a row of every system at a time
+    for (int i = 0; i < dim; i++){
+      const double* di = &D[i];
+      double* bi = &B[i];
+      double* ci = &C[i];
+      const double* li = (i > 0 ? &DL[i-1] : NULL);
+      const double* cp = (i > 0 ? &C[i-1] : NULL);
+      const double* bp = (i > 0 ? &B[i-1] : NULL);
+      const double* ui = (i < dim-1 ? &DU[i] : NULL);
+#pragma omp simd reduction(&&:ok)
+      for (int s = s0; s < s1; s++){
+	double piv = (i > 0 ? di[s] - li[s]*cp[s] : di[s]);
+	ok = ok && (piv != 0.0);
+	ci[s] = (i < dim-1 ? ui[s]/piv : 0.0);
+	bi[s] = (i > 0 ? bi[s] - li[s]*bp[s] : bi[s])/piv;
+      }
+    }
+    // Back substitution
+    for (int i = dim-2; i > -1; i--){
+      double* bi = &B[i];
+      const double* bn = &B[i+1];
+      const double* ci = &C[i];
+#pragma omp simd
+      for (int s = s0; s < s1; s++){
+	bi[s] -= ci[s]*bn[s];
+      }
+    }
+  }
+  if (!ok) {
+    throw( Error("THOMAS", "Zero pivot, matrix needs pivoting.") );
+  }
+}
+
+
+Vector bandedlusolve(const BandedMatrix& A, const Vector& b)
+{
+  // The fill from interchanges widens the upper band to kl + ku
+  PROFILE("bandedlusolve", 2.0*A.size()*A.nlower()*(A.nlower() + A.nupper())
+	  + 2.0*A.size()*(2.0*A.nlower() + A.nupper()));
+  BandedMatrix B;
+  Vector p = dgblu(A, B);
+  return bandedlusolve(B, p, b);
+}
+
+
+Vector bandedlusolve(const BandedMatrix& B, const Vector& p, const Vector& b)
+{
+  int dim = B.size();
+  if (b.size() != dim) {
+    throw( Error("BANDSOLVE", "Vector and matrix are different sizes.") );
+  }
+  int kl = B.nlower(), ku = B.nupper();
+  const double* a = B.data();
+  long w = B.width();
+  Vector x(dim);
+  x = b;
+  // Forward substitution, applying each interchange in turn
+  for (int k = 0; k < dim-1; k++){
+    int pk = (int)p(k);
+    if (pk != k) {
+      double temp = x(k);
+      x[k] = x(pk);
+      x[pk] = temp;
+    }
+    double xk = x(k);
+    int imax = (k+kl < dim-1 ? k+kl : dim-1);
+    for (int i = k+1; i <= imax; i++){
+      x[i] -= a[i*w+k-i+kl]*xk;
+    }
+  }
+  // Back substitution with U
+  for (int i = dim-1; i > -1; i--){
+    const double* ri = a + i*w - i + kl;
+    int jmax = (i+ku < dim-1 ? i+ku : dim-1);
+    double sum = x(i);
+    for (int j = i+1; j <= jmax; j++){
+      sum -= ri[j]*x(j);
+    }
+    x[i] = sum/ri[i];
+  }
+  return x;
+}
+
+
+Vector bandedcholeskysolve(const BandedMatrix& A, const Vector& b)
+{
+  PROFILE("bandedcholeskysolve", (double)A.size()*A.nupper()*(A.nupper() + 5.0));
+  BandedMatrix R = bandedcholesky(A);
+  return bandedcholeskysolve(b, R);
+}
+
+
+Vector bandedcholeskysolve(const Vector& b, const BandedMatrix& R)
+{
+  int dim = R.size();
+  if (b.size() != dim) {
+    throw( Error("BANDSOLVE", "Vector and matrix are different sizes.") );
+  }
+  int bw = R.nupper();
+  const double* r = R.data();
+  long w = R.width();
+  Vector x(dim);
+  x = b;
+  // Solve R(T)y = b, a column of R(T) (row of R) at a time
+  for (int k = 0; k < dim; k++){
+    const double* rk = r + k*w;
+    x[k] /= rk[0];
+    double xk = x(k);
+    int jmax = (k+bw < dim-1 ? k+bw : dim-1) - k;
+    for (int j = 1; j <= jmax; j++){
+      x[k+j] -= rk[j]*xk;
+    }
+  }
+  // Then Rx = y
+  for (int k = dim-1; k > -1; k--){
+    const double* rk = r + k*w;
+    int jmax = (k+bw < dim-1 ? k+bw : dim-1) - k;
+    double sum = x(k);
+    for (int j = 1; j <= jmax; j++){
+      sum -= rk[j]*x(k+j);
+    }
+    x[k] = sum/rk[0];
+  }
+  return x;
+}
+
+Vector trisolve(const TriangularMatrix& T, const Vector& b, bool trans)
+{
+  int dim = T.size();
+  PROFILE("trisolve", (double)dim*dim);
+  if (b.size() != dim) {
+    throw( Error("TRISOLVE", "Vector and matrix are different sizes.") );
+  }
+  const double* t = T.data();
+  Vector x(dim);
+  x = b;
+  double* xv = x.data();
+  // Solving with the stored triangle is a sweep of inner products along its
+  // rows, whereas with its transpose each row updates the rest of x
+  bool lower = (T.isUpper() == trans);
+  if (!trans) {
+    if (lower) {
+      for (int i = 0; i < dim; i++){
+	const double* ti = t + T.rowStart(i);
+	double sum = xv[i];
+	for (int j = 0; j < i; j++){
+	  sum -= ti[j]*xv[j];
+	}
+	xv[i] = sum/ti[i];
+      }
+    } else {
+      for (int i = dim-1; i > -1; i--){
+	const double* ti = t + T.rowStart(i) - i; // Indexed by column
+	double sum = xv[i];
+	for (int j = i+1; j < dim; j++){
+	  sum -= ti[j]*xv[j];
+	}
+	xv[i] = sum/ti[i];
+      }
+    }
+  } else {
+    if (lower) {
+      // T(T) lower, so T is upper
+      for (int k = 0; k < dim; k++){
+	const double* tk = t + T.rowStart(k) - k;
+	xv[k] /= tk[k];
+	double xk = xv[k];
+	for (int j = k+1; j < dim; j++){
+	  xv[j] -= tk[j]*xk;
+	}
+      }
+    } else {
+      for (int k = dim-1; k > -1; k--){
+	const double* tk = t + T.rowStart(k);
+	xv[k] /= tk[k];
+	double xk = xv[k];
+	for (int j = 0; j < k; j++){
+	  xv[j] -= tk[j]*xk;
+	}
+      }
     }
   }
-  // Then solve by backsub
-  x = backsub(U, x);
   return x;
 }
 
 
+Vector choleskysolve(const SymmetricMatrix& A, const Vector& b)
+{
+  PROFILE("choleskysolve(packed)", (double)A.size()*A.size()*(A.size()/3.0 + 2.0));
+  TriangularMatrix R = cholesky(A);
+  return choleskysolve(b, R);
+}
+
+
+Vector choleskysolve(const Vector& b, const TriangularMatrix& R)
+{
+  if (!R.isUpper()) {
+    throw( Error("CHOLSOLVE", "Factor must be upper triangular.") );
+  }
+  // R(T)y = b, then Rx = y
+  Vector y = trisolve(R, b, true);
+  return trisolve(R, y);
+}
+
+
+Vector ldltsolve(const SymmetricMatrix& A, const Vector& b)
+{
+  PROFILE("ldltsolve", (double)A.size()*A.size()*(A.size()/3.0 + 2.0));
+  Vector d;
+  TriangularMatrix L = ldlt(A, d);
+  return ldltsolve(L, d, b);
+}
+
+
+Vector ldltsolve(const TriangularMatrix& L, const Vector& d, const Vector& b)
+{
+  if (L.isUpper() || d.size() != L.size()) {
+    throw( Error("LDLTSOLVE", "Factors are the wrong shape.") );
+  }
+  // Ly = b, Dz = y, then L(T)x = z
+  Vector x = trisolve(L, b);
+  for (int i = 0; i < x.size(); i++){
+    x[i] /= d(i);
+  }
+  return trisolve(L, x, true);
+}
+
 // Solve the linear system Ax = b, where A is real symmetric
 // positive definite, using Cholesky decomposition
 // The algorithm is A = R(T)R by decomposition, so we solve
@@ -166,6 +854,7 @@ Vector lusolve(const Matrix& B, const Vector& p, const Vector& b)
 Vector choleskysolve(const Matrix& A, const Vector& b)
 {
   int dim = A.nrows(); // Assume square
+  PROFILE("choleskysolve", dim*dim*(double)dim/3.0 + 2.0*dim*dim);
   Vector x(dim); // Solution vector
   Matrix R;
   R = cholesky(A); // Get the upper triangular matrix R
@@ -207,10 +896,11 @@ Vector choleskysolve(const Vector& b, const Matrix& R)
 
 // The power iteration method for finding the largest absolute 
 // valued eigenvalue of a matrix A, given a normalised vector v.
+// The iterate is updated in place, so no allocation is done per step.
 double poweriter(const Matrix& A, Vector& v, double PRECISION, int MAXITER)
 {
-  Vector w; // Temporary vector for intermediate steps
   int dim = v.size();
+  Vector w(dim); // Temporary vector for intermediate steps
   double norm = pnorm(v, 2);
   double lambda = 0.0; // The eigenvalue 
   if(norm - 1.0 > PRECISION) { // Normalise if not already
@@ -221,18 +911,30 @@ double poweriter(const Matrix& A, Vector& v, double PRECISION, int MAXITER)
   double err = 1.0; // Track error - max of dist and norm
   double oldlambda = 0.0; // Store the old lambda value for error calc
   int iter = 0; // Track number of iterations
-  Vector oldv;
   while(err > PRECISION && iter < MAXITER){
-    oldv = v; // Store previous vector
-    w = A*v; // Calculat Av
-    v = w;
-    w.sort(); // Sort w without changing v
+    // Calculate w = Av
+    for (int i = 0; i < dim; i++){
+      double sum = 0.0;
+      for (int j = 0; j < dim; j++){
+	sum += A(i, j)*v(j);
+      }
+      w[i] = sum;
+    }
     // The best guess for the eigenvalue is the largest by absolute value
     // member of w
-    lambda = (fabs(w(0)) > fabs(w(dim-1)) ? w(0) : w(dim-1));
-    v = (1.0/lambda)*v;
+    lambda = w(0);
+    for (int i = 1; i < dim; i++){
+      lambda = (fabs(w(i)) > fabs(lambda) ? w(i) : lambda);
+    }
+    // Rescale into v, measuring the change from the previous iterate
+    norm = 0.0;
+    for (int i = 0; i < dim; i++){
+      double vi = w(i)/lambda;
+      norm += (vi - v(i))*(vi - v(i));
+      v[i] = vi;
+    }
+    norm = sqrt(norm);
     dist = fabs(lambda - oldlambda);
-    norm = pnorm(v-oldv, 2);
     err = (norm < dist ? dist : norm);
     oldlambda = lambda;
     iter++;
@@ -240,8 +942,120 @@ double poweriter(const Matrix& A, Vector& v, double PRECISION, int MAXITER)
   return lambda;
 }
 
+// Block subspace iteration for the k eigenvalues of largest absolute value
+// of the real symmetric matrix A. A whole block of k vectors is multiplied
+// by A at each step, and the block is reorthonormalised by Householder QR.
+// A Rayleigh-Ritz projection onto the block then gives the current
+// approximations, and each Ritz pair is checked for convergence
+// individually, via the residual norm |Ax - theta*x|.
+// If vecs is already n x k on entry, it is used as the starting block.
+// Values are returned in order of decreasing absolute value, with the
+// corresponding vectors in the columns of vecs. Returns the number of
+// converged eigenpairs (k if successful).
+int subspaceiter(const Matrix& A, int k, Vector& vals, Matrix& vecs, double PRECISION, int MAXITER)
+{
+  int dim = A.nrows(); // Must be square
+  if (k > dim) { k = dim; }
+  if (k < 1 || !A.isSquare()) {
+    throw( Error("SUBSPACE", "Invalid block size for subspace iteration.") );
+  }
+  // Set up the starting block
+  Matrix X(dim, k);
+  if (vecs.nrows() == dim && vecs.ncols() == k) {
+    X = vecs;
+  } else {
+    // Deterministic, but generically not deficient in any eigenvector
+    for (int i = 0; i < dim; i++){
+      for (int j = 0; j < k; j++){
+	X(i, j) = (i == j ? 1.0 : 0.0) + 1.0/(double(i+j+1)*double(j+1));
+      }
+    }
+  }
+  vals.resize(k);
+  Matrix Z, R, V, H, W, T; // Block products, QR and Rayleigh-Ritz matrices
+  Vector theta; // Ritz values
+  int nconv = 0; // Number of leading converged Ritz pairs
+  int iter = 0;
+  double anorm = fnorm(A);
+  if (anorm < PRECISION) { anorm = 1.0; }
+  while (nconv < k && iter < MAXITER) {
+    // Orthonormalise the block
+    dgehh(X, R, V);
+    X = explicitq(V);
+    // Multiply the whole block by A at once
+    Z = A*X;
+    // Rayleigh-Ritz projection H = X(T)AX
+    H = X.transpose()*Z;
+    for (int i = 0; i < k; i++){ // Symmetrise against rounding
+      for (int j = 0; j < i; j++){
+	H(i, j) = H(j, i) = 0.5*(H(i, j) + H(j, i));
+      }
+    }
+    if (k > 1) {
+      symqr(H, theta, W, PRECISION*1e-2);
+    } else {
+      theta.assign(1, H(0, 0));
+      W.assign(1, 1, 1.0);
+    }
+    // Order the Ritz pairs by decreasing absolute value
+    for (int i = 0; i < k-1; i++){
+      int imax = i;
+      for (int j = i+1; j < k; j++){
+	imax = (fabs(theta(j)) > fabs(theta(imax)) ? j : imax);
+      }
+      if (imax != i) {
+	theta.swap(i, imax);
+	W.swapCols(i, imax);
+      }
+    }
+    // Ritz vectors X <- XW, and their images AX <- ZW
+    X = X*W;
+    Z = Z*W;
+    // Check the residual of each Ritz pair in turn
+    nconv = 0;
+    bool leading = true;
+    for (int j = 0; j < k; j++){
+      double res = 0.0;
+      for (int i = 0; i < dim; i++){
+	double r = Z(i, j) - theta(j)*X(i, j);
+	res += r*r;
+      }
+      if (sqrt(res) < PRECISION*anorm && leading) {
+	nconv++;
+      } else {
+	leading = false;
+      }
+    }
+    for (int j = 0; j < k; j++) { vals[j] = theta(j); }
+    // Next iterate is the block AX, unless finished
+    if (nconv < k) { X = Z; }
+    iter++;
+  }
+  vecs = X;
+  return nconv;
+}
+
+// Split the tridiagonal (symmetric Hessenberg) matrix H into its three diagonals
+static void tridiagonals(const Matrix& H, Vector& dl, Vector& d, Vector& du)
+{
+  int dim = H.nrows();
+  d.resize(dim);
+  dl.resize(dim > 0 ? dim-1 : 0);
+  du.resize(dim > 0 ? dim-1 : 0);
+  for (int i = 0; i < dim; i++){
+    d[i] = H(i, i);
+    if (i < dim-1) {
+      dl[i] = H(i+1, i);
+      du[i] = H(i, i+1);
+    }
+  }
+}
+
 // Do the inverse power iteration to find the eigenvalue closest to u, and the
-// corresponding eigenvector (stored in v). Uses lusolve.
+// corresponding eigenvector (stored in v). A is reduced to Hessenberg form
+// H = Q(T)AQ once, and the iteration is done on Q(T)v, so that the shifted
+// system costs O(n^2) to factorise and solve - or O(n), when A is
+// symmetric and H is tridiagonal.
 double inverseiter(const Matrix& A, Vector& v, double u, double PRECISION, int MAXITER)
 {
   Vector w; // Temporary vector for intermediate steps                              
@@ -251,151 +1065,285 @@ double inverseiter(const Matrix& A, Vector& v, double u, double PRECISION, int M
   if(norm - 1.0 > PRECISION) { // Normalise if not already                     
     v = (1.0/norm)*v;
   }
-  // Form the matrix A-uI and LU decompose
-  Matrix X(dim, dim);
-  X = A;
-  for (int i = 0; i < dim; i++){
-    X(i, i) -= u;
+  // Reduce A to Hessenberg form, and transform v
+  Matrix H; Matrix q;
+  hessenberg(A, H, q);
+  implicitqtb(q, v);
+  bool tridiag = A.isSymmetric();
+  // Form H - uI and decompose
+  Vector dl, d, du; // Diagonals of H - uI, if tridiagonal
+  Matrix B; Vector p; // Will store the Hessenberg LU decomposition otherwise
+  if (tridiag) {
+    tridiagonals(H, dl, d, du);
+    for (int i = 0; i < dim; i++) { d[i] -= u; }
+  } else {
+    p = dhslu(H, u, B);
   }
-  Matrix B; Vector p; // Will store the LU/cholesky decomposition
-  p = dgelu(X, B);
 
   // Begin loop                                                                   
   double dist = 1.0; // Track distance between eigenvalue at each iter                  
   double err = 1.0; // Track error - max of dist and norm                            
   double oldlambda = 0.0; // Store the old lambda value for error calc              
   int iter = 0; // Track number of iterations                                 
-  Vector oldv;
   while(err > PRECISION && iter < MAXITER){
-    oldv = v; // Store previous vector                           
     // Solve the system of equations
-    w = lusolve(B, p, v);
-    v = w;
-    w.sort();
-    lambda = (fabs(w(0)) > fabs(w(dim-1)) ? w(0) : w(dim-1));
-    v = (1.0/lambda)*v;
+    if (tridiag) {
+      w = tridiagsolve(dl, d, du, v);
+    } else {
+      w = hessenbergsolve(B, p, v);
+    }
+    // Scale by the largest element, measuring the change in v
+    lambda = w(0);
+    for (int i = 1; i < dim; i++){
+      lambda = (fabs(w(i)) > fabs(lambda) ? w(i) : lambda);
+    }
+    norm = 0.0;
+    double vnorm = 0.0;
+    for (int i = 0; i < dim; i++){
+      double vi = w(i)/lambda;
+      norm += (vi - v(i))*(vi - v(i));
+      vnorm += vi*vi;
+      v[i] = vi;
+    }
+    norm = sqrt(norm/vnorm);
     lambda = (1.0/lambda) + u;
     dist = fabs(lambda - oldlambda);
-    norm = pnorm(v-oldv, 2)/(pnorm(v, 2));
     err = (norm < dist ? dist : norm);
     oldlambda = lambda;
     iter++;
   }
   v = (1.0/pnorm(v, 2))*v;
+  implicitqx(q, v);
   return lambda;
 }  
 
 // Rayleigh quotient iteration to get fast convergence to an eigenvalue
 // eigenvector pair. Takes the matrix A for which eigenv's are needed,
 // a starting guess eigenvec v, a starting guess value l0, and cutoff criteria.
-// Returns eigenvalue, stores vector in v.
+// Returns eigenvalue, stores vector in v. The shift changes every step, so
+// A is first reduced to Hessenberg form, making each new shifted system
+// O(n^2) to solve from scratch (O(n) for symmetric A).
 double rayleigh(const Matrix& A, Vector& v, double l0, double PRECISION, int MAXITER)
 {
   double lambda = 0.0;
   double mu = l0;
+  int dim = v.size();
   v = (1.0/pnorm(v, 2))*v;
-  // Form A - mu*I
-  Matrix X;
-  X = A;
-  for (int i = 0; i < A.nrows(); i++){
-    X(i, i) = X(i, i) - mu;
+  // Reduce A to Hessenberg form, and transform v
+  Matrix H; Matrix q;
+  hessenberg(A, H, q);
+  implicitqtb(q, v);
+  bool tridiag = A.isSymmetric();
+  Vector dl, d, du, ds; // Diagonals, and shifted diagonal, if tridiagonal
+  if (tridiag) {
+    tridiagonals(H, dl, d, du);
+    ds.resize(dim);
   }
-  // Solve Xy = v for y
+  // Solve (H - mu*I)y = v for y
   Vector y;
-  y = lusolve(X, v);
-  lambda = inner(y, v);
-  mu = mu + (1.0/lambda);
-  double err = pnorm(y-lambda*v, 2)/(pnorm(y, 2));
   int iter = 0;
-  while (err > PRECISION && iter < MAXITER){
-    v = (1.0/pnorm(y, 2))*y;
-    // Form A - mu*I
-    X = A;
-    for (int i = 0; i < A.nrows(); i++){
-      X(i, i) = X(i, i) - mu;
-    }
-    // Solve Xy = v
-    y = lusolve(X, v);
+  double err = 1.0;
+  while (iter == 0 || (err > PRECISION && iter <= MAXITER)){
+    if (iter > 0) { v = (1.0/pnorm(y, 2))*y; }
+    if (tridiag) {
+      for (int i = 0; i < dim; i++) { ds[i] = d(i) - mu; }
+      y = tridiagsolve(dl, ds, du, v);
+    } else {
+      y = hessenbergsolve(H, mu, v);
+    }
     lambda = inner(y, v);
     mu = mu + (1.0/lambda);
     err = pnorm(y-lambda*v, 2)/pnorm(y, 2);
     iter++;
   }
+  implicitqx(q, v);
   return mu;
 }
 
+// The shifted QR iteration itself, on the matrix vectemp, which is already
+// in Hessenberg form. Destroys vectemp.
+static bool qrshifthess(Matrix& vectemp, Vector& vals, double PRECISION, int MAXITER)
+{
+  bool rval = true;
+  int n = vectemp.nrows();
+  PROFILE("qrshift/sweeps", 0.0); // Counted by each step
+  Matrix v;
+  // Begin main loop
+  for (int m = n-1; m > 0; m--){
+    TRACEARG("qrshift/eigenvalue", m);
+    // Proceed until subdiagonal element is essentially zero (for a
+    // nonsymmetric matrix the superdiagonal need not go to zero at all)
+    int iter = 0;
+    while(fabs(vectemp(m, m-1)) > PRECISION && iter < MAXITER){
+      // Form vecs - vec(m, m)*I = temp
+      Matrix temp1;
+      temp1 = vectemp;
+      for (int i = 0; i<m+1; i++){
+	temp1(i, i) = temp1(i, i) - temp1(m, m);
+      }
+      // Do householder qr decomp
+      Matrix temp2;
+      // QR, forming Q and RQ are 4k^3/3, 4k^3/3 and 2k^3 on the k x k block
+      PROFILEFLOPS(14.0*(m+1)*(m+1)*(m+1)/3.0);
+      if (dgehh(temp1, temp2, v)){
+	// Form R*Q
+	temp1 = explicitq(v);
+	temp1 = temp2*temp1;
+	// Add in vectemp(m, m) * I
+	for (int i = 0; i < m+1; i++){
+	  temp1(i, i) = temp1(i, i) + vectemp(m, m);
+	}
+	vectemp = temp1;
+      } else {
+	rval = false; // Something went wrong
+      }
+      iter++;
+    }
+    // Record eigenvalue m
+    vals[m] = vectemp(m, m);
+    // Deflate vectemp
+    vectemp.removeRow(m);
+    vectemp.removeCol(m);
+  }
+  // Record eigenvalue 0
+  if (n > 0) { vals[0] = vectemp(0, 0); }
+  return rval;
+}
+
 // QR Algorithm with shifts to calculate the eigenvalues of a matrix A.
-// Assumes real symmetric matrix.
+// Assumes the eigenvalues are real.
 bool qrshift(const Matrix& A, Vector& vals, double PRECISION, int MAXITER)
 {
+  PROFILE("qrshift", 10.0*A.nrows()*A.nrows()*(double)A.nrows()/3.0);
   bool rval = true;
   int n = A.nrows(); // Must be square
   vals.resize(n);
   Matrix v;
   Matrix vectemp;
-  // Reduce A to tridiagonal form
+  // Reduce A to Hessenberg (tridiagonal, if symmetric) form
   if(hessenberg(A, vectemp, v)){
-    // Begin main loop
-    for (int m = n-1; m > 0; m--){
-      // Proceed until subdiagonal element is essentially zero
-      int iter = 0;
-      while(fabs(vectemp(m-1, m)) > PRECISION && iter < MAXITER){
-	// Form vecs - vec(m, m)*I = temp
-	Matrix temp1;
-	temp1 = vectemp;
-	for (int i = 0; i<m+1; i++){
-	  temp1(i, i) = temp1(i, i) - temp1(m, m);
-	}
-	// Do householder qr decomp
-	Matrix temp2;
-	if (dgehh(temp1, temp2, v)){
-	  // Form R*Q
-	  temp1 = explicitq(v);
-	  temp1 = temp2*temp1;
-	  // Add in vectemp(m, m) * I
-	  for (int i = 0; i < m+1; i++){
-	    temp1(i, i) = temp1(i, i) + vectemp(m, m);
-	  }
-	  vectemp = temp1;
-	} else {
-	  rval = false; // Something went wrong
-	}
-	iter++;
-      }
-      // Record eigenvalue m
-      vals[m] = vectemp(m, m);
-      // Deflate vectemp
-      vectemp.removeRow(m);
-      vectemp.removeCol(m);
-    }
-    // Record eigenvalue 0
-    vals[0] = vectemp(0, 0);
+    rval = qrshifthess(vectemp, vals, PRECISION, MAXITER);
   } else {
     rval = false; // Something went wrong with hessenberg
   }
   return rval;
 }
 
-// Same as above, but for when vectors are wanted as well
+// Same as above, but for when vectors are wanted as well.
+// The eigenvectors are found by inverse iteration on the Hessenberg form H
+// of A, which is computed only once, so each solve is O(n^2) (O(n) for
+// tridiagonal H). The eigenvalues are split into clusters of close values:
+// the clusters are independent and are shared between threads, whilst
+// within a cluster of a symmetric A each new vector is reorthogonalised
+// against the previous ones at every step. All the vectors are then transformed back to those of
+// A by a single matrix-matrix product with Q.
 bool qrshift(const Matrix& A, Vector& vals, Matrix& vecs, double PRECISION, int MAXITER)
 {
+  // Hessenberg form, then forming Q and back-transforming at the end
+  PROFILE("qrshift", 20.0*A.nrows()*A.nrows()*(double)A.nrows()/3.0);
   bool rval = true;
-  if(qrshift(A, vals, PRECISION, MAXITER)){
-    // Find eigenvectors using inverse iteration, as we have a good guess for eigenvalue
-    double temp;
-    int dim = vals.size();
-    Vector v(dim);
-    for (int i = 0; i<dim; i++){
-      v[i] = 1.0;
-    }
-    vecs.resize(dim, dim);
-    for(int i = 0; i < dim; i++){
-      temp = inverseiter(A, v, vals(i), PRECISION, MAXITER);
-      vecs.setCol(i, v);
+  int dim = A.nrows(); // Must be square
+  vals.resize(dim);
+  Matrix H; Matrix q;
+  if (!hessenberg(A, H, q)) { return false; }
+  Matrix T;
+  T = H;
+  rval = qrshifthess(T, vals, PRECISION, MAXITER);
+  if (!rval) { return false; }
+
+  bool tridiag = A.isSymmetric();
+  Vector dl, d, du; // Diagonals of H, if tridiagonal
+  if (tridiag) { tridiagonals(H, dl, d, du); }
+  double hnorm = pnorm(H, 1);
+  if (hnorm == 0.0) { hnorm = 1.0; }
+  double eps = 2.2e-16;
+  double ortol = 1e-3*hnorm; // Values closer than this form a cluster
+  double pertol = 10.0*eps*hnorm; // Minimum separation of the shifts
+  double restol = (PRECISION > 10.0*dim*eps ? PRECISION : 10.0*dim*eps)*hnorm;
+  int maxit = (MAXITER < 10 ? MAXITER : 10);
+
+  // Order the values, and find the start of each cluster
+  int* order = new int[dim];
+  for (int i = 0; i < dim; i++) { order[i] = i; }
+  for (int i = 1; i < dim; i++){ // Insertion sort, by value
+    int j = i;
+    while (j > 0 && vals(order[j]) < vals(order[j-1])) {
+      int temp = order[j]; order[j] = order[j-1]; order[j-1] = temp;
+      j--;
     }
-  } else {
-    rval = false;
   }
+  int* clusters = new int[dim+1];
+  int nclusters = 0;
+  for (int i = 0; i < dim; i++){
+    if (i == 0 || vals(order[i]) - vals(order[i-1]) > ortol) { clusters[nclusters++] = i; }
+  }
+  clusters[nclusters] = dim;
+
+  Matrix Y(dim, dim); // Eigenvectors of H
+  {
+    PROFILE("qrshift/vectors", 0.0);
+    double vflops = 0.0; // Counted by the threads, added after
+#pragma omp parallel for schedule(dynamic) reduction(+:vflops)
+    for (int c = 0; c < nclusters; c++){
+      TRACEARG("qrshift/cluster", c);
+      int first = clusters[c], size = clusters[c+1] - clusters[c];
+      Vector* zs = new Vector[size]; // The vectors found so far in this cluster
+      Matrix B; Vector p; // Hessenberg LU, if needed
+      Vector ds(dim);
+      Vector x(dim), y(dim);
+      double lambda = 0.0;
+      for (int j = 0; j < size; j++){
+	int k = order[first+j];
+	// Make sure the shifts within a cluster are distinct
+	double shift = vals(k);
+	if (j > 0 && shift - lambda < pertol) { shift = lambda + pertol; }
+	lambda = shift;
+	if (tridiag) {
+	  for (int i = 0; i < dim; i++) { ds[i] = d(i) - shift; }
+	} else {
+	  p = dhslu(H, shift, B);
+	  vflops += 2.0*dim*dim;
+	}
+	// Pseudo-random starting vector, different for each value
+	unsigned long seed = 1234567UL + 7919UL*k;
+	for (int i = 0; i < dim; i++){
+	  seed = (1103515245UL*seed + 12345UL) % 2147483648UL;
+	  x[i] = double(seed)/2147483648.0 - 0.5;
+	}
+	x = (1.0/pnorm(x, 2))*x;
+	int extra = 0;
+	for (int iter = 0; iter < maxit && extra < 2; iter++){
+	  if (tridiag) {
+	    y = tridiagsolve(dl, ds, du, x);
+	  } else {
+	    y = hessenbergsolve(B, p, x);
+	  }
+	  // Reorthogonalise against the rest of the cluster, if symmetric, as
+	  // otherwise the vectors need not be orthogonal
+	  for (int l = 0; tridiag && l < j; l++){
+	    double proj = inner(zs[l], y);
+	    for (int i = 0; i < dim; i++) { y[i] -= proj*zs[l](i); }
+	  }
+	  // As |x| = 1, the residual of the new iterate is 1/|y|
+	  double ynorm = pnorm(y, 2);
+	  for (int i = 0; i < dim; i++) { x[i] = y(i)/ynorm; }
+	  // The solve, the reorthogonalisation and the normalisation
+	  vflops += (tridiag ? 8.0*dim + 4.0*dim*j : 2.0*dim*dim) + 3.0*dim;
+	  if (1.0 < restol*ynorm) { extra++; }
+	}
+	zs[j] = x;
+	for (int i = 0; i < dim; i++) { Y(i, k) = x(i); }
+      }
+      delete[] zs;
+    }
+    PROFILEFLOPS(vflops);
+  }
+  delete[] order;
+  delete[] clusters;
+
+  // Back-transform all the vectors at once, v = Qy
+  PROFILE("qrshift/backtransform", 2.0*dim*dim*(double)dim);
+  vecs = explicitq(q)*Y;
   return rval;
 }
 
@@ -403,6 +1351,7 @@ bool qrshift(const Matrix& A, Vector& vals, Matrix& vecs, double PRECISION, int
 // as in the following implementation:
 bool symqr(const Matrix& A, Vector& vals, double PRECISION)
 {
+  PROFILE("symqr", 10.0*A.nrows()*A.nrows()*(double)A.nrows()/3.0);
   bool rval = true;
   int dim = A.nrows(); // It's square
   vals.resize(dim);
@@ -447,17 +1396,23 @@ bool symqr(const Matrix& A, Vector& vals, double PRECISION)
 	  D(i-p, i-p) = B(i, i);
 	  D(i-p+1, i-p) = D(i-p, i-p+1) = B(i, i+1);
 	}
-	D(q-p, q-p) = B(q-p, q-p);
+	D(q-p, q-p) = B(q, q);
 	// Do the implicit shift step, getting the transformation matrix Z
 	Matrix Z;
-	Z = implicitshift(D, PRECISION);
+	{
+	  // k-1 rotations, each applied to rows and columns of D and to Z
+	  PROFILE("symqr/sweep", 0.0);
+	  PROFILEFLOPS(18.0*(q-p+1)*(q-p));
+	  Z = implicitshift(D, PRECISION);
+	}
 	// Recompute B
 	for (int i = p; i < q; i++){
 	  B(i, i) = D(i-p, i-p);
 	  B(i, i+1) = B(i+1, i) = D(i-p+1, i-p);
 	}
-	B(q-p, q-p) = D(q-p, q-p);
+	B(q, q) = D(q-p, q-p);
       }
+      if (p > flag) { TRACEMARK("symqr/deflate", p); }
       flag = p;
     }
     // Copy eigenvalues from diagonal of B
@@ -473,6 +1428,8 @@ bool symqr(const Matrix& A, Vector& vals, double PRECISION)
 // Same as above, but computes eigenvectors as well
 bool symqr(const Matrix& A, Vector& vals, Matrix& vecs, double PRECISION)
 {
+  // Hessenberg form, and forming its Q
+  PROFILE("symqr", 14.0*A.nrows()*A.nrows()*(double)A.nrows()/3.0);
   bool rval = true;
   int dim = A.nrows(); // It's square
   vals.resize(dim);
@@ -520,16 +1477,21 @@ bool symqr(const Matrix& A, Vector& vals, Matrix& vecs, double PRECISION)
 	  D(i-p, i-p) = B(i, i);
 	  D(i-p+1, i-p) = D(i-p, i-p+1) = B(i, i+1);
 	}
-	D(q-p, q-p) = B(q-p, q-p);
+	D(q-p, q-p) = B(q, q);
 	// Do the implicit shift step, getting the transformation matrix Z
 	Matrix Z;
-	Z = implicitshift(D, PRECISION);
+	{
+	  // k-1 rotations, each applied to rows and columns of D and to Z
+	  PROFILE("symqr/sweep", 0.0);
+	  PROFILEFLOPS(18.0*(q-p+1)*(q-p));
+	  Z = implicitshift(D, PRECISION);
+	}
 	// Recompute B
 	for (int i = p; i < q; i++){
 	  B(i, i) = D(i-p, i-p);
 	  B(i, i+1) = B(i+1, i) = D(i-p+1, i-p);
 	}
-	B(q-p, q-p) = D(q-p, q-p);
+	B(q, q) = D(q-p, q-p);
 	// Recompute Q
 	D.assign(dim, dim, 0.0);
 	for (int i = 0; i < p; i++) { D(i, i) = 1.0; }
@@ -539,8 +1501,11 @@ bool symqr(const Matrix& A, Vector& vals, Matrix& vecs, double PRECISION)
 	    D(i, j) = Z(i-p, j-p);
 	  }
 	}
+	PROFILE("symqr/backtransform", 0.0);
+	PROFILEFLOPS(2.0*dim*dim*(double)dim);
 	vecs = vecs*D;
       }
+      if (p > flag) { TRACEMARK("symqr/deflate", p); }
       flag = p;
     }
     // Copy eigenvalues from diagonal of B
@@ -553,6 +1518,99 @@ bool symqr(const Matrix& A, Vector& vals, Matrix& vecs, double PRECISION)
   return rval;
 }
 
+// Parallel cyclic Jacobi. Within a round of the round-robin ordering the
+// pairs (p, q) are disjoint, so the rotations commute: all the angles can be
+// computed from the current matrix, then all the row rotations applied,
+// followed by all the column rotations. The latter are split by blocks of
+// rows between threads, so that each thread works on contiguous memory.
+bool jacobi(const Matrix& A, Vector& vals, Matrix& vecs, double PRECISION, int MAXSWEEP)
+{
+  PROFILE("jacobi", 0.0);
+  bool rval = false;
+  int dim = A.nrows(); // Must be square
+  Matrix B;
+  B = A;
+  vecs.assign(dim, dim, 0.0);
+  for (int i = 0; i < dim; i++) { vecs(i, i) = 1.0; }
+
+  int nrounds = roundrobin(dim, 0, NULL);
+  int* pairs = new int[dim+1];
+  bool* active = new bool[dim/2 + 1]; // Whether each pair needs rotating
+  Vector* rots = new Vector[dim/2 + 1];
+  for (int i = 0; i < dim/2 + 1; i++) { rots[i].resize(2); }
+  int sweep = 0;
+  while (!rval && sweep < MAXSWEEP) {
+    TRACEARG("jacobi/sweep", sweep);
+    int nrot = 0; // Rotations done this sweep
+    for (int r = 0; r < nrounds; r++){
+      int npairs = roundrobin(dim, r, pairs);
+      // Compute the rotations from the 2x2 subproblems
+      for (int i = 0; i < npairs; i++){
+	int p = pairs[2*i], q = pairs[2*i+1];
+	double apq = B(p, q);
+	active[i] = (fabs(apq) > PRECISION*sqrt(fabs(B(p, p)*B(q, q))) && fabs(apq) > 0.0);
+	if (active[i]) {
+	  double theta = (B(q, q) - B(p, p))/(2.0*apq);
+	  double t = (theta < 0.0 ? -1.0 : 1.0)/(fabs(theta) + sqrt(1.0 + theta*theta));
+	  rots[i][0] = 1.0/sqrt(1.0 + t*t);
+	  rots[i][1] = rots[i](0)*t;
+	  nrot++;
+	}
+      }
+      // Rows, one pair per thread
+#pragma omp parallel for schedule(static)
+      for (int i = 0; i < npairs; i++){
+	if (active[i]) { igivens(rots[i], B, pairs[2*i], pairs[2*i+1]); }
+      }
+      // Columns of B and of the eigenvectors, by blocks of rows
+#pragma omp parallel
+      {
+	TRACEARG("jacobi/columns", r);
+#ifdef _OPENMP
+	int nthreads = omp_get_num_threads();
+	int tid = omp_get_thread_num();
+#else
+	int nthreads = 1;
+	int tid = 0;
+#endif
+	int start = (dim*tid)/nthreads;
+	int end = (dim*(tid+1))/nthreads;
+	for (int i = 0; i < npairs; i++){
+	  if (active[i]) {
+	    igivens(B, rots[i], pairs[2*i], pairs[2*i+1], start, end);
+	    igivens(vecs, rots[i], pairs[2*i], pairs[2*i+1], start, end);
+	  }
+	}
+      }
+      // The rotated elements are zero in exact arithmetic
+      for (int i = 0; i < npairs; i++){
+	if (active[i]) { B(pairs[2*i], pairs[2*i+1]) = B(pairs[2*i+1], pairs[2*i]) = 0.0; }
+      }
+    }
+    // Each rotation is applied to two rows and columns of B, and two
+    // columns of the vectors
+    PROFILEFLOPS(18.0*dim*nrot);
+    rval = (nrot == 0);
+    sweep++;
+  }
+  delete[] pairs;
+  delete[] active;
+  delete[] rots;
+
+  // Eigenvalues are the diagonal, sort into ascending order
+  vals.resize(dim);
+  for (int i = 0; i < dim; i++) { vals[i] = B(i, i); }
+  for (int i = 0; i < dim-1; i++){
+    int imin = i;
+    for (int j = i+1; j < dim; j++) { imin = (vals(j) < vals(imin) ? j : imin); }
+    if (imin != i) {
+      vals.swap(i, imin);
+      vecs.swapCols(i, imin);
+    }
+  }
+  return rval;
+}
+
 // This does the implicit symmetric QR step with Wilkinson shift needed for the
 // symqr algorithm. It overwrites the tridiagonal matrix T with Z(T)TZ where
 // Z is a product of givens rotations, and returns Z.
@@ -7,6 +7,14 @@
  *   21/08/15         Robert Shaw       Original code
  *   22/08/15         Robert Shaw       Iterative eigenv's  added.
  *   23/08/15         Robert Shaw       Symqr with implicit shifts.
+ *   19/10/26         Robert Shaw       Block subspace iteration.
+ *   19/10/26         Robert Shaw       Parallel Jacobi eigensolver.
+ *   19/10/26         Robert Shaw       SVD least squares.
+ *   19/10/26         Robert Shaw       Hessenberg/tridiagonal shifted solves.
+ *   19/10/26         Robert Shaw       Banded and batched tridiagonal solves.
+ *   19/10/26         Robert Shaw       Packed triangular, cholesky and LDL(T) solves.
+ *   19/10/26         Robert Shaw       Mixed precision iterative refinement.
+ *   19/10/26         Robert Shaw       qrshift deflates nonsymmetric matrices.
  */
 
 #ifndef SOLVERSHEADERDEF
@@ -16,6 +24,10 @@
 class Vector;
 class Matrix;
 class Error;
+class BandedMatrix;
+class TridiagonalMatrix;
+class SymmetricMatrix;
+class TriangularMatrix;
 
 // The basic back-substitution routine, which is used in pretty much
 // every other solver. R is an upper triangular matrix, y is the 
@@ -34,6 +46,12 @@ Vector qrsolve(const Matrix& R, const Matrix& v, const Vector& b);
 // Ax = y with A being an m x n matrix, m > n
 Vector qrsquares(const Matrix& A, const Vector& b);
 
+// Solve the least squares problem Ax = b for any m x n A, including the
+// rank-deficient case, by singular value decomposition. Singular values
+// below PRECISION times the largest are treated as zero, giving the
+// minimum norm solution x = V S^+ U(T) b.
+Vector svdsquares(const Matrix& A, const Vector& b, double PRECISION = 1e-12);
+
 // Solve the square Ax = b problem by LU decomposition, i.e 
 // Gaussian elimination with partial pivoting. 
 // First instance does decomposition, second instance
@@ -41,6 +59,52 @@ Vector qrsquares(const Matrix& A, const Vector& b);
 Vector lusolve(const Matrix& A, const Vector& b);
 Vector lusolve(const Matrix& B, const Vector& p, const Vector& b);
 
+// Mixed precision variants of lusolve and choleskysolve. A is factorised
+// in single precision, by a blocked right-looking algorithm, and the
+// solution refined with residuals computed in double precision until
+// ||b - Ax|| <= ||A|| ||x|| eps sqrt(n), in the infinity norm, as in
+// LAPACK's dsgesv. iters is set to the number of refinement steps taken.
+// If A does not fit in single precision, its factorisation breaks down,
+// or the refinement stagnates (the residual does not halve) or has not
+// converged after MAXITER steps, the system is solved with the double
+// precision lusolve or choleskysolve instead, and iters is set to -1.
+Vector mixedlusolve(const Matrix& A, const Vector& b, int& iters, int MAXITER = 30);
+Vector mixedcholeskysolve(const Matrix& A, const Vector& b, int& iters, int MAXITER = 30);
+
+// Solve the shifted upper Hessenberg system (H - mu*I)x = b in O(n^2).
+// The first instance does the decomposition with dhslu, the second
+// takes the already formed decomposition.
+Vector hessenbergsolve(const Matrix& H, double mu, const Vector& b);
+Vector hessenbergsolve(const Matrix& B, const Vector& p, const Vector& b);
+
+// Solve the tridiagonal system Tx = b in O(n), where T has subdiagonal dl,
+// diagonal d and superdiagonal du, by Gaussian elimination with partial
+// pivoting (so T need not be diagonally dominant, or symmetric).
+Vector tridiagsolve(const Vector& dl, const Vector& d, const Vector& du, const Vector& b);
+Vector tridiagsolve(const TridiagonalMatrix& T, const Vector& b);
+
+// Solve Tx = b by the Thomas algorithm - Gaussian elimination without
+// pivoting - which is stable for diagonally dominant or SPD T. Throws an
+// error on a zero pivot, when tridiagsolve should be used instead.
+Vector thomas(const TridiagonalMatrix& T, const Vector& b);
+
+// Solve many independent tridiagonal systems by the Thomas algorithm at
+// once. Column s of each matrix belongs to system s, so the diagonals
+// DL, DU are (n-1) x m, D is n x m, and the right hand sides B (n x m)
+// are overwritten by the solutions. Working along rows, the inner loop runs
+// across the systems, so is vectorised, and blocks of systems are threaded.
+void thomas(const Matrix& DL, const Matrix& D, const Matrix& DU, Matrix& B);
+
+// Solve the banded system Ax = b, by LU decomposition (dgblu) in the
+// first instance, or with the already formed decomposition in the second
+Vector bandedlusolve(const BandedMatrix& A, const Vector& b);
+Vector bandedlusolve(const BandedMatrix& B, const Vector& p, const Vector& b);
+
+// Solve the banded SPD system Ax = b by banded cholesky factorisation,
+// or with the already formed factor R, arguments reversed as for choleskysolve
+Vector bandedcholeskysolve(const BandedMatrix& A, const Vector& b);
+Vector bandedcholeskysolve(const Vector& b, const BandedMatrix& R);
+
 // Solve the square, symmetric positive definite sytem Ax = b 
 // using cholesky factorisation
 // Second instance uses already formed factorisation - note
@@ -48,6 +112,20 @@ Vector lusolve(const Matrix& B, const Vector& p, const Vector& b);
 Vector choleskysolve(const Matrix& A, const Vector& b);
 Vector choleskysolve(const Vector& b, const Matrix& R);
 
+// Solve Tx = b, or T(T)x = b if trans is true, for the packed triangular T,
+// by forward or back substitution as appropriate. Rows of T are contiguous,
+// so the transposed solves work a row (column of T(T)) at a time.
+Vector trisolve(const TriangularMatrix& T, const Vector& b, bool trans = false);
+
+// As choleskysolve, for packed storage, where R is the packed factor
+Vector choleskysolve(const SymmetricMatrix& A, const Vector& b);
+Vector choleskysolve(const Vector& b, const TriangularMatrix& R);
+
+// Solve the symmetric system Ax = b by LDL(T) factorisation (ldlt), or
+// with the already formed factors L and d in the second instance
+Vector ldltsolve(const SymmetricMatrix& A, const Vector& b);
+Vector ldltsolve(const TriangularMatrix& L, const Vector& d, const Vector& b);
+
 // Use the power iteration algorithm to find an eigenvalue -
 // specifically the eigenvalue with largest absolute value -
 // of A given a (normalised) vector, v. The eigenvector is
@@ -55,17 +133,29 @@ Vector choleskysolve(const Vector& b, const Matrix& R);
 // Cuts off when PRECISION is reached, or MAXITER iterations done
 double poweriter(const Matrix& A, Vector& v, double PRECISION = 1e-12, int MAXITER = 100);
 
+// Use block subspace iteration to find the k eigenvalues of largest absolute
+// value of the real symmetric matrix A, together with their eigenvectors.
+// The block is orthonormalised by Householder QR and the eigenpairs are
+// extracted by Rayleigh-Ritz projection. Values are returned in vals in
+// decreasing order of absolute value, vectors in the columns of vecs (which
+// is used as the starting block if already n x k). Returns the number of
+// eigenpairs that have converged to within PRECISION.
+int subspaceiter(const Matrix& A, int k, Vector& vals, Matrix& vecs, double PRECISION = 1e-10, int MAXITER = 500);
+
 // Use the inverse power iteration method to find the eigenvalue
 // (and corresponding eigenvector) of A nearest to u, given a vector v.
-// Returns the eigenvalue.
+// A is reduced to Hessenberg (tridiagonal, if symmetric) form once, so
+// that each step costs O(n^2) (O(n)). Returns the eigenvalue.
 double inverseiter(const Matrix& A, Vector& v, double u, double PRECISION = 1e-12, int MAXITER=100);
 
 // Use the Rayleigh Iteration Algorithm to get approximations for an eigenvec/val pair
-// of a matrix A. Returns eigenvalue, stores vector in v.
+// of a matrix A. Returns eigenvalue, stores vector in v. As above, the
+// shifted systems are solved in Hessenberg (tridiagonal) form.
 double rayleigh(const Matrix& A, Vector& v, double l0, double PRECISION = 1e-8, int MAXITER = 50);
 
 // Use the QR algorithm with shifts to find the approximate eigenvalues
-// of a matrix A. The values are returned in the vector vals.
+// of a matrix A, which must all be real. The values are returned in the
+// vector vals.
 // The second instance is for when vectors are wanted as well.
 // Will return true if successful.
 bool qrshift(const Matrix& A, Vector& vals, double PRECISION = 1e-12, int MAXITER = 100);
@@ -79,6 +169,12 @@ Matrix implicitshift(Matrix& T, double PRECISION);
 bool symqr(const Matrix& A, Vector& vals, double PRECISION = 1e-12);
 bool symqr(const Matrix& A, Vector& vals, Matrix& vecs, double PRECISION);
 
+// The cyclic Jacobi method for a real-symmetric matrix, using a round-robin
+// ordering so that each round rotates disjoint pairs, in parallel.
+// Slower than symqr, but gives eigenvalues to high relative accuracy.
+// Values are returned in ascending order in vals, with the corresponding
+// vectors in the columns of vecs. Returns true if converged.
+bool jacobi(const Matrix& A, Vector& vals, Matrix& vecs, double PRECISION = 1e-14, int MAXSWEEP = 60);
 
 // Utility functions for symeig that pack and unpack matrices              
 void splitmatrix(const Matrix& B, Matrix& b1, Matrix& b2, int i);
@@ -0,0 +1,652 @@
+// Implements spchol.hpp
+
+#include "spchol.hpp"
+#include "factors.hpp"
+#include "vector.hpp"
+#include "matrix.hpp"
+#include "sparse.hpp"
+#include "error.hpp"
+#include "profile.hpp"
+#include <cmath>
+
+// Subgraphs of at most this many vertices are not dissected further
+static const int NDLEAF = 64;
+
+// Form the adjacency structure (xadj, adj) of the graph of the symmetric
+// matrix A, from its strictly lower triangle
+static void symmetricgraph(const SparseMatrix& A, int*& xadj, int*& adj)
+{
+  int n = A.nrows();
+  bool csc = A.isCSC();
+  const int* ptr = A.getPtr();
+  const int* idx = A.getIdx();
+  xadj = new int[n+1];
+  for (int i = 0; i <= n; i++){
+    xadj[i] = 0;
+  }
+  // Entry p of row (column) o is in the strictly lower triangle if
+  // idx[p] < o (idx[p] > o), and then joins vertices o and idx[p]
+  if (ptr != NULL) {
+    for (int o = 0; o < n; o++){
+      for (int p = ptr[o]; p < ptr[o+1]; p++){
+	if (csc ? idx[p] > o : idx[p] < o) {
+	  xadj[o+1]++; xadj[idx[p]+1]++;
+	}
+      }
+    }
+  }
+  for (int i = 0; i < n; i++){
+    xadj[i+1] += xadj[i];
+  }
+  adj = new int[xadj[n] > 0 ? xadj[n] : 1];
+  int* fill = new int[n > 0 ? n : 1];
+  for (int i = 0; i < n; i++){
+    fill[i] = xadj[i];
+  }
+  if (ptr != NULL) {
+    for (int o = 0; o < n; o++){
+      for (int p = ptr[o]; p < ptr[o+1]; p++){
+	if (csc ? idx[p] > o : idx[p] < o) {
+	  adj[fill[o]++] = idx[p];
+	  adj[fill[idx[p]]++] = o;
+	}
+      }
+    }
+  }
+  delete[] fill;
+}
+
+// Breadth-first search from root, over the vertices v with inset[v] == stamp,
+// which must have level[v] = -1 on entry. Visited vertices are put in queue
+// in order, with their level set. Returns the no. of levels, and the no.
+// of vertices visited in nvis.
+static int bfs(int root, const int* xadj, const int* adj, const int* inset, int stamp,
+	       int* level, int* queue, int& nvis)
+{
+  int head = 0, tail = 0, nlev = 1;
+  queue[tail++] = root;
+  level[root] = 0;
+  while (head < tail) {
+    int v = queue[head++];
+    for (int p = xadj[v]; p < xadj[v+1]; p++){
+      int u = adj[p];
+      if (inset[u] == stamp && level[u] == -1) {
+	level[u] = level[v] + 1;
+	nlev = (level[u]+1 > nlev ? level[u]+1 : nlev);
+	queue[tail++] = u;
+      }
+    }
+  }
+  nvis = tail;
+  return nlev;
+}
+
+
+void nesteddissection(const SparseMatrix& A, int* perm)
+{
+  if (!A.isSquare()) {
+    throw( Error("NESTDISS", "Matrix must be square.") );
+  }
+  int n = A.nrows();
+  if (n == 0) { return; }
+  PROFILE("nesteddissection", 0.0);
+  int *xadj, *adj;
+  symmetricgraph(A, xadj, adj);
+  // Each subproblem is a segment [lo, hi) of work, which is ordered into
+  // the same positions of perm, with any separator placed last
+  int* work = new int[n];
+  int* inset = new int[n];
+  int* level = new int[n];
+  int* queue = new int[n];
+  int* stack = new int[2*n+2];
+  for (int i = 0; i < n; i++){
+    work[i] = i;
+    inset[i] = -1;
+  }
+  int top = 0, stamp = 0;
+  stack[top++] = 0; stack[top++] = n;
+  while (top > 0) {
+    int hi = stack[--top];
+    int lo = stack[--top];
+    int size = hi - lo;
+    stamp++;
+    for (int k = lo; k < hi; k++){
+      inset[work[k]] = stamp;
+      level[work[k]] = -1;
+    }
+    int nvis;
+    int nlev = bfs(work[lo], xadj, adj, inset, stamp, level, queue, nvis);
+    if (nvis < size) {
+      // Disconnected, so split off the component found
+      int tail = nvis;
+      for (int k = lo; k < hi; k++){
+	if (level[work[k]] == -1) { queue[tail++] = work[k]; }
+      }
+      for (int k = 0; k < size; k++){
+	work[lo+k] = queue[k];
+      }
+      stack[top++] = lo; stack[top++] = lo+nvis;
+      stack[top++] = lo+nvis; stack[top++] = hi;
+      continue;
+    }
+    // Find a pseudo-peripheral root, to get a long, narrow level structure
+    for (int iter = 0; iter < 8 && size > NDLEAF; iter++){
+      int root = queue[nvis-1], mindeg = xadj[root+1] - xadj[root];
+      for (int k = nvis-1; k >= 0 && level[queue[k]] == nlev-1; k--){
+	int deg = xadj[queue[k]+1] - xadj[queue[k]];
+	if (deg < mindeg) { root = queue[k]; mindeg = deg; }
+      }
+      for (int k = lo; k < hi; k++){
+	level[work[k]] = -1;
+      }
+      int oldlev = nlev;
+      nlev = bfs(root, xadj, adj, inset, stamp, level, queue, nvis);
+      if (nlev <= oldlev) { break; }
+    }
+    if (size <= NDLEAF || nlev < 3) {
+      // Order small pieces by reverse Cuthill-McKee
+      for (int k = 0; k < size; k++){
+	perm[lo+k] = queue[size-1-k];
+      }
+      continue;
+    }
+    // The level containing the median vertex separates the levels before
+    // it from those after it, and the queue is already sorted by level
+    int mid = level[queue[size/2]];
+    mid = (mid < 1 ? 1 : (mid > nlev-2 ? nlev-2 : mid));
+    int a = 0, b;
+    while (level[queue[a]] < mid) { a++; }
+    b = a;
+    while (level[queue[b]] == mid) { b++; }
+    int n1 = a, n2 = size - b, ns = b - a;
+    for (int k = 0; k < n1; k++){
+      work[lo+k] = queue[k];
+    }
+    for (int k = 0; k < n2; k++){
+      work[lo+n1+k] = queue[b+k];
+    }
+    for (int k = 0; k < ns; k++){
+      work[hi-ns+k] = queue[a+k];
+      perm[hi-ns+k] = queue[a+k];
+    }
+    stack[top++] = lo; stack[top++] = lo+n1;
+    stack[top++] = lo+n1; stack[top++] = lo+n1+n2;
+  }
+  delete[] xadj; delete[] adj;
+  delete[] work; delete[] inset; delete[] level; delete[] queue; delete[] stack;
+}
+
+// SparseCholesky
+
+SparseCholesky::SparseCholesky()
+  : n(0), annz(0), acsc(false), patptr(NULL), patidx(NULL), perm(NULL), parent(NULL), nsuper(0), super(NULL),
+    snode(NULL), rowptr(NULL), rowidx(NULL), valptr(NULL), amap(NULL), nlev(0),
+    levorder(NULL), levptr(NULL), val(NULL), factored(false)
+{
+}
+
+
+SparseCholesky::SparseCholesky(const SparseMatrix& A, bool reorder)
+  : n(0), annz(0), acsc(false), patptr(NULL), patidx(NULL), perm(NULL), parent(NULL), nsuper(0), super(NULL),
+    snode(NULL), rowptr(NULL), rowidx(NULL), valptr(NULL), amap(NULL), nlev(0),
+    levorder(NULL), levptr(NULL), val(NULL), factored(false)
+{
+  analyse(A, reorder);
+  if (!factorise(A)) {
+    throw( Error("SPCHOL", "Matrix is not positive definite.") );
+  }
+}
+
+
+SparseCholesky::~SparseCholesky()
+{
+  cleanUp();
+}
+
+
+void SparseCholesky::cleanUp()
+{
+  delete[] perm; delete[] parent; delete[] super; delete[] snode;
+  delete[] rowptr; delete[] rowidx; delete[] valptr; delete[] amap;
+  delete[] levorder; delete[] levptr; delete[] val; delete[] patptr; delete[] patidx;
+  perm = parent = super = snode = rowptr = rowidx = levorder = levptr = NULL;
+  patptr = patidx = NULL;
+  valptr = amap = NULL;
+  val = NULL;
+  n = annz = nsuper = nlev = 0;
+  factored = false;
+}
+
+
+long SparseCholesky::nonzeros() const
+{
+  return (valptr == NULL ? 0 : valptr[nsuper]);
+}
+
+
+void SparseCholesky::analyse(const SparseMatrix& A, bool reorder)
+{
+  PROFILE("spchol/analyse", 0.0);
+  if (!A.isSquare()) {
+    throw( Error("SPCHOL", "Matrix must be square.") );
+  }
+  cleanUp();
+  n = A.nrows();
+  annz = A.nonzeros();
+  acsc = A.isCSC();
+  int outer = n;
+  const int* aptr = A.getPtr();
+  const int* aidx = A.getIdx();
+  // Keep the pattern, for factorise to check against
+  patptr = new int[n+1];
+  patidx = new int[annz > 0 ? annz : 1];
+  for (int i = 0; i <= n; i++) { patptr[i] = (aptr != NULL ? aptr[i] : 0); }
+  for (int p = 0; p < annz; p++) { patidx[p] = aidx[p]; }
+
+  // Ordering
+  perm = new int[n > 0 ? n : 1];
+  if (reorder) {
+    nesteddissection(A, perm);
+  } else {
+    for (int i = 0; i < n; i++){
+      perm[i] = i;
+    }
+  }
+  int* iperm = new int[n > 0 ? n : 1];
+  for (int k = 0; k < n; k++){
+    iperm[perm[k]] = k;
+  }
+
+  // Strictly lower triangle of PAP(T), by rows (unsorted within a row)
+  int* cptr = new int[n+1];
+  for (int i = 0; i <= n; i++){
+    cptr[i] = 0;
+  }
+  if (aptr != NULL) {
+    for (int o = 0; o < outer; o++){
+      for (int p = aptr[o]; p < aptr[o+1]; p++){
+	int i = (acsc ? aidx[p] : o), j = (acsc ? o : aidx[p]);
+	if (i > j) {
+	  int r = (iperm[i] > iperm[j] ? iperm[i] : iperm[j]);
+	  cptr[r+1]++;
+	}
+      }
+    }
+  }
+  for (int i = 0; i < n; i++){
+    cptr[i+1] += cptr[i];
+  }
+  int* cidx = new int[cptr[n] > 0 ? cptr[n] : 1];
+  int* work = new int[n > 0 ? n : 1];
+  for (int i = 0; i < n; i++){
+    work[i] = cptr[i];
+  }
+  if (aptr != NULL) {
+    for (int o = 0; o < outer; o++){
+      for (int p = aptr[o]; p < aptr[o+1]; p++){
+	int i = (acsc ? aidx[p] : o), j = (acsc ? o : aidx[p]);
+	if (i > j) {
+	  int pi = iperm[i], pj = iperm[j];
+	  int r = (pi > pj ? pi : pj), c = (pi > pj ? pj : pi);
+	  cidx[work[r]++] = c;
+	}
+      }
+    }
+  }
+
+  // Elimination tree, with path compression through work
+  parent = new int[n > 0 ? n : 1];
+  for (int k = 0; k < n; k++){
+    parent[k] = -1;
+    work[k] = -1;
+    for (int p = cptr[k]; p < cptr[k+1]; p++){
+      int i = cidx[p];
+      while (i != -1 && i < k) {
+	int next = work[i];
+	work[i] = k;
+	if (next == -1) { parent[i] = k; }
+	i = next;
+      }
+    }
+  }
+
+  // Column counts, by walking the row subtree of each row k from its
+  // entries up the tree to k
+  int* count = new int[n > 0 ? n : 1];
+  for (int j = 0; j < n; j++){
+    count[j] = 1;
+    work[j] = -1;
+  }
+  for (int k = 0; k < n; k++){
+    work[k] = k;
+    for (int p = cptr[k]; p < cptr[k+1]; p++){
+      for (int j = cidx[p]; work[j] != k; j = parent[j]){
+	count[j]++;
+	work[j] = k;
+      }
+    }
+  }
+
+  // Fundamental supernodes: column j+1 joins column j's supernode if it is
+  // j's parent, with j as its only child, and the same structure below
+  int* nchild = new int[n > 0 ? n : 1];
+  for (int j = 0; j < n; j++){
+    nchild[j] = 0;
+  }
+  for (int j = 0; j < n; j++){
+    if (parent[j] != -1) { nchild[parent[j]]++; }
+  }
+  snode = new int[n > 0 ? n : 1];
+  nsuper = 0;
+  for (int j = 0; j < n; j++){
+    if (j > 0 && parent[j-1] == j && count[j-1] == count[j]+1 && nchild[j] == 1) {
+      snode[j] = nsuper-1;
+    } else {
+      snode[j] = nsuper++;
+    }
+  }
+  super = new int[nsuper+1];
+  for (int j = n-1; j >= 0; j--){
+    super[snode[j]] = j;
+  }
+  super[nsuper] = n;
+
+  // Row structure of each supernode, which is that of its first column
+  rowptr = new int[nsuper+1];
+  valptr = new long[nsuper+1];
+  rowptr[0] = 0;
+  valptr[0] = 0;
+  for (int s = 0; s < nsuper; s++){
+    int nc = super[s+1] - super[s];
+    rowptr[s+1] = rowptr[s] + count[super[s]];
+    valptr[s+1] = valptr[s] + (long)count[super[s]]*nc;
+  }
+  rowidx = new int[rowptr[nsuper] > 0 ? rowptr[nsuper] : 1];
+  for (int s = 0; s < nsuper; s++){
+    nchild[s] = rowptr[s]; // Reused as the fill position
+    rowidx[nchild[s]++] = super[s];
+  }
+  for (int j = 0; j < n; j++){
+    work[j] = -1;
+  }
+  for (int k = 0; k < n; k++){
+    work[k] = k;
+    for (int p = cptr[k]; p < cptr[k+1]; p++){
+      for (int j = cidx[p]; work[j] != k; j = parent[j]){
+	if (j == super[snode[j]]) { rowidx[nchild[snode[j]]++] = k; }
+	work[j] = k;
+      }
+    }
+  }
+
+  // Position of each entry of A within the supernode blocks
+  amap = new long[annz > 0 ? annz : 1];
+  if (aptr != NULL) {
+    for (int o = 0; o < outer; o++){
+      for (int p = aptr[o]; p < aptr[o+1]; p++){
+	int i = (acsc ? aidx[p] : o), j = (acsc ? o : aidx[p]);
+	if (i < j) {
+	  amap[p] = -1;
+	} else {
+	  int pi = iperm[i], pj = iperm[j];
+	  int r = (pi > pj ? pi : pj), c = (pi > pj ? pj : pi);
+	  int s = snode[c];
+	  int nc = super[s+1] - super[s];
+	  // Binary search for row r in the supernode
+	  int left = rowptr[s], right = rowptr[s+1]-1;
+	  while (left < right) {
+	    int m = (left + right)/2;
+	    if (rowidx[m] < r) { left = m+1; }
+	    else { right = m; }
+	  }
+	  amap[p] = valptr[s] + (long)(left - rowptr[s])*nc + (c - super[s]);
+	}
+      }
+    }
+  }
+
+  // Group supernodes by height in the supernodal elimination tree, so that
+  // those in the same level are not ancestors of each other. Parents always
+  // come after their children, as parent[j] > j.
+  int* height = count; // Reused
+  for (int s = 0; s < nsuper; s++){
+    height[s] = 0;
+  }
+  nlev = (nsuper > 0 ? 1 : 0);
+  for (int s = 0; s < nsuper; s++){
+    int p = parent[super[s+1]-1];
+    if (p != -1) {
+      int t = snode[p];
+      height[t] = (height[s]+1 > height[t] ? height[s]+1 : height[t]);
+      nlev = (height[t]+1 > nlev ? height[t]+1 : nlev);
+    }
+  }
+  levptr = new int[nlev+1];
+  levorder = new int[nsuper > 0 ? nsuper : 1];
+  for (int l = 0; l <= nlev; l++){
+    levptr[l] = 0;
+  }
+  for (int s = 0; s < nsuper; s++){
+    levptr[height[s]+1]++;
+  }
+  for (int l = 0; l < nlev; l++){
+    levptr[l+1] += levptr[l];
+    work[l] = levptr[l];
+  }
+  for (int s = 0; s < nsuper; s++){
+    levorder[work[height[s]]++] = s;
+  }
+
+  delete[] iperm; delete[] cptr; delete[] cidx; delete[] work;
+  delete[] count; delete[] nchild;
+}
+
+// Factorise supernode s, all of whose descendants have already been
+// factorised, and subtract its contribution from its ancestors
+void SparseCholesky::factorSupernode(int s, bool& ok)
+{
+  if (!ok) { return; }
+  int f = super[s], nc = super[s+1] - f;
+  int nr = rowptr[s+1] - rowptr[s], nb = nr - nc;
+  double* B = val + valptr[s];
+  const int* rows = rowidx + rowptr[s];
+
+  // Cholesky of the diagonal block, and the solve XL(T) = B for the rows
+  // below it, in place, by rows. Each element is a dot product of two
+  // rows, contiguous in the block, so the inner loops are vectorised.
+  for (int r = 0; r < nr; r++){
+    double* x = B + (long)r*nc;
+    int jmax = (r < nc ? r : nc);
+    for (int j = 0; j < jmax; j++){
+      const double* lj = B + (long)j*nc;
+      double dot = 0.0;
+#pragma omp simd reduction(+:dot)
+      for (int k = 0; k < j; k++){
+	dot += x[k]*lj[k];
+      }
+      x[j] = (x[j] - dot)/lj[j];
+    }
+    if (r < nc) {
+      double dot = 0.0;
+#pragma omp simd reduction(+:dot)
+      for (int k = 0; k < r; k++){
+	dot += x[k]*x[k];
+      }
+      double d = x[r] - dot;
+      if (!(d > 0.0)) {
+	ok = false;
+	return;
+      }
+      x[r] = sqrt(d);
+    }
+  }
+  if (nb == 0) { return; }
+  const double* X = B + (long)nc*nc; // The nb rows below the diagonal block
+
+  // Subtract the lower triangle of the update from the supernodes that
+  // contain the columns rows[nc..nr-1], a group of columns at a time. All
+  // the rows of s from a column down must also be in that column.
+  int* loc = new int[nb];
+  int g0 = 0;
+  while (g0 < nb) {
+    int t = snode[rows[nc+g0]];
+    int ft = super[t], nct = super[t+1] - ft;
+    int g1 = g0;
+    while (g1 < nb && rows[nc+g1] < super[t+1]) { g1++; }
+    const int* trows = rowidx + rowptr[t];
+    int q = 0;
+    for (int i = g0; i < nb; i++){
+      while (trows[q] != rows[nc+i]) { q++; }
+      loc[i] = q;
+    }
+    // Only this lower part of XX(T) is formed, each element a dot product
+    // of two rows of X
+    double* T = val + valptr[t];
+    for (int i1 = g0; i1 < nb; i1++){
+      const double* x1 = X + (long)i1*nc;
+      double* ti = T + (long)loc[i1]*nct;
+      int jmax = (i1 < g1 ? i1+1 : g1);
+      for (int i2 = g0; i2 < jmax; i2++){
+	const double* x2 = X + (long)i2*nc;
+	double c = 0.0;
+#pragma omp simd reduction(+:c)
+	for (int k = 0; k < nc; k++){
+	  c += x1[k]*x2[k];
+	}
+	// Other supernodes in the same level may update the same ancestor
+#pragma omp atomic
+	ti[rows[nc+i2] - ft] -= c;
+      }
+    }
+    g0 = g1;
+  }
+  delete[] loc;
+}
+
+
+bool SparseCholesky::factorise(const SparseMatrix& A)
+{
+  if (perm == NULL) {
+    throw( Error("SPCHOL", "Matrix has not been analysed.") );
+  }
+  // The values are placed by amap, so a different pattern with the same
+  // no. of entries would silently give a wrong factor
+  bool same = (A.nrows() == n && A.nonzeros() == annz && A.isCSC() == acsc);
+  const int* aptr = A.getPtr();
+  const int* aidx = A.getIdx();
+  for (int i = 0; same && aptr != NULL && i <= n; i++) { same = (aptr[i] == patptr[i]); }
+  for (int p = 0; same && p < annz; p++) { same = (aidx[p] == patidx[p]); }
+  if (!same) {
+    throw( Error("SPCHOL", "Matrix does not have the pattern that was analysed.") );
+  }
+  PROFILE("spchol/factorise", 0.0);
+  long nnzl = valptr[nsuper];
+  if (val == NULL) {
+    val = new double[nnzl > 0 ? nnzl : 1];
+  }
+#pragma omp parallel for
+  for (long p = 0; p < nnzl; p++){
+    val[p] = 0.0;
+  }
+  const double* aval = A.getVal();
+#pragma omp parallel for
+  for (int p = 0; p < annz; p++){
+    if (amap[p] > -1) { val[amap[p]] = aval[p]; }
+  }
+
+  bool ok = true;
+  for (int l = 0; l < nlev && ok; l++){
+#pragma omp parallel for schedule(dynamic) reduction(&&:ok) if (levptr[l+1] - levptr[l] > 1)
+    for (int k = levptr[l]; k < levptr[l+1]; k++){
+      factorSupernode(levorder[k], ok);
+    }
+  }
+  // The dense work on each supernode: cholesky of the diagonal block,
+  // the solve for the rows below it, and the update it sends to its
+  // ancestors
+  double flops = 0.0;
+  for (int s = 0; s < nsuper; s++){
+    double nc = super[s+1] - super[s], nb = rowptr[s+1] - rowptr[s] - nc;
+    flops += nc*nc*nc/3.0 + nb*nc*nc + nb*nb*nc;
+  }
+  PROFILEFLOPS(flops);
+  factored = ok;
+  return ok;
+}
+
+
+void SparseCholesky::solve(const Vector& b, Vector& x) const
+{
+  if (!factored) {
+    throw( Error("SPCHOLSOLVE", "Matrix has not been factorised.") );
+  }
+  if (b.size() != n) {
+    throw( Error("SPCHOLSOLVE", "Vector is the wrong size.") );
+  }
+  PROFILE("spchol/solve", 4.0*nonzeros());
+  Vector y(n);
+  for (int k = 0; k < n; k++){
+    y[k] = b(perm[k]);
+  }
+  // Forward substitution, Ly = Pb
+  for (int s = 0; s < nsuper; s++){
+    int f = super[s], nc = super[s+1] - f, nr = rowptr[s+1] - rowptr[s];
+    const double* B = val + valptr[s];
+    const int* rows = rowidx + rowptr[s];
+    for (int j = 0; j < nc; j++){
+      double sum = y(f+j);
+      for (int k = 0; k < j; k++){
+	sum -= B[j*nc+k]*y(f+k);
+      }
+      y[f+j] = sum/B[j*nc+j];
+    }
+    for (int r = nc; r < nr; r++){
+      const double* lr = B + (long)r*nc;
+      double sum = 0.0;
+      for (int j = 0; j < nc; j++){
+	sum += lr[j]*y(f+j);
+      }
+      y[rows[r]] -= sum;
+    }
+  }
+  // Back substitution, L(T)z = y
+  for (int s = nsuper-1; s >= 0; s--){
+    int f = super[s], nc = super[s+1] - f, nr = rowptr[s+1] - rowptr[s];
+    const double* B = val + valptr[s];
+    const int* rows = rowidx + rowptr[s];
+    for (int r = nc; r < nr; r++){
+      const double* lr = B + (long)r*nc;
+      double yr = y(rows[r]);
+      for (int j = 0; j < nc; j++){
+	y[f+j] -= lr[j]*yr;
+      }
+    }
+    for (int j = nc-1; j >= 0; j--){
+      double sum = y(f+j);
+      for (int k = j+1; k < nc; k++){
+	sum -= B[k*nc+j]*y(f+k);
+      }
+      y[f+j] = sum/B[j*nc+j];
+    }
+  }
+  x.resize(n);
+  for (int k = 0; k < n; k++){
+    x[perm[k]] = y(k);
+  }
+}
+
+
+Vector SparseCholesky::solve(const Vector& b) const
+{
+  Vector x(n);
+  solve(b, x);
+  return x;
+}
+
+
+Vector sparsecholeskysolve(const SparseMatrix& A, const Vector& b)
+{
+  PROFILE("sparsecholeskysolve", 0.0);
+  SparseCholesky chol(A);
+  return chol.solve(b);
+}
@@ -0,0 +1,91 @@
+/*
+ *   Purpose: To define a sparse direct cholesky factorisation, PAP(T) = LL(T),
+ *            for large sparse symmetric positive definite matrices, where
+ *            the dense cholesky would need too much memory.
+ *
+ *            The factorisation is split into a symbolic phase (analyse),
+ *            which finds a fill-reducing ordering P by nested dissection,
+ *            the elimination tree, and the structure of L as a set of
+ *            supernodes - groups of adjacent columns with the same
+ *            structure, stored as dense blocks - and a numeric phase
+ *            (factorise), which can be repeated for any matrix with the
+ *            same pattern. Supernodes that are not ancestors of each other
+ *            in the elimination tree are factorised in parallel.
+ *
+ *   DATE             AUTHOR            CHANGES
+ *   ===============================================================
+ *   19/10/26         Robert Shaw       Original code.
+ *   19/10/26         Robert Shaw       Pattern checked, blocks in place.
+ */
+
+#ifndef SPCHOLHEADERDEF
+#define SPCHOLHEADERDEF
+
+#include "vector.hpp"
+#include "sparse.hpp"
+
+// Find a fill-reducing ordering of the symmetric matrix A by nested
+// dissection, splitting the graph of A recursively by the middle level
+// of a breadth-first level structure. perm[k] is set to the original
+// index of the k-th pivot, and must be of length A.nrows().
+void nesteddissection(const SparseMatrix& A, int* perm);
+
+// Only the lower triangle of A (i >= j) is read, so A may be stored with
+// either just that or both triangles.
+class SparseCholesky
+{
+private:
+  // Symbolic factorisation
+  int n; // Dimension
+  int annz; // No. of entries in the pattern analysed
+  bool acsc; // Storage format of the pattern analysed
+  int* patptr; // Copy of the ptr array of the pattern analysed
+  int* patidx; // Copy of its idx array
+  int* perm; // perm[k] is the original index of the k-th pivot
+  int* parent; // Elimination tree in pivot order, -1 for roots
+  int nsuper; // No. of supernodes
+  int* super; // First column of each supernode, length nsuper+1
+  int* snode; // Supernode containing each column
+  int* rowptr; // Start of each supernode's rows in rowidx, length nsuper+1
+  int* rowidx; // Rows of each supernode (in pivot order), ascending
+  long* valptr; // Start of each supernode's block in val, length nsuper+1
+  long* amap; // Position in val of each entry of A, or -1 if upper triangle
+  int nlev; // No. of levels of supernodes that can be done in parallel
+  int* levorder; // Supernodes, grouped by their height in the tree
+  int* levptr; // Start of each level in levorder, length nlev+1
+  // Numeric factorisation
+  double* val; // Supernode blocks of L, each (rows x cols), stored by rows
+  bool factored;
+  void cleanUp();
+  void factorSupernode(int s, bool& ok);
+  // Factorisations can be large, so are not copied
+  SparseCholesky(const SparseCholesky& other);
+  SparseCholesky& operator=(const SparseCholesky& other);
+public:
+  SparseCholesky();
+  // Analyse and factorise A, with a nested dissection ordering unless
+  // reorder is false. Throws an error if A is not positive definite.
+  SparseCholesky(const SparseMatrix& A, bool reorder = true);
+  ~SparseCholesky();
+  // Symbolic phase only
+  void analyse(const SparseMatrix& A, bool reorder = true);
+  // Numeric phase, for A with the pattern that was analysed (which is
+  // checked, throwing an error if not), returning false if A is not
+  // positive definite
+  bool factorise(const SparseMatrix& A);
+  // Solve Ax = b with the factors
+  Vector solve(const Vector& b) const;
+  void solve(const Vector& b, Vector& x) const;
+  // Accessors
+  int size() const { return n; }
+  int supernodes() const { return nsuper; }
+  long nonzeros() const; // No. of entries stored for L, including padding
+  bool isFactored() const { return factored; }
+  const int* permutation() const { return perm; }
+  const int* etree() const { return parent; }
+};
+
+// Solve Ax = b for sparse SPD A by sparse cholesky factorisation
+Vector sparsecholeskysolve(const SparseMatrix& A, const Vector& b);
+
+#endif
@@ -5,12 +5,69 @@
 #include "solvers.hpp"
 #include "matrix.hpp"
 #include "vector.hpp"
+#include "sparse.hpp"
+#include "banded.hpp"
+#include "packed.hpp"
+#include "binary.hpp"
+#include "textio.hpp"
+#include "profile.hpp"
+#include "tuning.hpp"
+#include "iterative.hpp"
+#include "precond.hpp"
+#include "spchol.hpp"
+#include "batched.hpp"
+#include "factcache.hpp"
+#include "condition.hpp"
+#include "inverse.hpp"
 #include "error.hpp"
 #include <iostream>
 #include <iomanip>
 #include <cmath>
 #include <cstdlib>
 #include <ctime>
+#include <fstream>
+#include <algorithm>
+#include <string>
+
+// Checks print the error found, and are counted as failures (giving a
+// nonzero exit status) if it is over the tolerance
+static int failures = 0;
+static void check(const char* what, double err, double tol = 1e-10)
+{
+  std::cout << what << ": " << err;
+  if (!(err <= tol)) {
+    std::cout << "  FAILED";
+    failures++;
+  }
+  std::cout << "\n";
+}
+
+// The Frobenius norm of Q(T)Q - I, for Q with orthonormal columns
+static double orthoerror(const Matrix& Q)
+{
+  Matrix E = Q.transpose()*Q;
+  for (int i = 0; i < E.nrows(); i++){ E(i, i) -= 1.0; }
+  return fnorm(E);
+}
+
+// Matrices with the n real eigenvalues in eigs: a symmetric QDQ(T), with
+// Q orthogonal, and a nonsymmetric XDX^-1, with X kept away from singular
+static void eigtestmatrices(const double* eigs, int n, Matrix& As, Matrix& An)
+{
+  Matrix G(n, n), QR, v, D(n, n, 0.0);
+  for (int i = 0; i < n; i++){
+    D(i, i) = eigs[i];
+    for (int j = 0; j < n; j++) { G(i, j) = (rand()%201 - 100.0)/100.0; }
+  }
+  dgehh(G, QR, v);
+  Matrix Q = explicitq(v);
+  for (int i = 0; i < n; i++) { G(i, i) += 5.0; }
+  As = Q*D*Q.transpose();
+  An = G*D*inverse(G);
+  for (int i = 0; i < n; i++){ // Exactly symmetric
+    for (int j = 0; j < i; j++) { As(i, j) = As(j, i) = 0.5*(As(i, j) + As(j, i)); }
+  }
+}
 
 int main(int argc, char* argv[]){
   Matrix x(5, 5);
@@ -36,6 +93,15 @@ int main(int argc, char* argv[]){
     b = lusolve(x, b);
     b.print();
     std::cout << "\n\n";
+    // Condition numbers, from the factors already formed
+    std::cout << lucond(x, r, p) << " " << lucond2(x, r, p) << " " << pnorm(x, 2) << "\n\n";
+    // Determinant, and the inverse in place of the factors
+    int sign;
+    double logabs = lulogdet(r, p, sign);
+    std::cout << ludet(r, p) << " " << sign*exp(logabs) << "\n\n";
+    luinverse(r, p);
+    (x*r).print();
+    std::cout << "\n\n";
     Matrix m2(3, 2);
     b.resize(3);
     m2(0, 0) = 3.0; m2(0, 1) = -6.0;
@@ -49,6 +115,78 @@ int main(int argc, char* argv[]){
     std::cout << "Routine failed!\n";
   }
 
+  // Inverses and determinants of matrices larger than one block, a
+  // general A (kept well away from singular) and S = AA(T)/n + I
+  {
+    int n = 2*tuning().invblock + 17;
+    Matrix G(n, n), S(n, n), I(n, n, 0.0);
+    for (int i = 0; i < n; i++){
+      I(i, i) = 1.0;
+      for (int j = 0; j < n; j++) { G(i, j) = (rand()%201 - 100.0)/100.0; }
+      G(i, i) += 10.0;
+    }
+    for (int i = 0; i < n; i++){
+      for (int j = 0; j <= i; j++){
+	double sum = 0.0;
+	for (int k = 0; k < n; k++) { sum += G(i, k)*G(j, k); }
+	S(i, j) = S(j, i) = sum/n + (i == j ? 1.0 : 0.0);
+      }
+    }
+    Matrix B, R = cholesky(S), Gi = inverse(G), Si = spdinverse(S);
+    Vector piv = dgelu(G, B);
+    int sign;
+    double ldg = lulogdet(B, piv, sign), ldr = choleskylogdet(R);
+    double dg = ludet(B, piv);
+    luinverse(B, piv);
+    choleskyinverse(R);
+    check("luinverse ||AX - I||", pnorm(G*B - I, 0));
+    check("inverse ||AX - I||", pnorm(G*Gi - I, 0));
+    check("choleskyinverse ||AX - I||", pnorm(S*R - I, 0));
+    check("spdinverse ||AX - I||", pnorm(S*Si - I, 0));
+    int gsign, isign, ssign;
+    double ldgen = logdet(G, gsign), ldinv = logdet(Gi, isign);
+    check("logdet against lulogdet", fabs(ldgen - ldg)/fabs(ldg) + (gsign == sign ? 0.0 : 1.0));
+    check("logdet of the inverse", fabs(ldgen + ldinv)/fabs(ldgen) + (isign == gsign ? 0.0 : 1.0));
+    check("det against logdet", fabs(det(G) - gsign*exp(ldgen))/fabs(dg) + fabs(dg - det(G))/fabs(dg));
+    check("choleskylogdet against logdet", fabs(ldr - logdet(S, ssign))/fabs(ldr) + (ssign == 1 ? 0.0 : 1.0));
+    check("choleskydet against det", fabs(choleskydet(cholesky(S)) - det(S))/det(S));
+  }
+
+  // The condition estimators against ||A|| ||A^-1|| from explicit inverses,
+  // in the 1-norm, and in the 2-norm from the largest eigenvalues of A(T)A
+  // and of its inverse. The estimates are lower bounds, within a factor of
+  // 3 of the truth, so the ratio checked is how far outside [1/3, 1] each
+  // lies. The matrices have no diagonal shift, so are not well conditioned.
+  {
+    int n = 40;
+    Matrix G(n, n), S(n, n);
+    for (int i = 0; i < n; i++){
+      for (int j = 0; j < n; j++) { G(i, j) = (rand()%201 - 100.0)/100.0; }
+    }
+    for (int i = 0; i < n; i++){
+      for (int j = 0; j <= i; j++){
+	double sum = 0.0;
+	for (int k = 0; k < n; k++) { sum += G(i, k)*G(j, k); }
+	S(i, j) = S(j, i) = sum + (i == j ? 1e-3 : 0.0);
+      }
+    }
+    Matrix B, R, QR, v, Gi = inverse(G);
+    Vector piv = dgelu(G, B), ev1, ev2;
+    R = cholesky(S);
+    dgehh(G, QR, v);
+    double k1 = pnorm(G, 1)*pnorm(Gi, 1), ks = pnorm(S, 1)*pnorm(spdinverse(S), 1);
+    symqr(G.transpose()*G, ev1);
+    symqr(Gi.transpose()*Gi, ev2);
+    double k2 = sqrt(pnorm(ev1, 0)*pnorm(ev2, 0));
+    double ratios[4] = { lucond(G, B, piv)/k1, lucond2(G, B, piv)/k2,
+			 choleskycond(S, R)/ks, qrcond(G, QR, v)/k1 };
+    const char* names[4] = { "lucond against ||A||1 ||A^-1||1", "lucond2 against ||A||2 ||A^-1||2",
+			     "choleskycond against ||A||1 ||A^-1||1", "qrcond against ||A||1 ||A^-1||1" };
+    for (int c = 0; c < 4; c++){
+      check(names[c], std::max(0.0, std::max(ratios[c] - 1.0, 1.0/3.0 - ratios[c])), 1e-8);
+    }
+  }
+
   // Test 2 - Least squares
   Matrix A(100, 15);
   Vector t(100);
@@ -110,6 +248,87 @@ int main(int argc, char* argv[]){
     std::cout << "QR shift failed\n";
   }
 
+  // And by Jacobi, which should give back x as V diag(vals) V(T), with
+  // the same values as symqr
+  {
+    Vector jvals; Matrix jvecs;
+    if (jacobi(x, jvals, jvecs)) {
+      Matrix D(5, 5, 0.0);
+      for (int i = 0; i < 5; i++){ D(i, i) = jvals(i); }
+      check("jacobi reconstruction", fnorm(jvecs*(D*jvecs.transpose()) - x)/fnorm(x));
+      check("jacobi orthogonality", orthoerror(jvecs));
+      Vector qvals = vals;
+      std::sort(qvals.data(), qvals.data() + 5);
+      check("jacobi against symqr", pnorm(jvals - qvals, 0)/pnorm(qvals, 0));
+    } else {
+      check("jacobi convergence", 1.0, 0.0);
+    }
+  }
+
+  // And the singular value decomposition of a general 6 x 4 matrix by
+  // one-sided Jacobi, which should give back A as U S V(T)
+  Matrix ga(6, 4);
+  for (int i = 0; i < 6; i++){
+    for (int j = 0; j < 4; j++){
+      ga(i, j) = rand()%21 - 10.0;
+    }
+  }
+  {
+    Vector s; Matrix U, V;
+    if (jacobisvd(ga, s, U, V)) {
+      Matrix S(4, 4, 0.0);
+      for (int i = 0; i < 4; i++){ S(i, i) = s(i); }
+      check("jacobisvd reconstruction", fnorm(U*(S*V.transpose()) - ga)/fnorm(ga));
+      check("jacobisvd orthogonality of U", orthoerror(U));
+      check("jacobisvd orthogonality of V", orthoerror(V));
+    } else {
+      check("jacobisvd convergence", 1.0, 0.0);
+    }
+  }
+
+  // And by bidiagonal QR, thin and full, on the matrix and its transpose
+  for (int wide = 0; wide < 2; wide++){
+    Matrix a = (wide ? ga.transpose() : ga);
+    int m = a.nrows(), n = a.ncols();
+    for (int full = 0; full < 2; full++){
+      Vector s; Matrix U, V;
+      if (svd(a, s, U, V, full)) {
+	Matrix S(U.ncols(), V.ncols(), 0.0);
+	for (int i = 0; i < s.size(); i++){ S(i, i) = s(i); }
+	double err = fnorm(U*(S*V.transpose()) - a)/fnorm(a);
+	double orth = orthoerror(U) + orthoerror(V);
+	bool shape = (full ? U.ncols() == m && V.ncols() == n : U.ncols() == 4 && V.ncols() == 4);
+	std::string what = std::string(full ? "full" : "thin") + " svd of " + (wide ? "4 x 6" : "6 x 4");
+	check((what + ", reconstruction").c_str(), (shape ? err : 1.0));
+	check((what + ", orthogonality").c_str(), orth);
+      } else {
+	check("svd convergence", 1.0, 0.0);
+      }
+    }
+  }
+
+  // Least squares with a rank deficient matrix, its last column the sum
+  // of the first two. The minimum norm solution is a solution using only
+  // the first three columns, less its part along the null vector z.
+  {
+    Matrix a(6, 4), a3(6, 3);
+    Vector rhs(6), z(4);
+    for (int i = 0; i < 6; i++){
+      for (int j = 0; j < 3; j++){
+	a(i, j) = a3(i, j) = ga(i, j);
+      }
+      a(i, 3) = ga(i, 0) + ga(i, 1);
+      rhs[i] = rand()%21 - 10.0;
+    }
+    z[0] = 1.0; z[1] = 1.0; z[2] = 0.0; z[3] = -1.0;
+    Vector x3 = qrsquares(a3, rhs);
+    Vector xmin(4, 0.0);
+    for (int j = 0; j < 3; j++){ xmin[j] = x3(j); }
+    axpy(-inner(xmin, z)/inner(z, z), z, xmin);
+    Vector xs = svdsquares(a, rhs);
+    check("svdsquares minimum norm solution", pnorm(xs - xmin, 0)/pnorm(xmin, 0));
+  }
+
   // Test Cholesky
   x.resize(3, 3);
   x(0, 0) = x(1, 1) = x(2, 2) = 3.0;
@@ -139,4 +358,524 @@ int main(int argc, char* argv[]){
     vals.print();
     vecs.print();
   }
+
+  // qrshift's vectors, for a symmetric matrix with the eigenvalues 1 and
+  // 1 + 1e-6 close enough to share a cluster, and for a nonsymmetric one
+  // with the same (real) eigenvalues. Residuals are relative to ||A||1.
+  {
+    int n = 8;
+    double eigs[8] = { 1.0, 1.0 + 1e-6, 3.0, -2.0, 5.0, 7.0, -4.0, 0.5 };
+    Matrix As, An;
+    eigtestmatrices(eigs, n, As, An);
+    Matrix* tests[2] = { &As, &An };
+    const char* names[2] = { "symmetric", "nonsymmetric" };
+    Vector sorteigs(n);
+    for (int i = 0; i < n; i++) { sorteigs[i] = eigs[i]; }
+    sorteigs = sorteigs.sorted();
+    for (int t = 0; t < 2; t++){
+      const Matrix& A = *tests[t];
+      Vector qvals, col(n);
+      Matrix qvecs;
+      bool ok = qrshift(A, qvals, qvecs);
+      double anorm = pnorm(A, 1), reserr = 0.0;
+      for (int k = 0; ok && k < n; k++){
+	for (int i = 0; i < n; i++) { col[i] = qvecs(i, k); }
+	reserr = std::max(reserr, pnorm(A*col - qvals(k)*col, 0)/(anorm*pnorm(col, 2)));
+      }
+      std::string what = std::string("qrshift ") + names[t];
+      check((what + " values").c_str(), (ok ? pnorm(qvals.sorted() - sorteigs, 0)/anorm : 1.0));
+      check((what + " residual").c_str(), (ok ? reserr : 1.0));
+      if (t == 0) { check((what + " orthogonality").c_str(), (ok ? orthoerror(qvecs) : 1.0)); }
+    }
+  }
+
+  // Rayleigh quotient and inverse iteration, each on a symmetric matrix
+  // (solved in tridiagonal form) and a nonsymmetric one (in Hessenberg
+  // form), checking the residual ||Av - lv|| / (||A|| ||v||) and, for
+  // inverse iteration, that the eigenvalue nearest the shift was found
+  {
+    int n = 8;
+    double eigs[8] = { 1.0, 3.0, -2.0, 5.0, 7.0, -4.0, 0.5, 2.0 };
+    Matrix As, An;
+    eigtestmatrices(eigs, n, As, An);
+    Matrix* tests[2] = { &As, &An };
+    const char* names[2] = { "symmetric", "nonsymmetric" };
+    for (int t = 0; t < 2; t++){
+      const Matrix& A = *tests[t];
+      double anorm = pnorm(A, 1);
+      Vector vr(n), vi(n);
+      for (int i = 0; i < n; i++) { vr[i] = vi[i] = (rand()%201 - 100.0)/100.0 + 0.01; }
+      double lr = rayleigh(A, vr, 4.8, 1e-12, 100);
+      double li = inverseiter(A, vi, 2.9, 1e-12, 200);
+      std::string what = std::string(" ") + names[t] + " residual";
+      check(("rayleigh" + what).c_str(), pnorm(A*vr - lr*vr, 0)/(anorm*pnorm(vr, 2)));
+      check(("inverseiter" + what).c_str(), pnorm(A*vi - li*vi, 0)/(anorm*pnorm(vi, 2)));
+      check((std::string("inverseiter ") + names[t] + " nearest value").c_str(), fabs(li - 3.0)/anorm);
+    }
+  }
+
+  // Test block subspace iteration on the same matrix
+  int nconv = subspaceiter(x, 2, vals, vecs, 1e-10, 500);
+  std::cout << "\n\n" << nconv << " converged\n";
+  vals.print();
+  vecs.print();
+
+  // Test sparse matrices - assemble the same matrix from triplets,
+  // with the diagonal split into two contributions
+  SparseBuilder coo(4, 4);
+  for (int i = 0; i < 4; i++){
+    coo.add(i, i, 0.5*x(i, i));
+    coo.add(i, i, 0.5*x(i, i));
+    for (int j = 0; j < 4; j++){
+      if (j != i && x(i, j) != 0.0) { coo.add(i, j, x(i, j)); }
+    }
+  }
+  SparseMatrix sx(coo);
+  std::cout << "\n\n" << sx.nonzeros() << " nonzeros\n";
+  d.assign(4, 1.0);
+  d = sx*d;
+  d.print();
+  d = x*d - sx*d;
+  d.print();
+
+  // Products that scatter (by columns, or transposed by rows) on a large
+  // tridiagonal matrix, against those that gather
+  {
+    int big = 1000000;
+    SparseBuilder tb(big, big, 3*big);
+    for (int i = 0; i < big; i++){
+      tb.add(i, i, 4.0);
+      if (i > 0) { tb.add(i, i-1, -1.0 - i%3); }
+      if (i < big-1) { tb.add(i, i+1, -2.0); }
+    }
+    SparseMatrix bycols(tb, true), byrows(tb);
+    Vector bx(big);
+    for (int i = 0; i < big; i++){ bx[i] = sin(double(i)); }
+    check("large CSC A*x against CSR", pnorm(bycols*bx - byrows*bx, 0));
+    check("large CSR x*A against the transpose", pnorm(bx*byrows - byrows.transpose()*bx, 0));
+  }
+
+  // Test conjugate gradient on the sparse matrix, shifted to be positive definite
+  coo.clear();
+  for (int i = 0; i < 4; i++){
+    coo.add(i, i, x(i, i) + 5.0);
+    for (int j = 0; j < 4; j++){
+      if (j != i && x(i, j) != 0.0) { coo.add(i, j, x(i, j)); }
+    }
+  }
+  SparseMatrix spd(coo);
+  SparseOperator op(spd);
+  IterControl ctl(1e-12, 100, 0.0, true);
+  d.assign(4, 1.0);
+  Vector cgx;
+  pcg(op, d, cgx, ctl);
+  std::cout << "\n\n" << ctl.iters << " iterations\n";
+  ctl.residuals.print();
+  cgx.print();
+
+  // And the nonsymmetric solvers on the same system
+  IterControl gctl(1e-12, 100);
+  cgx.resize(0);
+  gmres(op, d, cgx, gctl, 3);
+  std::cout << "\n" << gctl.iters << " GMRES iterations\n";
+  cgx.print();
+  cgx.resize(0);
+  bicgstab(op, d, cgx, gctl);
+  std::cout << gctl.iters << " BiCGSTAB iterations\n";
+  cgx.print();
+
+  // And with an incomplete cholesky preconditioner
+  IC0Precond ic(spd);
+  cgx.resize(0);
+  pcg(op, d, cgx, ctl, &ic);
+  std::cout << ctl.iters << " preconditioned CG iterations\n";
+  cgx.print();
+
+  // And block Jacobi, which must refuse blocks that cannot be factorised
+  {
+    BlockJacobiPrecond bj(spd, 2, true);
+    cgx.resize(0);
+    pcg(op, d, cgx, ctl, &bj);
+    check("block Jacobi preconditioned CG residual", pnorm(spd*cgx - d, 0));
+    std::string code = "none";
+    try {
+      BlockJacobiPrecond bad(x, 2, true); // Has negative diagonal elements
+    } catch (Error& e) {
+      code = e.getCode();
+    }
+    check("block Jacobi refuses an indefinite block", (code == "BJACOBIPC" ? 0.0 : 1.0), 0.0);
+    Matrix sing(4, 4, 1.0);
+    code = "none";
+    try {
+      BlockJacobiPrecond bad(sing, 2);
+    } catch (Error& e) {
+      code = e.getCode();
+    }
+    check("block Jacobi refuses a singular block", (code == "BJACOBIPC" ? 0.0 : 1.0), 0.0);
+  }
+
+  // And directly, by sparse cholesky
+  SparseCholesky spchol(spd);
+  std::cout << spchol.supernodes() << " supernodes, " << spchol.nonzeros() << " nonzeros\n";
+  cgx = spchol.solve(d);
+  cgx.print();
+  check("sparse cholesky residual", pnorm(spd*cgx - d, 0));
+  {
+    // The same no. of entries in a different pattern must be refused
+    SparseBuilder other(4, 4);
+    for (int i = 0; i < 4; i++){ other.add(i, i, 5.0); }
+    other.add(0, 2, 1.0); other.add(2, 0, 1.0);
+    other.add(1, 3, 1.0); other.add(3, 1, 1.0);
+    other.add(0, 3, 1.0); other.add(3, 0, 1.0);
+    SparseMatrix so(other);
+    std::string code = "none";
+    try {
+      if (so.nonzeros() == spd.nonzeros()) { spchol.factorise(so); }
+    } catch (Error& e) {
+      code = e.getCode();
+    }
+    check("sparse cholesky refuses a different pattern", (code == "SPCHOL" ? 0.0 : 1.0), 0.0);
+  }
+
+  // Test banded and tridiagonal solves on the same (pentadiagonal) system
+  BandedMatrix band(spd.toDense(), 2, 2);
+  cgx = bandedlusolve(band, d);
+  cgx.print();
+  cgx = bandedcholeskysolve(band, d);
+  cgx.print();
+  TridiagonalMatrix tri(spd.toDense());
+  cgx = thomas(tri, d);
+  cgx.print();
+
+  // And in packed symmetric storage
+  SymmetricMatrix sym(spd.toDense());
+  cgx = choleskysolve(sym, d);
+  cgx.print();
+  cgx = ldltsolve(sym, d);
+  cgx.print();
+  {
+    // SYMV against the dense product, past the threaded size
+    int ns = 700;
+    Matrix big(ns, ns);
+    Vector xs(ns), ys(ns);
+    for (int i = 0; i < ns; i++){
+      xs[i] = (double)(rand()%100)/50.0 - 1.0;
+      for (int j = 0; j <= i; j++) { big(i, j) = big(j, i) = (double)(rand()%100)/50.0 - 1.0; }
+    }
+    SymmetricMatrix bigsym(big);
+    bigsym.multiply(xs, ys);
+    check("packed SYMV against dense", pnorm(ys - big*xs, 0));
+    Vector yd(d.size());
+    sym.multiply(d, yd);
+    check("small packed SYMV against dense", pnorm(yd - spd.toDense()*d, 0));
+  }
+
+  // And in mixed precision, refined to double
+  int nref;
+  cgx = mixedcholeskysolve(spd.toDense(), d, nref);
+  std::cout << nref << " refinement steps\n";
+  cgx.print();
+  cgx = mixedlusolve(spd.toDense(), d, nref);
+  cgx.print();
+
+  // And as a batch of three copies of the system, one per column
+  Matrix dense = spd.toDense();
+  Matrix batch(16, 3), rhs(4, 3);
+  for (int s = 0; s < 3; s++){
+    for (int i = 0; i < 4; i++){
+      rhs(i, s) = d(i);
+      for (int j = 0; j < 4; j++){
+	batch(i*4+j, s) = dense(i, j);
+      }
+    }
+  }
+  bool cholok = batchcholesky(4, batch);
+  batchcholeskysolve(4, batch, rhs);
+  rhs.print();
+  {
+    Vector xchol = choleskysolve(dense, d);
+    double cholerr = 0.0;
+    for (int s = 0; s < 3; s++){
+      for (int i = 0; i < 4; i++){
+	cholerr = std::max(cholerr, fabs(rhs(i, s) - xchol(i))/pnorm(xchol, 0));
+      }
+    }
+    check("batchcholesky against choleskysolve", (cholok ? cholerr : 1.0));
+  }
+
+  // And batches of three different general systems, each column checked
+  // against solving its system alone, by LU, QR and, with the cholesky
+  // factors R above, by triangular solves with R and R(T)
+  {
+    Matrix gen(16, 3), lu, qr, piv, tau, blu(4, 3), bqr, btri, btrans;
+    Matrix Rs[3], As[3];
+    for (int s = 0; s < 3; s++){
+      As[s].assign(4, 4, 0.0);
+      Rs[s].assign(4, 4, 0.0);
+      for (int e = 0; e < 16; e++){
+	gen(e, s) = As[s](e/4, e%4) = rand()%21 - 10.0;
+	Rs[s](e/4, e%4) = batch(e, s);
+      }
+      As[s](s, s) += 25.0; // Keep them well away from singular
+      gen(5*s, s) += 25.0;
+      for (int i = 0; i < 4; i++){ blu(i, s) = rand()%21 - 10.0; }
+    }
+    lu = qr = gen;
+    bqr = btri = btrans = blu;
+    bool ok = batchlu(4, lu, piv);
+    batchlusolve(4, lu, piv, blu);
+    ok = batchqr(4, 4, qr, tau) && ok;
+    batchqrsolve(4, 4, qr, tau, bqr);
+    Matrix rhs0 = btri;
+    batchtrisolve(4, batch, btri);
+    batchtrisolve(4, batch, btrans, true, true);
+    double luerr = 0.0, qrerr = 0.0, trierr = 0.0;
+    for (int s = 0; s < 3; s++){
+      Vector bs(4);
+      for (int i = 0; i < 4; i++){ bs[i] = rhs0(i, s); }
+      Vector xlu = lusolve(As[s], bs);
+      Vector xqr = qrsolve(As[s], bs);
+      Vector xtri = lusolve(Rs[s], bs);
+      Vector xtrans = lusolve(Rs[s].transpose(), bs);
+      for (int i = 0; i < 4; i++){
+	luerr = std::max(luerr, fabs(blu(i, s) - xlu(i))/pnorm(xlu, 0));
+	qrerr = std::max(qrerr, fabs(bqr(i, s) - xqr(i))/pnorm(xqr, 0));
+	trierr = std::max(trierr, fabs(btri(i, s) - xtri(i))/pnorm(xtri, 0));
+	trierr = std::max(trierr, fabs(btrans(i, s) - xtrans(i))/pnorm(xtrans, 0));
+      }
+    }
+    check("batchlu against lusolve", (ok ? luerr : 1.0));
+    check("batchqr against qrsolve", (ok ? qrerr : 1.0));
+    check("batchtrisolve against lusolve", trierr);
+  }
+
+  // And the eigenvalues of the batch
+  for (int s = 0; s < 3; s++){
+    for (int e = 0; e < 16; e++){
+      batch(e, s) = dense(e/4, e%4);
+    }
+  }
+  Matrix bvals, bvecs;
+  if (!batchsymeig(4, batch, bvals, bvecs)) {
+    check("batchsymeig convergence", 1.0, 0.0);
+  }
+  bvals.print();
+
+  // Against symqr, for the closed forms (n = 2, 3) and batchjacobi (n = 8),
+  // on random matrices and, in the last system, I + uu(T), which has the
+  // eigenvalue 1 repeated n-1 times. Errors are relative to the largest
+  // element, as batched.hpp quotes them, and symqr's own tolerance of
+  // 1e-12 bounds the eigenvalues it is compared against.
+  const int eigsizes[] = {2, 3, 8};
+  for (int n : eigsizes) {
+    const int nsys = 4;
+    Matrix As(n*n, nsys), svals, svecs;
+    Matrix Ad[nsys];
+    for (int s = 0; s < nsys; s++){
+      Ad[s].assign(n, n, 0.0);
+      Vector u(n);
+      for (int i = 0; i < n; i++) { u[i] = (rand()%201 - 100.0)/100.0; }
+      for (int i = 0; i < n; i++){
+	for (int j = 0; j <= i; j++){
+	  double a = (s < nsys-1 ? (rand()%201 - 100.0)/100.0 : u[i]*u[j] + (i == j ? 1.0 : 0.0));
+	  Ad[s](i, j) = Ad[s](j, i) = a;
+	}
+      }
+      for (int e = 0; e < n*n; e++) { As(e, s) = Ad[s](e/n, e%n); }
+    }
+    bool ok = batchsymeig(n, As, svals, svecs);
+    double valerr = 0.0, reserr = 0.0, orthoerr = 0.0;
+    for (int s = 0; s < nsys; s++){
+      double amax = 0.0;
+      for (int e = 0; e < n*n; e++) { amax = std::max(amax, fabs(As(e, s))); }
+      Vector qrvals;
+      ok = symqr(Ad[s], qrvals) && ok;
+      qrvals = qrvals.sorted();
+      Matrix V(n, n);
+      for (int k = 0; k < n; k++){
+	valerr = std::max(valerr, fabs(svals(k, s) - qrvals(k))/amax);
+	Vector v(n);
+	for (int i = 0; i < n; i++) { V(i, k) = v[i] = svecs(i*n+k, s); }
+	reserr = std::max(reserr, pnorm(Ad[s]*v - svals(k, s)*v, 0)/amax);
+      }
+      orthoerr = std::max(orthoerr, orthoerror(V));
+    }
+    std::string size = " (n = " + std::to_string(n) + ")";
+    check(("batchsymeig against symqr" + size).c_str(), (ok ? valerr : 1.0), 1e-11);
+    check(("batchsymeig residual" + size).c_str(), (ok ? reserr : 1.0), 1e-13);
+    check(("batchsymeig orthogonality" + size).c_str(), (ok ? orthoerr : 1.0), 1e-13);
+  }
+
+  // Save the system, and solve it again from a mapping of the file
+  savebinary("test.bin", dense);
+  {
+    MappedFile mapped("test.bin", true);
+    cgx = choleskysolve(mapped.matrix(), d);
+    cgx.print();
+  }
+  std::remove("test.bin");
+
+  // And through Matrix Market text
+  writemm("test.mtx", spd);
+  SparseMatrix fromtext;
+  readmm("test.mtx", fromtext);
+  cgx = choleskysolve(fromtext.toDense(), d);
+  cgx.print();
+  std::remove("test.mtx");
+
+  // Dense text should read back to exactly the same doubles, so these
+  // checks allow no error at all
+  {
+    Matrix dm(5, 3), back;
+    for (int i = 0; i < 5; i++){
+      for (int j = 0; j < 3; j++){
+	dm(i, j) = (rand() - RAND_MAX/2.0)/(j + 1.0)/RAND_MAX*std::pow(10.0, 3*i - 6);
+      }
+    }
+    dm(4, 2) = -1.5e300; dm(0, 0) = 2.5e-300;
+    writemm("test.mtx", dm);
+    readmm("test.mtx", back);
+    check("Matrix Market general round trip", (back.nrows() == 5 && back.ncols() == 3 ? fnorm(back - dm) : 1.0), 0.0);
+    writecsv("test.csv", dm);
+    readcsv("test.csv", back);
+    check("CSV round trip", (back.nrows() == 5 && back.ncols() == 3 ? fnorm(back - dm) : 1.0), 0.0);
+    Vector dv(5), vback;
+    for (int i = 0; i < 5; i++){ dv[i] = dm(i, 1); }
+    writecsv("test.csv", dv);
+    readcsv("test.csv", vback);
+    check("CSV vector round trip", (vback.size() == 5 ? pnorm(vback - dv, 0) : 1.0), 0.0);
+
+    // A symmetric matrix, written out in full, and also in symmetric
+    // array storage (the lower triangle by columns), which should be
+    // filled out on reading
+    writemm("test.mtx", dense);
+    readmm("test.mtx", back);
+    check("Matrix Market symmetric round trip", (back.nrows() == 4 ? fnorm(back - dense) : 1.0), 0.0);
+    std::ofstream sym("test.mtx");
+    sym << std::setprecision(17) << "%%MatrixMarket matrix array real symmetric\n4 4\n";
+    for (int j = 0; j < 4; j++){
+      for (int i = j; i < 4; i++){ sym << dense(i, j) << "\n"; }
+    }
+    sym.close();
+    readmm("test.mtx", back);
+    check("Matrix Market symmetric storage", (back.nrows() == 4 ? fnorm(back - dense) : 1.0), 0.0);
+
+    // Malformed input must throw, here a short row in a CSV file
+    std::ofstream bad("test.csv");
+    bad << "1.0,2.0,3.0\n4.0,5.0\n";
+    bad.close();
+    std::string code = "none";
+    try {
+      readcsv("test.csv", back);
+    } catch (Error& e) {
+      code = e.getCode();
+    }
+    check("CSV with a short row throws TEXTFORMAT", (code == "TEXTFORMAT" ? 0.0 : 1.0), 0.0);
+  }
+  std::remove("test.mtx");
+  std::remove("test.csv");
+
+  // Repeated solves with a cache of factors, which survives a restart
+  {
+    FactorCache cache;
+    cgx = cache.choleskysolve(dense, d);
+    cgx = cache.choleskysolve(dense, d);
+    cache.save("test.fac");
+    FactorCache warm;
+    warm.load("test.fac");
+    cgx = warm.choleskysolve(dense, d);
+    cgx.print();
+    FactorCacheStats cs = warm.stats();
+    std::cout << cs.hits << " hits, " << cs.misses << " misses\n";
+    check("factor cache hits after a restart", fabs(cs.hits - 1.0) + fabs(cs.misses - 0.0), 0.0);
+  }
+  std::remove("test.fac");
+
+  // LU factors, with their n-1 pivots, through a save and load; then the
+  // least recently used entry going first under a budget of two and a
+  // half entries; then files with a flipped byte, and cut short, refused
+  {
+    int n = 20;
+    Matrix Ms[3];
+    Vector bs(n);
+    for (int k = 0; k < 3; k++){
+      Ms[k].assign(n, n, 0.0);
+      for (int i = 0; i < n; i++){
+	bs[i] = rand()%21 - 10.0;
+	for (int j = 0; j < n; j++) { Ms[k](i, j) = (rand()%201 - 100.0)/100.0; }
+	Ms[k](i, i) += 10.0;
+      }
+      Ms[k](n-1, 0) = 50.0; // So that dgelu swaps rows
+    }
+    FactorCache cache;
+    Vector x0 = cache.lusolve(Ms[0], bs);
+    long entry = cache.stats().bytes;
+    cache.save("test.fac");
+    FactorCache warm;
+    int added = warm.load("test.fac");
+    Vector x1 = warm.lusolve(Ms[0], bs);
+    FactorCacheStats cs = warm.stats();
+    check("factor cache LU round trip", pnorm(x1 - x0, 0) + fabs(added - 1.0) + fabs(cs.hits - 1.0) + fabs(cs.misses - 0.0), 0.0);
+    check("factor cache LU solve", pnorm(Ms[0]*x1 - bs, 0)/pnorm(bs, 0));
+
+    // 0 and 1 held, 0 used again so 1 is the oldest, then 2 evicts 1
+    cache.clear();
+    cache.setbudget(5*entry/2);
+    cache.lusolve(Ms[0], bs);
+    cache.lusolve(Ms[1], bs);
+    cache.lusolve(Ms[0], bs);
+    cache.lusolve(Ms[2], bs);
+    cs = cache.stats();
+    check("factor cache eviction count", fabs(cs.evictions - 1.0) + fabs(cs.entries - 2.0) + fabs(cs.hits - 1.0) + fabs(cs.misses - 3.0), 0.0);
+    cache.lusolve(Ms[0], bs);
+    cache.lusolve(Ms[2], bs);
+    cache.lusolve(Ms[1], bs);
+    cs = cache.stats();
+    check("factor cache evicts the least recent", fabs(cs.hits - 3.0) + fabs(cs.misses - 4.0) + (cs.bytes <= cs.budget ? 0.0 : 1.0), 0.0);
+
+    // The file ends with the pivots, so flip a bit in the last one, or
+    // drop it altogether
+    for (int t = 0; t < 2; t++){
+      cache.save("test.fac");
+      std::ifstream in("test.fac", std::ios::binary | std::ios::ate);
+      long size = (long)in.tellg();
+      std::string bytes(size, '\0');
+      in.seekg(0);
+      in.read(&bytes[0], size);
+      in.close();
+      if (t == 0) { bytes[size-4] ^= 0x40; }
+      std::ofstream out("test.fac", std::ios::binary | std::ios::trunc);
+      out.write(bytes.data(), (t == 0 ? size : size - 8));
+      out.close();
+      FactorCache bad;
+      std::string code = "none";
+      try {
+	bad.load("test.fac");
+      } catch (Error& e) {
+	code = e.getCode();
+      }
+      check((t == 0 ? "factor cache refuses a corrupt file" : "factor cache refuses a short file"),
+	    (code == "CACHEFORMAT" && bad.stats().entries == 0 ? 0.0 : 1.0), 0.0);
+    }
+  }
+  std::remove("test.fac");
+
+  // The same mixed precision solve with narrower panels, as an autotuned
+  // profile (make tune) might choose
+  {
+    TuningParams saved = tuning();
+    TuningParams narrow = saved;
+    narrow.lublock = 2;
+    settuning(narrow);
+    cgx = mixedlusolve(spd.toDense(), d, nref);
+    cgx.print();
+    settuning(saved);
+  }
+
+  // Where the time went, if built with DEFINES=-DPROFILING
+  profilereport();
+  if (failures > 0) {
+    std::cout << failures << " checks failed\n";
+  }
+  return failures;
 }